@@ -0,0 +1,201 @@
+#include "math/utils.h"
+#include "math/fast.h"
+#include "math/affine.h"
+#include "check.h"
+
+// Checks math/affine.h against math/fast.h: mat4x3_t rotations, scales,
+// translations and products must match the mat4_t ones, and
+// mat4x3_inverse() must undo random transforms (non-uniform and mirrored
+// scales included) and refuse singular ones. Runs the SSE or scalar paths,
+// whichever the build uses.
+
+#define RANDOM_MATRICES 10000
+#define EPSILON 1e-4f
+#define ROUNDING 1e-6f
+
+static float random_scale(void) {
+    const float s = check_random_float(0.1f, 10.0f);
+    return check_random_float(0, 1) < 0.2f ? -s : s;
+}
+
+// The same random transform built both ways.
+static void random_transform(mat4x3_t* a, mat4_t* m) {
+    const float rx = check_random_float(-PI, PI), ry = check_random_float(-PI, PI), rz = check_random_float(-PI, PI);
+    const float sx = random_scale(), sy = random_scale(), sz = random_scale();
+    const float tx = check_random_float(-100, 100), ty = check_random_float(-100, 100), tz = check_random_float(-100, 100);
+
+    *a = IDENTITY4X3;
+    *m = IDENTITY4;
+    mat4x3_scale(a, sx, sy, sz);
+    scale_fast(m, sx, sy, sz);
+    mat4x3_rot_x(a, rx);
+    rot_x_fast(m, rx);
+    mat4x3_rot_y(a, ry);
+    rot_y_fast(m, ry);
+    mat4x3_rot_z(a, rz);
+    rot_z_fast(m, rz);
+    mat4x3_translate(a, tx, ty, tz);
+    translate_fast(m, tx, ty, tz);
+}
+
+// Relative to the largest of the two.
+static int close_to(float a, float b) {
+    const float scale = fabsf(a) > fabsf(b) ? fabsf(a) : fabsf(b);
+    return fabsf(a - b) <= EPSILON * (scale > 1 ? scale : 1);
+}
+
+static int equal_4x3(const mat4x3_t* a, const mat4x3_t* b) {
+    unsigned int i;
+
+    for (i = 0; i < 12; ++i)
+        if (!close_to(a->m[i], b->m[i])) return 0;
+    return 1;
+}
+
+// Components compared relative to the vectors' largest one.
+static int same_vector(const float a[3], const float b[3]) {
+    float scale = 1;
+    unsigned int i;
+
+    for (i = 0; i < 3; ++i) {
+        if (fabsf(a[i]) > scale) scale = fabsf(a[i]);
+        if (fabsf(b[i]) > scale) scale = fabsf(b[i]);
+    }
+    for (i = 0; i < 3; ++i)
+        if (fabsf(a[i] - b[i]) > EPSILON * scale) return 0;
+    return 1;
+}
+
+static float max_abs(const mat4x3_t* m) {
+    float largest = 0;
+    unsigned int i;
+
+    for (i = 0; i < 12; ++i)
+        if (fabsf(m->m[i]) > largest) largest = fabsf(m->m[i]);
+    return largest;
+}
+
+// Rounding in a product grows with its factors' elements: a * inverse(a) is
+// the identity to within a few ulps of the largest product of two elements.
+static int near_identity(const mat4x3_t* product, const mat4x3_t* a, const mat4x3_t* inv) {
+    const float tolerance = ROUNDING * max_abs(a) * max_abs(inv);
+    unsigned int i;
+
+    for (i = 0; i < 12; ++i)
+        if (fabsf(product->m[i] - IDENTITY4X3.m[i]) > tolerance) return 0;
+    return 1;
+}
+
+static void conversions_and_products(void) {
+    mat4x3_t a, b, ab, converted;
+    mat4_t ma, mb, mab, back;
+    unsigned int i, bad_builds = 0, bad_products = 0, bad_round_trips = 0;
+
+    for (i = 0; i < RANDOM_MATRICES; ++i) {
+        random_transform(&a, &ma);
+        random_transform(&b, &mb);
+
+        mat4x3_from_mat4(&converted, &ma);
+        if (!equal_4x3(&a, &converted)) ++bad_builds;
+
+        mat4x3_mult(&ab, &a, &b);
+        mat_mult_fast(&mab, &ma, &mb);
+        mat4x3_from_mat4(&converted, &mab);
+        if (!equal_4x3(&ab, &converted)) ++bad_products;
+
+        mat4x3_to_mat4(&back, &ab);
+        mat4x3_from_mat4(&converted, &back);
+        if (!equal_4x3(&ab, &converted) || back.m[3] != 0 || back.m[7] != 0 || back.m[11] != 0 || back.m[15] != 1)
+            ++bad_round_trips;
+    }
+    CHECK(bad_builds == 0);
+    CHECK(bad_products == 0);
+    CHECK(bad_round_trips == 0);
+    printf("  %u transforms against mat4_t: %u built, %u multiplied, %u converted differently\n",
+           RANDOM_MATRICES, bad_builds, bad_products, bad_round_trips);
+}
+
+static void inverses(void) {
+    mat4x3_t a, inv, product;
+    mat4_t unused;
+    float p[3], q[3], r[3];
+    unsigned int i, bad = 0, failed = 0;
+
+    CHECK(mat4x3_inverse(&inv, &IDENTITY4X3));
+    CHECK(equal_4x3(&inv, &IDENTITY4X3));
+
+    for (i = 0; i < RANDOM_MATRICES; ++i) {
+        random_transform(&a, &unused);
+        if (!mat4x3_inverse(&inv, &a)) {
+            ++failed;
+            continue;
+        }
+        // Both orders give the identity, and points come back.
+        mat4x3_mult(&product, &a, &inv);
+        if (!near_identity(&product, &a, &inv)) ++bad;
+        mat4x3_mult(&product, &inv, &a);
+        if (!near_identity(&product, &a, &inv)) ++bad;
+
+        p[0] = check_random_float(-50, 50);
+        p[1] = check_random_float(-50, 50);
+        p[2] = check_random_float(-50, 50);
+        mat4x3_transform_point(q, &a, p);
+        mat4x3_transform_point(r, &inv, q);
+        if (!same_vector(p, r)) ++bad;
+        mat4x3_transform_vector(q, &a, p);
+        mat4x3_transform_vector(r, &inv, q);
+        if (!same_vector(p, r)) ++bad;
+    }
+    CHECK(failed == 0);
+    CHECK(bad == 0);
+    printf("  %u random inverses: %u refused, %u inexact\n", RANDOM_MATRICES, failed, bad);
+
+    // A small uniform scale is still invertible...
+    a = IDENTITY4X3;
+    mat4x3_scale(&a, 1e-3f, 1e-3f, 1e-3f);
+    mat4x3_translate(&a, 5, 6, 7);
+    CHECK(mat4x3_inverse(&inv, &a));
+    CHECK(close_to(inv.m[0], 1e3f) && close_to(inv.m[3], -5e3f) && close_to(inv.m[11], -7e3f));
+
+    // ...a flattened or degenerate one isn't, and leaves `out` alone.
+    a = IDENTITY4X3;
+    mat4x3_scale(&a, 1, 0, 1);
+    mat4x3_rot_y(&a, 0.5f);
+    product = inv;
+    CHECK(!mat4x3_inverse(&inv, &a));
+    CHECK(memcmp(&inv, &product, sizeof(inv)) == 0);
+
+    // Two equal rows.
+    a = IDENTITY4X3;
+    a.m[4] = 1;
+    a.m[5] = 0;
+    CHECK(!mat4x3_inverse(&inv, &a));
+}
+
+static void batch_points(void) {
+    mat4x3_t a;
+    mat4_t unused;
+    float in[4 * 7], out[4 * 7], one[3];
+    unsigned int i, bad = 0;
+
+    random_transform(&a, &unused);
+    for (i = 0; i < 4 * 7; ++i) in[i] = check_random_float(-10, 10);
+    mat4x3_transform_points(out, &a, in, 7);
+    for (i = 0; i < 7; ++i) {
+        mat4x3_transform_point(one, &a, &in[i * 4]);
+        if (!same_vector(&out[i * 4], one) || out[i * 4 + 3] != 1.0f) ++bad;
+    }
+    CHECK(bad == 0);
+}
+
+int main(void) {
+#ifdef MATH_FAST_SSE
+    printf("mat4x3_t (SSE):\n");
+#else
+    printf("mat4x3_t (scalar):\n");
+#endif
+    conversions_and_products();
+    inverses();
+    batch_points();
+    return check_result("affine_test");
+}
@@ -0,0 +1,255 @@
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "core/archive.h"
+#include "core/jobs.h"
+#include "check.h"
+
+// Packs a few assets with core/archive.h, reads them back one at a time and
+// in parallel, then opens copies of the archive with one header, block or
+// entry field broken at a time, each of which archive_open() must reject.
+
+#define ASSET_COUNT 4
+
+typedef struct image_ {
+    unsigned char* data;
+    size_t size;
+    archive_header_t* header;
+    archive_entry_t* entries;
+    archive_block_t* blocks;
+    char* names;
+} image_t;
+
+static int write_file(const char* path, const void* data, size_t size) {
+    FILE* f = fopen(path, "wb");
+    int ok;
+
+    if (f == NULL) return 0;
+    ok = fwrite(data, 1, size, f) == size;
+    return fclose(f) == 0 && ok;
+}
+
+static int read_file(const char* path, image_t* img) {
+    FILE* f = fopen(path, "rb");
+    long size;
+
+    if (f == NULL || fseek(f, 0, SEEK_END) != 0 || (size = ftell(f)) <= 0 || fseek(f, 0, SEEK_SET) != 0
+            || (img->data = (unsigned char*) malloc((size_t)size)) == NULL
+            || fread(img->data, 1, (size_t)size, f) != (size_t)size) {
+        if (f != NULL) fclose(f);
+        return 0;
+    }
+    fclose(f);
+    img->size = (size_t)size;
+    return 1;
+}
+
+// Points into a copy of the packed file, to break it.
+static void image_copy(image_t* dst, const image_t* src) {
+    dst->size = src->size;
+    dst->data = (unsigned char*) malloc(src->size);
+    memcpy(dst->data, src->data, src->size);
+    dst->header = (archive_header_t*) dst->data;
+    dst->entries = (archive_entry_t*)(dst->data + dst->header->index_offset);
+    dst->blocks = (archive_block_t*)(dst->entries + dst->header->entry_count);
+    dst->names = (char*)(dst->blocks + dst->header->block_count);
+}
+
+static int opens(const char* path, const image_t* img) {
+    archive_t a;
+
+    if (!write_file(path, img->data, img->size)) return -1;
+    if (!archive_open(&a, path)) return 0;
+    archive_close(&a);
+    return 1;
+}
+
+static void check_rejected(const char* what, const char* path, image_t* img) {
+    const int result = opens(path, img);
+
+    printf("  %-36s %s\n", what, result == 0 ? "rejected" : "ACCEPTED");
+    CHECK(result == 0);
+    free(img->data);
+}
+
+static void corrupt(const char* path, const image_t* good) {
+    image_t img;
+
+    printf("Corrupt archives (archive_open() reports an error for each):\n");
+
+    image_copy(&img, good);
+    CHECK(opens(path, &img) == 1);
+    free(img.data);
+
+    image_copy(&img, good);
+    img.size = sizeof(archive_header_t) - 1;
+    check_rejected("shorter than the header", path, &img);
+
+    image_copy(&img, good);
+    img.header->magic[0] = 'X';
+    check_rejected("magic", path, &img);
+
+    image_copy(&img, good);
+    ++img.header->version;
+    check_rejected("version", path, &img);
+
+    image_copy(&img, good);
+    img.header->index_offset += 4;
+    check_rejected("misaligned index", path, &img);
+
+    image_copy(&img, good);
+    img.header->index_offset = img.size + 8;
+    check_rejected("index past the end", path, &img);
+
+    image_copy(&img, good);
+    --img.size;
+    check_rejected("truncated index", path, &img);
+
+    image_copy(&img, good);
+    ++img.header->block_count;
+    check_rejected("block count past the index", path, &img);
+
+    image_copy(&img, good);
+    img.names[img.header->names_size - 1] = 'x';
+    check_rejected("unterminated names", path, &img);
+
+    image_copy(&img, good);
+    img.blocks[0].size = 0;
+    img.blocks[0].packed_size = 0;
+    check_rejected("empty block", path, &img);
+
+    image_copy(&img, good);
+    img.header->block_size = 1024;
+    check_rejected("block larger than the block size", path, &img);
+
+    image_copy(&img, good);
+    img.blocks[1].packed_size = img.blocks[1].size + 1;
+    check_rejected("packed larger than unpacked", path, &img);
+
+    image_copy(&img, good);
+    img.blocks[0].offset = sizeof(archive_header_t) - 1;
+    check_rejected("block inside the header", path, &img);
+
+    image_copy(&img, good);
+    img.blocks[img.header->block_count - 1].offset = img.header->index_offset - 1;
+    check_rejected("block running into the index", path, &img);
+
+    image_copy(&img, good);
+    img.entries[0].name_offset = img.header->names_size;
+    check_rejected("name past the names", path, &img);
+
+    image_copy(&img, good);
+    img.entries[img.header->entry_count - 1].block_count = img.header->block_count + 1;
+    check_rejected("entry past the block table", path, &img);
+
+    image_copy(&img, good);
+    img.entries[0].first_block = UINT32_MAX;
+    check_rejected("first block overflowing", path, &img);
+
+    image_copy(&img, good);
+    img.entries[1].name_offset = img.entries[0].name_offset;
+    check_rejected("duplicate name", path, &img);
+
+    image_copy(&img, good);
+    {
+        const uint32_t name = img.entries[0].name_offset;
+        img.entries[0].name_offset = img.entries[1].name_offset;
+        img.entries[1].name_offset = name;
+    }
+    check_rejected("names out of order", path, &img);
+
+    image_copy(&img, good);
+    ++img.entries[0].size;
+    check_rejected("entry size against its blocks", path, &img);
+}
+
+int main(void) {
+    // Names out of order; one asset empty, one random.
+    const char* names[ASSET_COUNT] = { "shaders/cube.vert", "big.bin", "empty", "noise.bin" };
+    size_t sizes[ASSET_COUNT] = { 0, 200000, 0, 70000 };
+    unsigned char* data[ASSET_COUNT];
+    char dir[] = "/tmp/archive_test.XXXXXX";
+    char path[64], broken[64];
+    archive_set_t set;
+    archive_t a;
+    image_t good;
+    unsigned int i;
+    size_t j;
+
+    const char* text = "#version 450\nlayout(location = 0) in vec4 in_position;\nvoid main() {}\n";
+    sizes[0] = strlen(text);
+    for (i = 0; i < ASSET_COUNT; ++i) data[i] = (unsigned char*) malloc(sizes[i] + 1);
+    memcpy(data[0], text, sizes[0]);
+    for (j = 0; j < sizes[1]; ++j) data[1][j] = (unsigned char)(j / 300 + (j % 7 == 0));
+    for (j = 0; j < sizes[3]; ++j) data[3][j] = (unsigned char)check_random();
+
+    if (mkdtemp(dir) == NULL) {
+        fprintf(stderr, "ERROR: Could not create a temporary directory.\n");
+        return EXIT_FAILURE;
+    }
+    snprintf(path, sizeof(path), "%s/test.pak", dir);
+    snprintf(broken, sizeof(broken), "%s/broken.pak", dir);
+
+    CHECK(archive_pack(path, names, (const void* const*) data, sizes, ASSET_COUNT));
+    CHECK(archive_open(&a, path));
+    if (a.header != NULL) {
+        CHECK(a.header->entry_count == ASSET_COUNT);
+        // 200000 bytes are four blocks, 70000 two and the rest one or none.
+        CHECK(a.header->block_count == 4 + 2 + 1);
+        CHECK(archive_find(&a, "missing") == -1);
+        CHECK(archive_find(&a, "") == -1);
+        for (i = 0; i < ASSET_COUNT; ++i) {
+            const int e = archive_find(&a, names[i]);
+            unsigned char* out;
+
+            CHECK(e >= 0);
+            if (e < 0) continue;
+            out = (unsigned char*) malloc(sizes[i] + 1);
+            CHECK(strcmp(archive_name(&a, e), names[i]) == 0);
+            CHECK(archive_size(&a, e) == sizes[i]);
+            CHECK(archive_read(&a, e, out));
+            CHECK(memcmp(out, data[i], sizes[i]) == 0);
+            free(out);
+        }
+        // big.bin's blocks compress; noise.bin's don't and are stored.
+        for (i = 1; i < ASSET_COUNT; i += 2) {
+            const int e = archive_find(&a, names[i]);
+            const archive_entry_t* entry = &a.entries[e >= 0 ? e : 0];
+
+            for (j = entry->first_block; j < (size_t)entry->first_block + entry->block_count; ++j) {
+                if (i == 1) CHECK(a.blocks[j].packed_size < a.blocks[j].size);
+                else CHECK(a.blocks[j].packed_size == a.blocks[j].size);
+            }
+        }
+
+        jobs_init(0);
+        CHECK(archive_unpack(&set, &a, names, ASSET_COUNT));
+        for (i = 0; i < ASSET_COUNT; ++i) {
+            size_t size = 0;
+            const unsigned char* asset = archive_set_find(&set, names[i], &size);
+
+            CHECK(asset != NULL && size == sizes[i]);
+            if (asset == NULL) continue;
+            CHECK(memcmp(asset, data[i], sizes[i]) == 0);
+            CHECK(asset[size] == '\0');
+        }
+        CHECK(archive_set_find(&set, "missing", NULL) == NULL);
+        archive_set_free(&set);
+        jobs_shutdown();
+        archive_close(&a);
+    }
+
+    if (read_file(path, &good)) {
+        corrupt(broken, &good);
+        free(good.data);
+    } else {
+        CHECK(!"could not read the packed archive back");
+    }
+
+    remove(path);
+    remove(broken);
+    rmdir(dir);
+    for (i = 0; i < ASSET_COUNT; ++i) free(data[i]);
+    return check_result("archive_test");
+}
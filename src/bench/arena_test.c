@@ -0,0 +1,188 @@
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "core/arena.h"
+#include "core/pool.h"
+#include "check.h"
+
+// Checks core/arena.h (alignment, heap overflow, marks and rewinds, the frame
+// arena's statistics, one scratch arena per thread) and core/pool.h (slot
+// sizes, exhaustion, reuse). Allocations are filled and checked afterwards,
+// so overlapping ones show up too.
+
+#define ARENA_SIZE 4096
+#define POOL_CAPACITY 64
+
+static int aligned(const void* p, size_t align) {
+    return ((uintptr_t)p & (align - 1)) == 0;
+}
+
+static void arena_basics(void) {
+    static const size_t aligns[] = { 1, 2, 4, 8, 16, 64, 256 };
+    unsigned char* ptrs[7];
+    arena_t a;
+    arena_stats_t st;
+    unsigned int i;
+    size_t j;
+    double* d;
+
+    CHECK(arena_init(&a, ARENA_SIZE));
+    for (i = 0; i < 7; ++i) {
+        ptrs[i] = (unsigned char*) arena_alloc(&a, 100 + i, aligns[i]);
+        CHECK(ptrs[i] != NULL && aligned(ptrs[i], aligns[i]));
+        CHECK(ptrs[i] >= a.base && ptrs[i] + 100 + i <= a.base + ARENA_SIZE);
+        memset(ptrs[i], (int)i + 1, 100 + i);
+    }
+    for (i = 0; i < 7; ++i)
+        for (j = 0; j < 100 + i; ++j) CHECK(ptrs[i][j] == i + 1);
+
+    // 0 means the default alignment.
+    CHECK(aligned(arena_alloc(&a, 1, 0), ARENA_DEFAULT_ALIGN));
+    d = ARENA_NEW(&a, double, 3);
+    CHECK(aligned(d, _Alignof(double)));
+
+    st = arena_stats(&a);
+    CHECK(st.capacity == ARENA_SIZE && st.heap_allocs == 0);
+    CHECK(st.used == a.offset && st.used >= 7 * 100 && st.used == st.peak);
+
+    // Past the end: served from the heap, still aligned, counted.
+    ptrs[0] = (unsigned char*) arena_alloc(&a, ARENA_SIZE, 64);
+    CHECK(ptrs[0] != NULL && aligned(ptrs[0], 64));
+    CHECK(ptrs[0] < a.base || ptrs[0] >= a.base + ARENA_SIZE);
+    memset(ptrs[0], 0xEE, ARENA_SIZE);
+    st = arena_stats(&a);
+    CHECK(st.heap_allocs == 1 && st.used == a.offset + ARENA_SIZE && st.peak == st.used);
+
+    // Reset drops everything but the peak.
+    arena_reset(&a);
+    st = arena_stats(&a);
+    CHECK(st.used == 0 && st.heap_allocs == 0 && a.overflow == NULL && st.peak > ARENA_SIZE);
+    CHECK(arena_alloc(&a, 16, 16) == a.base);
+    arena_destroy(&a);
+    CHECK(a.base == NULL);
+}
+
+static void arena_marks(void) {
+    arena_t a;
+    arena_mark_t outer, inner;
+    void *first, *again;
+
+    CHECK(arena_init(&a, ARENA_SIZE));
+    arena_alloc(&a, 1000, 0);
+    outer = arena_mark(&a);
+    first = arena_alloc(&a, 500, 0);
+
+    // Overflow inside a nested scope, freed by rewinding it.
+    inner = arena_mark(&a);
+    arena_alloc(&a, 2000, 0);         // Still fits,
+    arena_alloc(&a, 4000, 0);         // these two don't.
+    arena_alloc(&a, 8000, 0);
+    CHECK(a.heap_allocs == 2 && a.overflow != NULL);
+    arena_rewind(&a, inner);
+    CHECK(a.overflow == NULL && a.overflow_bytes == 0);
+    CHECK(arena_stats(&a).used == inner.offset);
+
+    // Overflow before a mark survives rewinding to it.
+    arena_alloc(&a, 8000, 0);
+    inner = arena_mark(&a);
+    arena_alloc(&a, 9000, 0);
+    arena_rewind(&a, inner);
+    CHECK(a.overflow == inner.overflow && a.overflow != NULL && a.overflow_bytes == 8000);
+
+    arena_rewind(&a, outer);
+    CHECK(a.overflow == NULL && arena_stats(&a).used == outer.offset);
+    again = arena_alloc(&a, 500, 0);
+    CHECK(again == first);
+    arena_destroy(&a);
+}
+
+static void frame_arena_stats(void) {
+    frame_stats_t fs;
+
+    CHECK(frame_arena_init(1024));
+    CHECK(frame_alloc(600) != NULL);
+    CHECK(frame_alloc(600) != NULL);  // Overflows.
+    frame_end();
+    fs = frame_stats();
+    CHECK(fs.frames == 1 && fs.last_frame_heap_allocs == 1 && fs.total_heap_allocs == 1);
+    CHECK(fs.last_frame_bytes >= 1200 && fs.peak_frame_bytes == fs.last_frame_bytes);
+
+    CHECK(frame_alloc(100) == frame_arena()->base);
+    frame_end();
+    fs = frame_stats();
+    CHECK(fs.frames == 2 && fs.last_frame_heap_allocs == 0 && fs.total_heap_allocs == 1);
+    CHECK(fs.last_frame_bytes == 100 && fs.peak_frame_bytes >= 1200);
+    frame_arena_destroy();
+}
+
+static void* scratch_thread(void* arg) {
+    arena_t* s = scratch_arena();
+
+    *(arena_t**) arg = s;
+    CHECK(s != NULL && scratch_arena() == s);
+    CHECK(s != NULL && s->capacity == SCRATCH_ARENA_SIZE);
+    scratch_arena_release();
+    return NULL;
+}
+
+static void scratch_arenas(void) {
+    arena_t *mine = scratch_arena(), *theirs = NULL;
+    pthread_t thread;
+
+    CHECK(mine != NULL && scratch_arena() == mine);
+    CHECK(pthread_create(&thread, NULL, scratch_thread, &theirs) == 0);
+    pthread_join(thread, NULL);
+    CHECK(theirs != NULL && theirs != mine);
+    scratch_arena_release();
+    // Recreated on next use.
+    CHECK(scratch_arena() != NULL);
+    scratch_arena_release();
+}
+
+static void pools(void) {
+    unsigned char* objs[POOL_CAPACITY];
+    pool_t p;
+    pool_stats_t st;
+    unsigned int i, j;
+
+    // Slots hold at least a pointer and stay pointer-aligned.
+    CHECK(pool_init(&p, 1, 4));
+    CHECK(pool_stats(&p).slot_size == sizeof(void*));
+    pool_destroy(&p);
+    CHECK(pool_init(&p, sizeof(void*) + 5, 4));
+    CHECK(pool_stats(&p).slot_size == 2 * sizeof(void*));
+    pool_destroy(&p);
+
+    CHECK(pool_init(&p, 24, POOL_CAPACITY));
+    for (i = 0; i < POOL_CAPACITY; ++i) {
+        objs[i] = (unsigned char*) pool_alloc(&p);
+        CHECK(objs[i] != NULL && aligned(objs[i], sizeof(void*)));
+        CHECK(objs[i] >= p.slots && objs[i] + 24 <= p.slots + p.slot_size * POOL_CAPACITY);
+        memset(objs[i], (int)i, 24);
+    }
+    CHECK(pool_alloc(&p) == NULL);
+    for (i = 0; i < POOL_CAPACITY; ++i)
+        for (j = 0; j < 24; ++j) CHECK(objs[i][j] == i);
+    st = pool_stats(&p);
+    CHECK(st.in_use == POOL_CAPACITY && st.peak == POOL_CAPACITY);
+
+    // Freed slots come back, most recent first; the peak stays.
+    for (i = 0; i < POOL_CAPACITY; i += 2) pool_free(&p, objs[i]);
+    pool_free(&p, NULL);
+    st = pool_stats(&p);
+    CHECK(st.in_use == POOL_CAPACITY / 2 && st.peak == POOL_CAPACITY);
+    CHECK(pool_alloc(&p) == objs[POOL_CAPACITY - 2]);
+    CHECK(pool_alloc(&p) == objs[POOL_CAPACITY - 4]);
+    CHECK(pool_stats(&p).in_use == POOL_CAPACITY / 2 + 2);
+    pool_destroy(&p);
+}
+
+int main(void) {
+    arena_basics();
+    arena_marks();
+    frame_arena_stats();
+    scratch_arenas();
+    pools();
+    return check_result("arena_test");
+}
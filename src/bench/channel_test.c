@@ -0,0 +1,223 @@
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "core/channel.h"
+#include "check.h"
+
+// Checks core/channel.h on one thread (capacity, FIFO order, full and empty
+// rings, indices wrapping, triple buffer freshness) and then between two:
+// a producer streams numbered messages through a small ring, which must
+// arrive in order and intact, and a writer publishes snapshots as fast as it
+// can, which the reader must always see whole and never older than before.
+
+#define STREAM_MESSAGES 2000000u
+#define STREAM_CAPACITY 64
+#define SNAPSHOTS 1000000u
+
+typedef struct message_ {
+    uint32_t seq;
+    uint32_t words[5];              // Derived from seq, to catch torn copies.
+} message_t;
+
+typedef struct snapshot_ {
+    uint32_t seq;
+    float values[30];               // More than a cache line.
+} snapshot_t;
+
+static void make_message(message_t* m, uint32_t seq) {
+    unsigned int i;
+
+    m->seq = seq;
+    for (i = 0; i < 5; ++i) m->words[i] = seq * 2654435761u + i;
+}
+
+static int message_ok(const message_t* m) {
+    unsigned int i;
+
+    for (i = 0; i < 5; ++i)
+        if (m->words[i] != m->seq * 2654435761u + i) return 0;
+    return 1;
+}
+
+static void ring_single(void) {
+    spsc_ring_t r;
+    message_t m;
+    uint32_t i, round, seq = 0, next = 0;
+
+    // Capacity rounds up to a power of two.
+    CHECK(spsc_ring_init(&r, 5, sizeof(message_t)));
+    CHECK(!spsc_ring_pop(&r, &m));
+    for (i = 0; i < 8; ++i) {
+        make_message(&m, seq++);
+        CHECK(spsc_ring_push(&r, &m));
+    }
+    CHECK(!spsc_ring_push(&r, &m));
+    for (i = 0; i < 8; ++i) {
+        CHECK(spsc_ring_pop(&r, &m));
+        CHECK(m.seq == next++ && message_ok(&m));
+    }
+    CHECK(!spsc_ring_pop(&r, &m));
+
+    // Free-running indices wrapping past UINT_MAX, with the ring kept about
+    // half full.
+    atomic_store(&r.head, UINT_MAX - 20);
+    atomic_store(&r.tail, UINT_MAX - 20);
+    r.tail_cache = r.head_cache = UINT_MAX - 20;
+    for (round = 0; round < 30; ++round) {
+        for (i = 0; i < (round == 0 ? 6u : 3u); ++i) {
+            make_message(&m, seq++);
+            CHECK(spsc_ring_push(&r, &m));
+        }
+        for (i = 0; i < 3; ++i) {
+            CHECK(spsc_ring_pop(&r, &m));
+            CHECK(m.seq == next++ && message_ok(&m));
+        }
+    }
+    for (i = 0; i < 5; ++i) {
+        make_message(&m, seq++);
+        CHECK(spsc_ring_push(&r, &m));
+    }
+    CHECK(!spsc_ring_push(&r, &m));
+    while (spsc_ring_pop(&r, &m)) CHECK(m.seq == next++ && message_ok(&m));
+    CHECK(next == seq);
+    spsc_ring_destroy(&r);
+
+    CHECK(spsc_ring_init(&r, 1, sizeof(message_t)));
+    CHECK(spsc_ring_push(&r, &m) && spsc_ring_push(&r, &m) && !spsc_ring_push(&r, &m));
+    spsc_ring_destroy(&r);
+}
+
+static void* stream_producer(void* arg) {
+    spsc_ring_t* r = (spsc_ring_t*) arg;
+    message_t m;
+    uint32_t seq;
+
+    for (seq = 0; seq < STREAM_MESSAGES; ++seq) {
+        make_message(&m, seq);
+        while (!spsc_ring_push(r, &m)) sched_yield();
+    }
+    return NULL;
+}
+
+static void ring_threads(void) {
+    spsc_ring_t r;
+    pthread_t producer;
+    message_t m;
+    uint32_t next = 0;
+    unsigned long bad = 0;
+
+    CHECK(spsc_ring_init(&r, STREAM_CAPACITY, sizeof(message_t)));
+    CHECK(pthread_create(&producer, NULL, stream_producer, &r) == 0);
+    while (next < STREAM_MESSAGES) {
+        if (!spsc_ring_pop(&r, &m)) {
+            sched_yield();
+            continue;
+        }
+        if (m.seq != next || !message_ok(&m)) ++bad;
+        next = m.seq + 1;
+    }
+    pthread_join(producer, NULL);
+    CHECK(bad == 0);
+    CHECK(!spsc_ring_pop(&r, &m));
+    spsc_ring_destroy(&r);
+    printf("  %u messages through a ring of %d, %lu out of order or torn\n",
+           STREAM_MESSAGES, STREAM_CAPACITY, bad);
+}
+
+static void fill_snapshot(snapshot_t* s, uint32_t seq) {
+    unsigned int i;
+
+    s->seq = seq;
+    for (i = 0; i < 30; ++i) s->values[i] = (float)(seq % 65536) + (float)i;
+}
+
+static int snapshot_ok(const snapshot_t* s) {
+    unsigned int i;
+
+    for (i = 0; i < 30; ++i)
+        if (s->values[i] != (float)(s->seq % 65536) + (float)i) return 0;
+    return 1;
+}
+
+static void triple_single(void) {
+    triple_buffer_t t;
+    const snapshot_t* s;
+    int fresh = -1;
+
+    CHECK(triple_buffer_init(&t, sizeof(snapshot_t)));
+
+    // Nothing published yet: the zeroed initial slot, not fresh.
+    s = (const snapshot_t*) triple_buffer_read(&t, &fresh);
+    CHECK(s->seq == 0 && !fresh);
+
+    fill_snapshot((snapshot_t*) triple_buffer_slot(&t), 1);
+    triple_buffer_publish(&t);
+    s = (const snapshot_t*) triple_buffer_read(&t, &fresh);
+    CHECK(s->seq == 1 && fresh && snapshot_ok(s));
+    s = (const snapshot_t*) triple_buffer_read(&t, &fresh);
+    CHECK(s->seq == 1 && !fresh);
+
+    // Values the reader misses are overwritten.
+    fill_snapshot((snapshot_t*) triple_buffer_slot(&t), 2);
+    triple_buffer_publish(&t);
+    fill_snapshot((snapshot_t*) triple_buffer_slot(&t), 3);
+    triple_buffer_publish(&t);
+    s = (const snapshot_t*) triple_buffer_read(&t, &fresh);
+    CHECK(s->seq == 3 && fresh && snapshot_ok(s));
+
+    // The writer's slot is never the one the reader holds.
+    CHECK(triple_buffer_slot(&t) != (void*) s);
+    triple_buffer_publish(&t);
+    CHECK(triple_buffer_slot(&t) != (void*) s);
+    triple_buffer_destroy(&t);
+}
+
+static void* snapshot_writer(void* arg) {
+    triple_buffer_t* t = (triple_buffer_t*) arg;
+    uint32_t seq;
+
+    for (seq = 1; seq <= SNAPSHOTS; ++seq) {
+        fill_snapshot((snapshot_t*) triple_buffer_slot(t), seq);
+        triple_buffer_publish(t);
+    }
+    return NULL;
+}
+
+static void triple_threads(void) {
+    triple_buffer_t t;
+    pthread_t writer;
+    uint32_t last = 0;
+    unsigned long reads = 0, fresh_reads = 0, bad = 0;
+
+    CHECK(triple_buffer_init(&t, sizeof(snapshot_t)));
+    CHECK(pthread_create(&writer, NULL, snapshot_writer, &t) == 0);
+    while (last < SNAPSHOTS) {
+        int fresh;
+        const snapshot_t* s = (const snapshot_t*) triple_buffer_read(&t, &fresh);
+
+        ++reads;
+        if (!fresh) sched_yield();
+        if (s->seq == 0) continue;
+        if (!snapshot_ok(s) || s->seq < last || (fresh && s->seq == last) || (!fresh && s->seq != last)) ++bad;
+        if (fresh) ++fresh_reads;
+        last = s->seq;
+    }
+    pthread_join(writer, NULL);
+    CHECK(bad == 0);
+    triple_buffer_destroy(&t);
+    printf("  %u snapshots published, %lu reads, %lu fresh, %lu torn or stale\n",
+           SNAPSHOTS, reads, fresh_reads, bad);
+}
+
+int main(void) {
+    printf("spsc_ring:\n");
+    ring_single();
+    ring_threads();
+    printf("triple_buffer:\n");
+    triple_single();
+    triple_threads();
+    return check_result("channel_test");
+}
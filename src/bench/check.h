@@ -0,0 +1,47 @@
+#ifndef BENCH_CHECK_H
+#define BENCH_CHECK_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+// Assertions for the *_test executables, which CTest runs. A failed CHECK()
+// prints where and what and is counted, and the test carries on, so one run
+// lists every failure; main() returns check_result().
+
+static unsigned int check_failures;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            fprintf(stderr, "FAILED: %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+            ++check_failures; \
+        } \
+    } while (0)
+
+static int check_result(const char* name) {
+    if (check_failures > 0) {
+        fprintf(stderr, "%s: %u checks failed.\n", name, check_failures);
+        return EXIT_FAILURE;
+    }
+    printf("%s: passed.\n", name);
+    return EXIT_SUCCESS;
+}
+
+// Xorshift32, so every run sees the same "random" inputs and a failure
+// repeats. A test may set check_seed first to pick another sequence.
+static uint32_t check_seed = 12345;
+
+static inline uint32_t check_random(void) {
+    check_seed ^= check_seed << 13;
+    check_seed ^= check_seed >> 17;
+    check_seed ^= check_seed << 5;
+    return check_seed;
+}
+
+// In [lo, hi).
+static inline float check_random_float(float lo, float hi) {
+    return lo + (hi - lo) * (float)(check_random() >> 8) / (float)(1 << 24);
+}
+
+#endif // BENCH_CHECK_H
@@ -0,0 +1,283 @@
+#include <string.h>
+
+#include "render/clustered.h"
+#include "core/jobs.h"
+#include "check.h"
+
+// Checks render/clustered.h on the CPU: the near and far planes and depth
+// slices recovered from a proj() matrix, the tile boundary planes, and the
+// light assignment. Points sampled inside every light's sphere are looked up
+// the way CLUSTERED_FRAGMENT_SHADER does, and their cluster must list the
+// light. Runs the SSE or scalar paths, whichever the build uses.
+
+#define WIDTH 1600
+#define HEIGHT 900
+#define NEAR_PLANE 0.5f
+#define FAR_PLANE 200.0f
+#define MAX_LIGHTS 4096
+#define RANDOM_LIGHTS 3000
+#define SAMPLES 48
+
+static int close_to(float a, float b, float epsilon) {
+    return fabsf(a - b) <= epsilon * (fabsf(b) > 1 ? fabsf(b) : 1);
+}
+
+// Row vector times the view matrix, as clusters_assign() does.
+static void to_view(float out[3], const mat4_t* view, const float p[3]) {
+    const float* m = view->m;
+
+    out[0] = p[0] * m[0] + p[1] * m[4] + p[2] * m[8] + m[12];
+    out[1] = p[0] * m[1] + p[1] * m[5] + p[2] * m[9] + m[13];
+    out[2] = p[0] * m[2] + p[1] * m[6] + p[2] * m[10] + m[14];
+}
+
+static int clamp_index(float f, int count) {
+    const float i = floorf(f);
+    return i < 0 ? 0 : i > (float)(count - 1) ? count - 1 : (int)i;
+}
+
+// The cluster of a view-space point, as the fragment shader finds it; -1
+// outside the frustum.
+static int shader_cluster(const clusters_t* c, const mat4_t* projection, const float v[3]) {
+    const float depth = -v[2];
+    float ndc_x, ndc_y;
+    int x, y, z;
+
+    if (depth < c->near_plane || depth > c->far_plane) return -1;
+    ndc_x = projection->m[0] * v[0] / depth;
+    ndc_y = projection->m[5] * v[1] / depth;
+    if (fabsf(ndc_x) >= 1 || fabsf(ndc_y) >= 1) return -1;
+
+    x = clamp_index((ndc_x + 1) * 0.5f * CLUSTER_X, CLUSTER_X);
+    y = clamp_index((ndc_y + 1) * 0.5f * CLUSTER_Y, CLUSTER_Y);
+    z = clamp_index(logf(depth) * c->log_scale + c->log_bias, CLUSTER_Z);
+    return (z * CLUSTER_Y + y) * CLUSTER_X + x;
+}
+
+static int listed(const clusters_t* c, int cluster, GLuint light) {
+    const GLuint* grid = c->packed + CLUSTER_GRID_HEADER_UINTS;
+    GLuint i;
+
+    for (i = 0; i < grid[cluster * 2 + 1]; ++i)
+        if (c->indices[grid[cluster * 2] + i] == light) return 1;
+    return 0;
+}
+
+// The packed grid must match the per-cluster lists, back to back, each in
+// light order.
+static void check_packing(const clusters_t* c) {
+    const cluster_grid_header_t* header = (const cluster_grid_header_t*) c->packed;
+    const GLuint* grid = c->packed + CLUSTER_GRID_HEADER_UINTS;
+    GLuint total = 0;
+    unsigned int i, j, bad = 0;
+
+    CHECK(header->dims[0] == CLUSTER_X && header->dims[1] == CLUSTER_Y && header->dims[2] == CLUSTER_Z);
+    CHECK(header->depth[0] == c->log_scale && header->depth[1] == c->log_bias);
+    for (i = 0; i < CLUSTER_COUNT; ++i) {
+        const GLuint* list = c->indices + grid[i * 2];
+
+        if (grid[i * 2] != total || grid[i * 2 + 1] != c->counts[i]) ++bad;
+        for (j = 0; j < grid[i * 2 + 1]; ++j) {
+            if (list[j] != c->lists[(size_t)i * CLUSTER_MAX_LIGHTS + j]) ++bad;
+            if (j > 0 && list[j] <= list[j - 1]) ++bad;
+        }
+        total += grid[i * 2 + 1];
+    }
+    CHECK(bad == 0);
+    CHECK(total == c->stats.indices);
+}
+
+static void projection(clusters_t* c, const mat4_t* p) {
+    const float depths[] = { 0.6f, 1, 7.5f, 40, 199 };
+    unsigned int i, d, bad = 0;
+
+    CHECK(close_to(c->near_plane, NEAR_PLANE, 1e-4f));
+    CHECK(close_to(c->far_plane, FAR_PLANE, 1e-3f));
+    CHECK(close_to(logf(c->near_plane) * c->log_scale + c->log_bias, 0, 1e-4f));
+    CHECK(close_to(logf(c->far_plane) * c->log_scale + c->log_bias, CLUSTER_Z, 1e-4f));
+
+    // Boundary i goes through NDC x = 2i / CLUSTER_X - 1 at every depth,
+    // with a unit normal pointing towards tile i.
+    for (i = 0; i <= CLUSTER_X; ++i) {
+        const float* n = c->planes_x[i];
+        const float s = 2 * (float)i / CLUSTER_X - 1;
+
+        if (!close_to(n[0] * n[0] + n[1] * n[1], 1, 1e-5f)) ++bad;
+        for (d = 0; d < sizeof(depths) / sizeof(depths[0]); ++d) {
+            const float z = -depths[d];
+            const float on = s * depths[d] / p->m[0], next = (s + 0.01f) * depths[d] / p->m[0];
+
+            if (fabsf(on * n[0] + z * n[1]) > 1e-5f * depths[d]) ++bad;
+            if (next * n[0] + z * n[1] <= 0) ++bad;
+        }
+    }
+    for (i = 0; i <= CLUSTER_Y; ++i) {
+        const float* n = c->planes_y[i];
+        const float s = 2 * (float)i / CLUSTER_Y - 1;
+
+        if (!close_to(n[0] * n[0] + n[1] * n[1], 1, 1e-5f)) ++bad;
+        for (d = 0; d < sizeof(depths) / sizeof(depths[0]); ++d) {
+            const float z = -depths[d];
+            const float on = s * depths[d] / p->m[5], next = (s + 0.01f) * depths[d] / p->m[5];
+
+            if (fabsf(on * n[0] + z * n[1]) > 1e-5f * depths[d]) ++bad;
+            if (next * n[0] + z * n[1] <= 0) ++bad;
+        }
+    }
+    CHECK(bad == 0);
+}
+
+// One small light in the middle of a known cluster, and lights the frustum
+// can't see.
+static void single_lights(clusters_t* c, const mat4_t* p) {
+    const int tx = 5, ty = 3, tz = 10;
+    const float depth = expf(((float)tz + 0.5f - c->log_bias) / c->log_scale);
+    point_light_t lights[5];
+    const cluster_range_t* r = c->ranges;
+    unsigned int i;
+
+    memset(lights, 0, sizeof(lights));
+    lights[0].position[0] = (2 * ((float)tx + 0.5f) / CLUSTER_X - 1) * depth / p->m[0];
+    lights[0].position[1] = (2 * ((float)ty + 0.5f) / CLUSTER_Y - 1) * depth / p->m[5];
+    lights[0].position[2] = -depth;
+    lights[0].radius = 0.01f;
+    clusters_assign(c, lights, 1, &IDENTITY4);
+    CHECK(r->x0 == tx && r->x1 == tx && r->y0 == ty && r->y1 == ty && r->z0 == tz && r->z1 == tz);
+    CHECK(c->stats.lights == 1 && c->stats.visible_lights == 1 && c->stats.indices == 1);
+    CHECK(listed(c, (tz * CLUSTER_Y + ty) * CLUSTER_X + tx, 0));
+    check_packing(c);
+
+    // Behind the eye, beyond the far plane, left of and above the frustum.
+    lights[0].position[2] = 3;
+    lights[0].radius = 2;
+    lights[1].position[2] = -FAR_PLANE - 5;
+    lights[1].radius = 4;
+    lights[2].position[0] = -2 * 50 / p->m[0];
+    lights[2].position[2] = -50;
+    lights[2].radius = 1;
+    lights[3].position[1] = 2 * 50 / p->m[5];
+    lights[3].position[2] = -50;
+    lights[3].radius = 1;
+    // Straddling the near plane: seen, in the first slice.
+    lights[4].position[2] = -NEAR_PLANE;
+    lights[4].radius = 0.25f;
+    clusters_assign(c, lights, 5, &IDENTITY4);
+    for (i = 0; i < 4; ++i) CHECK(c->ranges[i].x0 > c->ranges[i].x1);
+    CHECK(c->stats.visible_lights == 1);
+    CHECK(c->ranges[4].x0 <= c->ranges[4].x1 && c->ranges[4].z0 == 0);
+    check_packing(c);
+}
+
+static void random_lights(clusters_t* c, const mat4_t* p) {
+    point_light_t* lights = (point_light_t*) malloc(sizeof(point_light_t) * RANDOM_LIGHTS);
+    mat4_t view = IDENTITY4;
+    unsigned long samples = 0, misses = 0, moved = 0;
+    unsigned int i, k;
+
+    rot_y(&view, 0.3f);
+    rot_x(&view, -0.1f);
+    translate(&view, 4, -2, -10);
+
+    for (i = 0; i < RANDOM_LIGHTS; ++i) {
+        lights[i].position[0] = check_random_float(-120, 120);
+        lights[i].position[1] = check_random_float(-80, 80);
+        lights[i].position[2] = check_random_float(-FAR_PLANE - 20, 20);
+        lights[i].radius = check_random_float(0, 1) < 0.8f ? check_random_float(0.1f, 3) : check_random_float(3, 30);
+        for (k = 0; k < 4; ++k) lights[i].color[k] = (float)i;
+    }
+    clusters_assign(c, lights, RANDOM_LIGHTS, &view);
+    check_packing(c);
+
+    for (i = 0; i < RANDOM_LIGHTS; ++i) {
+        const float r = lights[i].radius;
+        float v[3], q[3];
+
+        to_view(v, &view, lights[i].position);
+        if (!close_to(c->view_lights[i].position[0], v[0], 1e-5f)
+                || !close_to(c->view_lights[i].position[2], v[2], 1e-5f)
+                || c->view_lights[i].radius != r || c->view_lights[i].color[0] != (float)i)
+            ++moved;
+
+        // The center, then points spread through the sphere, just inside it.
+        for (k = 0; k <= SAMPLES; ++k) {
+            int cluster;
+
+            if (k == 0) {
+                memcpy(q, v, sizeof(q));
+            } else {
+                float d[3], len;
+                do {
+                    d[0] = check_random_float(-1, 1);
+                    d[1] = check_random_float(-1, 1);
+                    d[2] = check_random_float(-1, 1);
+                    len = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+                } while (len > 1 || len < 1e-6f);
+                // Half of them on the surface.
+                len = k % 2 ? 0.999f / sqrtf(len) : 0.999f;
+                q[0] = v[0] + d[0] * r * len;
+                q[1] = v[1] + d[1] * r * len;
+                q[2] = v[2] + d[2] * r * len;
+            }
+            cluster = shader_cluster(c, p, q);
+            if (cluster < 0) continue;
+            ++samples;
+            if (!listed(c, cluster, i)) ++misses;
+        }
+    }
+    CHECK(moved == 0);
+    CHECK(misses == 0);
+    CHECK(c->stats.visible_lights > RANDOM_LIGHTS / 4 && c->stats.visible_lights < RANDOM_LIGHTS);
+    printf("  %u lights, %u visible, %u references; %lu points in their spheres, %lu in clusters missing them\n",
+           RANDOM_LIGHTS, c->stats.visible_lights, c->stats.indices, samples, misses);
+    free(lights);
+}
+
+// More lights in one place than a cluster holds.
+static void overflow(clusters_t* c) {
+    const unsigned int count = CLUSTER_MAX_LIGHTS + 44;
+    point_light_t* lights = (point_light_t*) calloc(count, sizeof(point_light_t));
+    const unsigned long before = c->stats.overflows;
+    unsigned int i, clusters = 0;
+
+    for (i = 0; i < count; ++i) {
+        lights[i].position[2] = -20;
+        lights[i].radius = 0.5f;
+    }
+    clusters_assign(c, lights, count, &IDENTITY4);
+    for (i = 0; i < CLUSTER_COUNT; ++i) {
+        if (c->counts[i] == 0) continue;
+        ++clusters;
+        CHECK(c->counts[i] == CLUSTER_MAX_LIGHTS);
+        // The first lights are kept.
+        CHECK(c->lists[(size_t)i * CLUSTER_MAX_LIGHTS + CLUSTER_MAX_LIGHTS - 1] == CLUSTER_MAX_LIGHTS - 1);
+    }
+    CHECK(clusters > 0);
+    CHECK(c->stats.max_per_cluster == CLUSTER_MAX_LIGHTS);
+    CHECK(c->stats.overflows - before == (unsigned long)clusters * (count - CLUSTER_MAX_LIGHTS));
+    CHECK(c->stats.indices == clusters * CLUSTER_MAX_LIGHTS);
+    check_packing(c);
+    free(lights);
+}
+
+int main(void) {
+    const mat4_t p = proj(60, (float)WIDTH / HEIGHT, NEAR_PLANE, FAR_PLANE);
+    clusters_t c;
+
+#ifdef __SSE__
+    printf("Clusters (SSE):\n");
+#else
+    printf("Clusters (scalar):\n");
+#endif
+    jobs_init(0);
+    if (!clusters_init(&c, MAX_LIGHTS)) return EXIT_FAILURE;
+    clusters_set_projection(&c, &p, WIDTH, HEIGHT);
+
+    projection(&c, &p);
+    single_lights(&c, &p);
+    random_lights(&c, &p);
+    overflow(&c);
+
+    clusters_destroy(&c);
+    jobs_shutdown();
+    return check_result("cluster_test");
+}
@@ -0,0 +1,108 @@
+#include "math/utils.h"
+#include "render/trace.h"
+
+// Replays a GL trace recorded with `chapter4 --record PATH` in a hidden
+// window, as fast as the driver accepts it: no vsync, no frame cap and no
+// application logic, so every run submits exactly the same commands. Reports
+// the CPU time spent issuing each frame and the overall frame rate.
+
+#define DEFAULT_LOOPS 1
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void on_error(int error, const char* desc) {
+    fprintf(stderr, "ERROR (%d): %s.\n", error, desc);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char* argv[]) {
+    const unsigned int loops = argc > 2 ? (unsigned int)atoi(argv[2]) : DEFAULT_LOOPS;
+    double submit, submit_total = 0, submit_max = 0, start, elapsed;
+    unsigned long frames = 0;
+    unsigned int loop;
+    GLFWwindow* wnd;
+    GLenum glew_res;
+    trace_player_t player;
+    trace_t trace;
+
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s TRACE [LOOPS]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (!trace_load(&trace, argv[1])) return EXIT_FAILURE;
+    if (trace.frames == 0) {
+        fprintf(stderr, "ERROR: %s has no frames.\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    if (!glfwInit()) {
+        fprintf(stderr, "ERROR: Failed to initialize GLFW.\n");
+        return EXIT_FAILURE;
+    }
+    glfwSetErrorCallback(on_error);
+
+    // Same context as the recording.
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, trace.header.gl_major);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, trace.header.gl_minor);
+    if (trace.header.core_profile)
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    wnd = glfwCreateWindow(trace.header.width, trace.header.height, "gl_replay", NULL, NULL);
+    if (!wnd) {
+        fprintf(stderr, "ERROR: Could not create a GL %d.%d context.\n",
+                trace.header.gl_major, trace.header.gl_minor);
+        return EXIT_FAILURE;
+    }
+    glfwMakeContextCurrent(wnd);
+    glfwSwapInterval(0);
+
+    glewExperimental = GL_TRUE;
+    if ((glew_res = glewInit()) != GLEW_OK) {
+        fprintf(stderr, "ERROR: %s\n", glewGetErrorString(glew_res));
+        return EXIT_FAILURE;
+    }
+    glGetError();
+
+    trace_player_init(&player, &trace);
+    if (!trace_player_setup(&player))
+        fprintf(stderr, "ERROR: GL errors while replaying setup, results may be off.\n");
+    glFinish(); // Keep setup out of the measurement.
+
+    printf("%s: GL %d.%d%s, %dx%d, %lu frames x %u loops\n", argv[1],
+           trace.header.gl_major, trace.header.gl_minor, trace.header.core_profile ? " core" : "",
+           trace.header.width, trace.header.height, trace.frames, loops);
+
+    start = now_sec();
+    for (loop = 0; loop < loops; ++loop) {
+        trace_player_rewind(&player);
+        for (;;) {
+            double frame_start = now_sec();
+            if (!trace_player_frame(&player)) break;
+            submit = now_sec() - frame_start;
+
+            submit_total += submit;
+            if (submit > submit_max) submit_max = submit;
+            ++frames;
+            glfwSwapBuffers(wnd);
+        }
+    }
+    glFinish();
+    elapsed = now_sec() - start;
+    exit_on_glError("ERROR: GL errors while replaying frames.");
+
+    printf("%lu frames in %.3f s: %.1f fps, submit %.3f ms avg / %.3f ms max, %lu records\n",
+           frames, elapsed, frames / elapsed, submit_total * 1000. / frames, submit_max * 1000.,
+           player.records);
+
+    trace_player_finish(&player);
+    trace_player_destroy(&player);
+    trace_free(&trace);
+
+    glfwDestroyWindow(wnd);
+    glfwTerminate();
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,138 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "core/lz4.h"
+#include "check.h"
+
+// Round trips core/lz4.h over inputs that reach its edge cases (empty, too
+// short to match, long literal and match runs, incompressible), and feeds
+// the decoder truncated, mutated and hand-built malformed blocks, which must
+// fail or decode without writing past the output.
+
+#define CANARY 0xA5
+#define CANARY_SIZE 16
+
+// Decompresses into a buffer of exactly `size` bytes followed by a canary,
+// which must survive whether or not decompression succeeds.
+static int decompress_guarded(const unsigned char* packed, size_t packed_size, unsigned char* out, size_t size) {
+    int ok;
+    size_t i;
+
+    memset(out + size, CANARY, CANARY_SIZE);
+    ok = lz4_decompress(packed, packed_size, out, size);
+    for (i = 0; i < CANARY_SIZE; ++i) CHECK(out[size + i] == CANARY);
+    return ok;
+}
+
+static void round_trip(const char* what, const unsigned char* src, size_t size) {
+    const size_t capacity = LZ4_BOUND(size);
+    unsigned char* packed = (unsigned char*) malloc(capacity);
+    unsigned char* out = (unsigned char*) malloc(size + 1 + CANARY_SIZE);
+    size_t packed_size, n;
+
+    packed_size = lz4_compress(src, size, packed, capacity);
+    CHECK(packed_size > 0 && packed_size <= capacity);
+    CHECK(decompress_guarded(packed, packed_size, out, size));
+    CHECK(memcmp(out, src, size) == 0);
+
+    // The block must expand to exactly the size asked for.
+    CHECK(!decompress_guarded(packed, packed_size, out, size + 1));
+    if (size > 0) CHECK(!decompress_guarded(packed, packed_size, out, size - 1));
+
+    // Every truncation is an incomplete stream.
+    for (n = 0; n < packed_size; n += 1 + n / 64)
+        CHECK(!decompress_guarded(packed, n, out, size));
+
+    // Too small an output buffer fails rather than writing past it.
+    if (packed_size > 1) CHECK(lz4_compress(src, size, packed, packed_size - 1) == 0);
+
+    printf("  %-28s %8lu -> %8lu bytes\n", what, (unsigned long)size, (unsigned long)packed_size);
+    free(packed);
+    free(out);
+}
+
+// Random byte changes in a valid block: decoding may succeed or fail, but
+// stays within its buffers.
+static void mutate(const unsigned char* src, size_t size, unsigned int rounds) {
+    const size_t capacity = LZ4_BOUND(size);
+    unsigned char* packed = (unsigned char*) malloc(capacity);
+    unsigned char* corrupt = (unsigned char*) malloc(capacity);
+    unsigned char* out = (unsigned char*) malloc(size + CANARY_SIZE);
+    const size_t packed_size = lz4_compress(src, size, packed, capacity);
+    unsigned int i, j;
+
+    CHECK(packed_size > 0);
+    for (i = 0; i < rounds; ++i) {
+        memcpy(corrupt, packed, packed_size);
+        for (j = 0; j < 1 + i % 4; ++j) corrupt[check_random() % packed_size] = (unsigned char)check_random();
+        decompress_guarded(corrupt, packed_size, out, size);
+    }
+    free(packed);
+    free(corrupt);
+    free(out);
+}
+
+static void malformed(void) {
+    unsigned char out[64 + CANARY_SIZE];
+    // 4 literals, then a match reaching back 5 bytes into 4 written.
+    static const unsigned char far_offset[] = { 0x40, 'a', 'b', 'c', 'd', 5, 0, 0x00, 'e' };
+    // A zero offset.
+    static const unsigned char zero_offset[] = { 0x40, 'a', 'b', 'c', 'd', 0, 0, 0x00, 'e' };
+    // 15 + 255 + 255 literals announced, 2 present.
+    static const unsigned char long_literals[] = { 0xF0, 255, 255, 0, 'a', 'b' };
+    // A literal length continuation that runs out.
+    static const unsigned char cut_length[] = { 0xF0, 255, 255 };
+    // A match whose offset is cut off.
+    static const unsigned char cut_offset[] = { 0x10, 'a', 1 };
+    // A valid overlapping match: "ab" then 6 more repeating it, then "x".
+    static const unsigned char overlap[] = { 0x22, 'a', 'b', 2, 0, 0x10, 'x' };
+
+    CHECK(!decompress_guarded(far_offset, sizeof(far_offset), out, 9));
+    CHECK(!decompress_guarded(zero_offset, sizeof(zero_offset), out, 9));
+    CHECK(!decompress_guarded(long_literals, sizeof(long_literals), out, 64));
+    CHECK(!decompress_guarded(cut_length, sizeof(cut_length), out, 64));
+    CHECK(!decompress_guarded(cut_offset, sizeof(cut_offset), out, 64));
+    CHECK(!decompress_guarded(NULL, 0, out, 0));
+
+    CHECK(decompress_guarded(overlap, sizeof(overlap), out, 9));
+    CHECK(memcmp(out, "abababab" "x", 9) == 0);
+    // The same match overrunning a smaller output.
+    CHECK(!decompress_guarded(overlap, sizeof(overlap), out, 5));
+}
+
+int main(void) {
+    const size_t size = 256 * 1024;
+    unsigned char* data = (unsigned char*) malloc(size);
+    size_t i;
+
+    printf("Round trips:\n");
+    memcpy(data, "0123456789abc", 13);
+    round_trip("empty", data, 0);
+    round_trip("12 bytes (no matches)", data, 12);
+    round_trip("13 bytes", data, 13);
+
+    memset(data, 'z', size);
+    round_trip("one byte repeated", data, size);
+
+    for (i = 0; i < size; ++i)
+        data[i] = (unsigned char)(i % 251 < 200 ? (uint32_t)"shader source "[i % 14] : check_random());
+    round_trip("text with noise", data, size);
+
+    for (i = 0; i < size; ++i) data[i] = (unsigned char)check_random();
+    round_trip("random", data, size);
+    round_trip("random, 1000 bytes", data, 1000);
+
+    // Matches further back than 64 KB can't be used.
+    for (i = 0; i < 70000; ++i) data[i + 70000] = data[i];
+    round_trip("repeat past 64 KB", data, 140000);
+
+    printf("Corrupt input:\n");
+    malformed();
+    for (i = 0; i < 64 * 1024; ++i)
+        data[i] = (unsigned char)("vec4 color = texture(tex, uv);\n"[i % 31] ^ (i % 997 == 0));
+    mutate(data, 64 * 1024, 2000);
+    mutate(data, 300, 2000);
+
+    free(data);
+    return check_result("lz4_test");
+}
@@ -0,0 +1,163 @@
+#include "math/utils.h"
+#include "math/fast.h"
+#include "math/affine.h"
+
+// Times the per-frame transform path chapter4 runs for every object: build
+// the model matrix from rotations and a translation, then compose it with the
+// view and projection matrices. Runs the book (utils.c) path against the
+// header-inline path and checks they agree. Then times the model-view part
+// alone with mat4_t against mat4x3_t (math/affine.h), which skips the
+// constant bottom row, and checks those agree too.
+
+#define DEFAULT_OBJECTS 10000
+#define DEFAULT_FRAMES 200
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void transform_book(mat4_t* out, const mat4_t* view, const mat4_t* projection,
+                           unsigned int count, float t) {
+    unsigned int i;
+    for (i = 0; i < count; ++i) {
+        const float angle = deg2rad(t + (float)i);
+        mat4_t model = IDENTITY4, model_view;
+
+        rot_y(&model, angle);
+        rot_x(&model, angle);
+        translate(&model, (float)(i % 100), (float)(i / 100), 0);
+        model_view = mat_mult(&model, view);
+        out[i] = mat_mult(&model_view, projection);
+    }
+}
+
+static void transform_fast(mat4_t* out, const mat4_t* view, const mat4_t* projection,
+                           unsigned int count, float t) {
+    unsigned int i;
+    for (i = 0; i < count; ++i) {
+        const float angle = deg2rad_fast(t + (float)i);
+        mat4_t model = IDENTITY4, model_view;
+
+        rot_y_fast(&model, angle);
+        rot_x_fast(&model, angle);
+        translate_fast(&model, (float)(i % 100), (float)(i / 100), 0);
+        mat_mult_fast(&model_view, &model, view);
+        mat_mult_fast(&out[i], &model_view, projection);
+    }
+}
+
+// Model-view only: both matrices are affine.
+static void model_view_fast(mat4_t* out, const mat4_t* view, unsigned int count, float t) {
+    unsigned int i;
+    for (i = 0; i < count; ++i) {
+        const float angle = deg2rad_fast(t + (float)i);
+        mat4_t model = IDENTITY4;
+
+        rot_y_fast(&model, angle);
+        rot_x_fast(&model, angle);
+        translate_fast(&model, (float)(i % 100), (float)(i / 100), 0);
+        mat_mult_fast(&out[i], &model, view);
+    }
+}
+
+static void model_view_affine(mat4x3_t* out, const mat4x3_t* view, unsigned int count, float t) {
+    unsigned int i;
+    for (i = 0; i < count; ++i) {
+        const float angle = deg2rad_fast(t + (float)i);
+        mat4x3_t model = IDENTITY4X3;
+
+        mat4x3_rot_y(&model, angle);
+        mat4x3_rot_x(&model, angle);
+        mat4x3_translate(&model, (float)(i % 100), (float)(i / 100), 0);
+        mat4x3_mult(&out[i], &model, view);
+    }
+}
+
+typedef void (*transform_fn)(mat4_t*, const mat4_t*, const mat4_t*, unsigned int, float);
+
+static double run(transform_fn fn, mat4_t* out, const mat4_t* view, const mat4_t* projection,
+                  unsigned int count, unsigned int frames) {
+    unsigned int f;
+    double start = now_sec();
+    for (f = 0; f < frames; ++f)
+        fn(out, view, projection, count, (float)f);
+    return now_sec() - start;
+}
+
+int main(int argc, char* argv[]) {
+    const unsigned int count = argc > 1 ? (unsigned int)atoi(argv[1]) : DEFAULT_OBJECTS;
+    const unsigned int frames = argc > 2 ? (unsigned int)atoi(argv[2]) : DEFAULT_FRAMES;
+    mat4_t view = IDENTITY4, projection = proj(60, 1.f, 1.f, 100.f);
+    mat4_t *book, *fast;
+    mat4x3_t view4x3, *affine;
+    double t_book, t_fast, t_mv4, t_mv4x3, start;
+    float max_err = 0, max_affine_err = 0;
+    unsigned int i, j, f;
+
+    if (count == 0 || frames == 0) {
+        fprintf(stderr, "Usage: %s [objects] [frames]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    book = (mat4_t*) malloc(sizeof(mat4_t) * count);
+    fast = (mat4_t*) malloc(sizeof(mat4_t) * count);
+    affine = (mat4x3_t*) malloc(sizeof(mat4x3_t) * count);
+    if (book == NULL || fast == NULL || affine == NULL) {
+        fprintf(stderr, "ERROR: Could not allocate %u matrices.\n", count);
+        exit(EXIT_FAILURE);
+    }
+
+    translate(&view, 0, 0, -2);
+
+    // Warm up, then check both paths produce the same matrices.
+    transform_book(book, &view, &projection, count, 0);
+    transform_fast(fast, &view, &projection, count, 0);
+    for (i = 0; i < count; ++i)
+        for (j = 0; j < 16; ++j) {
+            const float err = fabsf(book[i].m[j] - fast[i].m[j]);
+            if (err > max_err) max_err = err;
+        }
+
+    t_book = run(transform_book, book, &view, &projection, count, frames);
+    t_fast = run(transform_fast, fast, &view, &projection, count, frames);
+
+    printf("objects: %u, frames: %u, max abs diff: %g\n", count, frames, max_err);
+    printf("book:   %8.2f ns/object, %8.3f ms/frame\n",
+           t_book * 1e9 / ((double)count * frames), t_book * 1e3 / frames);
+    printf("inline: %8.2f ns/object, %8.3f ms/frame\n",
+           t_fast * 1e9 / ((double)count * frames), t_fast * 1e3 / frames);
+    printf("speedup: %.2fx\n", t_book / t_fast);
+
+    mat4x3_from_mat4(&view4x3, &view);
+    model_view_fast(fast, &view, count, 0);
+    model_view_affine(affine, &view4x3, count, 0);
+    for (i = 0; i < count; ++i) {
+        mat4x3_t m;
+        mat4x3_from_mat4(&m, &fast[i]);
+        for (j = 0; j < 12; ++j) {
+            const float err = fabsf(m.m[j] - affine[i].m[j]);
+            if (err > max_affine_err) max_affine_err = err;
+        }
+    }
+
+    start = now_sec();
+    for (f = 0; f < frames; ++f) model_view_fast(fast, &view, count, (float)f);
+    t_mv4 = now_sec() - start;
+    start = now_sec();
+    for (f = 0; f < frames; ++f) model_view_affine(affine, &view4x3, count, (float)f);
+    t_mv4x3 = now_sec() - start;
+
+    printf("model-view, max abs diff: %g\n", max_affine_err);
+    printf("mat4:   %8.2f ns/object, %8.3f ms/frame\n",
+           t_mv4 * 1e9 / ((double)count * frames), t_mv4 * 1e3 / frames);
+    printf("mat4x3: %8.2f ns/object, %8.3f ms/frame\n",
+           t_mv4x3 * 1e9 / ((double)count * frames), t_mv4x3 * 1e3 / frames);
+    printf("speedup: %.2fx\n", t_mv4 / t_mv4x3);
+
+    free(book);
+    free(fast);
+    free(affine);
+    return max_err < 1e-3f && max_affine_err < 1e-3f ? EXIT_SUCCESS : EXIT_FAILURE;
+}
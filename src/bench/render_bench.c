@@ -0,0 +1,466 @@
+#include "math/utils.h"
+#include "math/fast.h"
+#include "math/affine.h"
+#include "render/program.h"
+#include "render/vertex_pull.h"
+
+// Scaling benchmark for chapter4's cube, drawn N times with five submission
+// strategies:
+//
+//   naive      one glDrawElements per cube, setting the program, the model
+//              and view uniforms and the VAO each time, as draw_cube() does;
+//   vaos       one glDrawElements per cube with the program and view set once,
+//              each cube binding its own VAO (BENCH_VAOS of them, cycled), as
+//              when every mesh has its own attribute setup;
+//   pulled     the same draws through one empty VAO, the vertex shader
+//              pulling indices and vertices from storage buffers
+//              (render/vertex_pull.h) with the base vertex as a uniform;
+//   instanced  one glDrawElementsInstanced, model matrices in a per-instance
+//              vertex attribute;
+//   indirect   one glMultiDrawElementsIndirect with a command per cube, each
+//              picking its matrix through base_instance.
+//
+// The cubes are static and fill the same square of the screen whatever their
+// number; only the camera moves. For each count (1, 10, ... up to the maximum)
+// and strategy, the frames run in a hidden window without vsync and report
+// the CPU time spent issuing the frame, the GPU time from GL_TIME_ELAPSED
+// queries and the overall frame rate. A point stops early after
+// POINT_BUDGET_SEC, so the naive path doesn't take minutes at 1M cubes.
+
+#define DEFAULT_MAX_OBJECTS 1000000
+#define DEFAULT_FRAMES 60
+#define POINT_BUDGET_SEC 3.0
+#define QUERY_LATENCY 4     // Frames between issuing a timer query and reading it.
+#define WINDOW_SIZE 512
+#define BENCH_VAOS 1024
+
+typedef enum submit_mode_ {
+    SUBMIT_NAIVE = 0,
+    SUBMIT_VAOS,
+    SUBMIT_PULLED,
+    SUBMIT_INSTANCED,
+    SUBMIT_INDIRECT,
+    SUBMIT_MODE_COUNT
+} submit_mode_t;
+
+static const char* MODE_NAMES[SUBMIT_MODE_COUNT] = { "naive", "vaos", "pulled", "instanced", "indirect" };
+
+typedef struct draw_elements_indirect_ {
+    GLuint count;
+    GLuint instance_count;
+    GLuint first_index;
+    GLint base_vertex;
+    GLuint base_instance;
+} draw_elements_indirect_t;
+
+typedef struct bench_ {
+    GLuint naive_prog, instanced_prog;
+    GLint model_uloc, naive_view_uloc, naive_proj_uloc, view_uloc, proj_uloc;
+    GLuint vbo, ibo, naive_vao, instanced_vao, models_buf, commands_buf;
+    GLuint mesh_vaos[BENCH_VAOS];
+    vertex_pull_t pull;
+    GLuint queries[QUERY_LATENCY];
+    mat4x3_t* models;
+    unsigned int count;
+    mat4_t view, projection;
+} bench_t;
+
+typedef struct bench_result_ {
+    unsigned long frames;
+    double submit_ms;   // Average CPU time issuing a frame.
+    double gpu_ms;      // Average GPU time, over the frames whose query was read.
+    double fps;
+} bench_result_t;
+
+static const vertex_t CUBE_VERTICES[8] = {
+    { { -.5f, -.5f,  .5f, 1 }, { 0, 0, 1, 1 } },
+    { { -.5f,  .5f,  .5f, 1 }, { 1, 0, 0, 1 } },
+    { {  .5f,  .5f,  .5f, 1 }, { 0, 1, 0, 1 } },
+    { {  .5f, -.5f,  .5f, 1 }, { 1, 1, 0, 1 } },
+    { { -.5f, -.5f, -.5f, 1 }, { 1, 1, 1, 1 } },
+    { { -.5f,  .5f, -.5f, 1 }, { 1, 0, 0, 1 } },
+    { {  .5f,  .5f, -.5f, 1 }, { 1, 0, 1, 1 } },
+    { {  .5f, -.5f, -.5f, 1 }, { 0, 0, 1, 1 } }
+};
+
+static const GLuint CUBE_INDICES[36] = {
+    0,2,1,  0,3,2,
+    4,3,0,  4,7,3,
+    4,1,5,  4,0,1,
+    3,6,2,  3,7,6,
+    1,6,5,  1,2,6,
+    7,5,6,  7,4,5
+};
+
+// chapter4's simple.vertex.glsl, with the model matrix a mat4x3; the
+// projection is set once, the model and view matrices for every draw, as in
+// draw_cube().
+static const GLchar* NAIVE_VERTEX_SHADER = {
+    "#version 430 core\n"
+    "layout(location=0) in vec4 in_Position;\n"
+    "layout(location=1) in vec4 in_Color;\n"
+    "uniform mat4x3 ModelMatrix;\n"
+    "uniform mat4 ViewMatrix;\n"
+    "uniform mat4 ProjectionMatrix;\n"
+    "out vec4 ex_Color;\n"
+
+    "void main(void)\n"
+    "{\n"
+    "  gl_Position = ProjectionMatrix * ViewMatrix * vec4(ModelMatrix * in_Position, 1.0);\n"
+    "  ex_Color = in_Color;\n"
+    "}\n"
+};
+
+// The model matrix takes attribute locations 2 to 4, one mat4x3_t row each;
+// as the columns of a mat3x4, a row vector times it transforms.
+static const GLchar* INSTANCED_VERTEX_SHADER = {
+    "#version 430 core\n"
+    "layout(location=0) in vec4 in_Position;\n"
+    "layout(location=1) in vec4 in_Color;\n"
+    "layout(location=2) in mat3x4 in_Model;\n"
+    "uniform mat4 ViewMatrix;\n"
+    "uniform mat4 ProjectionMatrix;\n"
+    "out vec4 ex_Color;\n"
+
+    "void main(void)\n"
+    "{\n"
+    "  gl_Position = ProjectionMatrix * ViewMatrix * vec4(in_Position * in_Model, 1.0);\n"
+    "  ex_Color = in_Color;\n"
+    "}\n"
+};
+
+static const GLchar* FRAGMENT_SHADER = {
+    "#version 430 core\n"
+    "in vec4 ex_Color;\n"
+    "out vec4 out_Color;\n"
+
+    "void main(void)\n"
+    "{\n"
+    "  out_Color = ex_Color;\n"
+    "}\n"
+};
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void on_error(int error, const char* desc) {
+    fprintf(stderr, "ERROR (%d): %s.\n", error, desc);
+    exit(EXIT_FAILURE);
+}
+
+static void bind_cube(GLuint vbo, GLuint ibo) {
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(vertex_t), (GLvoid*)0);
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(vertex_t), (GLvoid*)sizeof(CUBE_VERTICES[0].pos));
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+}
+
+static void bench_init(bench_t* b, unsigned int capacity) {
+    unsigned int column, i;
+
+    memset(b, 0, sizeof(*b));
+    if ((b->naive_prog = program_from_source(NAIVE_VERTEX_SHADER, FRAGMENT_SHADER)) == 0
+            || (b->instanced_prog = program_from_source(INSTANCED_VERTEX_SHADER, FRAGMENT_SHADER)) == 0
+            || !vertex_pull_init(&b->pull, FRAGMENT_SHADER))
+        exit(EXIT_FAILURE);
+    b->model_uloc = glGetUniformLocation(b->naive_prog, "ModelMatrix");
+    b->naive_view_uloc = glGetUniformLocation(b->naive_prog, "ViewMatrix");
+    b->naive_proj_uloc = glGetUniformLocation(b->naive_prog, "ProjectionMatrix");
+    b->view_uloc = glGetUniformLocation(b->instanced_prog, "ViewMatrix");
+    b->proj_uloc = glGetUniformLocation(b->instanced_prog, "ProjectionMatrix");
+
+    if ((b->models = (mat4x3_t*) malloc(sizeof(mat4x3_t) * capacity)) == NULL) {
+        fprintf(stderr, "ERROR: Could not allocate %u matrices.\n", capacity);
+        exit(EXIT_FAILURE);
+    }
+
+    glGenBuffers(1, &b->vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, b->vbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(CUBE_VERTICES), CUBE_VERTICES, GL_STATIC_DRAW);
+    glGenBuffers(1, &b->ibo);
+    glBindBuffer(GL_ARRAY_BUFFER, b->ibo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(CUBE_INDICES), CUBE_INDICES, GL_STATIC_DRAW);
+
+    glGenBuffers(1, &b->models_buf);
+    glBindBuffer(GL_ARRAY_BUFFER, b->models_buf);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(mat4x3_t) * capacity, NULL, GL_STATIC_DRAW);
+    glGenBuffers(1, &b->commands_buf);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, b->commands_buf);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(draw_elements_indirect_t) * capacity, NULL, GL_STATIC_DRAW);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+    glGenVertexArrays(1, &b->naive_vao);
+    glBindVertexArray(b->naive_vao);
+    bind_cube(b->vbo, b->ibo);
+
+    // Same buffers, separate attribute state.
+    glGenVertexArrays(BENCH_VAOS, b->mesh_vaos);
+    for (i = 0; i < BENCH_VAOS; ++i) {
+        glBindVertexArray(b->mesh_vaos[i]);
+        bind_cube(b->vbo, b->ibo);
+    }
+
+    // Shared by the instanced and indirect paths: base_instance offsets the
+    // per-instance attributes of each indirect command.
+    glGenVertexArrays(1, &b->instanced_vao);
+    glBindVertexArray(b->instanced_vao);
+    bind_cube(b->vbo, b->ibo);
+    glBindBuffer(GL_ARRAY_BUFFER, b->models_buf);
+    for (column = 0; column < 3; ++column) {
+        glEnableVertexAttribArray(2 + column);
+        glVertexAttribPointer(2 + column, 4, GL_FLOAT, GL_FALSE, sizeof(mat4x3_t),
+                              (GLvoid*)(sizeof(float) * 4 * column));
+        glVertexAttribDivisor(2 + column, 1);
+    }
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    // Set once, as resize() does in chapter4.
+    b->projection = proj(60, 1.f, 1.f, 100.f);
+    glUseProgram(b->naive_prog);
+    glUniformMatrix4fv(b->naive_proj_uloc, 1, GL_FALSE, b->projection.m);
+    glUseProgram(b->instanced_prog);
+    glUniformMatrix4fv(b->proj_uloc, 1, GL_FALSE, b->projection.m);
+    glUseProgram(0);
+
+    glGenQueries(QUERY_LATENCY, b->queries);
+    exit_on_glError("ERROR: Could not create benchmark objects.");
+}
+
+static void bench_destroy(bench_t* b) {
+    GLuint buffers[4];
+
+    buffers[0] = b->vbo;
+    buffers[1] = b->ibo;
+    buffers[2] = b->models_buf;
+    buffers[3] = b->commands_buf;
+    glDeleteBuffers(4, buffers);
+    glDeleteVertexArrays(1, &b->naive_vao);
+    glDeleteVertexArrays(1, &b->instanced_vao);
+    glDeleteVertexArrays(BENCH_VAOS, b->mesh_vaos);
+    vertex_pull_destroy(&b->pull);
+    glDeleteQueries(QUERY_LATENCY, b->queries);
+    glDeleteProgram(b->naive_prog);
+    glDeleteProgram(b->instanced_prog);
+    free(b->models);
+}
+
+// Lays `count` cubes out on a square grid spanning [-1, 1] and uploads their
+// matrices and indirect commands.
+static void bench_set_count(bench_t* b, unsigned int count) {
+    const unsigned int side = (unsigned int)ceilf(sqrtf((float)count));
+    const float spacing = 2.0f / (float)side;
+    draw_elements_indirect_t* commands;
+    unsigned int i;
+
+    b->count = count;
+    for (i = 0; i < count; ++i) {
+        mat4x3_t* m = &b->models[i];
+        *m = IDENTITY4X3;
+        mat4x3_scale(m, 0.6f * spacing, 0.6f * spacing, 0.6f * spacing);
+        mat4x3_translate(m,
+                         spacing * ((float)(i % side) - 0.5f * (side - 1)),
+                         spacing * ((float)(i / side) - 0.5f * (side - 1)),
+                         0);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, b->models_buf);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(mat4x3_t) * count, b->models);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, b->commands_buf);
+    commands = (draw_elements_indirect_t*) glMapBufferRange(
+        GL_DRAW_INDIRECT_BUFFER, 0, sizeof(draw_elements_indirect_t) * count,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (commands == NULL) {
+        fprintf(stderr, "ERROR: Could not map the indirect commands.\n");
+        exit(EXIT_FAILURE);
+    }
+    for (i = 0; i < count; ++i) {
+        commands[i].count = 36;
+        commands[i].instance_count = 1;
+        commands[i].first_index = 0;
+        commands[i].base_vertex = 0;
+        commands[i].base_instance = i;
+    }
+    glUnmapBuffer(GL_DRAW_INDIRECT_BUFFER);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    exit_on_glError("ERROR: Could not upload the objects.");
+}
+
+static void submit_frame(bench_t* b, submit_mode_t mode) {
+    unsigned int i;
+
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    switch (mode) {
+    case SUBMIT_NAIVE:
+        for (i = 0; i < b->count; ++i) {
+            glUseProgram(b->naive_prog);
+            glUniformMatrix4x3fv(b->model_uloc, 1, GL_TRUE, b->models[i].m);
+            glUniformMatrix4fv(b->naive_view_uloc, 1, GL_FALSE, b->view.m);
+            glBindVertexArray(b->naive_vao);
+            glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, (GLvoid*)0);
+        }
+        break;
+    case SUBMIT_VAOS:
+        glUseProgram(b->naive_prog);
+        glUniformMatrix4fv(b->naive_view_uloc, 1, GL_FALSE, b->view.m);
+        for (i = 0; i < b->count; ++i) {
+            glUniformMatrix4x3fv(b->model_uloc, 1, GL_TRUE, b->models[i].m);
+            glBindVertexArray(b->mesh_vaos[i % BENCH_VAOS]);
+            glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, (GLvoid*)0);
+        }
+        break;
+    case SUBMIT_PULLED:
+        vertex_pull_begin(&b->pull, &b->view, &b->projection);
+        vertex_pull_bind(b->vbo, b->ibo);
+        for (i = 0; i < b->count; ++i)
+            vertex_pull_draw(&b->pull, &b->models[i], 36, 0, 0);
+        break;
+    case SUBMIT_INSTANCED:
+        glUseProgram(b->instanced_prog);
+        glUniformMatrix4fv(b->view_uloc, 1, GL_FALSE, b->view.m);
+        glBindVertexArray(b->instanced_vao);
+        glDrawElementsInstanced(GL_TRIANGLES, 36, GL_UNSIGNED_INT, (GLvoid*)0, (GLsizei)b->count);
+        break;
+    case SUBMIT_INDIRECT:
+    default:
+        glUseProgram(b->instanced_prog);
+        glUniformMatrix4fv(b->view_uloc, 1, GL_FALSE, b->view.m);
+        glBindVertexArray(b->instanced_vao);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, b->commands_buf);
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (GLvoid*)0, (GLsizei)b->count, 0);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        break;
+    }
+    glBindVertexArray(0);
+    glUseProgram(0);
+}
+
+static bench_result_t run_point(bench_t* b, GLFWwindow* wnd, submit_mode_t mode, unsigned int frames) {
+    bench_result_t r;
+    double submit_total = 0, gpu_total = 0, start, end;
+    unsigned long gpu_frames = 0, f;
+
+    memset(&r, 0, sizeof(r));
+    glFinish();
+    start = now_sec();
+    for (f = 0; f < frames; ++f) {
+        const unsigned int slot = f % QUERY_LATENCY;
+        double frame_start;
+
+        // The slot's previous query was issued QUERY_LATENCY frames ago.
+        if (f >= QUERY_LATENCY) {
+            GLuint64 ns;
+            glGetQueryObjectui64v(b->queries[slot], GL_QUERY_RESULT, &ns);
+            gpu_total += (double)ns * 1e-6;
+            ++gpu_frames;
+        }
+
+        b->view = IDENTITY4;
+        rot_y_fast(&b->view, deg2rad_fast(0.5f * (float)f));
+        translate_fast(&b->view, 0, 0, -2.5f);
+
+        frame_start = now_sec();
+        glBeginQuery(GL_TIME_ELAPSED, b->queries[slot]);
+        submit_frame(b, mode);
+        glEndQuery(GL_TIME_ELAPSED);
+        submit_total += now_sec() - frame_start;
+
+        glfwSwapBuffers(wnd);
+        glfwPollEvents();
+        if (now_sec() - start > POINT_BUDGET_SEC && f >= 2) {
+            ++f;
+            break;
+        }
+    }
+    glFinish();
+    end = now_sec();
+
+    // Whatever is still outstanding has completed by now.
+    for (r.frames = f; gpu_frames < r.frames; ++gpu_frames) {
+        GLuint64 ns;
+        glGetQueryObjectui64v(b->queries[gpu_frames % QUERY_LATENCY], GL_QUERY_RESULT, &ns);
+        gpu_total += (double)ns * 1e-6;
+    }
+    exit_on_glError("ERROR: GL errors during the benchmark.");
+
+    r.submit_ms = submit_total * 1000. / (double)r.frames;
+    r.gpu_ms = gpu_total / (double)r.frames;
+    r.fps = (double)r.frames / (end - start);
+    return r;
+}
+
+int main(int argc, char* argv[]) {
+    const unsigned int max_objects = argc > 1 ? (unsigned int)atoi(argv[1]) : DEFAULT_MAX_OBJECTS;
+    const unsigned int frames = argc > 2 ? (unsigned int)atoi(argv[2]) : DEFAULT_FRAMES;
+    GLFWwindow* wnd;
+    GLenum glew_res;
+    bench_t bench;
+    unsigned int count;
+    int mode;
+
+    if (max_objects == 0 || frames == 0) {
+        fprintf(stderr, "Usage: %s [max_objects] [frames]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (!glfwInit()) {
+        fprintf(stderr, "ERROR: Failed to initialize GLFW.\n");
+        return EXIT_FAILURE;
+    }
+    glfwSetErrorCallback(on_error);
+
+    // Multi-draw-indirect needs 4.3; Mesa's llvmpipe provides 4.5 core.
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    if ((wnd = glfwCreateWindow(WINDOW_SIZE, WINDOW_SIZE, "render_bench", NULL, NULL)) == NULL) {
+        fprintf(stderr, "ERROR: Could not create a GL 4.5 context.\n");
+        return EXIT_FAILURE;
+    }
+    glfwMakeContextCurrent(wnd);
+    glfwSwapInterval(0);
+
+    glewExperimental = GL_TRUE;
+    if ((glew_res = glewInit()) != GLEW_OK) {
+        fprintf(stderr, "ERROR: %s\n", glewGetErrorString(glew_res));
+        return EXIT_FAILURE;
+    }
+    glGetError();
+
+    printf("%s, %dx%d, up to %u frames or %.0f s per point\n",
+           glGetString(GL_RENDERER), WINDOW_SIZE, WINDOW_SIZE, frames, POINT_BUDGET_SEC);
+
+    glClearColor(0, 0, 0, 0);
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LESS);
+    glEnable(GL_CULL_FACE);
+    glCullFace(GL_BACK);
+    glFrontFace(GL_CCW);
+    glViewport(0, 0, WINDOW_SIZE, WINDOW_SIZE);
+
+    bench_init(&bench, max_objects);
+
+    printf("%-10s %10s %8s %12s %12s %10s\n", "mode", "objects", "frames", "submit ms", "gpu ms", "fps");
+    for (count = 1; ; count = count > max_objects / 10 ? max_objects : count * 10) {
+        bench_set_count(&bench, count);
+        for (mode = 0; mode < SUBMIT_MODE_COUNT; ++mode) {
+            const bench_result_t r = run_point(&bench, wnd, (submit_mode_t)mode, frames);
+            printf("%-10s %10u %8lu %12.3f %12.3f %10.1f\n",
+                   MODE_NAMES[mode], count, r.frames, r.submit_ms, r.gpu_ms, r.fps);
+            fflush(stdout);
+        }
+        if (count == max_objects) break;
+    }
+
+    bench_destroy(&bench);
+    glfwDestroyWindow(wnd);
+    glfwTerminate();
+    return EXIT_SUCCESS;
+}
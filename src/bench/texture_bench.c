@@ -0,0 +1,263 @@
+#include <unistd.h>
+
+#include "math/utils.h"
+#include "core/jobs.h"
+#include "render/texture.h"
+
+// Streams a set of generated textures through render/texture.h in a hidden
+// window and reports how the upload budget spreads them over frames.
+//
+// Half the textures are uncompressed TGA files, decoded with a generated mip
+// chain on the job system; the other half are BC1 DDS files with a full
+// chain, uploaded as stored. They're written to a temporary directory, all
+// loaded at once, and every RELEASE_EVERY-th one is released straight away,
+// while still decoding. Frames then call texture_streamer_update() and swap
+// until every remaining texture is resident, and the bench prints the frames
+// and time that took, the bytes uploaded per frame against the budget, and
+// the frames where uploads waited on a busy PBO.
+
+#define DEFAULT_COUNT 64
+#define DEFAULT_SIZE 1024
+#define DEFAULT_BUDGET_MB 8
+#define RELEASE_EVERY 8
+#define TIMEOUT_SEC 60.0
+#define WINDOW_SIZE 256
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void on_error(int error, const char* desc) {
+    fprintf(stderr, "ERROR (%d): %s.\n", error, desc);
+    exit(EXIT_FAILURE);
+}
+
+static int write_file(const char* path, const unsigned char* header, size_t header_size,
+                      const unsigned char* data, size_t size) {
+    FILE* f = fopen(path, "wb");
+    int ok;
+
+    if (f == NULL) {
+        fprintf(stderr, "ERROR: Could not create %s.\n", path);
+        return 0;
+    }
+    ok = fwrite(header, 1, header_size, f) == header_size && fwrite(data, 1, size, f) == size;
+    ok = fclose(f) == 0 && ok;
+    if (!ok) fprintf(stderr, "ERROR: Could not write %s.\n", path);
+    return ok;
+}
+
+static void put_u32(unsigned char* p, unsigned int v) {
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+    p[2] = (unsigned char)(v >> 16);
+    p[3] = (unsigned char)(v >> 24);
+}
+
+// 32 bpp uncompressed TGA, a different checkerboard for every `seed`.
+static int write_tga(const char* path, int size, unsigned int seed) {
+    unsigned char header[18] = { 0 };
+    unsigned char* pixels = (unsigned char*) malloc((size_t)size * size * 4);
+    unsigned char* p = pixels;
+    int x, y, ok;
+
+    if (pixels == NULL) return 0;
+    for (y = 0; y < size; ++y) {
+        for (x = 0; x < size; ++x, p += 4) {
+            const int on = ((x >> 5) ^ (y >> 5)) & 1;
+            p[0] = (unsigned char)(on ? seed * 37 : (unsigned int)x);
+            p[1] = (unsigned char)(on ? seed * 91 : (unsigned int)y);
+            p[2] = (unsigned char)(on ? 255 : seed);
+            p[3] = 255;
+        }
+    }
+
+    header[2] = 2;
+    header[12] = (unsigned char)size;
+    header[13] = (unsigned char)(size >> 8);
+    header[14] = (unsigned char)size;
+    header[15] = (unsigned char)(size >> 8);
+    header[16] = 32;
+    header[17] = 8;     // Alpha bits; bottom-up.
+
+    ok = write_file(path, header, sizeof(header), pixels, (size_t)size * size * 4);
+    free(pixels);
+    return ok;
+}
+
+// BC1 DDS with a full mip chain. Any 8 bytes are a valid BC1 block, so the
+// blocks are just two endpoint colours and a pattern.
+static int write_dds(const char* path, int size, unsigned int seed) {
+    unsigned char header[128] = { 0 };
+    const int levels = image_level_count(size, size);
+    size_t bytes = 0, i;
+    unsigned char* blocks;
+    int l, s, ok;
+
+    for (l = 0, s = size; l < levels; ++l, s = s > 1 ? s / 2 : 1)
+        bytes += (size_t)((s + 3) / 4) * ((s + 3) / 4) * 8;
+    if ((blocks = (unsigned char*) malloc(bytes)) == NULL) return 0;
+    for (i = 0; i < bytes; i += 8) {
+        put_u32(blocks + i, 0xF800u | (seed << 16));
+        put_u32(blocks + i + 4, (unsigned int)(i / 8) * 0x9E3779B9u);
+    }
+
+    memcpy(header, "DDS ", 4);
+    put_u32(header + 4, 124);
+    put_u32(header + 8, 0x000A1007);    // CAPS, HEIGHT, WIDTH, PIXELFORMAT, MIPMAPCOUNT, LINEARSIZE.
+    put_u32(header + 12, (unsigned int)size);
+    put_u32(header + 16, (unsigned int)size);
+    put_u32(header + 20, (unsigned int)((size + 3) / 4) * ((size + 3) / 4) * 8);
+    put_u32(header + 28, (unsigned int)levels);
+    put_u32(header + 76, 32);
+    put_u32(header + 80, 0x4);          // FOURCC.
+    memcpy(header + 84, "DXT1", 4);
+    put_u32(header + 108, 0x401008);    // COMPLEX, TEXTURE, MIPMAP.
+
+    ok = write_file(path, header, sizeof(header), blocks, bytes);
+    free(blocks);
+    return ok;
+}
+
+int main(int argc, char* argv[]) {
+    const unsigned int count = argc > 1 ? (unsigned int)atoi(argv[1]) : DEFAULT_COUNT;
+    const int size = argc > 2 ? atoi(argv[2]) : DEFAULT_SIZE;
+    const unsigned int budget_mb = argc > 3 ? (unsigned int)atoi(argv[3]) : DEFAULT_BUDGET_MB;
+    char dir[] = "/tmp/texture_bench.XXXXXX";
+    char path[TEXTURE_PATH_MAX];
+    double start, first_usable = 0, elapsed = 0;
+    unsigned long frames = 0, released = 0, failed = 0, loaded = 0;
+    size_t max_frame_bytes = 0;
+    GLFWwindow* wnd;
+    GLenum glew_res;
+    texture_streamer_t streamer;
+    texture_stats_t stats;
+    texture_t** textures;
+    unsigned int i;
+
+    if (count == 0 || size < 1 || size > IMAGE_MAX_SIZE || budget_mb == 0) {
+        fprintf(stderr, "Usage: %s [textures] [size] [budget_mb]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (!glfwInit()) {
+        fprintf(stderr, "ERROR: Failed to initialize GLFW.\n");
+        return EXIT_FAILURE;
+    }
+    glfwSetErrorCallback(on_error);
+
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    if ((wnd = glfwCreateWindow(WINDOW_SIZE, WINDOW_SIZE, "texture_bench", NULL, NULL)) == NULL) {
+        fprintf(stderr, "ERROR: Could not create a GL 4.5 context.\n");
+        return EXIT_FAILURE;
+    }
+    glfwMakeContextCurrent(wnd);
+    glfwSwapInterval(0);
+
+    glewExperimental = GL_TRUE;
+    if ((glew_res = glewInit()) != GLEW_OK) {
+        fprintf(stderr, "ERROR: %s\n", glewGetErrorString(glew_res));
+        return EXIT_FAILURE;
+    }
+    glGetError();
+
+    if (mkdtemp(dir) == NULL) {
+        fprintf(stderr, "ERROR: Could not create a temporary directory.\n");
+        return EXIT_FAILURE;
+    }
+    for (i = 0; i < count; ++i) {
+        snprintf(path, sizeof(path), "%s/%u.%s", dir, i, i % 2 ? "dds" : "tga");
+        if (!(i % 2 ? write_dds(path, size, i) : write_tga(path, size, i)))
+            return EXIT_FAILURE;
+    }
+
+    if ((textures = (texture_t**) calloc(count, sizeof(texture_t*))) == NULL) {
+        fprintf(stderr, "ERROR: Could not allocate %u textures.\n", count);
+        return EXIT_FAILURE;
+    }
+
+    jobs_init(0);
+    if (!texture_streamer_init(&streamer, count, (size_t)budget_mb * 1024 * 1024))
+        return EXIT_FAILURE;
+
+    printf("%s, %u textures of %dx%d (TGA and BC1 DDS), %u MB per frame\n",
+           glGetString(GL_RENDERER), count, size, size, budget_mb);
+
+    start = now_sec();
+    for (i = 0; i < count; ++i) {
+        snprintf(path, sizeof(path), "%s/%u.%s", dir, i, i % 2 ? "dds" : "tga");
+        if ((textures[i] = texture_load(&streamer, path)) == NULL) return EXIT_FAILURE;
+        if (i % RELEASE_EVERY == RELEASE_EVERY - 1) {
+            texture_release(textures[i]);
+            textures[i] = NULL;
+            ++released;
+        }
+    }
+    loaded = count - released;
+
+    glClearColor(0, 0, 0, 0);
+    while (elapsed < TIMEOUT_SEC) {
+        unsigned long usable = 0, done = 0;
+
+        glClear(GL_COLOR_BUFFER_BIT);
+        texture_streamer_update(&streamer);
+        stats = texture_streamer_stats(&streamer);
+        if (stats.bytes_last_frame > max_frame_bytes) max_frame_bytes = stats.bytes_last_frame;
+
+        failed = 0;
+        for (i = 0; i < count; ++i) {
+            texture_state_t state;
+
+            if (textures[i] == NULL) continue;
+            state = texture_state(textures[i]);
+            if (state == TEXTURE_FAILED) ++failed;
+            if (state == TEXTURE_UPLOADING || state == TEXTURE_RESIDENT) ++usable;
+            if (state == TEXTURE_RESIDENT || state == TEXTURE_FAILED) ++done;
+        }
+
+        glfwSwapBuffers(wnd);
+        glfwPollEvents();
+        ++frames;
+        elapsed = now_sec() - start;
+
+        if (first_usable == 0 && usable + failed == loaded) first_usable = elapsed;
+        if (done == loaded) break;
+    }
+
+    stats = texture_streamer_stats(&streamer);
+    printf("%-24s %12lu\n", "frames", frames);
+    printf("%-24s %12lu\n", "resident", stats.textures_resident);
+    printf("%-24s %12lu\n", "released while loading", released);
+    printf("%-24s %12lu\n", "failed", failed);
+    printf("%-24s %12.1f\n", "uploaded MB", stats.bytes_total / (1024.0 * 1024.0));
+    printf("%-24s %12.2f\n", "avg MB per frame", frames > 0 ? stats.bytes_total / (1024.0 * 1024.0) / frames : 0.0);
+    printf("%-24s %12.2f\n", "max MB per frame", max_frame_bytes / (1024.0 * 1024.0));
+    printf("%-24s %12lu\n", "PBO stall frames", stats.pbo_stalls);
+    printf("%-24s %12.1f\n", "all usable ms", first_usable * 1000.0);
+    printf("%-24s %12.1f\n", "all resident ms", elapsed * 1000.0);
+
+    for (i = 0; i < count; ++i) texture_release(textures[i]);
+    texture_streamer_destroy(&streamer);
+    jobs_shutdown();
+    free(textures);
+
+    for (i = 0; i < count; ++i) {
+        snprintf(path, sizeof(path), "%s/%u.%s", dir, i, i % 2 ? "dds" : "tga");
+        remove(path);
+    }
+    rmdir(dir);
+
+    glfwDestroyWindow(wnd);
+    glfwTerminate();
+
+    if (stats.textures_resident != loaded) {
+        fprintf(stderr, "ERROR: Only %lu of %lu textures became resident.\n", stats.textures_resident, loaded);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
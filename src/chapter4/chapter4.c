@@ -1,13 +1,140 @@
 #include "math/utils.h"
+#include "math/fast.h"
+#include "math/mesh.h"
+#include "core/arena.h"
+#include "core/jobs.h"
+#include "core/channel.h"
+#include "core/archive.h"
+#include "render/pacing.h"
+#include "render/gpu_scene.h"
+#include "render/capture.h"
+#include "render/loader.h"
+#include "render/counters.h"
+#include "render/mesh_buffer.h"
+#include "render/clustered.h"
+#include "render/particles.h"
+#include "render/shader_variants.h"
+#include "render/skinning.h"
+#include "render/geometry_heap.h"
+#include "render/vertex_pull.h"
+#include "render/occlusion.h"
+#include "render/render_graph.h"
+#include "render/post.h"
+#include "render/dynamic_res.h"
+#include "render/trace_gl.h" // Last: routes GL 1.1 calls through the recorder.
+
+#include <pthread.h>
+#include <unistd.h>
 
 #define WINDOW_TITLE_PREFIX "Chapter 4 (GLFW)"
+#define FRAME_ARENA_SIZE (256 * 1024)
+#define HEAP_PAGE_VERTICES (1 << 18)    // 8 MB of vertices and
+#define HEAP_PAGE_INDICES (3 << 18)     // 3 MB of indices per geometry page.
+#define HEAP_DEFRAG_BUDGET (256 * 1024) // Bytes moved per frame.
+#define OCCLUSION_WIDTH 256             // CPU depth buffer for --occlusion.
+#define OCCLUSION_HEIGHT 128
+#define SIM_STEP (1.0 / 240.0)          // Main thread's simulation period with --render-thread.
+#define COMMAND_QUEUE_SIZE 256
+#define ASSET_ARCHIVE "chapter4.pak"    // Next to the executable.
+#define MAX_PATH_LEN 4096
 
 int g_width = 500,
     g_height = 500;
 GLFWwindow* g_hwnd = NULL; // Render Window Handle
 unsigned int frames = 0;
-GLuint proj_uloc, view_uloc, model_uloc, buffers[3] = { 0 }, shaders[3] = {0};
+GLuint proj_uloc, view_uloc, model_uloc, buffers[3] = { 0 }, shaders[1] = {0};
 mat4_t proj_mat, view_mat, model_mat;
+pacing_t g_pacing;
+pacing_config_t g_pacing_cfg;
+int g_headless = 0;             // Hidden window, for benchmarks and PGO training.
+unsigned long g_max_frames = 0; // Exit after this many frames (0 = run until closed).
+unsigned long g_frame_count = 0;
+unsigned int g_gpu_objects = 0; // > 0: draw a grid of cubes through the GPU-driven path.
+gpu_scene_t g_scene;
+const char* g_capture_path = NULL; // Record frames here when set.
+capture_format_t g_capture_format = CAPTURE_PNG;
+capture_t g_capture;
+const char* g_record_path = NULL; // Record a GL trace here when set.
+int g_fixed_step = 0;           // Animate by frame count instead of wall time.
+int g_async_load = 0;           // Build the cube on the loader thread.
+resource_loader_t g_loader;
+resource_t* g_cube_res[3] = { NULL }; // Program, vertex and index buffers while loading.
+int g_cube_ready = 0;
+const char* g_counters_path = NULL; // Per-frame work counters as JSON lines.
+FILE* g_counters_file = NULL;
+int g_use_mesh = 0;             // Draw a procedural mesh instead of the cube in the GPU-driven grid.
+mesh_shape_t g_mesh_shape = MESH_UV_SPHERE;
+unsigned long g_mesh_triangles = 20000;
+mesh_buffer_t g_mesh_buffer;
+unsigned int g_light_count = 0; // > 0: clustered forward lighting of the GPU-driven grid.
+clusters_t g_clusters;
+point_light_t* g_light_base = NULL; // Orbit centres; g_lights is this frame's positions.
+point_light_t* g_lights = NULL;
+size_t g_particle_count = 0;    // > 0: draw a CPU-simulated particle fountain over the scene.
+particles_t g_particles;
+float g_particle_time = -1;
+unsigned int g_skinned_count = 0; // > 0: draw a crowd of skinned, animated tentacles.
+int g_gpu_skinning = 0;           // Skin in the vertex shader instead of on the jobs.
+skinning_t g_skinning;
+unsigned int g_heap_mesh_count = 0; // > 0: draw that many small meshes out of a geometry heap.
+geometry_heap_t g_heap;
+geometry_handle_t* g_heap_meshes = NULL;
+int g_vertex_pulling = 0;       // Draw the heap meshes from storage buffers, without attributes.
+vertex_pull_t g_vertex_pull;
+int g_occlusion = 0;            // Put a wall in front of the heap meshes and skip those it hides.
+occlusion_buffer_t g_occlusion_buf;
+occluder_t g_wall;              // The cube, stretched.
+float (*g_heap_min)[3] = NULL;  // World-space bounds of each heap mesh.
+float (*g_heap_max)[3] = NULL;
+unsigned char* g_heap_visible = NULL;
+unsigned long g_heap_draws = 0, g_heap_culled = 0;
+int g_post = 0;                 // Render through the frame graph: scene to a texture, bloom, composite.
+int g_bloom = 1;
+render_graph_t g_graph;
+post_t g_post_fx;
+float g_dynamic_res_ms = 0;     // > 0: GPU frame budget the scene's resolution is scaled to.
+float g_sharpness = 0;          // Sharpening applied when upscaling.
+dynamic_res_t g_dynamic_res;
+int g_render_width, g_render_height; // The scene's size: the window's, unless scaled.
+shader_cache_t g_shaders;       // Cube program variants, unless loaded in the background.
+int g_cube_variants[2] = { -1, -1 }; // Plain, fogged.
+int g_fog = 0;
+const char* g_assets_path = NULL; // Asset archive, instead of the one next to the executable.
+archive_set_t g_assets;         // The shaders, unpacked at startup.
+const char* const g_asset_names[] = { "simple.vertex.glsl", "simple.fragment.glsl", "fog.glsl" };
+
+int g_render_thread = 0;        // GL on a thread of its own; the main thread handles events and simulates.
+pthread_t g_renderer;
+atomic_int g_render_done;
+
+// Everything animated, as of one simulation step.
+typedef struct frame_snapshot_ {
+    float time;                 // Animation clock.
+    mat4_t model, view;         // The spinning cube, or the camera orbiting a grid.
+} frame_snapshot_t;
+
+// Main to render thread: input that needs the context.
+typedef enum command_type_ { CMD_RESIZE, CMD_KEY, CMD_QUIT } command_type_t;
+typedef struct command_ {
+    command_type_t type;
+    int a, b;                   // Size, or key.
+} command_t;
+
+// Render to main thread: what goes in the window title.
+typedef struct frame_report_ {
+    float fps;
+    int width, height;
+    vsync_mode_t vsync;
+    double latency_avg, latency_max;
+    float render_scale;         // 0 without dynamic resolution.
+} frame_report_t;
+
+spsc_ring_t g_commands, g_reports;
+triple_buffer_t g_snapshots;
+frame_snapshot_t g_frame;       // What this frame draws.
+int g_quit = 0;                 // Render thread: a quit command arrived.
+int g_resize_pending = 0, g_resize_width, g_resize_height; // Main thread: not queued yet.
+unsigned long g_sim_steps = 0, g_frames_repeated = 0, g_events_dropped = 0;
 
 float cube_rot = 0;
 float last_time = 0;
@@ -15,49 +142,226 @@ float last_time = 0;
 void on_error(int error, const char* desc);
 void init(int, char*[]);
 void init_wnd(int, char*[]);
+void init_gl(void);
+void load_assets(void);
+char* read_asset(const char* path, void* arg);
+void parse_args(int, char*[]);
+void run_frames(void);
+void finish(void);
+void run_main_thread(void);
+void* render_main(void*);
+void simulate(frame_snapshot_t* s, float now);
+void receive_frame(void);
+void on_resize(GLFWwindow*, int, int);
 void resize(GLFWwindow*, int, int);
 void render(void);
+void draw_scene(void);
+void render_post(void);
 
+float sim_clock(void);
+float frame_time(void);
 void update_fps(float elapsed);
+void show_title(const frame_report_t* r);
 void on_idle(void);
 
 // Cube functions
 void create_cube(void);
+int  poll_cube(void);
+void finish_cube(void);
 void delete_cube(void);
+void select_cube_variant(int fog);
 void draw_cube(void);
+void create_cube_grid(void);
+void draw_cube_grid(void);
+void create_lights(float extent);
+void update_lights(float now);
+void draw_particles(void);
+void draw_skinned(void);
+mesh_desc_t heap_mesh_desc(unsigned int i, unsigned long generation);
+void create_heap_meshes(void);
+void heap_mesh_center(unsigned int i, float c[3]);
+void set_heap_bounds(unsigned int i, const mesh_desc_t* desc);
+void create_wall(void);
+void cull_heap_meshes(void);
+void draw_wall(void);
+void draw_heap_meshes(void);
 void on_keyboard(GLFWwindow*, int, int, int, int);
+void handle_key(int key);
 void cleanup(void);
 
 int main(int argc, char* argv[]) {
     init(argc, argv);
 
-    // Rendering loop.
+    if (g_render_thread) {
+        run_main_thread();
+    } else {
+        init_gl();
+        run_frames();
+        finish();
+    }
+
+    glfwDestroyWindow(g_hwnd);
+    glfwTerminate(); // GLFW must be terminated before the application exits
+    exit(EXIT_SUCCESS);
+}
+
+// The frame loop, on the thread the context is current on.
+void run_frames(void) {
     float now, prev, delta;
     now = prev = glfwGetTime();
     update_fps(0);
-    while (!glfwWindowShouldClose(g_hwnd)) {
+    trace_frame(); // End of setup.
+    while ((g_render_thread ? !g_quit : !glfwWindowShouldClose(g_hwnd))
+            && (g_max_frames == 0 || g_frame_count < g_max_frames)) {
+        pacing_begin_frame(&g_pacing); // Frame cap, queue bound and (late) input.
+        if (g_render_thread) receive_frame();
+        else simulate(&g_frame, sim_clock());
+        counters_begin_frame();
         render();
+        counters_end_frame();
+        if (g_capture_path != NULL) capture_frame(&g_capture); // Before the swap.
+        pacing_end_frame(&g_pacing);   // Swap, fence and (early) input.
+        trace_frame();
         now = glfwGetTime();
         delta = now - prev;
         ++frames;
+        ++g_frame_count;
         if ( delta > 1) {
             update_fps(delta);
             prev = now;
         }
 
-        glfwPollEvents();
+        frame_end(); // Everything allocated this frame is released here.
     }
+}
+
+void finish(void) {
     printf("Exiting...\n");
 
-    glfwDestroyWindow(g_hwnd);
-    glfwTerminate(); // GLFW must be terminated before the application exits
-    exit(EXIT_SUCCESS);
+    frame_stats_t fs = frame_stats();
+    printf("Frame arena: %zu bytes last frame, %zu bytes peak, %lu heap fallbacks over %lu frames.\n",
+           fs.last_frame_bytes, fs.peak_frame_bytes, fs.total_heap_allocs, fs.frames);
+
+    cleanup();
+}
+
+// With --render-thread the main thread only handles events and simulates,
+// publishing a snapshot every SIM_STEP; it never waits on the GPU, swaps or
+// blocks on the render thread. Input that needs GL goes over a command
+// queue, which the render thread drains at the start of each frame along
+// with the newest snapshot.
+void run_main_thread(void) {
+    frame_report_t report;
+    int quit_posted = 0;
+
+    if (!spsc_ring_init(&g_commands, COMMAND_QUEUE_SIZE, sizeof(command_t))
+            || !spsc_ring_init(&g_reports, 16, sizeof(frame_report_t))
+            || !triple_buffer_init(&g_snapshots, sizeof(frame_snapshot_t)))
+        exit(EXIT_FAILURE);
+    simulate((frame_snapshot_t*) triple_buffer_slot(&g_snapshots), (float)glfwGetTime());
+    triple_buffer_publish(&g_snapshots);
+
+    atomic_init(&g_render_done, 0);
+    glfwMakeContextCurrent(NULL); // The render thread's from now on.
+    if (pthread_create(&g_renderer, NULL, render_main, NULL) != 0) {
+        fprintf(stderr, "ERROR: Could not start the render thread.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    while (!atomic_load(&g_render_done)) {
+        glfwWaitEventsTimeout(SIM_STEP);
+
+        if (g_resize_pending) on_resize(g_hwnd, g_resize_width, g_resize_height); // Queue was full.
+        if (!quit_posted && glfwWindowShouldClose(g_hwnd)) {
+            const command_t quit = { CMD_QUIT, 0, 0 };
+            quit_posted = spsc_ring_push(&g_commands, &quit);
+        }
+        while (spsc_ring_pop(&g_reports, &report)) show_title(&report);
+
+        simulate((frame_snapshot_t*) triple_buffer_slot(&g_snapshots), (float)glfwGetTime());
+        triple_buffer_publish(&g_snapshots);
+    }
+    pthread_join(g_renderer, NULL);
+
+    printf("Render thread: %lu simulation steps, %lu frames drawn, %lu repeating a snapshot,"
+           " %lu input events dropped.\n",
+           g_sim_steps, g_frame_count, g_frames_repeated, g_events_dropped);
+    spsc_ring_destroy(&g_commands);
+    spsc_ring_destroy(&g_reports);
+    triple_buffer_destroy(&g_snapshots);
+}
+
+void* render_main(void* arg) {
+    glfwMakeContextCurrent(g_hwnd);
+    init_gl();
+    run_frames();
+    finish();
+    glfwMakeContextCurrent(NULL);
+
+    atomic_store(&g_render_done, 1);
+    glfwPostEmptyEvent(); // Wake the main thread up.
+    return NULL;
+}
+
+// Drains the main thread's commands and takes its newest snapshot.
+void receive_frame(void) {
+    command_t cmd;
+    int fresh;
+
+    while (spsc_ring_pop(&g_commands, &cmd)) {
+        switch (cmd.type) {
+            case CMD_RESIZE: resize(g_hwnd, cmd.a, cmd.b); break;
+            case CMD_KEY:    handle_key(cmd.a); break;
+            case CMD_QUIT:   g_quit = 1; break;
+        }
+    }
+    g_frame = *(const frame_snapshot_t*) triple_buffer_read(&g_snapshots, &fresh);
+    if (!fresh) ++g_frames_repeated; // Rendering faster than simulating.
+}
+
+// Everything animated is a function of the snapshot; drawing only reads it.
+void simulate(frame_snapshot_t* s, float now) {
+    if (last_time == 0.) last_time = now;
+
+    s->time = now;
+    s->model = IDENTITY4;
+    s->view = IDENTITY4;
+    if (g_gpu_objects > 0 || g_heap_mesh_count > 0) {
+        // Orbit the grid.
+        const unsigned int side = (unsigned int)ceilf(sqrtf((float)(g_gpu_objects > 0 ? g_gpu_objects
+                                                                                     : g_heap_mesh_count)));
+        cube_rot += 10.0f * ((float)(now - last_time));
+        rot_y_fast(&s->view, deg2rad_fast(cube_rot));
+        translate_fast(&s->view, 0, 0, -fminf(1.0f + 0.75f * side, 80.0f)); // Stay within the far plane.
+    } else {
+        float angle;
+
+        cube_rot += 45.0f * ((float)(now - last_time));
+        angle = deg2rad_fast(cube_rot);
+        rot_y_fast(&s->model, angle);
+        rot_x_fast(&s->model, angle);
+        translate(&s->view, 0, 0, -2);
+    }
+    last_time = now;
+    ++g_sim_steps;
 }
 
 void init(int argc, char* argv[]) {
+    if (!frame_arena_init(FRAME_ARENA_SIZE))
+        exit(EXIT_FAILURE);
+
+    parse_args(argc, argv);
     init_wnd(argc, argv);
 
+    // Callbacks run on the main thread, wherever the context is.
+    glfwGetFramebufferSize(g_hwnd, &g_width, &g_height);
+    glfwSetFramebufferSizeCallback(g_hwnd, on_resize);
+    glfwSetKeyCallback(g_hwnd, on_keyboard);
+}
+
+void init_gl(void) {
     GLenum glew_res;
+    glewExperimental = GL_TRUE; // Core profile entry points aren't all advertised.
     glew_res = glewInit();
 
     if (glew_res != GLEW_OK) {
@@ -69,6 +373,22 @@ void init(int argc, char* argv[]) {
 
 
     glGetError();
+
+    // Before the first object is created, so the trace is self-contained.
+    if (g_record_path != NULL && !trace_begin_record(g_record_path))
+        exit(EXIT_FAILURE);
+
+    // After the recorder, whose hooks the counters chain to.
+    if (g_counters_path != NULL) {
+        if ((g_counters_file = fopen(g_counters_path, "w")) == NULL) {
+            fprintf(stderr, "ERROR: Could not open %s.\n", g_counters_path);
+            exit(EXIT_FAILURE);
+        }
+        if (!counters_init())
+            exit(EXIT_FAILURE);
+        counters_set_dump(g_counters_file);
+    }
+
     glClearColor(0., 0., 0., 0.);
 
     // Setup culling
@@ -85,17 +405,186 @@ void init(int argc, char* argv[]) {
     proj_mat = IDENTITY4;
     view_mat = IDENTITY4;
 
-    translate(&view_mat, 0, 0, -2);
-
+    jobs_init(0);
+    load_assets();
+    if (g_async_load && !resource_loader_init(&g_loader, g_hwnd, 16))
+        exit(EXIT_FAILURE);
     create_cube();
+    if (g_particle_count > 0 && !particles_init(&g_particles, g_particle_count, NULL))
+        exit(EXIT_FAILURE);
+    if (g_skinned_count > 0
+            && !skinning_init(&g_skinning, g_skinned_count, 8, g_gpu_skinning ? SKINNING_GPU : SKINNING_CPU))
+        exit(EXIT_FAILURE);
+    if (g_heap_mesh_count > 0) create_heap_meshes();
+    if (g_post) {
+        if (!post_init(&g_post_fx))
+            exit(EXIT_FAILURE);
+        g_post_fx.sharpness = g_sharpness;
+        render_graph_init(&g_graph);
+        if (g_dynamic_res_ms > 0 && !dynamic_res_init(&g_dynamic_res, g_dynamic_res_ms))
+            exit(EXIT_FAILURE);
+    }
 
     // Initialize the viewport.
-    glfwSetFramebufferSizeCallback(g_hwnd, resize);
-    glfwGetFramebufferSize(g_hwnd, &g_width, &g_height);
     resize(g_hwnd, g_width, g_height); // Initial resize call.
 
-    // Configure Event callbacks
-    glfwSetKeyCallback(g_hwnd, on_keyboard);
+    pacing_init(&g_pacing, g_hwnd, &g_pacing_cfg);
+
+    // Captures keep the initial framebuffer size, so the window can't be
+    // resized while recording.
+    if (g_capture_path != NULL) {
+        if (!capture_begin(&g_capture, g_capture_format, g_capture_path, g_width, g_height,
+                           g_pacing_cfg.fps_cap > 0 ? (int)g_pacing_cfg.fps_cap : 60))
+            exit(EXIT_FAILURE);
+        glfwSetWindowAttrib(g_hwnd, GLFW_RESIZABLE, GLFW_FALSE);
+    }
+}
+
+// The shaders come from an archive found next to the executable, whatever
+// the working directory; they're unpacked once, in parallel, and the shader
+// preprocessor reads them from memory from then on.
+void load_assets(void) {
+    char path[MAX_PATH_LEN];
+    archive_t archive;
+    ssize_t len;
+    char* slash;
+
+    if (g_assets_path != NULL) {
+        snprintf(path, sizeof(path), "%s", g_assets_path);
+    } else if ((len = readlink("/proc/self/exe", path, sizeof(path) - 1)) > 0) {
+        path[len] = '\0';
+        slash = strrchr(path, '/');
+        snprintf(slash + 1, sizeof(path) - (size_t)(slash + 1 - path), "%s", ASSET_ARCHIVE);
+    } else {
+        snprintf(path, sizeof(path), "%s", ASSET_ARCHIVE);
+    }
+
+    if (!archive_open(&archive, path))
+        exit(EXIT_FAILURE);
+    if (!archive_unpack(&g_assets, &archive, g_asset_names, sizeof(g_asset_names) / sizeof(g_asset_names[0])))
+        exit(EXIT_FAILURE);
+    archive_close(&archive);
+    shader_set_reader(read_asset, &g_assets);
+
+    printf("Assets: %u from %s, %zu bytes unpacked from %zu in %u blocks, %.3f ms on %u threads.\n",
+           g_assets.count, path, g_assets.stats.bytes, g_assets.stats.packed_bytes, g_assets.stats.blocks,
+           g_assets.stats.ms, jobs_worker_count() + 1);
+}
+
+char* read_asset(const char* path, void* arg) {
+    size_t size;
+    const unsigned char* data = archive_set_find((const archive_set_t*) arg, path, &size);
+    char* copy;
+
+    if (data == NULL || (copy = (char*) malloc(size + 1)) == NULL) return NULL;
+    memcpy(copy, data, size + 1); // With its NUL.
+    return copy;
+}
+
+void parse_args(int argc, char* argv[]) {
+    int i;
+
+    g_pacing_cfg = PACING_DEFAULTS;
+
+    for (i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--vsync") == 0 && i + 1 < argc) {
+            const char* mode = argv[++i];
+            if (strcmp(mode, "off") == 0) g_pacing_cfg.vsync = VSYNC_OFF;
+            else if (strcmp(mode, "adaptive") == 0) g_pacing_cfg.vsync = VSYNC_ADAPTIVE;
+            else g_pacing_cfg.vsync = VSYNC_ON;
+        } else if (strcmp(argv[i], "--fps-cap") == 0 && i + 1 < argc) {
+            g_pacing_cfg.fps_cap = (float)atof(argv[++i]);
+        } else if (strcmp(argv[i], "--max-queued") == 0 && i + 1 < argc) {
+            g_pacing_cfg.max_queued_frames = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--late-input") == 0) {
+            g_pacing_cfg.late_input = 1;
+        } else if (strcmp(argv[i], "--headless") == 0) {
+            g_headless = 1;
+        } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            g_max_frames = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--gpu-driven") == 0 && i + 1 < argc) {
+            g_gpu_objects = (unsigned int)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--capture") == 0 && i + 2 < argc
+                && capture_parse_format(argv[i + 1], &g_capture_format)) {
+            g_capture_path = argv[i + 2];
+            i += 2;
+        } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            g_record_path = argv[++i];
+        } else if (strcmp(argv[i], "--fixed-step") == 0) {
+            g_fixed_step = 1;
+        } else if (strcmp(argv[i], "--async-load") == 0) {
+            g_async_load = 1;
+        } else if (strcmp(argv[i], "--counters") == 0 && i + 1 < argc) {
+            g_counters_path = argv[++i];
+        } else if (strcmp(argv[i], "--mesh") == 0 && i + 1 < argc
+                && mesh_parse_shape(argv[i + 1], &g_mesh_shape)) {
+            g_use_mesh = 1;
+            ++i;
+        } else if (strcmp(argv[i], "--mesh-triangles") == 0 && i + 1 < argc) {
+            g_mesh_triangles = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--lights") == 0 && i + 1 < argc) {
+            g_light_count = (unsigned int)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--particles") == 0 && i + 1 < argc) {
+            g_particle_count = (size_t)strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--skinned") == 0 && i + 1 < argc) {
+            g_skinned_count = (unsigned int)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--gpu-skinning") == 0) {
+            g_gpu_skinning = 1;
+        } else if (strcmp(argv[i], "--heap-meshes") == 0 && i + 1 < argc) {
+            g_heap_mesh_count = (unsigned int)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--vertex-pulling") == 0) {
+            g_vertex_pulling = 1;
+        } else if (strcmp(argv[i], "--occlusion") == 0) {
+            g_occlusion = 1;
+        } else if (strcmp(argv[i], "--post") == 0) {
+            g_post = 1;
+        } else if (strcmp(argv[i], "--dynamic-res") == 0 && i + 1 < argc) {
+            g_dynamic_res_ms = strtof(argv[++i], NULL);
+        } else if (strcmp(argv[i], "--sharpen") == 0 && i + 1 < argc) {
+            g_sharpness = strtof(argv[++i], NULL);
+        } else if (strcmp(argv[i], "--render-thread") == 0) {
+            g_render_thread = 1;
+        } else if (strcmp(argv[i], "--assets") == 0 && i + 1 < argc) {
+            g_assets_path = argv[++i];
+        } else {
+            fprintf(stderr, "Usage: %s [--vsync off|on|adaptive] [--fps-cap N] [--max-queued N] [--late-input]"
+                            " [--headless] [--frames N] [--gpu-driven N] [--capture png|y4m|raw PATH]"
+                            " [--record PATH] [--fixed-step] [--async-load] [--counters PATH]"
+                            " [--mesh sphere|ico|torus|cylinder|grid] [--mesh-triangles N] [--lights N]"
+                            " [--particles N] [--skinned N] [--gpu-skinning] [--heap-meshes N]"
+                            " [--vertex-pulling] [--occlusion] [--post] [--dynamic-res MS] [--sharpen S] [--render-thread]"
+                            " [--assets PATH]\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // The recorder isn't thread-safe, and the loader calls GL on its own thread.
+    if (g_record_path != NULL && g_async_load) {
+        fprintf(stderr, "ERROR: --record and --async-load cannot be combined.\n");
+        exit(EXIT_FAILURE);
+    }
+    // Scaling and sharpening are passes of the frame graph.
+    if (g_dynamic_res_ms > 0 || g_sharpness > 0) g_post = 1;
+    // Nor does the recorder see the render targets the graph renders into.
+    if (g_record_path != NULL && g_post) {
+        fprintf(stderr, "ERROR: --record and --post cannot be combined.\n");
+        exit(EXIT_FAILURE);
+    }
+    // The loader's context is a hidden window, which only the main thread can
+    // create; and fixed steps tie the animation to the frames drawn, while the
+    // render thread draws whichever step is newest.
+    if (g_render_thread && (g_async_load || g_fixed_step)) {
+        fprintf(stderr, "ERROR: --render-thread cannot be combined with --async-load or --fixed-step.\n");
+        exit(EXIT_FAILURE);
+    }
+    g_pacing_cfg.external_events = g_render_thread;
+
+    // Meshes are drawn through the GPU-driven path; one is enough to look at.
+    if (g_use_mesh && g_gpu_objects == 0) g_gpu_objects = 1;
+    // Lights need something to fall on.
+    if (g_light_count > 0 && g_gpu_objects == 0) g_gpu_objects = 400;
+    // Vertex pulling and occlusion culling work on the heap meshes.
+    if ((g_vertex_pulling || g_occlusion) && g_heap_mesh_count == 0) g_heap_mesh_count = 1000;
 }
 
 void init_wnd(int argc, char* argv[]) {
@@ -110,6 +599,13 @@ void init_wnd(int argc, char* argv[]) {
 
     // Create the rendering viewport.
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4); // Require OpenGL > 4
+    if (g_gpu_objects > 0 || g_skinned_count > 0 || g_vertex_pulling) {
+        // Compute culling, multi-draw-indirect and storage buffers in vertex
+        // shaders need 4.3; ask for 4.5 core, which Mesa's llvmpipe provides.
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    }
+    if (g_headless) glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
     g_hwnd = glfwCreateWindow(g_width, g_height, WINDOW_TITLE_PREFIX, NULL, NULL);
 
     if (!g_hwnd) {
@@ -120,90 +616,374 @@ void init_wnd(int argc, char* argv[]) {
     glfwMakeContextCurrent(g_hwnd);
 }
 
+// Framebuffer size callback. With a render thread the size is queued for
+// it; if the queue is full it's retried, with whatever the size is by then.
+void on_resize(GLFWwindow* wnd, int w, int h) {
+    if (g_render_thread) {
+        const command_t cmd = { CMD_RESIZE, w, h };
+        g_resize_width = w;
+        g_resize_height = h;
+        g_resize_pending = !spsc_ring_push(&g_commands, &cmd);
+    } else {
+        resize(wnd, w, h);
+    }
+}
+
 void resize(GLFWwindow* wnd, int w, int h) {
     g_width = w;
     g_height = h;
+    g_render_width = w;
+    g_render_height = h;
 
     // x, y, w, h - bottom-left anchor point of the viewport.
     glViewport(0, 0, g_width, g_height);
 
     proj_mat = proj(60, (float)g_width / g_height, 1.0f, 100.0f);
+    if (g_clusters.capacity > 0) clusters_set_projection(&g_clusters, &proj_mat, g_width, g_height);
 
+    if (shaders[0] == 0) return; // Still loading, finish_cube() sets it.
     glUseProgram(shaders[0]);
     glUniformMatrix4fv(proj_uloc, 1, GL_FALSE, proj_mat.m);
     glUseProgram(0);
 }
 
 void render(void) {
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); // clear the frame
-    draw_cube();
-    glfwSwapBuffers(g_hwnd);
+    if (g_async_load) resource_loader_update(&g_loader);
+    if (!g_cube_ready && !poll_cube()) {
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        return; // Keep presenting while the cube loads.
+    }
 
+    model_mat = g_frame.model;
+    view_mat = g_frame.view;
+    if (g_post) {
+        render_post();
+    } else {
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); // clear the frame
+        draw_scene();
+    }
+}
+
+void draw_scene(void) {
+    if (g_gpu_objects > 0) draw_cube_grid();
+    else if (g_heap_mesh_count > 0) draw_heap_meshes();
+    else draw_cube();
+    if (g_skinned_count > 0) draw_skinned();
+    if (g_particle_count > 0) draw_particles();
+}
+
+static void scene_pass(const render_graph_t* g, void* arg) {
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    glViewport(0, 0, g_render_width, g_render_height); // The bottom-left corner, when scaled.
+    draw_scene();
+}
+
+// Sizes the scene for this frame's scale. Its targets stay the window's size,
+// so a new scale costs a viewport and the clusters' tiles, not reallocation.
+static void scale_scene(void) {
+    dynamic_res_begin_frame(&g_dynamic_res, g_width, g_height);
+    if (g_dynamic_res.width == g_render_width && g_dynamic_res.height == g_render_height) return;
+    g_render_width = g_dynamic_res.width;
+    g_render_height = g_dynamic_res.height;
+    if (g_clusters.capacity > 0) clusters_set_projection(&g_clusters, &proj_mat, g_render_width, g_render_height);
+}
+
+// The graph is declared from scratch every frame; with bloom off nothing
+// reads its passes, and compiling culls them.
+void render_post(void) {
+    graph_texture_desc_t color = { g_width, g_height, GL_RGBA16F };
+    graph_texture_desc_t depth = { g_width, g_height, GL_DEPTH_COMPONENT24 };
+    graph_resource_t scene, bloom;
+    unsigned int pass;
+
+    if (g_width <= 0 || g_height <= 0) return; // Minimized.
+    if (g_dynamic_res_ms > 0) scale_scene();
+    render_graph_begin(&g_graph, g_width, g_height);
+    scene = render_graph_create(&g_graph, "scene", &color);
+    pass = render_graph_add_pass(&g_graph, "scene", scene_pass, NULL);
+    render_graph_write(&g_graph, pass, scene);
+    render_graph_write(&g_graph, pass, render_graph_create(&g_graph, "scene depth", &depth));
+    if (g_dynamic_res_ms > 0 || g_post_fx.sharpness > 0)
+        scene = post_add_upscale(&g_post_fx, &g_graph, scene, g_render_width, g_render_height, g_width, g_height);
+
+    bloom = post_add_bloom(&g_post_fx, &g_graph, scene, g_width, g_height);
+    post_add_composite(&g_post_fx, &g_graph, scene, g_bloom ? bloom : 0, render_graph_backbuffer(&g_graph));
+
+    if (!render_graph_compile(&g_graph))
+        exit(EXIT_FAILURE);
+    render_graph_execute(&g_graph);
+    if (g_dynamic_res_ms > 0) dynamic_res_end_frame(&g_dynamic_res);
+    exit_on_glError("ERROR: Could not render the frame graph.");
 }
 
 void update_fps(float elapsed) {
-    char* title = (char*) malloc(512 + strlen(WINDOW_TITLE_PREFIX));
-    sprintf(title, "%s (%.2f fps @ %d x %d)",
+    const latency_stats_t lat = pacing_latency(&g_pacing);
+    frame_report_t report;
+
+    report.fps = elapsed > 0. ? (float)frames / elapsed : 0.;
+    report.width = g_width;
+    report.height = g_height;
+    report.vsync = g_pacing.vsync_applied;
+    report.latency_avg = lat.avg;
+    report.latency_max = lat.max;
+    report.render_scale = g_dynamic_res_ms > 0 ? g_dynamic_res.scale : 0.f;
+    pacing_reset_latency(&g_pacing);
+    frames = 0; // reset frame counter.
+
+    // Window titles are the main thread's business; a full queue skips one.
+    if (g_render_thread) spsc_ring_push(&g_reports, &report);
+    else show_title(&report);
+}
+
+void show_title(const frame_report_t* r) {
+    char title[512 + sizeof(WINDOW_TITLE_PREFIX)];
+    char scale[32] = "";
+    if (r->render_scale > 0) snprintf(scale, sizeof(scale), " (%.0f%% scale)", r->render_scale * 100.);
+    snprintf(title, sizeof(title), "%s (%.2f fps @ %d x %d%s, vsync %s, latency %.1f ms avg / %.1f ms max)",
             WINDOW_TITLE_PREFIX,
-            elapsed > 0. ? (float)frames / elapsed : 0.,
-            g_width,
-            g_height
+            r->fps,
+            r->width,
+            r->height,
+            scale,
+            vsync_mode_name(r->vsync),
+            r->latency_avg * 1000.,
+            r->latency_max * 1000.
     );
-
     glfwSetWindowTitle(g_hwnd, title);
-    free(title);
-    frames = 0; // reset frame counter.
+}
+
+// Simulation clock: wall time, or 60 Hz steps with --fixed-step so that runs
+// (and their traces) are identical whatever the frame rate.
+float sim_clock(void) {
+    return g_fixed_step ? (float)g_frame_count / 60.0f : (float)glfwGetTime();
+}
+
+// Animation clock of the frame being drawn.
+float frame_time(void) {
+    return g_frame.time;
 }
 
 void cleanup(void) {
+    if (g_counters_path != NULL) {
+        counters_stats_t st = counters_stats();
+        const double n = st.frames > 0 ? (double)st.frames : 1.;
+        printf("Counters per frame: %.1f draws, %.0f triangles, %.1f/%.1f program switches/binds,"
+               " %.1f/%.1f VAO switches/binds, %.1f uniform updates, %.0f bytes uploaded.\n",
+               st.cpu_total.draw_calls / n, st.cpu_total.triangles / n,
+               st.cpu_total.program_switches / n, st.cpu_total.program_binds / n,
+               st.cpu_total.vao_switches / n, st.cpu_total.vao_binds / n,
+               st.cpu_total.uniform_updates / n, st.cpu_total.buffer_bytes / n);
+        counters_shutdown(); // Before the recorder's hooks go.
+        fclose(g_counters_file);
+    }
+    if (g_capture_path != NULL) {
+        capture_stats_t cs;
+        capture_end(&g_capture);
+        cs = g_capture.stats; // Encoder has stopped, no need to lock.
+        printf("Capture: %lu frames encoded, %lu dropped, %lu skipped waiting for the GPU.\n",
+               cs.frames_encoded, cs.frames_dropped, cs.frames_skipped);
+    }
+    pacing_destroy(&g_pacing);
+    if (g_gpu_objects > 0) gpu_scene_destroy(&g_scene);
+    if (g_use_mesh) mesh_buffer_destroy(&g_mesh_buffer);
+    if (g_light_count > 0) {
+        const clusters_stats_t cs = g_clusters.stats;
+        printf("Clusters: %u lights, %u visible, %.1f lights per cluster (%u max), %lu overflows,"
+               " %.3f ms per frame assigning.\n",
+               cs.lights, cs.visible_lights, (double)cs.indices / CLUSTER_COUNT, cs.max_per_cluster,
+               cs.overflows, cs.frames > 0 ? cs.assign_ms / cs.frames : 0.);
+        clusters_destroy(&g_clusters);
+        free(g_light_base);
+        free(g_lights);
+    }
+    if (g_particle_count > 0) {
+        const particles_stats_t ps = g_particles.stats;
+        printf("Particles: %zu, %.0f particles/ms simulated, %.3f ms per frame, %lu respawns,"
+               " %lu buffer waits.\n",
+               g_particles.count, particles_per_ms(&g_particles),
+               ps.frames > 0 ? ps.simulate_ms / ps.frames : 0., ps.respawns, ps.buffer_waits);
+        particles_destroy(&g_particles);
+    }
+    if (g_skinned_count > 0) {
+        const skinning_stats_t ks = g_skinning.stats;
+        const double frames = ks.frames > 0 ? (double)ks.frames : 1.;
+        printf("Skinning (%s): %u characters x %u vertices, %.3f ms per frame posing, %.3f ms skinning,"
+               " %.2f MB uploaded per frame.\n",
+               g_skinning.mode == SKINNING_GPU ? "GPU" : "CPU", g_skinning.count, g_skinning.vertex_count,
+               ks.palette_ms / frames, ks.skin_ms / frames, ks.upload_bytes / (1024. * 1024.));
+        skinning_destroy(&g_skinning);
+    }
+    if (g_heap_mesh_count > 0) {
+        const geometry_heap_stats_t hs = geometry_heap_stats(&g_heap);
+        printf("Geometry heap: %u meshes in %u pages, %.1f of %.1f MB used, fragmentation %.2f (vertices)"
+               " / %.2f (indices), %lu meshes moved (%.1f MB) defragmenting.\n",
+               hs.meshes, hs.pages, hs.used_bytes / (1024. * 1024.), hs.capacity_bytes / (1024. * 1024.),
+               hs.vertex_fragmentation, hs.index_fragmentation, hs.defrag_moves, hs.defrag_bytes / (1024. * 1024.));
+        geometry_heap_destroy(&g_heap);
+        free(g_heap_meshes);
+        if (g_occlusion) {
+            printf("Occlusion: %lu of %lu heap mesh draws culled, off screen or behind the wall (%.1f%%).\n",
+                   g_heap_culled, g_heap_draws, g_heap_draws > 0 ? 100. * g_heap_culled / g_heap_draws : 0.);
+            occlusion_destroy(&g_occlusion_buf);
+            free(g_heap_min);
+            free(g_heap_max);
+            free(g_heap_visible);
+        }
+        if (g_vertex_pulling) vertex_pull_destroy(&g_vertex_pull);
+    }
+    jobs_shutdown();
+    if (g_post) {
+        const render_graph_stats_t gs = g_graph.stats;
+        printf("Render graph: %u passes, %u culled, %u transient textures in %u (%.1f of %.1f MB, %.1f MB peak).\n",
+               gs.passes, gs.culled, gs.resources, gs.textures, gs.texture_bytes / (1024. * 1024.),
+               gs.transient_bytes / (1024. * 1024.), gs.peak_texture_bytes / (1024. * 1024.));
+        render_graph_destroy(&g_graph);
+        post_destroy(&g_post_fx);
+    }
+    if (g_dynamic_res_ms > 0) {
+        const dynamic_res_stats_t ds = g_dynamic_res.stats;
+        printf("Dynamic resolution: %.1f ms budget, scale %.2f avg (%.2f - %.2f), %lu size changes,"
+               " %lu of %lu measured frames over budget.\n",
+               g_dynamic_res.budget_ms, ds.frames > 0 ? ds.scale_sum / ds.frames : 1., ds.min_scale, ds.max_scale,
+               ds.changes, ds.over_budget, ds.measured);
+        dynamic_res_destroy(&g_dynamic_res);
+    }
+    if (!g_async_load) {
+        const shader_cache_stats_t ss = g_shaders.stats;
+        printf("Shaders: %u of %u variants built, %u compiled (%u shared), %u linked (%u shared), %.1f ms.\n",
+               ss.variants_built, ss.variants, ss.shaders_compiled, ss.shaders_shared,
+               ss.programs_linked, ss.programs_shared, ss.build_ms);
+    }
     delete_cube();
+    if (g_async_load) {
+        loader_stats_t ls = resource_loader_stats(&g_loader);
+        int i;
+        for (i = 0; i < 3; ++i) resource_release(&g_loader, g_cube_res[i]);
+        resource_loader_destroy(&g_loader);
+        printf("Loader: %lu buffers (%zu bytes), %lu programs, %lu unsignalled fence polls.\n",
+               ls.buffers_loaded, ls.bytes_uploaded, ls.programs_loaded, ls.fence_polls);
+    }
+    if (g_record_path != NULL) {
+        trace_stats_t ts = trace_end_record();
+        printf("Trace: %lu frames, %lu calls, %zu bytes written to %s.\n",
+               ts.frames > 0 ? ts.frames - 1 : 0, ts.records, ts.bytes, g_record_path);
+    }
+    archive_set_free(&g_assets);
+    scratch_arena_release();
+    frame_arena_destroy();
 }
 
 void on_keyboard(GLFWwindow* wnd, int key, int scan, int action, int mods) {
-    if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
+    if (action != GLFW_PRESS) return;
+
+    if (key == GLFW_KEY_ESCAPE) {
         glfwSetWindowShouldClose(g_hwnd, GLFW_TRUE);
+    } else if (g_render_thread) {
+        const command_t cmd = { CMD_KEY, key, 0 };
+        if (!spsc_ring_push(&g_commands, &cmd)) ++g_events_dropped;
+    } else {
+        handle_key(key);
+    }
+}
+
+// Keys whose handling needs the context.
+void handle_key(int key) {
+    // Cycle through vsync modes.
+    if (key == GLFW_KEY_V)
+        pacing_set_vsync(&g_pacing, (vsync_mode_t)((g_pacing.cfg.vsync + 1) % 3));
+
+    // Toggle the fogged cube shader, built the first time it's asked for.
+    if (key == GLFW_KEY_F && !g_async_load)
+        select_cube_variant(!g_fog);
+
+    // Toggle bloom; the graph culls its passes while it's off.
+    if (key == GLFW_KEY_B)
+        g_bloom = !g_bloom;
 }
 
 // Cube Functions
+static const vertex_t CUBE_VERTICES[8] = {
+    { { -.5f, -.5f,  .5f, 1 }, { 0, 0, 1, 1 } },
+    { { -.5f,  .5f,  .5f, 1 }, { 1, 0, 0, 1 } },
+    { {  .5f,  .5f,  .5f, 1 }, { 0, 1, 0, 1 } },
+    { {  .5f, -.5f,  .5f, 1 }, { 1, 1, 0, 1 } },
+    { { -.5f, -.5f, -.5f, 1 }, { 1, 1, 1, 1 } },
+    { { -.5f,  .5f, -.5f, 1 }, { 1, 0, 0, 1 } },
+    { {  .5f,  .5f, -.5f, 1 }, { 1, 0, 1, 1 } },
+    { {  .5f, -.5f, -.5f, 1 }, { 0, 0, 1, 1 } }
+};
+
+static const GLuint CUBE_INDICES[36] = {
+    0,2,1,  0,3,2,
+    4,3,0,  4,7,3,
+    4,1,5,  4,0,1,
+    3,6,2,  3,7,6,
+    1,6,5,  1,2,6,
+    7,5,6,  7,4,5
+};
+
 void create_cube(void) {
-    const vertex_t vertices[8] = {
-        { { -.5f, -.5f,  .5f, 1 }, { 0, 0, 1, 1 } },
-        { { -.5f,  .5f,  .5f, 1 }, { 1, 0, 0, 1 } },
-        { {  .5f,  .5f,  .5f, 1 }, { 0, 1, 0, 1 } },
-        { {  .5f, -.5f,  .5f, 1 }, { 1, 1, 0, 1 } },
-        { { -.5f, -.5f, -.5f, 1 }, { 1, 1, 1, 1 } },
-        { { -.5f,  .5f, -.5f, 1 }, { 1, 0, 0, 1 } },
-        { {  .5f,  .5f, -.5f, 1 }, { 1, 0, 1, 1 } },
-        { {  .5f, -.5f, -.5f, 1 }, { 0, 0, 1, 1 } }
-    };
-
-    const GLuint indices[36] = {
-        0,2,1,  0,3,2,
-        4,3,0,  4,7,3,
-        4,1,5,  4,0,1,
-        3,6,2,  3,7,6,
-        1,6,5,  1,2,6,
-        7,5,6,  7,4,5
-    };
-
-    shaders[0] = glCreateProgram();
-    exit_on_glError("ERROR: Could not create shader.");
-
-    shaders[1] = load_shader("simple.fragment.glsl", GL_FRAGMENT_SHADER);
-    shaders[2] = load_shader("simple.vertex.glsl", GL_VERTEX_SHADER);
-    glAttachShader(shaders[0], shaders[1]);
-    glAttachShader(shaders[0], shaders[2]);
-    glLinkProgram(shaders[0]);
-    exit_on_glError("ERROR: Could not link shader.");
+    if (g_async_load) {
+        // Built on the loader thread; poll_cube() picks them up.
+        g_cube_res[0] = resource_program(&g_loader, "simple.vertex.glsl", "simple.fragment.glsl");
+        g_cube_res[1] = resource_buffer(&g_loader, sizeof(CUBE_VERTICES), CUBE_VERTICES, GL_STATIC_DRAW);
+        g_cube_res[2] = resource_buffer(&g_loader, sizeof(CUBE_INDICES), CUBE_INDICES, GL_STATIC_DRAW);
+        return;
+    }
 
+    // Only the plain variant is built now; the fogged one on first use.
+    shader_cache_init(&g_shaders);
+    g_cube_variants[0] = shader_cache_variant(&g_shaders, "simple.vertex.glsl", "simple.fragment.glsl", NULL);
+    g_cube_variants[1] = shader_cache_variant(&g_shaders, "simple.vertex.glsl", "simple.fragment.glsl", "FOG");
+    if ((shaders[0] = shader_cache_program(&g_shaders, g_cube_variants[g_fog])) == 0)
+        exit(EXIT_FAILURE);
+
+    glGenBuffers(2, &buffers[1]);
+    exit_on_glError("ERROR: Could not generate buffer objects.");
+
+    // Filled through the copy target: the index buffer is attached to the
+    // VAO in finish_cube().
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffers[1]);
+    glBufferData(GL_COPY_WRITE_BUFFER, sizeof(CUBE_VERTICES), CUBE_VERTICES, GL_STATIC_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffers[2]);
+    glBufferData(GL_COPY_WRITE_BUFFER, sizeof(CUBE_INDICES), CUBE_INDICES, GL_STATIC_DRAW);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    exit_on_glError("ERROR: Could not fill buffer objects.");
+
+    finish_cube();
+}
+
+// Returns 1 once the cube's resources have loaded and finish_cube() has run.
+int poll_cube(void) {
+    int i;
+
+    for (i = 0; i < 3; ++i) {
+        resource_state_t state = resource_state(g_cube_res[i]);
+        if (state == RESOURCE_FAILED) {
+            fprintf(stderr, "ERROR: Could not load the cube.\n");
+            exit(EXIT_FAILURE);
+        }
+        if (state != RESOURCE_READY) return 0;
+    }
+
+    shaders[0] = resource_take(&g_loader, g_cube_res[0]);
+    buffers[1] = resource_take(&g_loader, g_cube_res[1]);
+    buffers[2] = resource_take(&g_loader, g_cube_res[2]);
+    g_cube_res[0] = g_cube_res[1] = g_cube_res[2] = NULL;
+    printf("Cube loaded in the background after %lu frames.\n", g_frame_count);
+
+    finish_cube();
+    return 1;
+}
+
+// Render-thread half of the cube setup: vertex array objects aren't shared
+// between contexts, so this runs once the program and buffers exist.
+void finish_cube(void) {
     model_uloc = glGetUniformLocation(shaders[0], "ModelMatrix");
     view_uloc = glGetUniformLocation(shaders[0], "ViewMatrix");
     proj_uloc = glGetUniformLocation(shaders[0], "ProjectionMatrix");
     exit_on_glError("ERROR: Could not get shader uniform locations.");
 
-    glGenBuffers(2, &buffers[1]);
-    exit_on_glError("ERROR: Could not generate buffer objects.");
-
     glGenVertexArrays(1, &buffers[0]);
     exit_on_glError("ERROR: Could not generate VAO.");
     glBindVertexArray(buffers[0]);
@@ -214,27 +994,31 @@ void create_cube(void) {
     exit_on_glError("ERROR: Could not enable vertex attributes.");
 
     glBindBuffer(GL_ARRAY_BUFFER, buffers[1]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
     exit_on_glError("ERROR: Could not bind buffer to VAO.");
 
-    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(vertices[0]), (GLvoid*)0); // positions
-    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(vertices[0]), (GLvoid*)sizeof(vertices[0].pos)); // colors
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(CUBE_VERTICES[0]), (GLvoid*)0); // positions
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(CUBE_VERTICES[0]), (GLvoid*)sizeof(CUBE_VERTICES[0].pos)); // colors
     exit_on_glError("ERROR: Could not set VAO attributes.");
 
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[2]);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
     exit_on_glError("ERROR: Could not bind index buffer to VAO.");
 
     glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    // The projection may have been set up before the program existed.
+    glUseProgram(shaders[0]);
+    glUniformMatrix4fv(proj_uloc, 1, GL_FALSE, proj_mat.m);
+    glUseProgram(0);
+
+    if (g_gpu_objects > 0) create_cube_grid();
+    g_cube_ready = 1;
 }
 
 void delete_cube(void) {
-    glDetachShader(shaders[0], shaders[1]);
-    glDetachShader(shaders[0], shaders[2]);
-
-    glDeleteShader(shaders[1]);
-    glDeleteShader(shaders[2]);
-    glDeleteProgram(shaders[0]);
+    // The cache owns the programs it built; the loader's is ours.
+    if (g_async_load) glDeleteProgram(shaders[0]);
+    else shader_cache_destroy(&g_shaders);
 
     exit_on_glError("ERROR: Could not destroy shaders.");
 
@@ -243,20 +1027,24 @@ void delete_cube(void) {
     exit_on_glError("ERROR: Could not destroy buffers.");
 }
 
-void draw_cube(void) {
-    float angle;
-    float now = glfwGetTime();
+void select_cube_variant(int fog) {
+    const GLuint prog = shader_cache_program(&g_shaders, g_cube_variants[fog]);
 
-    if (last_time == 0.) last_time = now;
-
-    cube_rot += 45.0f * ((float)(now - last_time));
-    angle = deg2rad(cube_rot);
-    last_time = now;
+    if (prog == 0) return; // Keep drawing with the current one.
+    g_fog = fog;
+    shaders[0] = prog;
+    model_uloc = glGetUniformLocation(shaders[0], "ModelMatrix");
+    view_uloc = glGetUniformLocation(shaders[0], "ViewMatrix");
+    proj_uloc = glGetUniformLocation(shaders[0], "ProjectionMatrix");
 
-    model_mat = IDENTITY4;
-    rot_y(&model_mat, angle);
-    rot_x(&model_mat, angle);
+    // The projection is only set on resize.
+    glUseProgram(shaders[0]);
+    glUniformMatrix4fv(proj_uloc, 1, GL_FALSE, proj_mat.m);
+    glUseProgram(0);
+    exit_on_glError("ERROR: Could not switch the cube's shader.");
+}
 
+void draw_cube(void) {
     glUseProgram(shaders[0]);
     exit_on_glError("ERROR: Could not use shader program.");
 
@@ -274,6 +1062,286 @@ void draw_cube(void) {
     glUseProgram(0);
 }
 
+// A square grid of cubes (or of a procedural mesh with --mesh), culled and
+// drawn on the GPU. The transforms are static; the camera orbits instead, so
+// the CPU does the same work per frame whatever the number of cubes.
+void create_cube_grid(void) {
+    gpu_mesh_t mesh = { 36, 0, 0, 0 };
+    GLuint vbo = buffers[1], ibo = buffers[2];
+    float radius = 0.87f; // Half the cube's diagonal.
+    const unsigned int side = (unsigned int)ceilf(sqrtf((float)g_gpu_objects));
+    gpu_object_t* objects;
+    unsigned int i;
+
+    if (g_use_mesh) {
+        const mesh_desc_t desc = mesh_for_triangles(g_mesh_shape, g_mesh_triangles);
+
+        if (!mesh_buffer_create(&g_mesh_buffer, &desc, 1, &mesh))
+            exit(EXIT_FAILURE);
+        vbo = g_mesh_buffer.vbo;
+        ibo = g_mesh_buffer.ibo;
+        radius = mesh_bounding_radius(&desc);
+        printf("Mesh: %zu vertices, %zu triangles generated in %.2f ms on %u threads.\n",
+               g_mesh_buffer.vertex_count, g_mesh_buffer.index_count / 3,
+               g_mesh_buffer.generate_ms, jobs_worker_count() + 1);
+    }
+
+    if ((objects = (gpu_object_t*) malloc(sizeof(gpu_object_t) * g_gpu_objects)) == NULL) {
+        fprintf(stderr, "ERROR: Could not allocate %u objects.\n", g_gpu_objects);
+        exit(EXIT_FAILURE);
+    }
+
+    for (i = 0; i < g_gpu_objects; ++i) {
+        gpu_object_t* o = &objects[i];
+        memset(o, 0, sizeof(*o));
+        o->model = IDENTITY4;
+        translate_fast(&o->model,
+                       1.5f * ((float)(i % side) - 0.5f * (side - 1)),
+                       1.5f * ((float)(i / side) - 0.5f * (side - 1)),
+                       0);
+        o->bounds[3] = radius;
+    }
+
+    if (g_light_count > 0) {
+        if (!clusters_init(&g_clusters, g_light_count))
+            exit(EXIT_FAILURE);
+        if (proj_mat.m[11] != 0) // Otherwise the first resize() sets it.
+            clusters_set_projection(&g_clusters, &proj_mat, g_width, g_height);
+        create_lights(0.75f * side);
+    }
+
+    if (!(g_light_count > 0
+            ? gpu_scene_init_shaded(&g_scene, g_gpu_objects, vbo, ibo, &mesh, 1, CLUSTERED_FRAGMENT_SHADER)
+            : gpu_scene_init(&g_scene, g_gpu_objects, vbo, ibo, &mesh, 1))) {
+        fprintf(stderr, "ERROR: GPU-driven rendering is not available.\n");
+        exit(EXIT_FAILURE);
+    }
+    gpu_scene_set_objects(&g_scene, objects, 0, g_gpu_objects);
+    free(objects);
+
+    printf("GPU-driven: %u %s, %s.\n", g_gpu_objects, g_use_mesh ? "meshes" : "cubes",
+           g_scene.use_draw_count ? "compacted with draw count" : "culled by zero instance count");
+}
+
+void draw_cube_grid(void) {
+    if (g_light_count > 0) update_lights(frame_time());
+    gpu_scene_draw(&g_scene, &view_mat, &proj_mat);
+}
+
+// Lights scattered over the grid's square, each circling its own centre
+// just in front of the cubes.
+void create_lights(float extent) {
+    unsigned int i;
+
+    g_light_base = (point_light_t*) malloc(sizeof(point_light_t) * g_light_count);
+    g_lights = (point_light_t*) malloc(sizeof(point_light_t) * g_light_count);
+    if (g_light_base == NULL || g_lights == NULL) {
+        fprintf(stderr, "ERROR: Could not allocate %u lights.\n", g_light_count);
+        exit(EXIT_FAILURE);
+    }
+
+    srand(1); // Same lights on every run.
+    for (i = 0; i < g_light_count; ++i) {
+        point_light_t* l = &g_light_base[i];
+        l->position[0] = extent * (2.0f * rand() / RAND_MAX - 1.0f);
+        l->position[1] = extent * (2.0f * rand() / RAND_MAX - 1.0f);
+        l->position[2] = 0.5f + 1.5f * rand() / RAND_MAX;
+        l->radius = 1.0f + 1.5f * rand() / RAND_MAX;
+        l->color[0] = 0.2f + 0.8f * rand() / RAND_MAX;
+        l->color[1] = 0.2f + 0.8f * rand() / RAND_MAX;
+        l->color[2] = 0.2f + 0.8f * rand() / RAND_MAX;
+        l->color[3] = 1.0f;
+    }
+}
+
+void update_lights(float now) {
+    unsigned int i;
+
+    for (i = 0; i < g_light_count; ++i) {
+        const float phase = now + (float)i;
+        g_lights[i] = g_light_base[i];
+        g_lights[i].position[0] += 0.5f * cosf(phase);
+        g_lights[i].position[1] += 0.5f * sinf(phase);
+    }
+    clusters_update(&g_clusters, g_lights, g_light_count, &view_mat);
+}
+
+void draw_particles(void) {
+    const float now = frame_time();
+    // Clamped, so a stall doesn't fling everything through the floor.
+    const float dt = g_particle_time < 0 ? 0.f : fminf(now - g_particle_time, 0.1f);
+
+    g_particle_time = now;
+    particles_update(&g_particles, dt);
+    particles_draw(&g_particles, &view_mat, &proj_mat, g_render_height);
+}
+
+void draw_skinned(void) {
+    skinning_update(&g_skinning, frame_time());
+    skinning_draw(&g_skinning, &view_mat, &proj_mat);
+}
+
+// Every shape, from 64 to 1024 triangles; each generation of a mesh gets
+// another shape and size.
+mesh_desc_t heap_mesh_desc(unsigned int i, unsigned long generation) {
+    const mesh_shape_t shape = (mesh_shape_t)((i + generation) % MESH_SHAPE_COUNT);
+    return mesh_for_triangles(shape, (size_t)64 << ((i * 7 + generation * 3) % 5));
+}
+
+// A grid of small meshes sharing a few large buffers instead of a VBO and
+// IBO each.
+void create_heap_meshes(void) {
+    geometry_heap_stats_t hs;
+    unsigned int i;
+
+    if (!geometry_heap_init(&g_heap, HEAP_PAGE_VERTICES, HEAP_PAGE_INDICES))
+        exit(EXIT_FAILURE);
+    if ((g_heap_meshes = (geometry_handle_t*) malloc(sizeof(geometry_handle_t) * g_heap_mesh_count)) == NULL) {
+        fprintf(stderr, "ERROR: Could not allocate %u meshes.\n", g_heap_mesh_count);
+        exit(EXIT_FAILURE);
+    }
+    if (g_occlusion) create_wall();
+    for (i = 0; i < g_heap_mesh_count; ++i) {
+        const mesh_desc_t desc = heap_mesh_desc(i, 0);
+        if ((g_heap_meshes[i] = geometry_heap_add(&g_heap, &desc, NULL)) == 0)
+            exit(EXIT_FAILURE);
+        if (g_occlusion) set_heap_bounds(i, &desc);
+    }
+    exit_on_glError("ERROR: Could not upload the heap meshes.");
+    if (g_vertex_pulling && !vertex_pull_init(&g_vertex_pull, NULL))
+        exit(EXIT_FAILURE);
+
+    hs = geometry_heap_stats(&g_heap);
+    printf("Geometry heap: %u meshes in %u pages, %.1f MB.\n",
+           hs.meshes, hs.pages, hs.used_bytes / (1024. * 1024.));
+}
+
+// One mesh is regenerated every frame, at another size, leaving holes that
+// the defragmenter closes a little at a time. Meshes are drawn a page at a
+// time, so there is one VAO bind per page, or with vertex pulling one pair of
+// storage buffer binds per page and a single empty VAO.
+void draw_heap_meshes(void) {
+    const unsigned int replaced = (unsigned int)(g_frame_count % g_heap_mesh_count);
+    const mesh_desc_t desc = heap_mesh_desc(replaced, g_frame_count / g_heap_mesh_count + 1);
+    unsigned int page, i;
+
+    geometry_heap_free(&g_heap, g_heap_meshes[replaced]);
+    if ((g_heap_meshes[replaced] = geometry_heap_add(&g_heap, &desc, frame_arena())) == 0)
+        exit(EXIT_FAILURE);
+    geometry_heap_defrag(&g_heap, HEAP_DEFRAG_BUDGET);
+    if (g_occlusion) {
+        set_heap_bounds(replaced, &desc);
+        cull_heap_meshes();
+        draw_wall();
+    }
+
+    if (g_vertex_pulling) {
+        vertex_pull_begin(&g_vertex_pull, &view_mat, &proj_mat);
+    } else {
+        glUseProgram(shaders[0]);
+        glUniformMatrix4fv(view_uloc, 1, GL_FALSE, view_mat.m);
+    }
+    for (page = 0; page < g_heap.page_count; ++page) {
+        if (g_vertex_pulling) vertex_pull_bind(g_heap.pages[page].vbo, g_heap.pages[page].ibo);
+        else glBindVertexArray(geometry_heap_vao(&g_heap, page));
+        for (i = 0; i < g_heap_mesh_count; ++i) {
+            const geometry_range_t r = geometry_heap_range(&g_heap, g_heap_meshes[i]);
+            float c[3];
+
+            if (r.page != page || (g_occlusion && !g_heap_visible[i])) continue;
+            heap_mesh_center(i, c);
+            model_mat = IDENTITY4;
+            translate_fast(&model_mat, c[0], c[1], c[2]);
+            if (g_vertex_pulling) {
+                mat4x3_t model;
+                mat4x3_from_mat4(&model, &model_mat);
+                vertex_pull_draw(&g_vertex_pull, &model, r.index_count, r.first_index, r.base_vertex);
+            } else {
+                glUniformMatrix4fv(model_uloc, 1, GL_FALSE, model_mat.m);
+                geometry_heap_draw(&g_heap, g_heap_meshes[i]);
+            }
+        }
+    }
+    if (g_vertex_pulling) {
+        vertex_pull_end();
+    } else {
+        glBindVertexArray(0);
+        glUseProgram(0);
+    }
+    exit_on_glError("ERROR: Could not draw the heap meshes.");
+}
+
+// Row by row in the z = 0 plane, 1.5 apart, centred on the origin.
+void heap_mesh_center(unsigned int i, float c[3]) {
+    const unsigned int side = (unsigned int)ceilf(sqrtf((float)g_heap_mesh_count));
+
+    c[0] = 1.5f * ((float)(i % side) - 0.5f * (side - 1));
+    c[1] = 1.5f * ((float)(i / side) - 0.5f * (side - 1));
+    c[2] = 0;
+}
+
+void set_heap_bounds(unsigned int i, const mesh_desc_t* desc) {
+    const float radius = mesh_bounding_radius(desc);
+    float c[3];
+    int k;
+
+    heap_mesh_center(i, c);
+    for (k = 0; k < 3; ++k) {
+        g_heap_min[i][k] = c[k] - radius;
+        g_heap_max[i][k] = c[k] + radius;
+    }
+}
+
+// --occlusion: a wall across the middle half of the grid, just in front of
+// it, drawn with the cube's VAO and rasterized into the CPU depth buffer as
+// the only occluder. The camera orbits, so for about half the time it hides
+// the middle columns of meshes.
+void create_wall(void) {
+    const float side = ceilf(sqrtf((float)g_heap_mesh_count));
+
+    if (!occlusion_init(&g_occlusion_buf, OCCLUSION_WIDTH, OCCLUSION_HEIGHT))
+        exit(EXIT_FAILURE);
+    g_heap_min = (float (*)[3]) malloc(sizeof(float[3]) * g_heap_mesh_count);
+    g_heap_max = (float (*)[3]) malloc(sizeof(float[3]) * g_heap_mesh_count);
+    g_heap_visible = (unsigned char*) malloc(g_heap_mesh_count);
+    if (g_heap_min == NULL || g_heap_max == NULL || g_heap_visible == NULL) {
+        fprintf(stderr, "ERROR: Could not allocate bounds for %u meshes.\n", g_heap_mesh_count);
+        exit(EXIT_FAILURE);
+    }
+
+    g_wall.positions = CUBE_VERTICES[0].pos;
+    g_wall.stride = sizeof(vertex_t);
+    g_wall.vertex_count = 8;
+    g_wall.indices = CUBE_INDICES;
+    g_wall.index_count = 36;
+    g_wall.model = IDENTITY4;
+    scale_fast(&g_wall.model, 0.75f * side, 1.5f * side, 0.2f);
+    translate_fast(&g_wall.model, 0, 0, 1.5f);
+}
+
+// Rasterizes the wall and tests every mesh's box against it on the jobs;
+// boxes off screen fail the test too.
+void cull_heap_meshes(void) {
+    size_t visible;
+
+    occlusion_begin(&g_occlusion_buf, &view_mat, &proj_mat);
+    occlusion_render(&g_occlusion_buf, &g_wall, 1);
+    visible = occlusion_test_aabbs(&g_occlusion_buf, (const float (*)[3]) g_heap_min,
+                                   (const float (*)[3]) g_heap_max, g_heap_mesh_count, g_heap_visible);
+    g_heap_draws += g_heap_mesh_count;
+    g_heap_culled += g_heap_mesh_count - visible;
+}
+
+void draw_wall(void) {
+    glUseProgram(shaders[0]);
+    glUniformMatrix4fv(model_uloc, 1, GL_FALSE, g_wall.model.m);
+    glUniformMatrix4fv(view_uloc, 1, GL_FALSE, view_mat.m);
+    glBindVertexArray(buffers[0]);
+    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, (GLvoid*)0);
+    glBindVertexArray(0);
+    glUseProgram(0);
+}
+
 void on_error(int error, const char* desc) {
     fprintf(stderr, "ERROR (%d): %s.\n", error, desc);
     exit(EXIT_FAILURE);
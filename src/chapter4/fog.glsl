@@ -0,0 +1,12 @@
+// Fades fragments to black with their distance from the camera.
+#ifndef FOG_START
+#define FOG_START 1.5
+#endif
+#ifndef FOG_END
+#define FOG_END 2.8
+#endif
+
+vec4 apply_fog(vec4 color) {
+    float depth = 1.0 / gl_FragCoord.w; // Eye-space distance along the view axis.
+    return vec4(color.rgb * (1.0 - smoothstep(FOG_START, FOG_END, depth)), color.a);
+}
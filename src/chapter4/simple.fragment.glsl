@@ -1,8 +1,13 @@
 #version 400
+#include "fog.glsl"
 in vec4 ex_Color;
 out vec4 out_Color;
 
 void main(void) {
+#ifdef FOG
+    out_Color = apply_fog(ex_Color);
+#else
     out_Color = ex_Color;
+#endif
 }
 
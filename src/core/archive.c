@@ -0,0 +1,379 @@
+#include "archive.h"
+#include "lz4.h"
+#include "jobs.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define UNPACK_GRAIN 2          // Blocks per parallel_for range.
+#define INDEX_ALIGN 8           // The index is read in place from the mapping.
+
+typedef struct pack_input_ {
+    const char* name;
+    unsigned int index;
+} pack_input_t;
+
+static int compare_inputs(const void* a, const void* b) {
+    return strcmp(((const pack_input_t*) a)->name, ((const pack_input_t*) b)->name);
+}
+
+int archive_pack(const char* path, const char* const* names, const void* const* data, const size_t* sizes,
+                 unsigned int count) {
+    archive_header_t header;
+    pack_input_t* inputs = (pack_input_t*) malloc(sizeof(pack_input_t) * (count > 0 ? count : 1));
+    archive_entry_t* entries = (archive_entry_t*) calloc(count > 0 ? count : 1, sizeof(archive_entry_t));
+    archive_block_t* blocks = NULL;
+    unsigned char* packed = (unsigned char*) malloc(LZ4_BOUND(ARCHIVE_BLOCK_SIZE));
+    char* name_table = NULL;
+    size_t block_count = 0, names_size = 0;
+    uint64_t offset = sizeof(header);
+    FILE* fd = NULL;
+    unsigned int i, b = 0;
+    int ok = 0;
+
+    if (inputs == NULL || entries == NULL || packed == NULL) {
+        fprintf(stderr, "ERROR: Could not allocate the index of %u assets.\n", count);
+        goto done;
+    }
+    for (i = 0; i < count; ++i) {
+        inputs[i].name = names[i];
+        inputs[i].index = i;
+        block_count += (sizes[i] + ARCHIVE_BLOCK_SIZE - 1) / ARCHIVE_BLOCK_SIZE;
+        names_size += strlen(names[i]) + 1;
+    }
+    qsort(inputs, count, sizeof(*inputs), compare_inputs);
+    for (i = 1; i < count; ++i)
+        if (strcmp(inputs[i - 1].name, inputs[i].name) == 0) {
+            fprintf(stderr, "ERROR: %s is packed twice.\n", inputs[i].name);
+            goto done;
+        }
+    blocks = (archive_block_t*) malloc(sizeof(archive_block_t) * (block_count > 0 ? block_count : 1));
+    name_table = (char*) malloc(names_size > 0 ? names_size : 1);
+    if (blocks == NULL || name_table == NULL) {
+        fprintf(stderr, "ERROR: Could not allocate the index of %u assets.\n", count);
+        goto done;
+    }
+    if ((fd = fopen(path, "wb")) == NULL) {
+        fprintf(stderr, "ERROR: Could not open %s.\n", path);
+        goto done;
+    }
+
+    // The header is rewritten once the index is known.
+    memset(&header, 0, sizeof(header));
+    if (fwrite(&header, sizeof(header), 1, fd) != 1) goto write_error;
+
+    names_size = 0;
+    for (i = 0; i < count; ++i) {
+        const unsigned char* src = (const unsigned char*) data[inputs[i].index];
+        const size_t size = sizes[inputs[i].index];
+        archive_entry_t* e = &entries[i];
+        size_t done;
+
+        e->name_offset = (uint32_t)names_size;
+        e->first_block = b;
+        e->size = size;
+        memcpy(name_table + names_size, inputs[i].name, strlen(inputs[i].name) + 1);
+        names_size += strlen(inputs[i].name) + 1;
+
+        for (done = 0; done < size; done += ARCHIVE_BLOCK_SIZE, ++b) {
+            const size_t n = size - done < ARCHIVE_BLOCK_SIZE ? size - done : ARCHIVE_BLOCK_SIZE;
+            size_t packed_size = lz4_compress(src + done, n, packed, LZ4_BOUND(ARCHIVE_BLOCK_SIZE));
+            const int stored = packed_size == 0 || packed_size >= n;
+
+            if (stored) packed_size = n;
+            if (fwrite(stored ? src + done : packed, 1, packed_size, fd) != packed_size) goto write_error;
+            blocks[b].offset = offset;
+            blocks[b].packed_size = (uint32_t)packed_size;
+            blocks[b].size = (uint32_t)n;
+            offset += packed_size;
+        }
+        e->block_count = b - e->first_block;
+    }
+
+    for (; offset % INDEX_ALIGN != 0; ++offset)
+        if (fputc(0, fd) == EOF) goto write_error;
+    memcpy(header.magic, ARCHIVE_MAGIC, sizeof(header.magic));
+    header.version = ARCHIVE_VERSION;
+    header.entry_count = count;
+    header.block_count = (uint32_t)block_count;
+    header.block_size = ARCHIVE_BLOCK_SIZE;
+    header.names_size = (uint32_t)names_size;
+    header.index_offset = offset;
+    if (fwrite(entries, sizeof(*entries), count, fd) != count
+            || fwrite(blocks, sizeof(*blocks), block_count, fd) != block_count
+            || fwrite(name_table, 1, names_size, fd) != names_size
+            || fseek(fd, 0, SEEK_SET) != 0
+            || fwrite(&header, sizeof(header), 1, fd) != 1)
+        goto write_error;
+    ok = 1;
+
+write_error:
+    if (!ok) fprintf(stderr, "ERROR: Could not write %s.\n", path);
+done:
+    if (fd != NULL && fclose(fd) != 0 && ok) {
+        fprintf(stderr, "ERROR: Could not write %s.\n", path);
+        ok = 0;
+    }
+    free(inputs);
+    free(entries);
+    free(blocks);
+    free(packed);
+    free(name_table);
+    return ok;
+}
+
+// Everything lookups and reads rely on, so they don't check again.
+static int validate(const archive_t* a) {
+    const archive_header_t* h = a->header;
+    uint64_t index_size;
+    unsigned int i, j;
+
+    if (a->size < sizeof(*h) || memcmp(h->magic, ARCHIVE_MAGIC, sizeof(h->magic)) != 0
+            || h->version != ARCHIVE_VERSION || h->index_offset % INDEX_ALIGN != 0
+            || h->index_offset > a->size)
+        return 0;
+    index_size = (uint64_t)h->entry_count * sizeof(archive_entry_t)
+               + (uint64_t)h->block_count * sizeof(archive_block_t) + h->names_size;
+    if (index_size > a->size - h->index_offset) return 0;
+    if (h->names_size > 0 && a->names[h->names_size - 1] != '\0') return 0;
+
+    for (i = 0; i < h->block_count; ++i) {
+        const archive_block_t* b = &a->blocks[i];
+        if (b->size == 0 || b->size > h->block_size || b->packed_size > b->size
+                || b->offset < sizeof(*h) || b->offset > h->index_offset
+                || b->packed_size > h->index_offset - b->offset)
+            return 0;
+    }
+    for (i = 0; i < h->entry_count; ++i) {
+        const archive_entry_t* e = &a->entries[i];
+        uint64_t size = 0;
+
+        if (e->name_offset >= h->names_size || (uint64_t)e->first_block + e->block_count > h->block_count)
+            return 0;
+        if (i > 0 && strcmp(a->names + a->entries[i - 1].name_offset, a->names + e->name_offset) >= 0)
+            return 0; // Not sorted, or a duplicate.
+        for (j = 0; j < e->block_count; ++j) size += a->blocks[e->first_block + j].size;
+        if (size != e->size) return 0;
+    }
+    return 1;
+}
+
+int archive_open(archive_t* a, const char* path) {
+    struct stat st;
+    void* base;
+    int fd;
+
+    memset(a, 0, sizeof(*a));
+    if ((fd = open(path, O_RDONLY)) < 0) {
+        fprintf(stderr, "ERROR: Could not open %s.\n", path);
+        return 0;
+    }
+    if (fstat(fd, &st) != 0 || st.st_size == 0
+            || (base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+        fprintf(stderr, "ERROR: Could not map %s.\n", path);
+        close(fd);
+        return 0;
+    }
+    close(fd); // The mapping keeps the file.
+
+    a->base = (const unsigned char*) base;
+    a->size = (size_t)st.st_size;
+    a->header = (const archive_header_t*) a->base;
+    if (a->size >= sizeof(*a->header) && a->header->index_offset <= a->size) {
+        a->entries = (const archive_entry_t*)(a->base + a->header->index_offset);
+        a->blocks = (const archive_block_t*)(a->entries + a->header->entry_count);
+        a->names = (const char*)(a->blocks + a->header->block_count);
+    }
+    if (!validate(a)) {
+        fprintf(stderr, "ERROR: %s is not a valid asset archive.\n", path);
+        archive_close(a);
+        return 0;
+    }
+    return 1;
+}
+
+void archive_close(archive_t* a) {
+    if (a->base != NULL) munmap((void*) a->base, a->size);
+    memset(a, 0, sizeof(*a));
+}
+
+int archive_find(const archive_t* a, const char* name) {
+    int lo = 0, hi = (int)a->header->entry_count - 1;
+
+    while (lo <= hi) {
+        const int mid = lo + (hi - lo) / 2;
+        const int c = strcmp(name, a->names + a->entries[mid].name_offset);
+        if (c == 0) return mid;
+        if (c < 0) hi = mid - 1;
+        else lo = mid + 1;
+    }
+    return -1;
+}
+
+const char* archive_name(const archive_t* a, int entry) {
+    return a->names + a->entries[entry].name_offset;
+}
+
+size_t archive_size(const archive_t* a, int entry) {
+    return (size_t)a->entries[entry].size;
+}
+
+static int read_block(const archive_t* a, const archive_block_t* b, unsigned char* dst) {
+    const unsigned char* src = a->base + b->offset;
+
+    if (b->packed_size == b->size) {
+        memcpy(dst, src, b->size);
+        return 1;
+    }
+    return lz4_decompress(src, b->packed_size, dst, b->size);
+}
+
+int archive_read(const archive_t* a, int entry, void* dst) {
+    const archive_entry_t* e = &a->entries[entry];
+    unsigned char* out = (unsigned char*) dst;
+    unsigned int i;
+
+    for (i = 0; i < e->block_count; ++i) {
+        const archive_block_t* b = &a->blocks[e->first_block + i];
+        if (!read_block(a, b, out)) {
+            fprintf(stderr, "ERROR: Asset %s is corrupt.\n", archive_name(a, entry));
+            return 0;
+        }
+        out += b->size;
+    }
+    return 1;
+}
+
+typedef struct unpack_block_ {
+    const archive_block_t* block;
+    unsigned char* dst;
+    int entry;
+} unpack_block_t;
+
+typedef struct unpack_job_ {
+    const archive_t* archive;
+    const unpack_block_t* blocks;
+    atomic_int failed;          // Entry + 1 of a corrupt block.
+} unpack_job_t;
+
+static void unpack_range(size_t begin, size_t end, void* arg) {
+    unpack_job_t* job = (unpack_job_t*) arg;
+    size_t i;
+
+    for (i = begin; i < end; ++i)
+        if (!read_block(job->archive, job->blocks[i].block, job->blocks[i].dst))
+            atomic_store(&job->failed, job->blocks[i].entry + 1);
+}
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e3 + (double)ts.tv_nsec * 1e-6;
+}
+
+int archive_unpack(archive_set_t* s, const archive_t* a, const char* const* names, unsigned int count) {
+    const double start = now_ms();
+    unpack_job_t job;
+    unpack_block_t* blocks = NULL;
+    size_t block_count = 0;
+    unsigned int i, j;
+    int* entries;
+
+    memset(s, 0, sizeof(*s));
+    if ((entries = (int*) malloc(sizeof(int) * (count > 0 ? count : 1))) == NULL) {
+        fprintf(stderr, "ERROR: Could not allocate %u assets.\n", count);
+        return 0;
+    }
+    for (i = 0; i < count; ++i) {
+        if ((entries[i] = archive_find(a, names[i])) < 0) {
+            fprintf(stderr, "ERROR: %s is not in the asset archive.\n", names[i]);
+            free(entries);
+            return 0;
+        }
+        block_count += a->entries[entries[i]].block_count;
+    }
+
+    s->count = count;
+    s->names = (char**) calloc(count > 0 ? count : 1, sizeof(char*));
+    s->data = (unsigned char**) calloc(count > 0 ? count : 1, sizeof(unsigned char*));
+    s->sizes = (size_t*) calloc(count > 0 ? count : 1, sizeof(size_t));
+    blocks = (unpack_block_t*) malloc(sizeof(unpack_block_t) * (block_count > 0 ? block_count : 1));
+    if (s->names == NULL || s->data == NULL || s->sizes == NULL || blocks == NULL) goto out_of_memory;
+
+    // Every block of every asset is one item of the parallel_for.
+    block_count = 0;
+    for (i = 0; i < count; ++i) {
+        const archive_entry_t* e = &a->entries[entries[i]];
+        unsigned char* dst;
+
+        s->sizes[i] = (size_t)e->size;
+        s->names[i] = (char*) malloc(strlen(names[i]) + 1);
+        s->data[i] = dst = (unsigned char*) malloc(s->sizes[i] + 1);
+        if (s->names[i] == NULL || dst == NULL) goto out_of_memory;
+        memcpy(s->names[i], names[i], strlen(names[i]) + 1);
+        dst[s->sizes[i]] = '\0';
+
+        for (j = 0; j < e->block_count; ++j) {
+            unpack_block_t* u = &blocks[block_count++];
+            u->block = &a->blocks[e->first_block + j];
+            u->dst = dst;
+            u->entry = entries[i];
+            dst += u->block->size;
+            s->stats.packed_bytes += u->block->packed_size;
+        }
+        s->stats.bytes += s->sizes[i];
+    }
+
+    job.archive = a;
+    job.blocks = blocks;
+    atomic_init(&job.failed, 0);
+    jobs_parallel_for(block_count, UNPACK_GRAIN, unpack_range, &job);
+    if (atomic_load(&job.failed) != 0) {
+        fprintf(stderr, "ERROR: Asset %s is corrupt.\n", archive_name(a, atomic_load(&job.failed) - 1));
+        goto fail;
+    }
+
+    s->stats.blocks = (unsigned int)block_count;
+    s->stats.ms = now_ms() - start;
+    free(blocks);
+    free(entries);
+    return 1;
+
+out_of_memory:
+    fprintf(stderr, "ERROR: Could not allocate %u unpacked assets.\n", count);
+fail:
+    free(blocks);
+    free(entries);
+    archive_set_free(s);
+    return 0;
+}
+
+void archive_set_free(archive_set_t* s) {
+    unsigned int i;
+
+    for (i = 0; i < s->count; ++i) {
+        if (s->names != NULL) free(s->names[i]);
+        if (s->data != NULL) free(s->data[i]);
+    }
+    free(s->names);
+    free(s->data);
+    free(s->sizes);
+    memset(s, 0, sizeof(*s));
+}
+
+const unsigned char* archive_set_find(const archive_set_t* s, const char* name, size_t* size) {
+    unsigned int i;
+
+    for (i = 0; i < s->count; ++i)
+        if (strcmp(s->names[i], name) == 0) {
+            if (size != NULL) *size = s->sizes[i];
+            return s->data[i];
+        }
+    return NULL;
+}
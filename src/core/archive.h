@@ -0,0 +1,96 @@
+#ifndef CORE_ARCHIVE_H
+#define CORE_ARCHIVE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Packed asset archives: one file holding any number of named assets
+// (shaders, meshes, textures: the archive doesn't look inside them).
+//
+// Each asset is split into blocks of ARCHIVE_BLOCK_SIZE bytes, compressed
+// with LZ4 (core/lz4.h) independently of each other, or stored as-is when
+// that doesn't make them smaller. After the header come the blocks, then the
+// index: the entries, sorted by name, the block table and the names. All
+// fields are in native byte order, like GL traces.
+//
+// archive_open() maps the file read-only and checks the index once, after
+// which lookups are a binary search over the mapped entries and nothing is
+// read until an asset is unpacked. archive_unpack() unpacks a set of assets
+// at once, their blocks spread across the job system, into memory the set
+// owns, so the archive can be closed right after.
+//
+// Blocks carry no checksum: decompression catches corruption that breaks
+// the LZ4 stream, not damaged literals or stored blocks.
+
+#define ARCHIVE_MAGIC "GPAK"
+#define ARCHIVE_VERSION 1
+#define ARCHIVE_BLOCK_SIZE (64 * 1024)  // LZ4's offsets reach back 64 KB.
+
+typedef struct archive_header_ {
+    char magic[4];
+    uint32_t version;
+    uint32_t entry_count, block_count;
+    uint32_t block_size;
+    uint32_t names_size;            // Bytes of NUL-terminated names.
+    uint64_t index_offset;          // Entries, then blocks, then names.
+} archive_header_t;
+
+typedef struct archive_entry_ {
+    uint32_t name_offset;           // Into the names.
+    uint32_t first_block, block_count;
+    uint32_t pad;
+    uint64_t size;                  // Unpacked.
+} archive_entry_t;
+
+typedef struct archive_block_ {
+    uint64_t offset;                // From the start of the file.
+    uint32_t packed_size;           // Equal to size: stored uncompressed.
+    uint32_t size;
+} archive_block_t;
+
+typedef struct archive_ {
+    const unsigned char* base;      // The mapping.
+    size_t size;
+    const archive_header_t* header;
+    const archive_entry_t* entries;
+    const archive_block_t* blocks;
+    const char* names;
+} archive_t;
+
+// Writes `count` assets (given in any order, names unique) to `path`.
+int  archive_pack(const char* path, const char* const* names, const void* const* data, const size_t* sizes,
+                  unsigned int count);
+
+int  archive_open(archive_t* a, const char* path);
+void archive_close(archive_t* a);
+
+// The entry called `name`, or -1.
+int  archive_find(const archive_t* a, const char* name);
+const char* archive_name(const archive_t* a, int entry);
+size_t archive_size(const archive_t* a, int entry);
+
+// Unpacks one entry into `dst`, of archive_size() bytes, on this thread.
+int  archive_read(const archive_t* a, int entry, void* dst);
+
+typedef struct archive_unpack_stats_ {
+    size_t packed_bytes, bytes;
+    unsigned int blocks;
+    double ms;
+} archive_unpack_stats_t;
+
+// Assets unpacked together, each followed by a NUL so text can be used as is.
+typedef struct archive_set_ {
+    unsigned int count;
+    char** names;
+    unsigned char** data;
+    size_t* sizes;
+    archive_unpack_stats_t stats;
+} archive_set_t;
+
+// Unpacks the assets called `names` (every one must exist) into `s`.
+int  archive_unpack(archive_set_t* s, const archive_t* a, const char* const* names, unsigned int count);
+void archive_set_free(archive_set_t* s);
+// The asset called `name`, or NULL.
+const unsigned char* archive_set_find(const archive_set_t* s, const char* name, size_t* size);
+
+#endif // CORE_ARCHIVE_H
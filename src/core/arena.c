@@ -0,0 +1,155 @@
+#include "arena.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+
+static arena_t g_frame_arena;
+static frame_stats_t g_frame_stats;
+static _Thread_local arena_t* t_scratch = NULL;
+static _Thread_local arena_t t_scratch_storage;
+
+static size_t align_up(size_t v, size_t align) {
+    return (v + (align - 1)) & ~(align - 1);
+}
+
+int arena_init(arena_t* a, size_t capacity) {
+    a->base = (unsigned char*) malloc(capacity);
+    if (a->base == NULL) {
+        fprintf(stderr, "ERROR: Could not allocate %zu byte arena.\n", capacity);
+        return 0;
+    }
+    a->capacity = capacity;
+    a->offset = 0;
+    a->peak = 0;
+    a->overflow_bytes = 0;
+    a->heap_allocs = 0;
+    a->overflow = NULL;
+    return 1;
+}
+
+void arena_destroy(arena_t* a) {
+    arena_reset(a);
+    free(a->base);
+    a->base = NULL;
+    a->capacity = 0;
+}
+
+void* arena_alloc(arena_t* a, size_t size, size_t align) {
+    size_t start;
+    uintptr_t addr;
+    unsigned char* block;
+
+    if (align == 0) align = ARENA_DEFAULT_ALIGN;
+
+    // Fast path: bump the offset, aligning the actual address so alignments
+    // stricter than malloc's are honoured too.
+    addr = (uintptr_t)(a->base + a->offset);
+    start = a->offset + (align_up(addr, align) - addr);
+    if (start + size <= a->capacity) {
+        a->offset = start + size;
+        if (a->offset + a->overflow_bytes > a->peak)
+            a->peak = a->offset + a->overflow_bytes;
+        return a->base + start;
+    }
+
+    // Slow path: the arena is too small, keep going with a heap block that
+    // lives until the next reset. Over-allocate so the payload can be aligned
+    // past the block header.
+    if ((block = (unsigned char*) malloc(sizeof(arena_block_t) + align + size)) == NULL) return NULL;
+
+    ((arena_block_t*) block)->next = a->overflow;
+    a->overflow = (arena_block_t*) block;
+    a->overflow_bytes += size;
+    ++a->heap_allocs;
+    if (a->offset + a->overflow_bytes > a->peak)
+        a->peak = a->offset + a->overflow_bytes;
+
+    return (void*) align_up((uintptr_t)(block + sizeof(arena_block_t)), align);
+}
+
+void arena_reset(arena_t* a) {
+    arena_block_t* b = a->overflow;
+    while (b != NULL) {
+        arena_block_t* next = b->next;
+        free(b);
+        b = next;
+    }
+    a->overflow = NULL;
+    a->overflow_bytes = 0;
+    a->heap_allocs = 0;
+    a->offset = 0;
+}
+
+arena_stats_t arena_stats(const arena_t* a) {
+    arena_stats_t s;
+    s.capacity = a->capacity;
+    s.used = a->offset + a->overflow_bytes;
+    s.peak = a->peak;
+    s.heap_allocs = a->heap_allocs;
+    return s;
+}
+
+arena_mark_t arena_mark(const arena_t* a) {
+    arena_mark_t m;
+    m.offset = a->offset;
+    m.overflow = a->overflow;
+    m.overflow_bytes = a->overflow_bytes;
+    return m;
+}
+
+void arena_rewind(arena_t* a, arena_mark_t mark) {
+    // Blocks are pushed on the front of the list, so the ones allocated
+    // since the mark come before it.
+    while (a->overflow != NULL && a->overflow != mark.overflow) {
+        arena_block_t* next = a->overflow->next;
+        free(a->overflow);
+        a->overflow = next;
+    }
+    a->overflow_bytes = mark.overflow_bytes;
+    if (mark.offset <= a->offset) a->offset = mark.offset;
+}
+
+// Frame arena
+
+int frame_arena_init(size_t capacity) {
+    g_frame_stats = (frame_stats_t) { 0 };
+    return arena_init(&g_frame_arena, capacity);
+}
+
+void frame_arena_destroy(void) { arena_destroy(&g_frame_arena); }
+
+arena_t* frame_arena(void) { return &g_frame_arena; }
+
+void* frame_alloc(size_t size) {
+    return arena_alloc(&g_frame_arena, size, ARENA_DEFAULT_ALIGN);
+}
+
+void frame_end(void) {
+    const arena_stats_t s = arena_stats(&g_frame_arena);
+
+    g_frame_stats.last_frame_bytes = s.used;
+    if (s.used > g_frame_stats.peak_frame_bytes)
+        g_frame_stats.peak_frame_bytes = s.used;
+    g_frame_stats.last_frame_heap_allocs = s.heap_allocs;
+    g_frame_stats.total_heap_allocs += s.heap_allocs;
+    ++g_frame_stats.frames;
+
+    arena_reset(&g_frame_arena);
+}
+
+frame_stats_t frame_stats(void) { return g_frame_stats; }
+
+// Scratch arenas
+
+arena_t* scratch_arena(void) {
+    if (t_scratch == NULL && arena_init(&t_scratch_storage, SCRATCH_ARENA_SIZE))
+        t_scratch = &t_scratch_storage;
+    return t_scratch;
+}
+
+void scratch_arena_release(void) {
+    if (t_scratch == NULL) return;
+    arena_destroy(t_scratch);
+    t_scratch = NULL;
+}
@@ -0,0 +1,79 @@
+#ifndef CORE_ARENA_H
+#define CORE_ARENA_H
+
+#include <stddef.h>
+
+// Linear (bump) allocator. Allocations are carved out of one contiguous block
+// and are released all at once by arena_reset(). When the block runs out the
+// arena falls back to the heap and counts it, so we can tell whether a steady
+// state loop really stays off malloc.
+typedef struct arena_block_ {
+    struct arena_block_* next;
+} arena_block_t;
+
+typedef struct arena_ {
+    unsigned char* base;
+    size_t capacity;
+    size_t offset;
+    size_t peak;            // Highest offset ever reached (including overflow).
+    size_t overflow_bytes;  // Bytes served from the heap since the last reset.
+    unsigned long heap_allocs; // Heap fallbacks since the last reset.
+    arena_block_t* overflow;
+} arena_t;
+
+// Snapshot of what an arena has been used for.
+typedef struct arena_stats_ {
+    size_t capacity;
+    size_t used;            // Bytes handed out since the last reset.
+    size_t peak;
+    unsigned long heap_allocs;
+} arena_stats_t;
+
+#define ARENA_DEFAULT_ALIGN 16
+
+int  arena_init(arena_t* a, size_t capacity);
+void arena_destroy(arena_t* a);
+void* arena_alloc(arena_t* a, size_t size, size_t align);
+void arena_reset(arena_t* a);
+arena_stats_t arena_stats(const arena_t* a);
+
+// Save/restore points, for temporary allocations within a longer scope.
+// Rewinding also frees the heap blocks the arena overflowed into since the
+// mark, so a scratch arena that is only ever rewound doesn't keep them.
+typedef struct arena_mark_ {
+    size_t offset;
+    arena_block_t* overflow;
+    size_t overflow_bytes;
+} arena_mark_t;
+
+arena_mark_t arena_mark(const arena_t* a);
+void arena_rewind(arena_t* a, arena_mark_t mark);
+
+// Convenience: allocate space for `count` objects of `type`.
+#define ARENA_NEW(a, type, count) \
+    ((type*) arena_alloc((a), sizeof(type) * (count), _Alignof(type)))
+
+// Per-frame arena. Anything allocated from it lives until frame_end(), which
+// records the frame's usage and resets the arena for the next frame.
+typedef struct frame_stats_ {
+    size_t last_frame_bytes;
+    size_t peak_frame_bytes;
+    unsigned long last_frame_heap_allocs;
+    unsigned long total_heap_allocs;
+    unsigned long frames;
+} frame_stats_t;
+
+int  frame_arena_init(size_t capacity);
+void frame_arena_destroy(void);
+arena_t* frame_arena(void);
+void* frame_alloc(size_t size);
+void frame_end(void);
+frame_stats_t frame_stats(void);
+
+// Per-thread scratch arena, created lazily on first use. Callers are expected
+// to bracket their usage with arena_mark()/arena_rewind().
+#define SCRATCH_ARENA_SIZE (1 << 20)
+arena_t* scratch_arena(void);
+void scratch_arena_release(void);
+
+#endif // CORE_ARENA_H
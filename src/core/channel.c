@@ -0,0 +1,96 @@
+#include "channel.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#define TRIPLE_BUFFER_FRESH 4u
+
+int spsc_ring_init(spsc_ring_t* r, size_t capacity, size_t msg_size) {
+    size_t slots = 2;
+
+    while (slots < capacity) slots <<= 1;
+    memset(r, 0, sizeof(*r));
+    if ((r->slots = (unsigned char*) malloc(slots * msg_size)) == NULL) {
+        fprintf(stderr, "ERROR: Could not allocate a ring of %zu x %zu bytes.\n", slots, msg_size);
+        return 0;
+    }
+    r->msg_size = msg_size;
+    r->mask = (unsigned int)(slots - 1);
+    atomic_init(&r->head, 0);
+    atomic_init(&r->tail, 0);
+    return 1;
+}
+
+void spsc_ring_destroy(spsc_ring_t* r) {
+    free(r->slots);
+    r->slots = NULL;
+}
+
+int spsc_ring_push(spsc_ring_t* r, const void* msg) {
+    const unsigned int head = atomic_load_explicit(&r->head, memory_order_relaxed);
+
+    // Indices run freely and wrap; their difference is the fill level.
+    if (head - r->tail_cache > r->mask) {
+        r->tail_cache = atomic_load_explicit(&r->tail, memory_order_acquire);
+        if (head - r->tail_cache > r->mask) return 0;
+    }
+    memcpy(r->slots + (size_t)(head & r->mask) * r->msg_size, msg, r->msg_size);
+    atomic_store_explicit(&r->head, head + 1, memory_order_release);
+    return 1;
+}
+
+int spsc_ring_pop(spsc_ring_t* r, void* msg) {
+    const unsigned int tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+
+    if (tail == r->head_cache) {
+        r->head_cache = atomic_load_explicit(&r->head, memory_order_acquire);
+        if (tail == r->head_cache) return 0;
+    }
+    memcpy(msg, r->slots + (size_t)(tail & r->mask) * r->msg_size, r->msg_size);
+    atomic_store_explicit(&r->tail, tail + 1, memory_order_release);
+    return 1;
+}
+
+int triple_buffer_init(triple_buffer_t* t, size_t size) {
+    memset(t, 0, sizeof(*t));
+    // Slots on separate cache lines, so the writer filling one doesn't
+    // disturb the reader reading another.
+    t->stride = (size + CHANNEL_CACHE_LINE - 1) & ~(size_t)(CHANNEL_CACHE_LINE - 1);
+    if ((t->slots = (unsigned char*) calloc(3, t->stride)) == NULL) {
+        fprintf(stderr, "ERROR: Could not allocate a triple buffer of %zu bytes.\n", size);
+        return 0;
+    }
+    t->size = size;
+    t->write = 0;
+    t->read = 1;
+    atomic_init(&t->shared, 2);
+    return 1;
+}
+
+void triple_buffer_destroy(triple_buffer_t* t) {
+    free(t->slots);
+    t->slots = NULL;
+}
+
+void* triple_buffer_slot(triple_buffer_t* t) {
+    return t->slots + t->write * t->stride;
+}
+
+void triple_buffer_publish(triple_buffer_t* t) {
+    // Release the filled slot, and take back whichever the reader left there.
+    const unsigned int prev = atomic_exchange_explicit(&t->shared, t->write | TRIPLE_BUFFER_FRESH,
+                                                       memory_order_acq_rel);
+    t->write = prev & ~TRIPLE_BUFFER_FRESH;
+}
+
+const void* triple_buffer_read(triple_buffer_t* t, int* fresh) {
+    const int newer = (atomic_load_explicit(&t->shared, memory_order_relaxed) & TRIPLE_BUFFER_FRESH) != 0;
+
+    if (newer) {
+        const unsigned int prev = atomic_exchange_explicit(&t->shared, t->read, memory_order_acq_rel);
+        t->read = prev & ~TRIPLE_BUFFER_FRESH;
+    }
+    if (fresh != NULL) *fresh = newer;
+    return t->slots + t->read * t->stride;
+}
@@ -0,0 +1,59 @@
+#ifndef CORE_CHANNEL_H
+#define CORE_CHANNEL_H
+
+#include <stddef.h>
+#include <stdatomic.h>
+
+// Lock-free channels between exactly two threads, one producer and one
+// consumer. Neither side ever blocks or takes a lock, so a thread that must
+// stay responsive (event handling) can talk to one that may stall (a render
+// thread waiting on vsync) and the other way around.
+//
+// - spsc_ring_t: a bounded FIFO of fixed-size messages. Each side owns one
+//   index on its own cache line and keeps a cached copy of the other's, so
+//   the shared lines are only touched when the cached view says the ring
+//   looks full (or empty). Pushing to a full ring fails instead of waiting.
+// - triple_buffer_t: the latest value of a fixed-size snapshot. The writer
+//   fills its private slot and swaps it with the shared one; the reader swaps
+//   the shared one with its own if it's newer. Values the reader never got to
+//   are overwritten, so a slow reader always sees the newest one and a fast
+//   one sees the same one again.
+
+#define CHANNEL_CACHE_LINE 64
+
+typedef struct spsc_ring_ {
+    unsigned char* slots;
+    size_t msg_size;
+    unsigned int mask;              // Capacity - 1; capacity is a power of two.
+
+    _Alignas(CHANNEL_CACHE_LINE) atomic_uint head;  // Next message written; producer's.
+    unsigned int tail_cache;        // Producer's view of `tail`.
+    _Alignas(CHANNEL_CACHE_LINE) atomic_uint tail;  // Next message read; consumer's.
+    unsigned int head_cache;        // Consumer's view of `head`.
+} spsc_ring_t;
+
+// Room for at least `capacity` messages of `msg_size` bytes.
+int  spsc_ring_init(spsc_ring_t* r, size_t capacity, size_t msg_size);
+void spsc_ring_destroy(spsc_ring_t* r);
+// Producer side. Returns 0, copying nothing, when the ring is full.
+int  spsc_ring_push(spsc_ring_t* r, const void* msg);
+// Consumer side. Returns 0 when the ring is empty.
+int  spsc_ring_pop(spsc_ring_t* r, void* msg);
+
+typedef struct triple_buffer_ {
+    unsigned char* slots;           // Three, a cache line apart at least.
+    size_t size, stride;
+    atomic_uint shared;             // Slot index, flagged until the reader takes it.
+    unsigned int write, read;       // Each side's private slot.
+} triple_buffer_t;
+
+int  triple_buffer_init(triple_buffer_t* t, size_t size);
+void triple_buffer_destroy(triple_buffer_t* t);
+// Writer side: fill the slot returned by triple_buffer_slot(), then publish it.
+void* triple_buffer_slot(triple_buffer_t* t);
+void triple_buffer_publish(triple_buffer_t* t);
+// Reader side: the newest published value (the initial slot contents before
+// any). `fresh`, if given, is set to whether it wasn't returned before.
+const void* triple_buffer_read(triple_buffer_t* t, int* fresh);
+
+#endif // CORE_CHANNEL_H
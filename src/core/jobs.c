@@ -0,0 +1,193 @@
+#include "jobs.h"
+#include "arena.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <unistd.h>
+
+// Upper bound on the ranges a single parallel_for splits into.
+#define PARALLEL_FOR_MAX_RANGES 256
+
+typedef struct job_ {
+    job_fn fn;
+    void* arg;
+    job_counter_t* counter;
+} job_t;
+
+typedef struct range_job_ {
+    job_range_fn fn;
+    void* arg;
+    size_t begin, end;
+} range_job_t;
+
+static pthread_t g_workers[JOBS_MAX_WORKERS];
+static unsigned int g_worker_count = 0;
+static int g_running = 0;
+
+// Ring buffer of queued jobs, protected by g_lock.
+static job_t g_queue[JOB_QUEUE_SIZE];
+static unsigned int g_head = 0, g_tail = 0, g_count = 0;
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_has_work = PTHREAD_COND_INITIALIZER;
+
+static _Thread_local unsigned int t_index = 0;
+
+static int pop_job(job_t* out) {
+    if (g_count == 0) return 0;
+    *out = g_queue[g_tail];
+    g_tail = (g_tail + 1) % JOB_QUEUE_SIZE;
+    --g_count;
+    return 1;
+}
+
+static void run_job(const job_t* job) {
+    job->fn(job->arg);
+    if (job->counter != NULL)
+        atomic_fetch_sub_explicit(&job->counter->pending, 1, memory_order_release);
+}
+
+static void* worker_main(void* arg) {
+    job_t job;
+
+    t_index = (unsigned int)(size_t)arg;
+
+    pthread_mutex_lock(&g_lock);
+    while (g_running) {
+        if (!pop_job(&job)) {
+            pthread_cond_wait(&g_has_work, &g_lock);
+            continue;
+        }
+        pthread_mutex_unlock(&g_lock);
+        run_job(&job);
+        pthread_mutex_lock(&g_lock);
+    }
+    pthread_mutex_unlock(&g_lock);
+    scratch_arena_release(); // If a job used one.
+    return NULL;
+}
+
+int jobs_init(unsigned int workers) {
+    unsigned int i;
+
+    if (g_running) return 1;
+
+    if (workers == 0) {
+        const long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        workers = cores > 1 ? (unsigned int)cores - 1 : 0;
+    }
+    if (workers > JOBS_MAX_WORKERS) workers = JOBS_MAX_WORKERS;
+
+    g_running = 1;
+    for (i = 0; i < workers; ++i) {
+        if (pthread_create(&g_workers[i], NULL, worker_main, (void*)(size_t)(i + 1)) != 0) {
+            fprintf(stderr, "ERROR: Could not start worker thread %u.\n", i);
+            break;
+        }
+    }
+    g_worker_count = i;
+    return 1;
+}
+
+void jobs_shutdown(void) {
+    unsigned int i;
+    job_t job;
+
+    pthread_mutex_lock(&g_lock);
+    g_running = 0;
+    pthread_cond_broadcast(&g_has_work);
+    pthread_mutex_unlock(&g_lock);
+
+    for (i = 0; i < g_worker_count; ++i)
+        pthread_join(g_workers[i], NULL);
+    g_worker_count = 0;
+
+    // Anything still queued runs here rather than being dropped.
+    while (pop_job(&job)) run_job(&job);
+}
+
+unsigned int jobs_worker_count(void) { return g_worker_count; }
+
+unsigned int jobs_thread_index(void) { return t_index; }
+
+void jobs_submit(job_fn fn, void* arg, job_counter_t* counter) {
+    job_t job;
+
+    job.fn = fn;
+    job.arg = arg;
+    job.counter = counter;
+    if (counter != NULL)
+        atomic_fetch_add_explicit(&counter->pending, 1, memory_order_relaxed);
+
+    if (g_worker_count > 0) {
+        pthread_mutex_lock(&g_lock);
+        if (g_count < JOB_QUEUE_SIZE) {
+            g_queue[g_head] = job;
+            g_head = (g_head + 1) % JOB_QUEUE_SIZE;
+            ++g_count;
+            pthread_cond_signal(&g_has_work);
+            pthread_mutex_unlock(&g_lock);
+            return;
+        }
+        pthread_mutex_unlock(&g_lock);
+    }
+
+    run_job(&job); // No workers, or the queue is full.
+}
+
+void jobs_wait(job_counter_t* counter) {
+    job_t job;
+
+    while (atomic_load_explicit(&counter->pending, memory_order_acquire) > 0) {
+        int found;
+
+        pthread_mutex_lock(&g_lock);
+        found = pop_job(&job);
+        pthread_mutex_unlock(&g_lock);
+
+        if (found) run_job(&job);
+        else sched_yield(); // Remaining jobs are in progress on other threads.
+    }
+}
+
+static void range_job_main(void* arg) {
+    const range_job_t* r = (const range_job_t*) arg;
+    r->fn(r->begin, r->end, r->arg);
+}
+
+void jobs_parallel_for(size_t count, size_t grain, job_range_fn fn, void* arg) {
+    range_job_t ranges[PARALLEL_FOR_MAX_RANGES];
+    job_counter_t counter;
+    size_t ranges_count, per_range, i;
+
+    if (count == 0) return;
+    if (grain == 0) grain = 1;
+
+    // Aim for a few ranges per thread for load balancing, but never smaller
+    // than the grain.
+    ranges_count = (g_worker_count + 1) * 4;
+    if (ranges_count > PARALLEL_FOR_MAX_RANGES) ranges_count = PARALLEL_FOR_MAX_RANGES;
+    per_range = (count + ranges_count - 1) / ranges_count;
+    if (per_range < grain) per_range = grain;
+    ranges_count = (count + per_range - 1) / per_range;
+
+    if (ranges_count == 1 || g_worker_count == 0) {
+        fn(0, count, arg);
+        return;
+    }
+
+    atomic_init(&counter.pending, 0);
+    for (i = 0; i < ranges_count; ++i) {
+        ranges[i].fn = fn;
+        ranges[i].arg = arg;
+        ranges[i].begin = i * per_range;
+        ranges[i].end = i + 1 == ranges_count ? count : (i + 1) * per_range;
+    }
+
+    // Queue all but the first range; the calling thread takes that one.
+    for (i = 1; i < ranges_count; ++i)
+        jobs_submit(range_job_main, &ranges[i], &counter);
+    range_job_main(&ranges[0]);
+
+    jobs_wait(&counter);
+}
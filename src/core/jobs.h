@@ -0,0 +1,46 @@
+#ifndef CORE_JOBS_H
+#define CORE_JOBS_H
+
+#include <stddef.h>
+#include <stdatomic.h>
+
+// A small job system: a fixed set of worker threads pulling from one shared
+// queue. Jobs are plain function pointers; completion is tracked with
+// counters so callers can wait on a batch. Waiting threads help run queued
+// jobs instead of sleeping, so it is safe to wait from inside a job.
+//
+// Without jobs_init() (or with zero workers) everything runs inline on the
+// calling thread.
+
+#define JOB_QUEUE_SIZE 4096
+#define JOBS_MAX_WORKERS 64
+
+typedef void (*job_fn)(void* arg);
+typedef void (*job_range_fn)(size_t begin, size_t end, void* arg);
+
+typedef struct job_counter_ {
+    atomic_int pending;
+} job_counter_t;
+
+// 0 workers = one per core, minus the calling thread.
+int  jobs_init(unsigned int workers);
+void jobs_shutdown(void);
+unsigned int jobs_worker_count(void);
+
+// 0 for the main (non-worker) thread, 1..N for workers. Handy for indexing
+// per-thread data.
+unsigned int jobs_thread_index(void);
+
+// Queue fn(arg). If `counter` is given it is incremented now and decremented
+// when the job has run. When the queue is full the job runs inline.
+void jobs_submit(job_fn fn, void* arg, job_counter_t* counter);
+
+// Block until `counter` drops to zero, running queued jobs meanwhile.
+void jobs_wait(job_counter_t* counter);
+
+// Run fn over [0, count) split into ranges of at least `grain` items,
+// spread across the workers and the calling thread. Returns when all ranges
+// are done.
+void jobs_parallel_for(size_t count, size_t grain, job_range_fn fn, void* arg);
+
+#endif // CORE_JOBS_H
@@ -0,0 +1,140 @@
+#include "lz4.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#define MIN_MATCH 4
+#define LAST_LITERALS 5         // The block ends with at least this many literals,
+#define MATCH_FIND_LIMIT 12     // and the last match starts this far from the end.
+#define MAX_OFFSET 65535
+#define HASH_LOG 12
+
+static uint32_t read32(const unsigned char* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static unsigned int hash4(uint32_t v) {
+    return (v * 2654435761u) >> (32 - HASH_LOG);
+}
+
+// Lengths past a field's 15 continue in bytes of 255, then the remainder.
+static unsigned char* put_length(unsigned char* op, size_t length) {
+    for (; length >= 255; length -= 255) *op++ = 255;
+    *op++ = (unsigned char)length;
+    return op;
+}
+
+// Appends literals [anchor, anchor + literals) and, unless this is the last
+// sequence, a match of `length` at `offset`. Returns NULL if out of room.
+static unsigned char* put_sequence(unsigned char* op, const unsigned char* op_end, const unsigned char* anchor,
+                                   size_t literals, size_t offset, size_t length) {
+    const size_t match = length >= MIN_MATCH ? length - MIN_MATCH : 0;
+    unsigned char* token = op;
+
+    if ((size_t)(op_end - op) < 1 + literals + literals / 255 + 1 + 2 + match / 255 + 1) return NULL;
+    *token = (unsigned char)((literals >= 15 ? 15 : literals) << 4);
+    ++op;
+    if (literals >= 15) op = put_length(op, literals - 15);
+    memcpy(op, anchor, literals);
+    op += literals;
+    if (length == 0) return op;
+
+    *op++ = (unsigned char)(offset & 0xFF);
+    *op++ = (unsigned char)(offset >> 8);
+    *token |= (unsigned char)(match >= 15 ? 15 : match);
+    if (match >= 15) op = put_length(op, match - 15);
+    return op;
+}
+
+size_t lz4_compress(const void* src, size_t size, void* dst, size_t capacity) {
+    const unsigned char* in = (const unsigned char*) src;
+    const unsigned char *ip = in, *anchor = in, *end = in + size;
+    unsigned char *op = (unsigned char*) dst, *op_end = op + capacity;
+    uint32_t table[1 << HASH_LOG];  // Last position of each hashed 4 bytes.
+
+    if (size > MATCH_FIND_LIMIT) {
+        const unsigned char* match_start_limit = end - MATCH_FIND_LIMIT;
+        const unsigned char* match_end_limit = end - LAST_LITERALS;
+
+        memset(table, 0, sizeof(table));
+        while (ip <= match_start_limit) {
+            const uint32_t seq = read32(ip);
+            const unsigned int h = hash4(seq);
+            const unsigned char* ref = in + table[h];
+            size_t length = MIN_MATCH;
+
+            table[h] = (uint32_t)(ip - in);
+            if (ref >= ip || ip - ref > MAX_OFFSET || read32(ref) != seq) {
+                ++ip;
+                continue;
+            }
+            while (ip > anchor && ref > in && ip[-1] == ref[-1]) {
+                --ip;
+                --ref;
+                ++length;
+            }
+            while (ip + length < match_end_limit && ip[length] == ref[length]) ++length;
+
+            if ((op = put_sequence(op, op_end, anchor, (size_t)(ip - anchor), (size_t)(ip - ref), length)) == NULL)
+                return 0;
+            ip += length;
+            anchor = ip;
+            // Remember a position inside the match too, for runs.
+            if (ip <= match_start_limit) table[hash4(read32(ip - 2))] = (uint32_t)(ip - 2 - in);
+        }
+    }
+
+    if ((op = put_sequence(op, op_end, anchor, (size_t)(end - anchor), 0, 0)) == NULL) return 0;
+    return (size_t)(op - (unsigned char*) dst);
+}
+
+// Reads a length continued in bytes of 255; 0 if the input runs out.
+static int get_length(const unsigned char** ip, const unsigned char* ip_end, size_t* length) {
+    unsigned char b;
+
+    do {
+        if (*ip >= ip_end) return 0;
+        b = *(*ip)++;
+        *length += b;
+    } while (b == 255);
+    return 1;
+}
+
+int lz4_decompress(const void* src, size_t packed_size, void* dst, size_t size) {
+    const unsigned char *ip = (const unsigned char*) src, *ip_end = ip + packed_size;
+    unsigned char *out = (unsigned char*) dst, *op = out, *op_end = out + size;
+
+    for (;;) {
+        size_t literals, length, offset;
+        unsigned char token;
+
+        if (ip >= ip_end) return 0;
+        token = *ip++;
+        literals = token >> 4;
+        if (literals == 15 && !get_length(&ip, ip_end, &literals)) return 0;
+        if (literals > (size_t)(ip_end - ip) || literals > (size_t)(op_end - op)) return 0;
+        memcpy(op, ip, literals);
+        ip += literals;
+        op += literals;
+        if (ip == ip_end) return op == op_end; // The last sequence has no match.
+
+        if (ip_end - ip < 2) return 0;
+        offset = (size_t)ip[0] | (size_t)ip[1] << 8;
+        ip += 2;
+        length = token & 15;
+        if (length == 15 && !get_length(&ip, ip_end, &length)) return 0;
+        length += MIN_MATCH;
+        if (offset == 0 || offset > (size_t)(op - out) || length > (size_t)(op_end - op)) return 0;
+
+        if (offset >= length) {
+            memcpy(op, op - offset, length);
+            op += length;
+        } else {
+            // Overlapping: repeats the last `offset` bytes.
+            const unsigned char* ref = op - offset;
+            while (length-- > 0) *op++ = *ref++;
+        }
+    }
+}
@@ -0,0 +1,27 @@
+#ifndef CORE_LZ4_H
+#define CORE_LZ4_H
+
+#include <stddef.h>
+
+// LZ4 block compression, in tree.
+//
+// Reads and writes the LZ4 block format (a run of sequences, each a token,
+// literals, a 16-bit offset and a match length), as the reference library's
+// LZ4_compress_default() and LZ4_decompress_safe() do, without the frame
+// format around it. Compression is greedy over a small hash table of 4-byte
+// sequences: fast and modest, which suits assets compressed once at build
+// time. Decompression checks every length and offset against both buffers,
+// so corrupt input fails instead of reading or writing out of bounds.
+
+// Worst case compressed size of `size` bytes.
+#define LZ4_BOUND(size) ((size) + (size) / 255 + 16)
+
+// Compresses `size` bytes into `dst`. Returns the compressed size, or 0 if it
+// doesn't fit in `capacity` (LZ4_BOUND(size) always does).
+size_t lz4_compress(const void* src, size_t size, void* dst, size_t capacity);
+
+// Decompresses a block that must expand to exactly `size` bytes. Returns 0 if
+// the block is malformed or of another size.
+int lz4_decompress(const void* src, size_t packed_size, void* dst, size_t size);
+
+#endif // CORE_LZ4_H
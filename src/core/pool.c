@@ -0,0 +1,64 @@
+#include "pool.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+int pool_init(pool_t* p, size_t obj_size, size_t capacity) {
+    size_t i;
+
+    // Each free slot stores the next pointer, so it must fit one and keep it aligned.
+    if (obj_size < sizeof(void*)) obj_size = sizeof(void*);
+    obj_size = (obj_size + (sizeof(void*) - 1)) & ~(sizeof(void*) - 1);
+
+    p->slots = (unsigned char*) malloc(obj_size * capacity);
+    if (p->slots == NULL) {
+        fprintf(stderr, "ERROR: Could not allocate pool of %zu x %zu bytes.\n", capacity, obj_size);
+        return 0;
+    }
+
+    p->slot_size = obj_size;
+    p->capacity = capacity;
+    p->in_use = 0;
+    p->peak = 0;
+
+    // Thread every slot onto the free list, lowest address first.
+    p->free_list = NULL;
+    for (i = capacity; i > 0; --i) {
+        void** slot = (void**)(p->slots + (i - 1) * obj_size);
+        *slot = p->free_list;
+        p->free_list = slot;
+    }
+    return 1;
+}
+
+void pool_destroy(pool_t* p) {
+    free(p->slots);
+    p->slots = NULL;
+    p->free_list = NULL;
+    p->capacity = p->in_use = 0;
+}
+
+void* pool_alloc(pool_t* p) {
+    void** slot = (void**) p->free_list;
+    if (slot == NULL) return NULL; // Exhausted. Pools never grow.
+
+    p->free_list = *slot;
+    if (++p->in_use > p->peak) p->peak = p->in_use;
+    return slot;
+}
+
+void pool_free(pool_t* p, void* obj) {
+    if (obj == NULL) return;
+    *(void**) obj = p->free_list;
+    p->free_list = obj;
+    --p->in_use;
+}
+
+pool_stats_t pool_stats(const pool_t* p) {
+    pool_stats_t s;
+    s.slot_size = p->slot_size;
+    s.capacity = p->capacity;
+    s.in_use = p->in_use;
+    s.peak = p->peak;
+    return s;
+}
@@ -0,0 +1,31 @@
+#ifndef CORE_POOL_H
+#define CORE_POOL_H
+
+#include <stddef.h>
+
+// Fixed-size object pool. All slots are allocated up-front and recycled
+// through an intrusive free list, so alloc/free are O(1) and never touch the
+// heap after pool_init().
+typedef struct pool_ {
+    unsigned char* slots;
+    void* free_list;
+    size_t slot_size;
+    size_t capacity;
+    size_t in_use;
+    size_t peak;
+} pool_t;
+
+typedef struct pool_stats_ {
+    size_t slot_size;
+    size_t capacity;
+    size_t in_use;
+    size_t peak;
+} pool_stats_t;
+
+int  pool_init(pool_t* p, size_t obj_size, size_t capacity);
+void pool_destroy(pool_t* p);
+void* pool_alloc(pool_t* p);
+void pool_free(pool_t* p, void* obj);
+pool_stats_t pool_stats(const pool_t* p);
+
+#endif // CORE_POOL_H
@@ -0,0 +1,261 @@
+#ifndef MATH_AFFINE_H
+#define MATH_AFFINE_H
+
+// Header-only 4x3 affine matrices.
+//
+// Model and view matrices built from rotations, scales and translations keep
+// their bottom row at (0, 0, 0, 1), so mat4_t spends a quarter of its floats
+// and of every multiply on constants. mat4x3_t stores the three other rows,
+// each a rotation/scale row followed by its translation:
+//
+//     m[0..3]  = x' from (x, y, z, 1)
+//     m[4..7]  = y'
+//     m[8..11] = z'
+//
+// That's GLSL's mat4x3 uploaded with transpose = GL_TRUE
+// (glUniformMatrix4x3fv), and in buffers, where std430 would pad mat4x3's
+// vec3 columns, it reads as a mat3x4 applied on the right: `v * m`. Either way
+// it's 48 bytes instead of 64.
+//
+// The operations mirror math/fast.h and follow its conventions:
+// mat4x3_mult(out, a, b) is b * a in GL terms, like mat_mult_fast(), and the
+// in-place rotations, scale and translation give the same matrices as the
+// _fast versions on the corresponding mat4_t. A multiply is 9 multiplies and
+// 9 adds where mat_mult_fast() does 16 and 12.
+
+#include "fast.h"
+
+typedef struct mat4x3_ {
+    float m[12];
+} mat4x3_t;
+
+static const mat4x3_t IDENTITY4X3 = {{
+    1, 0, 0, 0,
+    0, 1, 0, 0,
+    0, 0, 1, 0
+}};
+
+// Drops mat4_t's bottom row, which must be (0, 0, 0, 1).
+MATH_INLINE void mat4x3_from_mat4(mat4x3_t* restrict out, const mat4_t* restrict m) {
+    unsigned int row, column;
+
+    for (row = 0; row < 3; ++row)
+        for (column = 0; column < 4; ++column)
+            out->m[row * 4 + column] = m->m[column * 4 + row];
+}
+
+MATH_INLINE void mat4x3_to_mat4(mat4_t* restrict out, const mat4x3_t* restrict m) {
+    unsigned int row, column;
+
+    for (column = 0; column < 4; ++column) {
+        for (row = 0; row < 3; ++row)
+            out->m[column * 4 + row] = m->m[row * 4 + column];
+        out->m[column * 4 + 3] = column == 3 ? 1.0f : 0.0f;
+    }
+}
+
+// out = m1 * m2 in this library's order, b * a in GL terms. `out` must not
+// alias either input.
+MATH_INLINE void mat4x3_mult(mat4x3_t* restrict out,
+                             const mat4x3_t* restrict m1,
+                             const mat4x3_t* restrict m2) {
+#ifdef MATH_FAST_SSE
+    // Each output row is a combination of m1's rows, plus m2's translation.
+    const __m128 r0 = _mm_loadu_ps(&m1->m[0]);
+    const __m128 r1 = _mm_loadu_ps(&m1->m[4]);
+    const __m128 r2 = _mm_loadu_ps(&m1->m[8]);
+    unsigned int row;
+
+    for (row = 0; row < 3; ++row) {
+        const float* b = &m2->m[row * 4];
+        __m128 acc = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(b[0]), r0), _mm_set_ps(b[3], 0, 0, 0));
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(b[1]), r1));
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(b[2]), r2));
+        _mm_storeu_ps(&out->m[row * 4], acc);
+    }
+#else
+    unsigned int row, column;
+
+    for (row = 0; row < 3; ++row) {
+        const float* b = &m2->m[row * 4];
+        for (column = 0; column < 4; ++column)
+            out->m[row * 4 + column] = b[0] * m1->m[column] + b[1] * m1->m[4 + column] + b[2] * m1->m[8 + column]
+                                     + (column == 3 ? b[3] : 0.0f);
+    }
+#endif
+}
+
+// General inverse (any invertible linear part, scales included): the
+// adjugate of the 3x3 part over its determinant, and the translation taken
+// back through it. Returns 0, leaving `out` alone, if `m` is singular.
+MATH_INLINE int mat4x3_inverse(mat4x3_t* restrict out, const mat4x3_t* restrict m) {
+#ifdef MATH_FAST_SSE
+    const __m128 r0 = _mm_loadu_ps(&m->m[0]);
+    const __m128 r1 = _mm_loadu_ps(&m->m[4]);
+    const __m128 r2 = _mm_loadu_ps(&m->m[8]);
+    // Cross products of the rows are the columns of the adjugate; their w
+    // lanes cancel out to 0.
+#define MATH_YZX(v) _mm_shuffle_ps((v), (v), _MM_SHUFFLE(3, 0, 2, 1))
+#define MATH_ZXY(v) _mm_shuffle_ps((v), (v), _MM_SHUFFLE(3, 1, 0, 2))
+#define MATH_CROSS(a, b) _mm_sub_ps(_mm_mul_ps(MATH_YZX(a), MATH_ZXY(b)), _mm_mul_ps(MATH_ZXY(a), MATH_YZX(b)))
+    __m128 c0 = MATH_CROSS(r1, r2), c1 = MATH_CROSS(r2, r0), c2 = MATH_CROSS(r0, r1);
+#undef MATH_CROSS
+#undef MATH_ZXY
+#undef MATH_YZX
+    __m128 d = _mm_mul_ps(r0, c0), t;
+    float det;
+
+    d = _mm_add_ps(d, _mm_movehl_ps(d, d));
+    d = _mm_add_ss(d, _mm_shuffle_ps(d, d, _MM_SHUFFLE(1, 1, 1, 1)));
+    det = _mm_cvtss_f32(d);
+    if (fabsf(det) < 1e-12f) return 0;
+
+    // -inverse(L) * translation, with the translation in the rows' w lanes.
+    t = _mm_mul_ps(c0, _mm_shuffle_ps(r0, r0, _MM_SHUFFLE(3, 3, 3, 3)));
+    t = _mm_add_ps(t, _mm_mul_ps(c1, _mm_shuffle_ps(r1, r1, _MM_SHUFFLE(3, 3, 3, 3))));
+    t = _mm_add_ps(t, _mm_mul_ps(c2, _mm_shuffle_ps(r2, r2, _MM_SHUFFLE(3, 3, 3, 3))));
+    t = _mm_sub_ps(_mm_setzero_ps(), t);
+
+    _MM_TRANSPOSE4_PS(c0, c1, c2, t);
+    d = _mm_set1_ps(1.0f / det);
+    _mm_storeu_ps(&out->m[0], _mm_mul_ps(c0, d));
+    _mm_storeu_ps(&out->m[4], _mm_mul_ps(c1, d));
+    _mm_storeu_ps(&out->m[8], _mm_mul_ps(c2, d));
+    return 1;
+#else
+    const float* a = m->m;
+    float inv[9], det, id;
+    unsigned int row;
+
+    // Cofactors, transposed.
+    inv[0] = a[5] * a[10] - a[6] * a[9];
+    inv[1] = a[2] * a[9] - a[1] * a[10];
+    inv[2] = a[1] * a[6] - a[2] * a[5];
+    inv[3] = a[6] * a[8] - a[4] * a[10];
+    inv[4] = a[0] * a[10] - a[2] * a[8];
+    inv[5] = a[2] * a[4] - a[0] * a[6];
+    inv[6] = a[4] * a[9] - a[5] * a[8];
+    inv[7] = a[1] * a[8] - a[0] * a[9];
+    inv[8] = a[0] * a[5] - a[1] * a[4];
+    det = a[0] * inv[0] + a[1] * inv[3] + a[2] * inv[6];
+    if (fabsf(det) < 1e-12f) return 0;
+
+    id = 1.0f / det;
+    for (row = 0; row < 3; ++row) {
+        float* o = &out->m[row * 4];
+        o[0] = inv[row * 3 + 0] * id;
+        o[1] = inv[row * 3 + 1] * id;
+        o[2] = inv[row * 3 + 2] * id;
+        o[3] = -(o[0] * a[3] + o[1] * a[7] + o[2] * a[11]);
+    }
+    return 1;
+#endif
+}
+
+// Transforms the point `p` (w = 1) and the direction `v` (w = 0).
+MATH_INLINE void mat4x3_transform_point(float out[3], const mat4x3_t* restrict m, const float p[3]) {
+    const float x = p[0], y = p[1], z = p[2];
+    out[0] = m->m[0] * x + m->m[1] * y + m->m[2] * z + m->m[3];
+    out[1] = m->m[4] * x + m->m[5] * y + m->m[6] * z + m->m[7];
+    out[2] = m->m[8] * x + m->m[9] * y + m->m[10] * z + m->m[11];
+}
+
+MATH_INLINE void mat4x3_transform_vector(float out[3], const mat4x3_t* restrict m, const float v[3]) {
+    const float x = v[0], y = v[1], z = v[2];
+    out[0] = m->m[0] * x + m->m[1] * y + m->m[2] * z;
+    out[1] = m->m[4] * x + m->m[5] * y + m->m[6] * z;
+    out[2] = m->m[8] * x + m->m[9] * y + m->m[10] * z;
+}
+
+#ifdef MATH_FAST_SSE
+// The matrix as four columns with their bottom row: (x, y, z, 0) for the
+// linear part and (tx, ty, tz, 1). A point is then
+//     c[0] * x + c[1] * y + c[2] * z + c[3]
+// with w coming out as 1, for transforming many points by one matrix.
+MATH_INLINE void mat4x3_columns(__m128 c[4], const mat4x3_t* restrict m) {
+    __m128 r0 = _mm_loadu_ps(&m->m[0]), r1 = _mm_loadu_ps(&m->m[4]);
+    __m128 r2 = _mm_loadu_ps(&m->m[8]), r3 = _mm_set_ps(1, 0, 0, 0);
+
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+    c[0] = r0;
+    c[1] = r1;
+    c[2] = r2;
+    c[3] = r3;
+}
+#endif
+
+// Transforms `count` points of four floats (w ignored, written as 1).
+MATH_INLINE void mat4x3_transform_points(float* restrict out, const mat4x3_t* restrict m, const float* restrict in,
+                                         size_t count) {
+    size_t i;
+#ifdef MATH_FAST_SSE
+    __m128 c[4];
+
+    mat4x3_columns(c, m);
+    for (i = 0; i < count; ++i) {
+        const float* p = in + i * 4;
+        __m128 acc = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(p[0]), c[0]), c[3]);
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(p[1]), c[1]));
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(p[2]), c[2]));
+        _mm_storeu_ps(out + i * 4, acc);
+    }
+#else
+    for (i = 0; i < count; ++i) {
+        mat4x3_transform_point(out + i * 4, m, in + i * 4);
+        out[i * 4 + 3] = 1.0f;
+    }
+#endif
+}
+
+// In place, as rot_x_fast() and friends: each only recombines two rows.
+
+MATH_INLINE void mat4x3_rot_x(mat4x3_t* restrict m, float angle) {
+    const float s = sinf(angle), c = cosf(angle);
+    unsigned int column;
+
+    for (column = 0; column < 4; ++column) {
+        const float a = m->m[4 + column], b = m->m[8 + column];
+        m->m[4 + column] = a * c + b * s;
+        m->m[8 + column] = b * c - a * s;
+    }
+}
+
+MATH_INLINE void mat4x3_rot_y(mat4x3_t* restrict m, float angle) {
+    const float s = sinf(angle), c = cosf(angle);
+    unsigned int column;
+
+    for (column = 0; column < 4; ++column) {
+        const float a = m->m[column], b = m->m[8 + column];
+        m->m[column] = a * c + b * s;
+        m->m[8 + column] = b * c - a * s;
+    }
+}
+
+MATH_INLINE void mat4x3_rot_z(mat4x3_t* restrict m, float angle) {
+    const float s = sinf(angle), c = cosf(angle);
+    unsigned int column;
+
+    for (column = 0; column < 4; ++column) {
+        const float a = m->m[column], b = m->m[4 + column];
+        m->m[column] = a * c + b * s;
+        m->m[4 + column] = b * c - a * s;
+    }
+}
+
+MATH_INLINE void mat4x3_scale(mat4x3_t* restrict m, float x, float y, float z) {
+    unsigned int column;
+
+    for (column = 0; column < 4; ++column) {
+        m->m[column] *= x;
+        m->m[4 + column] *= y;
+        m->m[8 + column] *= z;
+    }
+}
+
+MATH_INLINE void mat4x3_translate(mat4x3_t* restrict m, float x, float y, float z) {
+    m->m[3] += x;
+    m->m[7] += y;
+    m->m[11] += z;
+}
+
+#endif // MATH_AFFINE_H
@@ -0,0 +1,126 @@
+#ifndef MATH_FAST_H
+#define MATH_FAST_H
+
+// Header-only, inlinable versions of the hot math functions in utils.h.
+//
+// The utils.c versions are the book's: every rotation builds a full matrix
+// and multiplies by it, and mat_mult() returns 64 bytes by value from another
+// translation unit. These write into caller-provided (restrict) storage and
+// only touch the matrix elements each operation actually changes. Results are
+// identical to the utils.c versions up to float rounding.
+
+#include <math.h>
+#include <string.h>
+#include "utils.h"
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define MATH_FAST_SSE 1
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define MATH_INLINE static inline __attribute__((always_inline))
+#else
+#define MATH_INLINE static inline
+#endif
+
+MATH_INLINE float deg2rad_fast(float deg) { return deg * (float)(PI / 180); }
+MATH_INLINE float rad2deg_fast(float rad) { return rad * (float)(180 / PI); }
+
+// out = m1 * m2. `out` must not alias either input.
+MATH_INLINE void mat_mult_fast(mat4_t* restrict out,
+                               const mat4_t* restrict m1,
+                               const mat4_t* restrict m2) {
+#ifdef MATH_FAST_SSE
+    // Each output row is a linear combination of the rows of m2.
+    const __m128 r0 = _mm_loadu_ps(&m2->m[0]);
+    const __m128 r1 = _mm_loadu_ps(&m2->m[4]);
+    const __m128 r2 = _mm_loadu_ps(&m2->m[8]);
+    const __m128 r3 = _mm_loadu_ps(&m2->m[12]);
+    unsigned int row;
+
+    for (row = 0; row < 4; ++row) {
+        const float* a = &m1->m[row * 4];
+        __m128 acc = _mm_mul_ps(_mm_set1_ps(a[0]), r0);
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(a[1]), r1));
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(a[2]), r2));
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(a[3]), r3));
+        _mm_storeu_ps(&out->m[row * 4], acc);
+    }
+#else
+    unsigned int row, column;
+
+    for (row = 0; row < 4; ++row)
+        for (column = 0; column < 4; ++column)
+            out->m[row * 4 + column] =
+                (m1->m[row * 4 + 0] * m2->m[column + 0]) +
+                (m1->m[row * 4 + 1] * m2->m[column + 4]) +
+                (m1->m[row * 4 + 2] * m2->m[column + 8]) +
+                (m1->m[row * 4 + 3] * m2->m[column + 12]);
+#endif
+}
+
+// The rotations below compute m = m * R in place. R only mixes two columns,
+// so only those two columns of each row are recomputed.
+
+MATH_INLINE void rot_x_fast(mat4_t* restrict m, float angle) {
+    const float s = sinf(angle), c = cosf(angle);
+    unsigned int row;
+
+    for (row = 0; row < 4; ++row) {
+        float* r = &m->m[row * 4];
+        const float a = r[1], b = r[2];
+        r[1] = a * c + b * s;
+        r[2] = b * c - a * s;
+    }
+}
+
+MATH_INLINE void rot_y_fast(mat4_t* restrict m, float angle) {
+    const float s = sinf(angle), c = cosf(angle);
+    unsigned int row;
+
+    for (row = 0; row < 4; ++row) {
+        float* r = &m->m[row * 4];
+        const float a = r[0], b = r[2];
+        r[0] = a * c + b * s;
+        r[2] = b * c - a * s;
+    }
+}
+
+MATH_INLINE void rot_z_fast(mat4_t* restrict m, float angle) {
+    const float s = sinf(angle), c = cosf(angle);
+    unsigned int row;
+
+    for (row = 0; row < 4; ++row) {
+        float* r = &m->m[row * 4];
+        const float a = r[0], b = r[1];
+        r[0] = a * c + b * s;
+        r[1] = b * c - a * s;
+    }
+}
+
+MATH_INLINE void scale_fast(mat4_t* restrict m, float x, float y, float z) {
+    unsigned int row;
+
+    for (row = 0; row < 4; ++row) {
+        m->m[row * 4 + 0] *= x;
+        m->m[row * 4 + 1] *= y;
+        m->m[row * 4 + 2] *= z;
+    }
+}
+
+MATH_INLINE void translate_fast(mat4_t* restrict m, float x, float y, float z) {
+    unsigned int row;
+
+    // The translation lives in the bottom row, so each row picks up its w
+    // component times the offset.
+    for (row = 0; row < 4; ++row) {
+        float* r = &m->m[row * 4];
+        const float w = r[3];
+        r[0] += w * x;
+        r[1] += w * y;
+        r[2] += w * z;
+    }
+}
+
+#endif // MATH_FAST_H
@@ -0,0 +1,48 @@
+#include "frustum.h"
+
+void frustum_from_matrix(frustum_t* f, const mat4_t* view_proj) {
+    // mat4_t is column-major as far as GL is concerned, so row r of the clip
+    // matrix is m[r], m[4 + r], m[8 + r], m[12 + r]. Each plane is row 3
+    // plus or minus one of the other rows (Gribb & Hartmann).
+    const float* m = view_proj->m;
+    int p, i;
+
+    for (p = 0; p < 6; ++p) {
+        const int row = p / 2;
+        const float sign = (p % 2 == 0) ? 1.f : -1.f;
+        float len;
+
+        for (i = 0; i < 4; ++i)
+            f->planes[p][i] = m[i * 4 + 3] + sign * m[i * 4 + row];
+
+        len = sqrtf(f->planes[p][0] * f->planes[p][0] +
+                    f->planes[p][1] * f->planes[p][1] +
+                    f->planes[p][2] * f->planes[p][2]);
+        if (len > 0)
+            for (i = 0; i < 4; ++i) f->planes[p][i] /= len;
+    }
+}
+
+int frustum_test_sphere(const frustum_t* f, const float center[3], float radius) {
+    int p;
+    for (p = 0; p < 6; ++p) {
+        const float* pl = f->planes[p];
+        if (pl[0] * center[0] + pl[1] * center[1] + pl[2] * center[2] + pl[3] < -radius)
+            return 0;
+    }
+    return 1;
+}
+
+int frustum_test_aabb(const frustum_t* f, const float min[3], const float max[3]) {
+    int p;
+    for (p = 0; p < 6; ++p) {
+        // Test the corner furthest along the plane normal.
+        const float* pl = f->planes[p];
+        const float x = pl[0] >= 0 ? max[0] : min[0];
+        const float y = pl[1] >= 0 ? max[1] : min[1];
+        const float z = pl[2] >= 0 ? max[2] : min[2];
+        if (pl[0] * x + pl[1] * y + pl[2] * z + pl[3] < 0)
+            return 0;
+    }
+    return 1;
+}
@@ -0,0 +1,29 @@
+#ifndef MATH_FRUSTUM_H
+#define MATH_FRUSTUM_H
+
+#include "utils.h"
+
+// View frustum as six planes (a, b, c, d), normals pointing inwards, so a
+// point p is inside when dot(n, p) + d >= 0 for every plane.
+typedef enum frustum_plane_ {
+    FRUSTUM_LEFT = 0,
+    FRUSTUM_RIGHT,
+    FRUSTUM_BOTTOM,
+    FRUSTUM_TOP,
+    FRUSTUM_NEAR,
+    FRUSTUM_FAR
+} frustum_plane_t;
+
+typedef struct frustum_ {
+    float planes[6][4];
+} frustum_t;
+
+// Extracts the planes from a combined matrix, as built by
+// mat_mult(&view, &projection) (the shader's ProjectionMatrix * ViewMatrix).
+// Planes come out in the space the matrix transforms from.
+void frustum_from_matrix(frustum_t* f, const mat4_t* view_proj);
+
+int frustum_test_sphere(const frustum_t* f, const float center[3], float radius);
+int frustum_test_aabb(const frustum_t* f, const float min[3], const float max[3]);
+
+#endif // MATH_FRUSTUM_H
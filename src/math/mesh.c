@@ -0,0 +1,454 @@
+#include "mesh.h"
+#include "fast.h"
+#include "core/jobs.h"
+#include "core/arena.h"
+#include <stdint.h>
+
+// Vertices per parallel_for range, roughly.
+#define MESH_GRAIN_VERTICES 4096
+
+// Four-wide float lanes: SSE where available, plain arrays otherwise.
+#ifdef MATH_FAST_SSE
+typedef __m128 lane_t;
+MATH_INLINE lane_t lane_load(const float* p) { return _mm_loadu_ps(p); }
+MATH_INLINE lane_t lane_set1(float x) { return _mm_set1_ps(x); }
+MATH_INLINE lane_t lane_add(lane_t a, lane_t b) { return _mm_add_ps(a, b); }
+MATH_INLINE lane_t lane_sub(lane_t a, lane_t b) { return _mm_sub_ps(a, b); }
+MATH_INLINE lane_t lane_mul(lane_t a, lane_t b) { return _mm_mul_ps(a, b); }
+MATH_INLINE lane_t lane_div(lane_t a, lane_t b) { return _mm_div_ps(a, b); }
+MATH_INLINE lane_t lane_sqrt(lane_t a) { return _mm_sqrt_ps(a); }
+#else
+typedef struct lane_ { float v[4]; } lane_t;
+#define LANE_OP(name, expr) \
+    MATH_INLINE lane_t name(lane_t a, lane_t b) { \
+        lane_t r; int k; for (k = 0; k < 4; ++k) r.v[k] = (expr); return r; }
+LANE_OP(lane_add, a.v[k] + b.v[k])
+LANE_OP(lane_sub, a.v[k] - b.v[k])
+LANE_OP(lane_mul, a.v[k] * b.v[k])
+LANE_OP(lane_div, a.v[k] / b.v[k])
+#undef LANE_OP
+MATH_INLINE lane_t lane_load(const float* p) { lane_t r; memcpy(r.v, p, sizeof(r.v)); return r; }
+MATH_INLINE lane_t lane_set1(float x) { lane_t r = {{ x, x, x, x }}; return r; }
+MATH_INLINE lane_t lane_sqrt(lane_t a) {
+    lane_t r; int k; for (k = 0; k < 4; ++k) r.v[k] = sqrtf(a.v[k]); return r;
+}
+#endif
+
+MATH_INLINE lane_t lane_madd(lane_t a, lane_t b, lane_t c) { return lane_add(lane_mul(a, b), c); }
+
+// Writes `count` (1..4) vertices from lanes of positions and unit normals,
+// the normals packed into the colors.
+MATH_INLINE void emit_vertices(vertex_t* restrict out, unsigned int count,
+                               lane_t px, lane_t py, lane_t pz,
+                               lane_t nx, lane_t ny, lane_t nz) {
+    const lane_t half = lane_set1(0.5f);
+    lane_t cx = lane_madd(nx, half, half), cy = lane_madd(ny, half, half), cz = lane_madd(nz, half, half);
+    vertex_t tmp[4];
+    vertex_t* dst = count == 4 ? out : tmp;
+#ifdef MATH_FAST_SSE
+    __m128 pw = _mm_set1_ps(1.0f), cw = _mm_set1_ps(1.0f);
+
+    _MM_TRANSPOSE4_PS(px, py, pz, pw);
+    _MM_TRANSPOSE4_PS(cx, cy, cz, cw);
+    _mm_storeu_ps(dst[0].pos, px); _mm_storeu_ps(dst[0].color, cx);
+    _mm_storeu_ps(dst[1].pos, py); _mm_storeu_ps(dst[1].color, cy);
+    _mm_storeu_ps(dst[2].pos, pz); _mm_storeu_ps(dst[2].color, cz);
+    _mm_storeu_ps(dst[3].pos, pw); _mm_storeu_ps(dst[3].color, cw);
+#else
+    unsigned int k;
+
+    for (k = 0; k < 4; ++k) {
+        dst[k].pos[0] = px.v[k]; dst[k].pos[1] = py.v[k]; dst[k].pos[2] = pz.v[k]; dst[k].pos[3] = 1.0f;
+        dst[k].color[0] = cx.v[k]; dst[k].color[1] = cy.v[k]; dst[k].color[2] = cz.v[k]; dst[k].color[3] = 1.0f;
+    }
+#endif
+    // A partial group goes through `tmp` so that it never writes past the
+    // row, which may belong to another job or lie outside the buffer.
+    if (dst == tmp) memcpy(out, tmp, sizeof(vertex_t) * count);
+}
+
+MATH_INLINE void normalize_lanes(lane_t* x, lane_t* y, lane_t* z) {
+    const lane_t len = lane_sqrt(lane_madd(*x, *x, lane_madd(*y, *y, lane_mul(*z, *z))));
+    *x = lane_div(*x, len);
+    *y = lane_div(*y, len);
+    *z = lane_div(*z, len);
+}
+
+mesh_desc_t mesh_uv_sphere(unsigned int slices, unsigned int stacks, float radius) {
+    mesh_desc_t d = { MESH_UV_SPHERE, slices, stacks, radius, 0, 0 };
+    return d;
+}
+
+mesh_desc_t mesh_ico_sphere(unsigned int subdivisions, float radius) {
+    mesh_desc_t d = { MESH_ICO_SPHERE, subdivisions, 0, radius, 0, 0 };
+    return d;
+}
+
+mesh_desc_t mesh_torus(unsigned int segments, unsigned int tube_segments, float radius, float tube_radius) {
+    mesh_desc_t d = { MESH_TORUS, segments, tube_segments, radius, tube_radius, 0 };
+    return d;
+}
+
+mesh_desc_t mesh_cylinder(unsigned int segments, unsigned int rings, float radius, float height) {
+    mesh_desc_t d = { MESH_CYLINDER, segments, rings, radius, height, 0 };
+    return d;
+}
+
+mesh_desc_t mesh_grid(unsigned int columns, unsigned int rows, float half_size, float amplitude, unsigned int seed) {
+    mesh_desc_t d = { MESH_GRID, columns, rows, half_size, amplitude, seed };
+    return d;
+}
+
+static unsigned int at_least(double x, unsigned int min) {
+    return x > min ? (unsigned int)(x + 0.5) : min;
+}
+
+mesh_desc_t mesh_for_triangles(mesh_shape_t shape, size_t triangles) {
+    const double t = (double)triangles;
+    unsigned int n;
+
+    // Sized to fit a unit cube, like the book's cube.
+    switch (shape) {
+    case MESH_ICO_SPHERE:
+        return mesh_ico_sphere(at_least(sqrt(t / 20), 1), 0.5f);
+    case MESH_TORUS:
+        n = at_least(sqrt(t / 4), 3);
+        return mesh_torus(2 * n, n, 0.35f, 0.15f);
+    case MESH_CYLINDER:
+        n = at_least(sqrt(t / 2), 3);
+        return mesh_cylinder(n, n, 0.35f, 1.0f);
+    case MESH_GRID:
+        n = at_least(sqrt(t / 2), 1);
+        return mesh_grid(n, n, 0.5f, 0.1f, 1);
+    case MESH_UV_SPHERE:
+    default:
+        n = at_least(sqrt(t / 4), 2);
+        return mesh_uv_sphere(2 * n, n, 0.5f);
+    }
+}
+
+int mesh_parse_shape(const char* name, mesh_shape_t* shape) {
+    static const char* NAMES[MESH_SHAPE_COUNT] = { "sphere", "ico", "torus", "cylinder", "grid" };
+    int i;
+
+    for (i = 0; i < MESH_SHAPE_COUNT; ++i) {
+        if (strcmp(name, NAMES[i]) == 0) {
+            *shape = (mesh_shape_t)i;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void mesh_counts(const mesh_desc_t* d, size_t* vertex_count, size_t* index_count) {
+    const size_t s = d->segments, r = d->rings;
+
+    *vertex_count = *index_count = 0;
+    if (d->shape == MESH_ICO_SPHERE) {
+        if (s == 0) return;
+        *vertex_count = 20 * (s + 1) * (s + 2) / 2;
+        *index_count = 20 * s * s * 3;
+    } else if (d->shape < MESH_SHAPE_COUNT) {
+        if (s == 0 || r == 0) return;
+        *vertex_count = (s + 1) * (r + 1);
+        *index_count = s * r * 6;
+    }
+}
+
+float mesh_bounding_radius(const mesh_desc_t* d) {
+    switch (d->shape) {
+    case MESH_TORUS:
+        return d->radius + d->thickness;
+    case MESH_CYLINDER:
+        return sqrtf(d->radius * d->radius + 0.25f * d->thickness * d->thickness);
+    case MESH_GRID:
+        // The height never exceeds 1.5 times the amplitude.
+        return sqrtf(2 * d->radius * d->radius + 2.25f * d->thickness * d->thickness);
+    default:
+        return d->radius;
+    }
+}
+
+// UV sphere, torus, cylinder and terrain: a (columns x rows) vertex grid,
+// one row per parallel_for item. Each row writes its vertices and the two
+// triangles of every quad between it and the next row.
+typedef struct grid_job_ {
+    const mesh_desc_t* d;
+    unsigned int columns, rows;
+    const float* table[5];      // Per column, padded to a multiple of 4.
+    float freq[2], phase[4];    // Terrain.
+    vertex_t* vertices;
+    GLuint* indices;
+    GLuint base_vertex;
+} grid_job_t;
+
+static void grid_row_vertices(const grid_job_t* job, unsigned int j) {
+    const mesh_desc_t* d = job->d;
+    const float v = (float)j / (float)(job->rows - 1);
+    vertex_t* out = job->vertices + (size_t)j * job->columns;
+    const float* const* t = job->table;
+    unsigned int i;
+
+    for (i = 0; i < job->columns; i += 4) {
+        const unsigned int count = job->columns - i < 4 ? job->columns - i : 4;
+        lane_t px, py, pz, nx, ny, nz;
+
+        switch (d->shape) {
+        case MESH_UV_SPHERE: {
+            // Rows run from the north pole to the south pole; the poles are
+            // exact so that their degenerate triangles have no area.
+            const int pole = j == 0 || j + 1 == job->rows;
+            const float phi = (float)PI * v;
+            const lane_t s = lane_set1(pole ? 0 : sinf(phi)), r = lane_set1(d->radius);
+            nx = lane_mul(s, lane_load(t[0] + i));
+            ny = lane_set1(pole ? (j == 0 ? 1 : -1) : cosf(phi));
+            nz = lane_mul(s, lane_load(t[1] + i));
+            px = lane_mul(nx, r); py = lane_mul(ny, r); pz = lane_mul(nz, r);
+            break;
+        }
+        case MESH_TORUS: {
+            const float theta = 2 * (float)PI * v;
+            const lane_t c = lane_set1(cosf(theta));
+            const lane_t ring = lane_set1(d->radius + d->thickness * cosf(theta));
+            const lane_t cu = lane_load(t[0] + i), su = lane_load(t[1] + i);
+            nx = lane_mul(c, cu);
+            ny = lane_set1(-sinf(theta));
+            nz = lane_mul(c, su);
+            px = lane_mul(ring, cu);
+            py = lane_set1(-d->thickness * sinf(theta));
+            pz = lane_mul(ring, su);
+            break;
+        }
+        case MESH_CYLINDER: {
+            const lane_t r = lane_set1(d->radius);
+            nx = lane_load(t[0] + i);
+            ny = lane_set1(0);
+            nz = lane_load(t[1] + i);
+            px = lane_mul(nx, r);
+            py = lane_set1(d->thickness * (0.5f - v));
+            pz = lane_mul(nz, r);
+            break;
+        }
+        case MESH_GRID:
+        default: {
+            // h = A (sin(f1 x + p0) cos(f1 z + p1) + sin(f2 (x + z) + p2 + p3) / 2),
+            // the second wave split into per-column and per-row factors.
+            const float z = d->radius * (2 * v - 1);
+            const float z1 = job->freq[0] * z + job->phase[1], z2 = job->freq[1] * z + job->phase[3];
+            const lane_t sz1 = lane_set1(sinf(z1)), cz1 = lane_set1(cosf(z1));
+            const lane_t sz2 = lane_set1(sinf(z2)), cz2 = lane_set1(cosf(z2));
+            const lane_t a = lane_set1(d->thickness), half = lane_set1(0.5f);
+            const lane_t f1 = lane_set1(job->freq[0]), f2 = lane_set1(job->freq[1]);
+            const lane_t sx1 = lane_load(t[1] + i), cx1 = lane_load(t[2] + i);
+            const lane_t sx2 = lane_load(t[3] + i), cx2 = lane_load(t[4] + i);
+            // sin and cos of the second wave.
+            const lane_t s2 = lane_madd(sx2, cz2, lane_mul(cx2, sz2));
+            const lane_t c2 = lane_sub(lane_mul(cx2, cz2), lane_mul(sx2, sz2));
+            const lane_t d2 = lane_mul(lane_mul(half, f2), c2);
+            const lane_t dhdx = lane_mul(a, lane_madd(lane_mul(f1, cx1), cz1, d2));
+            const lane_t dhdz = lane_mul(a, lane_sub(d2, lane_mul(lane_mul(f1, sx1), sz1)));
+
+            px = lane_load(t[0] + i);
+            py = lane_mul(a, lane_madd(sx1, cz1, lane_mul(half, s2)));
+            pz = lane_set1(z);
+            nx = lane_sub(lane_set1(0), dhdx);
+            ny = lane_set1(1);
+            nz = lane_sub(lane_set1(0), dhdz);
+            normalize_lanes(&nx, &ny, &nz);
+            break;
+        }
+        }
+        emit_vertices(out + i, count, px, py, pz, nx, ny, nz);
+    }
+}
+
+static void grid_rows(size_t begin, size_t end, void* arg) {
+    const grid_job_t* job = (const grid_job_t*) arg;
+    const unsigned int quads = job->columns - 1;
+    size_t j;
+
+    for (j = begin; j < end; ++j) {
+        GLuint* out;
+        GLuint a;
+        unsigned int i;
+
+        grid_row_vertices(job, (unsigned int)j);
+        if (j + 1 == job->rows) continue;
+
+        out = job->indices + j * quads * 6;
+        a = job->base_vertex + (GLuint)(j * job->columns);
+        for (i = 0; i < quads; ++i, ++a, out += 6) {
+            // a b
+            // c d
+            const GLuint b = a + 1, c = a + job->columns, d = c + 1;
+            out[0] = a; out[1] = c; out[2] = b;
+            out[3] = b; out[4] = c; out[5] = d;
+        }
+    }
+}
+
+// A small hash so that every seed gets unrelated phases.
+static float seed_phase(unsigned int seed, unsigned int k) {
+    unsigned int h = seed * 0x9E3779B9u + k * 0x85EBCA6Bu;
+    h ^= h >> 16; h *= 0x7FEB352Du; h ^= h >> 15;
+    return (float)(h & 0xFFFF) / 65536.0f * 2 * (float)PI;
+}
+
+static int generate_grid(const mesh_desc_t* d, vertex_t* vertices, GLuint* indices, GLuint base_vertex) {
+    grid_job_t job;
+    const unsigned int padded = (d->segments + 4) & ~3u;
+    arena_t* scratch = scratch_arena();
+    arena_mark_t mark;
+    float* tables;
+    unsigned int i, k;
+
+    memset(&job, 0, sizeof(job));
+    job.d = d;
+    job.columns = d->segments + 1;
+    job.rows = d->rings + 1;
+    job.vertices = vertices;
+    job.indices = indices;
+    job.base_vertex = base_vertex;
+
+    // Meshes are regenerated every frame in some scenes: the tables come out
+    // of the thread's scratch arena rather than the heap.
+    if (scratch == NULL) return 0;
+    mark = arena_mark(scratch);
+    if ((tables = (float*) arena_alloc(scratch, sizeof(float) * padded * 5, 16)) == NULL) {
+        fprintf(stderr, "ERROR: Could not allocate mesh tables.\n");
+        arena_rewind(scratch, mark);
+        return 0;
+    }
+    memset(tables, 0, sizeof(float) * padded * 5);
+    for (k = 0; k < 5; ++k) job.table[k] = tables + (size_t)k * padded;
+
+    if (d->shape == MESH_GRID) {
+        job.freq[0] = 1.5f * (float)PI / d->radius;
+        job.freq[1] = 4.0f * (float)PI / d->radius;
+        for (k = 0; k < 4; ++k) job.phase[k] = seed_phase(d->seed, k);
+        for (i = 0; i < job.columns; ++i) {
+            const float x = d->radius * (2 * (float)i / (float)d->segments - 1);
+            tables[i] = x;
+            tables[padded + i] = sinf(job.freq[0] * x + job.phase[0]);
+            tables[padded * 2 + i] = cosf(job.freq[0] * x + job.phase[0]);
+            tables[padded * 3 + i] = sinf(job.freq[1] * x + job.phase[2]);
+            tables[padded * 4 + i] = cosf(job.freq[1] * x + job.phase[2]);
+        }
+    } else {
+        // cos u and -sin u: with rows running down the axis this keeps
+        // every shape counter-clockwise from outside.
+        for (i = 0; i < job.columns; ++i) {
+            const double u = 2 * PI * i / d->segments;
+            tables[i] = (float)cos(u);
+            tables[padded + i] = (float)-sin(u);
+        }
+    }
+
+    jobs_parallel_for(job.rows, MESH_GRAIN_VERTICES / job.columns + 1, grid_rows, &job);
+    arena_rewind(scratch, mark);
+    return 1;
+}
+
+// The icosahedron, counter-clockwise from outside.
+static const float ICO_VERTICES[12][3] = {
+    { -1,  1.618034f, 0 }, { 1,  1.618034f, 0 }, { -1, -1.618034f, 0 }, { 1, -1.618034f, 0 },
+    { 0, -1,  1.618034f }, { 0, 1,  1.618034f }, { 0, -1, -1.618034f }, { 0, 1, -1.618034f },
+    {  1.618034f, 0, -1 }, {  1.618034f, 0, 1 }, { -1.618034f, 0, -1 }, { -1.618034f, 0, 1 }
+};
+
+static const unsigned char ICO_FACES[20][3] = {
+    { 0, 11, 5 }, { 0, 5, 1 }, { 0, 1, 7 }, { 0, 7, 10 }, { 0, 10, 11 },
+    { 1, 5, 9 }, { 5, 11, 4 }, { 11, 10, 2 }, { 10, 7, 6 }, { 7, 1, 8 },
+    { 3, 9, 4 }, { 3, 4, 2 }, { 3, 2, 6 }, { 3, 6, 8 }, { 3, 8, 9 },
+    { 4, 9, 5 }, { 2, 4, 11 }, { 6, 2, 10 }, { 8, 6, 7 }, { 9, 8, 1 }
+};
+
+// Face f is a triangle of rows j = 0..n, row j holding vertices
+// a + (b - a) k / n + (c - a) j / n for k = 0..n-j. One parallel_for item
+// per (face, row).
+typedef struct ico_job_ {
+    unsigned int n;
+    float radius;
+    vertex_t* vertices;
+    GLuint* indices;
+    GLuint base_vertex;
+} ico_job_t;
+
+static void ico_rows(size_t begin, size_t end, void* arg) {
+    static const float IOTA[4] = { 0, 1, 2, 3 };
+    const ico_job_t* job = (const ico_job_t*) arg;
+    const size_t n = job->n;
+    const size_t face_vertices = (n + 1) * (n + 2) / 2, face_indices = n * n * 3;
+    const float inv_n = 1.0f / (float)n;
+    const lane_t r = lane_set1(job->radius);
+    size_t item;
+
+    for (item = begin; item < end; ++item) {
+        const size_t f = item / (n + 1), j = item % (n + 1);
+        const size_t row_length = n - j + 1;
+        const size_t first = f * face_vertices + j * (n + 1) - j * (j - 1) / 2;
+        const float* a = ICO_VERTICES[ICO_FACES[f][0]];
+        const float* b = ICO_VERTICES[ICO_FACES[f][1]];
+        const float* c = ICO_VERTICES[ICO_FACES[f][2]];
+        const float fj = (float)j * inv_n;
+        // The start of the row, and the step along it.
+        const lane_t ox = lane_set1(a[0] + (c[0] - a[0]) * fj);
+        const lane_t oy = lane_set1(a[1] + (c[1] - a[1]) * fj);
+        const lane_t oz = lane_set1(a[2] + (c[2] - a[2]) * fj);
+        const lane_t dx = lane_set1((b[0] - a[0]) * inv_n);
+        const lane_t dy = lane_set1((b[1] - a[1]) * inv_n);
+        const lane_t dz = lane_set1((b[2] - a[2]) * inv_n);
+        size_t k;
+
+        for (k = 0; k < row_length; k += 4) {
+            const lane_t fk = lane_add(lane_set1((float)k), lane_load(IOTA));
+            lane_t nx = lane_madd(dx, fk, ox), ny = lane_madd(dy, fk, oy), nz = lane_madd(dz, fk, oz);
+            normalize_lanes(&nx, &ny, &nz);
+            emit_vertices(job->vertices + first + k, row_length - k < 4 ? (unsigned int)(row_length - k) : 4,
+                          lane_mul(nx, r), lane_mul(ny, r), lane_mul(nz, r), nx, ny, nz);
+        }
+
+        if (j < n) {
+            // 2 (n - j) - 1 triangles between rows j and j + 1: one pointing
+            // up per vertex pair, one pointing down between them.
+            GLuint* out = job->indices + f * face_indices + (j * (2 * n - 1) - j * (j - 1)) * 3;
+            const GLuint v0 = job->base_vertex + (GLuint)first;
+            const GLuint v1 = v0 + (GLuint)row_length;
+            GLuint i;
+
+            for (i = 0; i + 1 < row_length; ++i) {
+                *out++ = v0 + i; *out++ = v0 + i + 1; *out++ = v1 + i;
+                if (i + 2 < row_length) {
+                    *out++ = v0 + i + 1; *out++ = v1 + i + 1; *out++ = v1 + i;
+                }
+            }
+        }
+    }
+}
+
+static int generate_ico(const mesh_desc_t* d, vertex_t* vertices, GLuint* indices, GLuint base_vertex) {
+    ico_job_t job;
+
+    job.n = d->segments;
+    job.radius = d->radius;
+    job.vertices = vertices;
+    job.indices = indices;
+    job.base_vertex = base_vertex;
+    jobs_parallel_for(20 * ((size_t)job.n + 1), MESH_GRAIN_VERTICES / (job.n + 1) + 1, ico_rows, &job);
+    return 1;
+}
+
+int mesh_generate(const mesh_desc_t* d, vertex_t* vertices, GLuint* indices, GLuint base_vertex) {
+    size_t vertex_count, index_count;
+
+    mesh_counts(d, &vertex_count, &index_count);
+    if (vertex_count == 0) return 0;
+    if (vertex_count + base_vertex > UINT32_MAX) {
+        fprintf(stderr, "ERROR: Mesh with %lu vertices is too large for 32-bit indices.\n",
+                (unsigned long)vertex_count);
+        return 0;
+    }
+    return d->shape == MESH_ICO_SPHERE
+        ? generate_ico(d, vertices, indices, base_vertex)
+        : generate_grid(d, vertices, indices, base_vertex);
+}
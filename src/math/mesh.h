@@ -0,0 +1,62 @@
+#ifndef MATH_MESH_H
+#define MATH_MESH_H
+
+#include <stddef.h>
+#include "utils.h"
+
+// Procedural meshes for stress scenes.
+//
+// Every shape is an indexed triangle list of vertex_t, counter-clockwise
+// when seen from outside, with the unit normal packed into the color
+// (n * 0.5 + 0.5) for a quick shaded look. mesh_counts() gives the sizes up
+// front so that the output can go straight into mapped GL buffers, and
+// mesh_generate() fills it in parallel on the job system, four vertices at a
+// time with SSE.
+//
+// The UV sphere, torus, cylinder and grid are (segments + 1) x (rings + 1)
+// vertex grids, with the seam duplicated. The icosphere subdivides each of
+// the 20 faces into `segments`^2 triangles and projects them onto the
+// sphere; vertices on face edges are duplicated so faces can be generated
+// independently.
+
+typedef enum mesh_shape_ {
+    MESH_UV_SPHERE = 0,
+    MESH_ICO_SPHERE,
+    MESH_TORUS,
+    MESH_CYLINDER,      // Open-ended tube.
+    MESH_GRID,          // Terrain: height field from a few separable sine waves.
+    MESH_SHAPE_COUNT
+} mesh_shape_t;
+
+typedef struct mesh_desc_ {
+    mesh_shape_t shape;
+    unsigned int segments;  // Around the axis (grid: along x; icosphere: subdivisions per face edge).
+    unsigned int rings;     // Along the axis (grid: along z; unused by the icosphere).
+    float radius;           // Sphere/cylinder radius, torus ring radius, grid half size.
+    float thickness;        // Torus tube radius, cylinder height, terrain amplitude.
+    unsigned int seed;      // Terrain phase.
+} mesh_desc_t;
+
+mesh_desc_t mesh_uv_sphere(unsigned int slices, unsigned int stacks, float radius);
+mesh_desc_t mesh_ico_sphere(unsigned int subdivisions, float radius);
+mesh_desc_t mesh_torus(unsigned int segments, unsigned int tube_segments, float radius, float tube_radius);
+mesh_desc_t mesh_cylinder(unsigned int segments, unsigned int rings, float radius, float height);
+mesh_desc_t mesh_grid(unsigned int columns, unsigned int rows, float half_size, float amplitude, unsigned int seed);
+
+// Tessellates `shape` so it has roughly `triangles` triangles.
+mesh_desc_t mesh_for_triangles(mesh_shape_t shape, size_t triangles);
+
+// "sphere", "ico", "torus", "cylinder" or "grid".
+int  mesh_parse_shape(const char* name, mesh_shape_t* shape);
+
+void mesh_counts(const mesh_desc_t* d, size_t* vertex_count, size_t* index_count);
+
+// Radius of a sphere around the origin containing the mesh.
+float mesh_bounding_radius(const mesh_desc_t* d);
+
+// Writes mesh_counts() vertices and indices; `base_vertex` is added to every
+// index so several meshes can share one buffer. Returns 0 for an empty or
+// unknown mesh.
+int  mesh_generate(const mesh_desc_t* d, vertex_t* vertices, GLuint* indices, GLuint base_vertex);
+
+#endif // MATH_MESH_H
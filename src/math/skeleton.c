@@ -0,0 +1,209 @@
+#include "skeleton.h"
+
+quat_t quat_axis_angle(float x, float y, float z, float angle) {
+    const float len = sqrtf(x * x + y * y + z * z);
+    const float s = len > 0 ? sinf(angle * 0.5f) / len : 0;
+    quat_t q = { x * s, y * s, z * s, cosf(angle * 0.5f) };
+    return q;
+}
+
+quat_t quat_mult(quat_t a, quat_t b) {
+    quat_t q = {
+        a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+        a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+        a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w,
+        a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z
+    };
+    return q;
+}
+
+quat_t quat_slerp(quat_t a, quat_t b, float t) {
+    float d = a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+    float theta, s, wa, wb;
+    quat_t q;
+
+    // q and -q are the same rotation: take the short way round.
+    if (d < 0) {
+        b.x = -b.x; b.y = -b.y; b.z = -b.z; b.w = -b.w;
+        d = -d;
+    }
+    if (d > 0.9995f) {
+        // Nearly parallel: normalized lerp, without dividing by sin(~0).
+        float len;
+        q.x = a.x + (b.x - a.x) * t;
+        q.y = a.y + (b.y - a.y) * t;
+        q.z = a.z + (b.z - a.z) * t;
+        q.w = a.w + (b.w - a.w) * t;
+        len = 1.0f / sqrtf(q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w);
+        q.x *= len; q.y *= len; q.z *= len; q.w *= len;
+        return q;
+    }
+
+    theta = acosf(d);
+    s = 1.0f / sinf(theta);
+    wa = sinf((1 - t) * theta) * s;
+    wb = sinf(t * theta) * s;
+    q.x = wa * a.x + wb * b.x;
+    q.y = wa * a.y + wb * b.y;
+    q.z = wa * a.z + wb * b.z;
+    q.w = wa * a.w + wb * b.w;
+    return q;
+}
+
+void pose_to_mat4x3(mat4x3_t* out, const joint_pose_t* pose) {
+    const quat_t q = pose->rotation;
+    const float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+    const float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+    const float wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+
+    // Row by row: m[row * 4 + column], the translation last.
+    out->m[0] = 1 - 2 * (yy + zz);
+    out->m[1] = 2 * (xy - wz);
+    out->m[2] = 2 * (xz + wy);
+    out->m[3] = pose->translation[0];
+    out->m[4] = 2 * (xy + wz);
+    out->m[5] = 1 - 2 * (xx + zz);
+    out->m[6] = 2 * (yz - wx);
+    out->m[7] = pose->translation[1];
+    out->m[8] = 2 * (xz - wy);
+    out->m[9] = 2 * (yz + wx);
+    out->m[10] = 1 - 2 * (xx + yy);
+    out->m[11] = pose->translation[2];
+}
+
+int skeleton_chain(skeleton_t* s, unsigned int joints, float length) {
+    const quat_t identity = { 0, 0, 0, 1 };
+    unsigned int j;
+
+    memset(s, 0, sizeof(*s));
+    if (joints == 0) return 0;
+    s->parents = (int*) malloc(sizeof(int) * joints);
+    s->bind = (joint_pose_t*) malloc(sizeof(joint_pose_t) * joints);
+    s->inverse_bind = (mat4x3_t*) malloc(sizeof(mat4x3_t) * joints);
+    if (s->parents == NULL || s->bind == NULL || s->inverse_bind == NULL) {
+        fprintf(stderr, "ERROR: Could not allocate a skeleton of %u joints.\n", joints);
+        skeleton_destroy(s);
+        return 0;
+    }
+
+    s->joint_count = joints;
+    for (j = 0; j < joints; ++j) {
+        s->parents[j] = (int)j - 1;
+        s->bind[j].translation[0] = s->bind[j].translation[2] = 0;
+        s->bind[j].translation[1] = j > 0 ? length / joints : 0;
+        s->bind[j].rotation = identity;
+    }
+    skeleton_bind(s);
+    return 1;
+}
+
+void skeleton_destroy(skeleton_t* s) {
+    free(s->parents);
+    free(s->bind);
+    free(s->inverse_bind);
+    memset(s, 0, sizeof(*s));
+}
+
+void skeleton_bind(skeleton_t* s) {
+    unsigned int j;
+
+    // inverse_bind doubles as the world matrices until they're all known.
+    for (j = 0; j < s->joint_count; ++j) {
+        mat4x3_t local;
+        pose_to_mat4x3(&local, &s->bind[j]);
+        if (s->parents[j] < 0) s->inverse_bind[j] = local;
+        else mat4x3_mult(&s->inverse_bind[j], &local, &s->inverse_bind[s->parents[j]]);
+    }
+    for (j = 0; j < s->joint_count; ++j) {
+        const mat4x3_t world = s->inverse_bind[j];
+        mat4x3_inverse(&s->inverse_bind[j], &world); // Rigid, never singular.
+    }
+}
+
+void skeleton_palette(const skeleton_t* s, const joint_pose_t* pose, const mat4x3_t* model,
+                      mat4x3_t* world, mat4x3_t* palette) {
+    unsigned int j;
+
+    // mat4x3_mult(out, a, b) is b * a in GL terms.
+    for (j = 0; j < s->joint_count; ++j) {
+        mat4x3_t local, skin;
+        pose_to_mat4x3(&local, &pose[j]);
+        if (s->parents[j] < 0) world[j] = local;
+        else mat4x3_mult(&world[j], &local, &world[s->parents[j]]);
+
+        mat4x3_mult(&skin, &s->inverse_bind[j], &world[j]);
+        mat4x3_mult(&palette[j], &skin, model);
+    }
+}
+
+int animation_wave(animation_t* a, const skeleton_t* s, unsigned int keys, float duration, float amplitude) {
+    unsigned int j, k;
+
+    memset(a, 0, sizeof(*a));
+    if (keys < 2 || s->joint_count == 0) return 0;
+    a->tracks = (animation_track_t*) malloc(sizeof(animation_track_t) * s->joint_count);
+    a->storage = (keyframe_t*) malloc(sizeof(keyframe_t) * keys * s->joint_count);
+    if (a->tracks == NULL || a->storage == NULL) {
+        fprintf(stderr, "ERROR: Could not allocate an animation of %u joints.\n", s->joint_count);
+        animation_destroy(a);
+        return 0;
+    }
+
+    a->duration = duration;
+    a->joint_count = s->joint_count;
+    for (j = 0; j < s->joint_count; ++j) {
+        animation_track_t* track = &a->tracks[j];
+        track->key_count = keys;
+        track->keys = a->storage + j * keys;
+
+        // The last key repeats the first, so the loop is seamless.
+        for (k = 0; k < keys; ++k) {
+            keyframe_t* key = &track->keys[k];
+            const float phase = 2 * (float)PI * k / (keys - 1);
+            const quat_t swing = quat_axis_angle(0, 0, 1, amplitude * sinf(phase - 0.6f * j));
+            const quat_t sway = quat_axis_angle(1, 0, 0, 0.5f * amplitude * cosf(phase - 0.9f * j));
+
+            key->time = duration * k / (keys - 1);
+            memcpy(key->pose.translation, s->bind[j].translation, sizeof(key->pose.translation));
+            key->pose.rotation = quat_mult(s->bind[j].rotation, quat_mult(swing, sway));
+        }
+    }
+    return 1;
+}
+
+void animation_destroy(animation_t* a) {
+    free(a->tracks);
+    free(a->storage);
+    memset(a, 0, sizeof(*a));
+}
+
+void animation_sample(const animation_t* a, float time, joint_pose_t* pose) {
+    float t = a->duration > 0 ? fmodf(time, a->duration) : 0;
+    unsigned int j;
+
+    if (t < 0) t += a->duration;
+    for (j = 0; j < a->joint_count; ++j) {
+        const animation_track_t* track = &a->tracks[j];
+        unsigned int lo = 0, hi = track->key_count - 1;
+        const keyframe_t *k0, *k1;
+        float f;
+
+        // Last key at or before t.
+        while (lo < hi) {
+            const unsigned int mid = (lo + hi + 1) / 2;
+            if (track->keys[mid].time <= t) lo = mid;
+            else hi = mid - 1;
+        }
+        k0 = &track->keys[lo];
+        if (lo + 1 == track->key_count || track->keys[lo + 1].time <= k0->time) {
+            pose[j] = k0->pose;
+            continue;
+        }
+        k1 = k0 + 1;
+        f = (t - k0->time) / (k1->time - k0->time);
+        pose[j].translation[0] = k0->pose.translation[0] + (k1->pose.translation[0] - k0->pose.translation[0]) * f;
+        pose[j].translation[1] = k0->pose.translation[1] + (k1->pose.translation[1] - k0->pose.translation[1]) * f;
+        pose[j].translation[2] = k0->pose.translation[2] + (k1->pose.translation[2] - k0->pose.translation[2]) * f;
+        pose[j].rotation = quat_slerp(k0->pose.rotation, k1->pose.rotation, f);
+    }
+}
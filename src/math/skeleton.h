@@ -0,0 +1,79 @@
+#ifndef MATH_SKELETON_H
+#define MATH_SKELETON_H
+
+#include "affine.h"
+
+// Joint hierarchies and keyframed animation for skinning.
+//
+// A skeleton is an array of joints whose parents come before them, each with
+// its bind pose relative to its parent. An animation has one track of
+// keyframes per joint; sampling it gives every joint's local pose at a time
+// (looped), interpolating translations linearly and rotations with slerp.
+// skeleton_palette() walks the hierarchy and returns, per joint, the matrix
+// taking a bind-pose vertex to its animated position:
+//
+//     palette[j] = model * world[j] * inverse_bind[j]    (GL order)
+//
+// Poses are rigid (rotation and translation); scale belongs in `model`. All
+// the matrices are affine, and stored as mat4x3_t.
+
+typedef struct quat_ {
+    float x, y, z, w;
+} quat_t;
+
+typedef struct joint_pose_ {
+    float translation[3];
+    quat_t rotation;
+} joint_pose_t;
+
+typedef struct skeleton_ {
+    unsigned int joint_count;
+    int* parents;               // -1 for a root.
+    joint_pose_t* bind;         // Relative to the parent.
+    mat4x3_t* inverse_bind;     // Model space to joint space, in the bind pose.
+} skeleton_t;
+
+typedef struct keyframe_ {
+    float time;
+    joint_pose_t pose;
+} keyframe_t;
+
+typedef struct animation_track_ {
+    unsigned int key_count;     // Sorted by time; at least one.
+    keyframe_t* keys;
+} animation_track_t;
+
+typedef struct animation_ {
+    float duration;             // Seconds; sampling loops over it.
+    unsigned int joint_count;
+    animation_track_t* tracks;
+    keyframe_t* storage;        // All the tracks' keys, in one allocation.
+} animation_t;
+
+quat_t quat_axis_angle(float x, float y, float z, float angle);
+quat_t quat_mult(quat_t a, quat_t b);
+// Shortest-path spherical interpolation.
+quat_t quat_slerp(quat_t a, quat_t b, float t);
+// Rotation by `pose`'s quaternion, then translation.
+void   pose_to_mat4x3(mat4x3_t* out, const joint_pose_t* pose);
+
+// A chain of `joints` joints along +y, `length` long from root to tip.
+int  skeleton_chain(skeleton_t* s, unsigned int joints, float length);
+void skeleton_destroy(skeleton_t* s);
+
+// Recomputes inverse_bind from the bind poses.
+void skeleton_bind(skeleton_t* s);
+
+// `world` is scratch space for joint_count matrices.
+void skeleton_palette(const skeleton_t* s, const joint_pose_t* pose, const mat4x3_t* model,
+                      mat4x3_t* world, mat4x3_t* palette);
+
+// A looping wave down the skeleton: every joint swings about z and x, out of
+// phase with its parent, with `keys` keyframes per joint.
+int  animation_wave(animation_t* a, const skeleton_t* s, unsigned int keys, float duration, float amplitude);
+void animation_destroy(animation_t* a);
+
+// Local poses of every joint at `time`.
+void animation_sample(const animation_t* a, float time, joint_pose_t* pose);
+
+#endif // MATH_SKELETON_H
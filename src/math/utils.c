@@ -1,4 +1,5 @@
 #include "utils.h"
+#include "core/arena.h"
 
 const mat4_t IDENTITY4 = {
     {
@@ -121,6 +122,11 @@ GLuint load_shader(const char* filename, GLenum shader_type) {
     FILE* fd;
     long fsz = -1;
     char* glsl_src;
+    arena_t* scratch = scratch_arena();
+    arena_mark_t mark;
+
+    if (scratch == NULL) return 0;
+    mark = arena_mark(scratch);
 
     if ((fd = fopen(filename, "rb")) != NULL
             && fseek(fd, 0, SEEK_END) == 0
@@ -128,7 +134,8 @@ GLuint load_shader(const char* filename, GLenum shader_type) {
 
         rewind(fd);
 
-        if ((glsl_src = (char*) malloc(fsz + 1)) != NULL) {
+        // The source only needs to live until glShaderSource() copies it.
+        if ((glsl_src = (char*) arena_alloc(scratch, fsz + 1, 1)) != NULL) {
             // Read the shader in
             if (fsz == (long)fread(glsl_src, sizeof(char), fsz, fd)) {
                 glsl_src[fsz] = '\0';
@@ -139,14 +146,13 @@ GLuint load_shader(const char* filename, GLenum shader_type) {
                     glCompileShader(shader_id);
                 } else fprintf(stderr, "ERROR: Could not create shader.\n");
             } else fprintf(stderr, "ERROR: Could not read file.\n");
-            free(glsl_src);
-        } else fprintf(stderr, "ERROR: Could not allocate %d bytes.\n", fsz);
+        } else fprintf(stderr, "ERROR: Could not allocate %ld bytes.\n", fsz);
         fclose(fd);
     } else {
         if (fd != NULL) fclose(fd);
         fprintf(stderr, "ERROR: Could not open file.\n");
     }
 
+    arena_rewind(scratch, mark);
     return shader_id;
 }
-
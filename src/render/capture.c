@@ -0,0 +1,344 @@
+#include "capture.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+static void* encoder_main(void* arg);
+static int oldest_pending(const capture_t* c);
+static void collect(capture_t* c, unsigned int slot);
+static int encode_png(capture_t* c, const capture_frame_t* f);
+static int encode_y4m(capture_t* c, const capture_frame_t* f);
+static int encode_raw(capture_t* c, const capture_frame_t* f);
+
+static size_t frame_bytes(const capture_t* c) { return (size_t)c->width * c->height * 4; }
+
+int capture_parse_format(const char* name, capture_format_t* format) {
+    if (strcmp(name, "png") == 0) *format = CAPTURE_PNG;
+    else if (strcmp(name, "y4m") == 0) *format = CAPTURE_Y4M;
+    else if (strcmp(name, "raw") == 0) *format = CAPTURE_RAW;
+    else return 0;
+    return 1;
+}
+
+int capture_begin(capture_t* c, capture_format_t format, const char* path, int width, int height, int fps) {
+    size_t scratch_size;
+    unsigned int i;
+
+    memset(c, 0, sizeof(*c));
+    c->format = format;
+    c->width = width;
+    c->height = height;
+    c->fps = fps > 0 ? fps : 60;
+    strncpy(c->path, path, CAPTURE_PATH_MAX - 1);
+
+    // Worst case is PNG: filtered rows plus their deflated copy.
+    scratch_size = (size_t)(width * 4 + 1) * height;
+    scratch_size += compressBound((uLong)scratch_size);
+
+    if (!pool_init(&c->frames, sizeof(capture_frame_t), CAPTURE_QUEUE_SIZE)
+            || (c->pixels = (unsigned char*) malloc(frame_bytes(c) * CAPTURE_QUEUE_SIZE)) == NULL
+            || (c->scratch = (unsigned char*) malloc(scratch_size)) == NULL) {
+        fprintf(stderr, "ERROR: Could not allocate capture buffers.\n");
+        pool_destroy(&c->frames);
+        free(c->pixels);
+        return 0;
+    }
+
+    if (format == CAPTURE_Y4M) {
+        if ((c->stream = fopen(path, "wb")) == NULL) {
+            fprintf(stderr, "ERROR: Could not open %s for writing.\n", path);
+            capture_end(c);
+            return 0;
+        }
+        fprintf(c->stream, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", width, height, c->fps);
+    }
+
+    glGenBuffers(CAPTURE_PBO_COUNT, c->pbos);
+    for (i = 0; i < CAPTURE_PBO_COUNT; ++i) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, c->pbos[i]);
+        glBufferData(GL_PIXEL_PACK_BUFFER, frame_bytes(c), NULL, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    pthread_mutex_init(&c->lock, NULL);
+    pthread_cond_init(&c->has_work, NULL);
+    c->running = 1;
+    if (pthread_create(&c->encoder, NULL, encoder_main, c) != 0) {
+        fprintf(stderr, "ERROR: Could not start the capture encoder thread.\n");
+        c->running = 0;
+        capture_end(c);
+        return 0;
+    }
+    return 1;
+}
+
+void capture_frame(capture_t* c) {
+    int slot;
+
+    // Fences signal in submission order, so stop at the first pending one.
+    while ((slot = oldest_pending(c)) >= 0
+            && glClientWaitSync(c->fences[slot], 0, 0) != GL_TIMEOUT_EXPIRED)
+        collect(c, (unsigned int)slot);
+
+    for (slot = 0; slot < CAPTURE_PBO_COUNT; ++slot)
+        if (c->fences[slot] == 0) break;
+    if (slot == CAPTURE_PBO_COUNT) {
+        // The GPU is CAPTURE_PBO_COUNT frames behind: skip this one rather
+        // than wait for a PBO.
+        ++c->stats.frames_skipped;
+        ++c->frame;
+        return;
+    }
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, c->pbos[slot]);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glReadPixels(0, 0, c->width, c->height, GL_RGBA, GL_UNSIGNED_BYTE, (GLvoid*)0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    c->fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    c->slot_frame[slot] = c->frame++;
+    ++c->stats.frames_read;
+}
+
+void capture_end(capture_t* c) {
+    int slot;
+
+    // Collect outstanding readbacks, oldest first; the capture is over, so
+    // waiting is fine here.
+    while ((slot = oldest_pending(c)) >= 0) {
+        glClientWaitSync(c->fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+        collect(c, (unsigned int)slot);
+    }
+
+    if (c->running) {
+        pthread_mutex_lock(&c->lock);
+        c->running = 0;
+        pthread_cond_signal(&c->has_work);
+        pthread_mutex_unlock(&c->lock);
+        pthread_join(c->encoder, NULL);
+        pthread_mutex_destroy(&c->lock);
+        pthread_cond_destroy(&c->has_work);
+    }
+
+    if (c->pbos[0] != 0) glDeleteBuffers(CAPTURE_PBO_COUNT, c->pbos);
+    if (c->stream != NULL) fclose(c->stream);
+    c->stream = NULL;
+
+    pool_destroy(&c->frames);
+    free(c->pixels);
+    free(c->scratch);
+    c->pixels = c->scratch = NULL;
+}
+
+capture_stats_t capture_stats(capture_t* c) {
+    capture_stats_t s;
+    pthread_mutex_lock(&c->lock);
+    s = c->stats;
+    pthread_mutex_unlock(&c->lock);
+    return s;
+}
+
+// The slot of the earliest readback still in flight, or -1.
+static int oldest_pending(const capture_t* c) {
+    int slot, oldest = -1;
+
+    for (slot = 0; slot < CAPTURE_PBO_COUNT; ++slot)
+        if (c->fences[slot] != 0 && (oldest < 0 || c->slot_frame[slot] < c->slot_frame[oldest]))
+            oldest = slot;
+    return oldest;
+}
+
+// Copies a signalled PBO into a pooled frame and queues it for encoding.
+static void collect(capture_t* c, unsigned int slot) {
+    capture_frame_t* f;
+    const void* src;
+
+    glDeleteSync(c->fences[slot]);
+    c->fences[slot] = 0;
+
+    pthread_mutex_lock(&c->lock);
+    if ((f = (capture_frame_t*) pool_alloc(&c->frames)) == NULL) {
+        ++c->stats.frames_dropped; // The encoder is behind; never wait for it.
+        pthread_mutex_unlock(&c->lock);
+        return;
+    }
+    pthread_mutex_unlock(&c->lock);
+
+    // Each pool slot owns the matching stretch of the pixel storage.
+    f->pixels = c->pixels + frame_bytes(c) * (((unsigned char*)f - c->frames.slots) / c->frames.slot_size);
+    f->index = c->slot_frame[slot];
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, c->pbos[slot]);
+    if ((src = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, frame_bytes(c), GL_MAP_READ_BIT)) != NULL) {
+        memcpy(f->pixels, src, frame_bytes(c));
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    pthread_mutex_lock(&c->lock);
+    if (src == NULL) {
+        pool_free(&c->frames, f);
+        ++c->stats.frames_dropped;
+    } else {
+        c->queue[c->head] = f;
+        c->head = (c->head + 1) % CAPTURE_QUEUE_SIZE;
+        ++c->count;
+        pthread_cond_signal(&c->has_work);
+    }
+    pthread_mutex_unlock(&c->lock);
+}
+
+static void* encoder_main(void* arg) {
+    capture_t* c = (capture_t*) arg;
+    capture_frame_t* f;
+    int ok;
+
+    pthread_mutex_lock(&c->lock);
+    while (c->running || c->count > 0) {
+        if (c->count == 0) {
+            pthread_cond_wait(&c->has_work, &c->lock);
+            continue;
+        }
+        f = c->queue[c->tail];
+        c->tail = (c->tail + 1) % CAPTURE_QUEUE_SIZE;
+        --c->count;
+        pthread_mutex_unlock(&c->lock);
+
+        switch (c->format) {
+            case CAPTURE_PNG: ok = encode_png(c, f); break;
+            case CAPTURE_Y4M: ok = encode_y4m(c, f); break;
+            default:          ok = encode_raw(c, f); break;
+        }
+
+        pthread_mutex_lock(&c->lock);
+        pool_free(&c->frames, f);
+        if (ok) ++c->stats.frames_encoded;
+    }
+    pthread_mutex_unlock(&c->lock);
+    return NULL;
+}
+
+static FILE* open_frame_file(const capture_t* c, const capture_frame_t* f, const char* ext) {
+    char name[CAPTURE_PATH_MAX + 32];
+    FILE* fd;
+
+    snprintf(name, sizeof(name), "%s_%06lu.%s", c->path, f->index, ext);
+    if ((fd = fopen(name, "wb")) == NULL)
+        fprintf(stderr, "ERROR: Could not open %s for writing.\n", name);
+    return fd;
+}
+
+static void put_u32_be(unsigned char* p, unsigned long v) {
+    p[0] = (unsigned char)(v >> 24);
+    p[1] = (unsigned char)(v >> 16);
+    p[2] = (unsigned char)(v >> 8);
+    p[3] = (unsigned char)v;
+}
+
+static void write_png_chunk(FILE* fd, const char* type, const unsigned char* data, size_t len) {
+    unsigned char buf[4];
+    uLong crc = crc32(0L, (const Bytef*)type, 4);
+
+    if (len > 0) crc = crc32(crc, data, (uInt)len);
+
+    put_u32_be(buf, (unsigned long)len);
+    fwrite(buf, 1, 4, fd);
+    fwrite(type, 1, 4, fd);
+    if (len > 0) fwrite(data, 1, len, fd);
+    put_u32_be(buf, crc);
+    fwrite(buf, 1, 4, fd);
+}
+
+// RGBA8 PNG, "Up" filter on every row, fastest deflate level.
+static int encode_png(capture_t* c, const capture_frame_t* f) {
+    static const unsigned char SIGNATURE[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    const size_t row = (size_t)c->width * 4, raw_size = (row + 1) * c->height;
+    unsigned char* raw = c->scratch;
+    unsigned char* deflated = c->scratch + raw_size;
+    uLongf deflated_size = compressBound((uLong)raw_size);
+    unsigned char ihdr[13];
+    FILE* fd;
+    int y;
+    size_t x;
+
+    // GL rows are bottom-up, PNG rows top-down.
+    for (y = 0; y < c->height; ++y) {
+        const unsigned char* src = f->pixels + (size_t)(c->height - 1 - y) * row;
+        const unsigned char* above = y > 0 ? src + row : NULL;
+        unsigned char* dst = raw + (size_t)y * (row + 1);
+
+        dst[0] = 2; // Up
+        for (x = 0; x < row; ++x)
+            dst[1 + x] = (unsigned char)(src[x] - (above != NULL ? above[x] : 0));
+    }
+
+    if (compress2(deflated, &deflated_size, raw, (uLong)raw_size, Z_BEST_SPEED) != Z_OK) {
+        fprintf(stderr, "ERROR: Could not compress frame %lu.\n", f->index);
+        return 0;
+    }
+
+    if ((fd = open_frame_file(c, f, "png")) == NULL) return 0;
+
+    put_u32_be(ihdr, (unsigned long)c->width);
+    put_u32_be(ihdr + 4, (unsigned long)c->height);
+    ihdr[8] = 8;    // Bit depth
+    ihdr[9] = 6;    // RGBA
+    ihdr[10] = ihdr[11] = ihdr[12] = 0;
+
+    fwrite(SIGNATURE, 1, sizeof(SIGNATURE), fd);
+    write_png_chunk(fd, "IHDR", ihdr, sizeof(ihdr));
+    write_png_chunk(fd, "IDAT", deflated, deflated_size);
+    write_png_chunk(fd, "IEND", NULL, 0);
+    fclose(fd);
+    return 1;
+}
+
+// One FRAME of planar 4:2:0, BT.601 limited range.
+static int encode_y4m(capture_t* c, const capture_frame_t* f) {
+    const int w = c->width, h = c->height, cw = (w + 1) / 2, ch = (h + 1) / 2;
+    unsigned char* yp = c->scratch;
+    unsigned char* up = yp + (size_t)w * h;
+    unsigned char* vp = up + (size_t)cw * ch;
+    int x, y;
+
+    for (y = 0; y < h; ++y) {
+        const unsigned char* src = f->pixels + (size_t)(h - 1 - y) * w * 4;
+        for (x = 0; x < w; ++x, src += 4)
+            yp[(size_t)y * w + x] = (unsigned char)(((66 * src[0] + 129 * src[1] + 25 * src[2] + 128) >> 8) + 16);
+    }
+
+    // Chroma from the average of each 2x2 block (clamped at odd edges).
+    for (y = 0; y < ch; ++y) {
+        const int y0 = h - 1 - 2 * y, y1 = y0 > 0 ? y0 - 1 : y0;
+        for (x = 0; x < cw; ++x) {
+            const int x0 = 2 * x, x1 = x0 + 1 < w ? x0 + 1 : x0;
+            const unsigned char* p00 = f->pixels + ((size_t)y0 * w + x0) * 4;
+            const unsigned char* p01 = f->pixels + ((size_t)y0 * w + x1) * 4;
+            const unsigned char* p10 = f->pixels + ((size_t)y1 * w + x0) * 4;
+            const unsigned char* p11 = f->pixels + ((size_t)y1 * w + x1) * 4;
+            const int r = (p00[0] + p01[0] + p10[0] + p11[0] + 2) / 4;
+            const int g = (p00[1] + p01[1] + p10[1] + p11[1] + 2) / 4;
+            const int b = (p00[2] + p01[2] + p10[2] + p11[2] + 2) / 4;
+
+            up[(size_t)y * cw + x] = (unsigned char)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+            vp[(size_t)y * cw + x] = (unsigned char)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+        }
+    }
+
+    fputs("FRAME\n", c->stream);
+    return fwrite(c->scratch, 1, (size_t)w * h + 2 * (size_t)cw * ch, c->stream)
+        == (size_t)w * h + 2 * (size_t)cw * ch;
+}
+
+static int encode_raw(capture_t* c, const capture_frame_t* f) {
+    const size_t row = (size_t)c->width * 4;
+    FILE* fd;
+    int y, ok = 1;
+
+    if ((fd = open_frame_file(c, f, "rgba")) == NULL) return 0;
+    for (y = c->height - 1; y >= 0 && ok; --y)
+        ok = fwrite(f->pixels + (size_t)y * row, 1, row, fd) == row;
+    fclose(fd);
+    return ok;
+}
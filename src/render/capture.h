@@ -0,0 +1,85 @@
+#ifndef RENDER_CAPTURE_H
+#define RENDER_CAPTURE_H
+
+#include <stdio.h>
+#include <pthread.h>
+#include <GL/glew.h>
+
+#include "core/pool.h"
+
+// Stall-free frame capture.
+//
+// capture_frame() is called once per frame after rendering and before the
+// swap. It issues an asynchronous glReadPixels into a free PBO of a ring and
+// fences it. Readbacks are mapped, oldest first, by the first call that
+// finds their fence signalled, so with the GPU a frame or two behind a frame
+// is normally mapped two frames later and at the latest CAPTURE_PBO_COUNT
+// frames later, when its PBO is needed again. The pixels are copied into a
+// pooled frame buffer and handed to an encoder thread, which writes PNG
+// files, a Y4M stream (4:2:0, BT.601) or raw RGBA frames.
+//
+// Nothing waits on the GPU or the encoder: if every PBO is still in flight
+// the frame isn't read at all, and if the encoder falls behind a read frame
+// is dropped. Either way the frame is missing from the output (PNG and raw
+// file numbers keep counting) rather than stalling the render loop.
+//
+// Every frame is read at the width and height given to capture_begin(); the
+// caller keeps the framebuffer that size until capture_end() (chapter4 makes
+// its window non-resizable while capturing).
+
+#define CAPTURE_PBO_COUNT 3
+#define CAPTURE_QUEUE_SIZE 8
+#define CAPTURE_PATH_MAX 256
+
+typedef enum capture_format_ {
+    CAPTURE_PNG = 0,    // <path>_000000.png, ...
+    CAPTURE_Y4M,        // A single <path> stream.
+    CAPTURE_RAW         // <path>_000000.rgba, ... (top row first, no header)
+} capture_format_t;
+
+typedef struct capture_stats_ {
+    unsigned long frames_read;      // Readbacks issued.
+    unsigned long frames_encoded;
+    unsigned long frames_dropped;   // Encoder queue was full.
+    unsigned long frames_skipped;   // Not read: every PBO was still in flight.
+} capture_stats_t;
+
+typedef struct capture_frame_ {
+    unsigned char* pixels;          // Bottom row first, RGBA8.
+    unsigned long index;
+} capture_frame_t;
+
+typedef struct capture_ {
+    capture_format_t format;
+    char path[CAPTURE_PATH_MAX];
+    int width, height, fps;
+    FILE* stream;                   // Y4M only.
+
+    GLuint pbos[CAPTURE_PBO_COUNT];
+    GLsync fences[CAPTURE_PBO_COUNT];
+    unsigned long slot_frame[CAPTURE_PBO_COUNT];
+    unsigned long frame;            // Frames passed to capture_frame().
+
+    // Pooled frame buffers queued to the encoder thread.
+    pool_t frames;
+    unsigned char* pixels;
+    capture_frame_t* queue[CAPTURE_QUEUE_SIZE];
+    unsigned int head, tail, count;
+    int running;
+    pthread_t encoder;
+    pthread_mutex_t lock;
+    pthread_cond_t has_work;
+
+    unsigned char* scratch;         // Encoder-owned conversion buffer.
+    capture_stats_t stats;
+} capture_t;
+
+int  capture_begin(capture_t* c, capture_format_t format, const char* path, int width, int height, int fps);
+void capture_frame(capture_t* c);
+void capture_end(capture_t* c);
+capture_stats_t capture_stats(capture_t* c);
+
+// "png", "y4m" or "raw".
+int  capture_parse_format(const char* name, capture_format_t* format);
+
+#endif // RENDER_CAPTURE_H
@@ -0,0 +1,350 @@
+#include "clustered.h"
+#include "core/jobs.h"
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define CLUSTERS_SSE 1
+#endif
+
+#define LIGHT_GRAIN 256
+
+const GLchar* const CLUSTERED_FRAGMENT_SHADER = {
+    "#version 430 core\n"
+    "in vec4 ex_Color;\n"
+    "in vec3 ex_ViewPos;\n"
+    "out vec4 out_Color;\n"
+
+    "struct Light { vec4 position_radius; vec4 color; };\n"
+    "layout(std430, binding=4) readonly buffer ClusterGrid {\n"
+    "  uvec4 dims;\n"
+    "  vec4 depth;\n"
+    "  vec4 viewport;\n"
+    "  uvec2 clusters[];\n"
+    "};\n"
+    "layout(std430, binding=5) readonly buffer Lights { Light lights[]; };\n"
+    "layout(std430, binding=6) readonly buffer LightIndices { uint light_indices[]; };\n"
+
+    "void main(void)\n"
+    "{\n"
+    "  vec3 n = normalize(cross(dFdx(ex_ViewPos), dFdy(ex_ViewPos)));\n"
+    "  float slice = clamp(floor(log(-ex_ViewPos.z) * depth.x + depth.y), 0.0, float(dims.z - 1u));\n"
+    "  vec2 tile = clamp(floor(gl_FragCoord.xy * viewport.zw * vec2(dims.xy)), vec2(0.0), vec2(dims.xy - 1u));\n"
+    "  uvec2 cluster = clusters[(uint(slice) * dims.y + uint(tile.y)) * dims.x + uint(tile.x)];\n"
+
+    "  vec3 light = vec3(0.1);\n"
+    "  for (uint i = 0u; i < cluster.y; ++i) {\n"
+    "    Light l = lights[light_indices[cluster.x + i]];\n"
+    "    vec3 d = l.position_radius.xyz - ex_ViewPos;\n"
+    "    float dist2 = dot(d, d);\n"
+    "    float r2 = l.position_radius.w * l.position_radius.w;\n"
+    "    if (dist2 < r2) {\n"
+    "      float falloff = 1.0 - dist2 / r2;\n"
+    "      light += l.color.rgb * (falloff * falloff * max(dot(n, d * inversesqrt(dist2)), 0.0));\n"
+    "    }\n"
+    "  }\n"
+    "  out_Color = vec4(ex_Color.rgb * light, ex_Color.a);\n"
+    "}\n"
+};
+
+typedef struct assign_job_ {
+    clusters_t* c;
+    const point_light_t* lights;
+    unsigned int count;
+    const mat4_t* view;
+    unsigned long overflows[CLUSTER_Z];
+} assign_job_t;
+
+int clusters_init(clusters_t* c, unsigned int max_lights) {
+    memset(c, 0, sizeof(*c));
+    c->capacity = max_lights;
+    c->view_lights = (point_light_t*) malloc(sizeof(point_light_t) * (max_lights + 4));
+    c->ranges = (cluster_range_t*) malloc(sizeof(cluster_range_t) * (max_lights + 4));
+    c->counts = (GLuint*) calloc(CLUSTER_COUNT, sizeof(GLuint));
+    c->lists = (GLuint*) malloc(sizeof(GLuint) * CLUSTER_COUNT * CLUSTER_MAX_LIGHTS);
+    c->packed = (GLuint*) calloc(CLUSTER_GRID_HEADER_UINTS + 2 * CLUSTER_COUNT, sizeof(GLuint));
+    c->indices = (GLuint*) malloc(sizeof(GLuint) * CLUSTER_COUNT * CLUSTER_MAX_LIGHTS);
+
+    if (max_lights == 0 || max_lights > 0xFFFFFF || c->view_lights == NULL || c->ranges == NULL
+            || c->counts == NULL || c->lists == NULL || c->packed == NULL || c->indices == NULL) {
+        fprintf(stderr, "ERROR: Could not allocate clusters for %u lights.\n", max_lights);
+        clusters_destroy(c);
+        return 0;
+    }
+    return 1;
+}
+
+void clusters_destroy(clusters_t* c) {
+    GLuint buffers[3];
+
+    buffers[0] = c->grid_ssbo;
+    buffers[1] = c->lights_ssbo;
+    buffers[2] = c->indices_ssbo;
+    if (buffers[0] != 0) glDeleteBuffers(3, buffers);
+    free(c->view_lights);
+    free(c->ranges);
+    free(c->counts);
+    free(c->lists);
+    free(c->packed);
+    free(c->indices);
+    memset(c, 0, sizeof(*c));
+}
+
+void clusters_set_projection(clusters_t* c, const mat4_t* projection, int width, int height) {
+    const float* m = projection->m;
+    cluster_grid_header_t header;
+    int i;
+
+    // Inverts m[10] = -(f + n) / (f - n) and m[14] = -2fn / (f - n).
+    c->near_plane = m[14] / (m[10] - 1);
+    c->far_plane = m[14] / (m[10] + 1);
+    c->log_scale = CLUSTER_Z / logf(c->far_plane / c->near_plane);
+    c->log_bias = -logf(c->near_plane) * c->log_scale;
+    c->viewport[0] = (float)width;
+    c->viewport[1] = (float)height;
+
+    // The boundary at NDC x = s is the plane m[0] x + s z = 0 in view space;
+    // its normal points towards the following tiles.
+    for (i = 0; i <= CLUSTER_X; ++i) {
+        const float s = 2 * (float)i / CLUSTER_X - 1;
+        const float len = sqrtf(m[0] * m[0] + s * s);
+        c->planes_x[i][0] = m[0] / len;
+        c->planes_x[i][1] = s / len;
+    }
+    for (i = 0; i <= CLUSTER_Y; ++i) {
+        const float s = 2 * (float)i / CLUSTER_Y - 1;
+        const float len = sqrtf(m[5] * m[5] + s * s);
+        c->planes_y[i][0] = m[5] / len;
+        c->planes_y[i][1] = s / len;
+    }
+
+    header.dims[0] = CLUSTER_X;
+    header.dims[1] = CLUSTER_Y;
+    header.dims[2] = CLUSTER_Z;
+    header.dims[3] = CLUSTER_COUNT;
+    header.depth[0] = c->log_scale;
+    header.depth[1] = c->log_bias;
+    header.depth[2] = c->near_plane;
+    header.depth[3] = c->far_plane;
+    header.viewport[0] = (float)width;
+    header.viewport[1] = (float)height;
+    header.viewport[2] = width > 0 ? 1.f / (float)width : 0;
+    header.viewport[3] = height > 0 ? 1.f / (float)height : 0;
+    memcpy(c->packed, &header, sizeof(header));
+}
+
+static unsigned char depth_slice(const clusters_t* c, float depth) {
+    const float s = floorf(logf(depth) * c->log_scale + c->log_bias);
+    return (unsigned char)(s < 0 ? 0 : s > CLUSTER_Z - 1 ? CLUSTER_Z - 1 : s);
+}
+
+// Turns the number of boundary planes a light is entirely in front of
+// (`ahead`) and entirely behind (`behind`) into a tile range.
+static int tile_range(int ahead, int behind, int tiles, unsigned char* first, unsigned char* last) {
+    if (ahead > tiles || behind > tiles) return 0;  // Beyond the first or last boundary.
+    *first = (unsigned char)(ahead > 0 ? ahead - 1 : 0);
+    *last = (unsigned char)(behind > 0 ? tiles - behind : tiles - 1);
+    return 1;
+}
+
+static void finish_range(const clusters_t* c, const float* v, int ahead_x, int behind_x,
+                         int ahead_y, int behind_y, cluster_range_t* r) {
+    const float depth_near = -v[2] - v[3], depth_far = -v[2] + v[3];
+
+    if (depth_far < c->near_plane || depth_near > c->far_plane
+            || !tile_range(ahead_x, behind_x, CLUSTER_X, &r->x0, &r->x1)
+            || !tile_range(ahead_y, behind_y, CLUSTER_Y, &r->y0, &r->y1)) {
+        r->x0 = 1;
+        r->x1 = 0;
+        return;
+    }
+    r->z0 = depth_slice(c, depth_near > c->near_plane ? depth_near : c->near_plane);
+    r->z1 = depth_slice(c, depth_far < c->far_plane ? depth_far : c->far_plane);
+}
+
+// Moves lights [begin, end) to view space and works out their cluster boxes.
+static void light_ranges(size_t begin, size_t end, void* arg) {
+    assign_job_t* job = (assign_job_t*) arg;
+    clusters_t* c = job->c;
+    const float* m = job->view->m;
+    size_t i;
+
+    for (i = begin; i < end; i += 4) {
+        const unsigned int n = end - i < 4 ? (unsigned int)(end - i) : 4;
+        point_light_t in[4];
+        unsigned int k;
+        int b;
+
+        // A partial group is padded with copies of its first light.
+        memcpy(in, &job->lights[i], sizeof(point_light_t) * n);
+        for (k = n; k < 4; ++k) in[k] = in[0];
+        for (k = 0; k < n; ++k) memcpy(c->view_lights[i + k].color, in[k].color, sizeof(in[k].color));
+#ifdef CLUSTERS_SSE
+        {
+            const __m128 one = _mm_set1_ps(1.f);
+            __m128 x = _mm_loadu_ps(in[0].position), y = _mm_loadu_ps(in[1].position);
+            __m128 z = _mm_loadu_ps(in[2].position), r = _mm_loadu_ps(in[3].position);
+            __m128 vx, vy, vz, neg_r;
+            __m128 ahead_x = _mm_setzero_ps(), behind_x = _mm_setzero_ps();
+            __m128 ahead_y = _mm_setzero_ps(), behind_y = _mm_setzero_ps();
+            float counts[4][4], v[4][4];
+
+            _MM_TRANSPOSE4_PS(x, y, z, r);
+            // Row vector times the view matrix, as mat_mult() composes.
+            vx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(m[0])), _mm_mul_ps(y, _mm_set1_ps(m[4]))),
+                            _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(m[8])), _mm_set1_ps(m[12])));
+            vy = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(m[1])), _mm_mul_ps(y, _mm_set1_ps(m[5]))),
+                            _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(m[9])), _mm_set1_ps(m[13])));
+            vz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(m[2])), _mm_mul_ps(y, _mm_set1_ps(m[6]))),
+                            _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(m[10])), _mm_set1_ps(m[14])));
+            neg_r = _mm_sub_ps(_mm_setzero_ps(), r);
+
+            for (b = 0; b <= CLUSTER_X; ++b) {
+                const __m128 d = _mm_add_ps(_mm_mul_ps(vx, _mm_set1_ps(c->planes_x[b][0])),
+                                            _mm_mul_ps(vz, _mm_set1_ps(c->planes_x[b][1])));
+                ahead_x = _mm_add_ps(ahead_x, _mm_and_ps(_mm_cmpgt_ps(d, r), one));
+                behind_x = _mm_add_ps(behind_x, _mm_and_ps(_mm_cmplt_ps(d, neg_r), one));
+            }
+            for (b = 0; b <= CLUSTER_Y; ++b) {
+                const __m128 d = _mm_add_ps(_mm_mul_ps(vy, _mm_set1_ps(c->planes_y[b][0])),
+                                            _mm_mul_ps(vz, _mm_set1_ps(c->planes_y[b][1])));
+                ahead_y = _mm_add_ps(ahead_y, _mm_and_ps(_mm_cmpgt_ps(d, r), one));
+                behind_y = _mm_add_ps(behind_y, _mm_and_ps(_mm_cmplt_ps(d, neg_r), one));
+            }
+
+            _mm_storeu_ps(counts[0], ahead_x);
+            _mm_storeu_ps(counts[1], behind_x);
+            _mm_storeu_ps(counts[2], ahead_y);
+            _mm_storeu_ps(counts[3], behind_y);
+            _MM_TRANSPOSE4_PS(vx, vy, vz, r);
+            _mm_storeu_ps(v[0], vx);
+            _mm_storeu_ps(v[1], vy);
+            _mm_storeu_ps(v[2], vz);
+            _mm_storeu_ps(v[3], r);
+            for (k = 0; k < n; ++k) {
+                memcpy(c->view_lights[i + k].position, v[k], sizeof(float) * 4);
+                finish_range(c, v[k], (int)counts[0][k], (int)counts[1][k],
+                             (int)counts[2][k], (int)counts[3][k], &c->ranges[i + k]);
+            }
+        }
+#else
+        for (k = 0; k < n; ++k) {
+            const float* p = in[k].position;
+            float v[4];
+            int ahead_x = 0, behind_x = 0, ahead_y = 0, behind_y = 0;
+
+            v[0] = p[0] * m[0] + p[1] * m[4] + p[2] * m[8] + m[12];
+            v[1] = p[0] * m[1] + p[1] * m[5] + p[2] * m[9] + m[13];
+            v[2] = p[0] * m[2] + p[1] * m[6] + p[2] * m[10] + m[14];
+            v[3] = in[k].radius;
+            for (b = 0; b <= CLUSTER_X; ++b) {
+                const float d = v[0] * c->planes_x[b][0] + v[2] * c->planes_x[b][1];
+                ahead_x += d > v[3];
+                behind_x += d < -v[3];
+            }
+            for (b = 0; b <= CLUSTER_Y; ++b) {
+                const float d = v[1] * c->planes_y[b][0] + v[2] * c->planes_y[b][1];
+                ahead_y += d > v[3];
+                behind_y += d < -v[3];
+            }
+            memcpy(c->view_lights[i + k].position, v, sizeof(v));
+            finish_range(c, v, ahead_x, behind_x, ahead_y, behind_y, &c->ranges[i + k]);
+        }
+#endif
+    }
+}
+
+// Builds the lists of depth slices [begin, end). Each slice owns its
+// clusters, so no locking is needed and lights stay in order.
+static void slice_lists(size_t begin, size_t end, void* arg) {
+    assign_job_t* job = (assign_job_t*) arg;
+    clusters_t* c = job->c;
+    size_t z;
+
+    for (z = begin; z < end; ++z) {
+        GLuint* counts = c->counts + z * CLUSTER_X * CLUSTER_Y;
+        unsigned int i;
+
+        memset(counts, 0, sizeof(GLuint) * CLUSTER_X * CLUSTER_Y);
+        for (i = 0; i < job->count; ++i) {
+            const cluster_range_t* r = &c->ranges[i];
+            unsigned int x, y;
+
+            if (r->x0 > r->x1 || z < r->z0 || z > r->z1) continue;
+            for (y = r->y0; y <= r->y1; ++y) {
+                for (x = r->x0; x <= r->x1; ++x) {
+                    const size_t cluster = (z * CLUSTER_Y + y) * CLUSTER_X + x;
+                    const GLuint n = c->counts[cluster];
+                    if (n < CLUSTER_MAX_LIGHTS) {
+                        c->lists[cluster * CLUSTER_MAX_LIGHTS + n] = i;
+                        c->counts[cluster] = n + 1;
+                    } else {
+                        ++job->overflows[z];
+                    }
+                }
+            }
+        }
+    }
+}
+
+static void upload(GLuint buffer, GLsizeiptr size, const void* data) {
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+    // A fresh store every frame, so the upload never waits on last frame's draws.
+    glBufferData(GL_SHADER_STORAGE_BUFFER, size > 0 ? size : 4, size > 0 ? data : NULL, GL_STREAM_DRAW);
+}
+
+void clusters_assign(clusters_t* c, const point_light_t* lights, unsigned int count, const mat4_t* view) {
+    GLuint* grid = c->packed + CLUSTER_GRID_HEADER_UINTS;
+    GLuint total = 0;
+    assign_job_t job;
+    unsigned int i;
+
+    if (count > c->capacity) count = c->capacity;
+    memset(&job, 0, sizeof(job));
+    job.c = c;
+    job.lights = lights;
+    job.count = count;
+    job.view = view;
+
+    jobs_parallel_for(count, LIGHT_GRAIN, light_ranges, &job);
+    jobs_parallel_for(CLUSTER_Z, 1, slice_lists, &job);
+
+    c->stats.visible_lights = 0;
+    for (i = 0; i < count; ++i) c->stats.visible_lights += c->ranges[i].x0 <= c->ranges[i].x1;
+
+    for (i = 0; i < CLUSTER_COUNT; ++i) {
+        const GLuint n = c->counts[i];
+        grid[i * 2] = total;
+        grid[i * 2 + 1] = n;
+        memcpy(c->indices + total, c->lists + (size_t)i * CLUSTER_MAX_LIGHTS, sizeof(GLuint) * n);
+        total += n;
+        if (n > c->stats.max_per_cluster) c->stats.max_per_cluster = n;
+    }
+    for (i = 0; i < CLUSTER_Z; ++i) c->stats.overflows += job.overflows[i];
+
+    c->stats.frames++;
+    c->stats.lights = count;
+    c->stats.indices = total;
+}
+
+void clusters_update(clusters_t* c, const point_light_t* lights, unsigned int count, const mat4_t* view) {
+    const double start = glfwGetTime();
+
+    if (c->grid_ssbo == 0) {
+        glGenBuffers(1, &c->grid_ssbo);
+        glGenBuffers(1, &c->lights_ssbo);
+        glGenBuffers(1, &c->indices_ssbo);
+        exit_on_glError("ERROR: Could not create cluster buffers.");
+    }
+    clusters_assign(c, lights, count, view);
+
+    upload(c->grid_ssbo, sizeof(GLuint) * (CLUSTER_GRID_HEADER_UINTS + 2 * CLUSTER_COUNT), c->packed);
+    upload(c->lights_ssbo, sizeof(point_light_t) * c->stats.lights, c->view_lights);
+    upload(c->indices_ssbo, sizeof(GLuint) * c->stats.indices, c->indices);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CLUSTER_BINDING_GRID, c->grid_ssbo);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CLUSTER_BINDING_LIGHTS, c->lights_ssbo);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CLUSTER_BINDING_INDICES, c->indices_ssbo);
+
+    c->stats.assign_ms += (glfwGetTime() - start) * 1000.;
+}
@@ -0,0 +1,106 @@
+#ifndef RENDER_CLUSTERED_H
+#define RENDER_CLUSTERED_H
+
+#include <GL/glew.h>
+#include "math/utils.h"
+
+// Clustered forward lighting.
+//
+// The view frustum of a proj() matrix is cut into CLUSTER_X x CLUSTER_Y
+// screen tiles and CLUSTER_Z depth slices, spaced exponentially between the
+// near and far planes. Every frame the point lights are moved to view space
+// and assigned to the clusters their sphere overlaps, on the CPU: a first
+// pass works out each light's cluster box four lights at a time with SSE, a
+// second pass builds the per-cluster lists one depth slice per job. The
+// lists are packed and uploaded to shader storage buffers, and
+// CLUSTERED_FRAGMENT_SHADER only loops over the lights of its fragment's
+// cluster, so shading cost follows the local light density rather than the
+// total light count.
+//
+// A cluster holds at most CLUSTER_MAX_LIGHTS lights; further ones are
+// dropped and counted in the stats.
+
+#define CLUSTER_X 16
+#define CLUSTER_Y 9
+#define CLUSTER_Z 24
+#define CLUSTER_COUNT (CLUSTER_X * CLUSTER_Y * CLUSTER_Z)
+#define CLUSTER_MAX_LIGHTS 256
+
+// Shader storage binding points, clear of the ones gpu_scene uses.
+#define CLUSTER_BINDING_GRID 4
+#define CLUSTER_BINDING_LIGHTS 5
+#define CLUSTER_BINDING_INDICES 6
+
+// Matches `Light` in the shader (std430).
+typedef struct point_light_ {
+    float position[3];
+    float radius;
+    float color[4];
+} point_light_t;
+
+// Start of the grid buffer, `ClusterGrid` in the shader (std430), followed
+// by an (offset, count) pair per cluster.
+typedef struct cluster_grid_header_ {
+    GLuint dims[4];
+    float depth[4];     // log_scale, log_bias, near, far
+    float viewport[4];  // width, height, 1 / width, 1 / height
+} cluster_grid_header_t;
+
+#define CLUSTER_GRID_HEADER_UINTS (sizeof(cluster_grid_header_t) / sizeof(GLuint))
+
+typedef struct cluster_range_ {
+    unsigned char x0, x1, y0, y1, z0, z1;   // Inclusive; x0 > x1 when the light is off screen.
+} cluster_range_t;
+
+typedef struct clusters_stats_ {
+    unsigned long frames;
+    unsigned int lights;            // Last frame.
+    unsigned int visible_lights;    // Last frame, overlapping the frustum.
+    unsigned int indices;           // Last frame, light references over all clusters.
+    unsigned int max_per_cluster;   // Peak over all frames.
+    unsigned long overflows;        // References dropped because a cluster was full.
+    double assign_ms;               // Total CPU time assigning and uploading.
+} clusters_stats_t;
+
+typedef struct clusters_ {
+    // From clusters_set_projection().
+    float near_plane, far_plane;
+    float log_scale, log_bias;      // slice = log(depth) * log_scale + log_bias
+    float viewport[2];
+    float planes_x[CLUSTER_X + 1][2];   // Tile boundary planes through the eye:
+    float planes_y[CLUSTER_Y + 1][2];   // (x or y, z) of their unit normals.
+
+    unsigned int capacity;          // Lights.
+    point_light_t* view_lights;
+    cluster_range_t* ranges;
+    GLuint* counts;                 // Per cluster.
+    GLuint* lists;                  // CLUSTER_MAX_LIGHTS per cluster.
+    GLuint* packed;                 // Grid header, then (offset, count) per cluster
+                                    // from CLUSTER_GRID_HEADER_UINTS on.
+    GLuint* indices;                // Packed light lists.
+
+    GLuint grid_ssbo, lights_ssbo, indices_ssbo;
+    clusters_stats_t stats;
+} clusters_t;
+
+// Fragment shader for gpu_scene_init_shaded(): flat normals from screen-space
+// derivatives of the view-space position, vertex colors as albedo.
+extern const GLchar* const CLUSTERED_FRAGMENT_SHADER;
+
+// Only allocates; the GL buffers are created by the first clusters_update().
+int  clusters_init(clusters_t* c, unsigned int max_lights);
+void clusters_destroy(clusters_t* c);
+
+// `projection` as built by proj(); call again on resize.
+void clusters_set_projection(clusters_t* c, const mat4_t* projection, int width, int height);
+
+// Assigns `lights` (world space) to the clusters seen through `view`,
+// uploads the result and binds the buffers for the next draws.
+void clusters_update(clusters_t* c, const point_light_t* lights, unsigned int count, const mat4_t* view);
+
+// The CPU half of clusters_update(), without GL: fills view_lights, ranges,
+// and the packed grid and light lists, and updates the stats other than
+// assign_ms. Needs the job system.
+void clusters_assign(clusters_t* c, const point_light_t* lights, unsigned int count, const mat4_t* view);
+
+#endif // RENDER_CLUSTERED_H
@@ -0,0 +1,392 @@
+#include "counters.h"
+
+#include <string.h>
+
+// Entry points counted while enabled, chained to the previous pointers.
+#define COUNTER_HOOKS(X) \
+    X(UseProgram, PFNGLUSEPROGRAMPROC) \
+    X(BindVertexArray, PFNGLBINDVERTEXARRAYPROC) \
+    X(BufferData, PFNGLBUFFERDATAPROC) \
+    X(BufferSubData, PFNGLBUFFERSUBDATAPROC) \
+    X(Uniform1i, PFNGLUNIFORM1IPROC) \
+    X(Uniform1ui, PFNGLUNIFORM1UIPROC) \
+    X(Uniform1f, PFNGLUNIFORM1FPROC) \
+    X(Uniform2f, PFNGLUNIFORM2FPROC) \
+    X(Uniform3fv, PFNGLUNIFORM3FVPROC) \
+    X(Uniform4fv, PFNGLUNIFORM4FVPROC) \
+    X(UniformMatrix4fv, PFNGLUNIFORMMATRIX4FVPROC) \
+    X(UniformMatrix4x3fv, PFNGLUNIFORMMATRIX4X3FVPROC) \
+    X(DrawArraysInstanced, PFNGLDRAWARRAYSINSTANCEDPROC) \
+    X(DrawElementsInstanced, PFNGLDRAWELEMENTSINSTANCEDPROC) \
+    X(DrawElementsBaseVertex, PFNGLDRAWELEMENTSBASEVERTEXPROC) \
+    X(MultiDrawElementsIndirect, PFNGLMULTIDRAWELEMENTSINDIRECTPROC) \
+    X(MultiDrawElementsIndirectCountARB, PFNGLMULTIDRAWELEMENTSINDIRECTCOUNTARBPROC) \
+    X(DispatchCompute, PFNGLDISPATCHCOMPUTEPROC)
+
+#define DECLARE_PREV(name, type) static type prev_##name = NULL;
+COUNTER_HOOKS(DECLARE_PREV)
+#undef DECLARE_PREV
+
+static const GLenum GPU_TARGETS[GPU_COUNTER_COUNT] = {
+    GL_VERTICES_SUBMITTED_ARB,
+    GL_PRIMITIVES_SUBMITTED_ARB,
+    GL_VERTEX_SHADER_INVOCATIONS_ARB,
+    GL_CLIPPING_INPUT_PRIMITIVES_ARB,
+    GL_CLIPPING_OUTPUT_PRIMITIVES_ARB,
+    GL_FRAGMENT_SHADER_INVOCATIONS_ARB,
+    GL_COMPUTE_SHADER_INVOCATIONS_ARB,
+    GL_TIME_ELAPSED
+};
+
+static const char* GPU_NAMES[GPU_COUNTER_COUNT] = {
+    "vertices_submitted",
+    "primitives_submitted",
+    "vertex_invocations",
+    "clipping_input",
+    "clipping_output",
+    "fragment_invocations",
+    "compute_invocations",
+    "time_ns"
+};
+
+typedef struct counters_slot_ {
+    counters_frame_t f;
+    GLuint queries[GPU_COUNTER_COUNT];
+} counters_slot_t;
+
+static int g_enabled = 0;
+static _Thread_local int t_counting = 0;   // Set on the render thread only.
+
+static frame_counters_t g_current;
+static GLuint g_program, g_vao;             // As last bound through the hooks.
+static unsigned long g_frame;
+static int g_frame_queried;                 // Queries are active for the current frame.
+
+static int g_target_enabled[GPU_COUNTER_COUNT];
+static counters_slot_t g_slots[COUNTERS_FRAMES];
+static unsigned int g_head, g_tail, g_in_flight;
+
+static counters_frame_t g_latest;
+static counters_stats_t g_stats;
+static FILE* g_dump = NULL;
+
+static unsigned long triangles(GLenum mode, GLsizei count) {
+    switch (mode) {
+    case GL_TRIANGLES: return (unsigned long)count / 3;
+    case GL_TRIANGLE_STRIP:
+    case GL_TRIANGLE_FAN: return count > 2 ? (unsigned long)count - 2 : 0;
+    default: return 0;
+    }
+}
+
+void counters_draw(GLenum mode, GLsizei count, GLsizei instances) {
+    if (!t_counting) return;
+    ++g_current.draw_calls;
+    g_current.instances += (unsigned long)instances;
+    g_current.triangles += triangles(mode, count) * (unsigned long)instances;
+}
+
+static void GLAPIENTRY cnt_UseProgram(GLuint program) {
+    prev_UseProgram(program);
+    if (!t_counting) return;
+    ++g_current.program_binds;
+    if (program != g_program) ++g_current.program_switches;
+    g_program = program;
+}
+
+static void GLAPIENTRY cnt_BindVertexArray(GLuint array) {
+    prev_BindVertexArray(array);
+    if (!t_counting) return;
+    ++g_current.vao_binds;
+    if (array != g_vao) ++g_current.vao_switches;
+    g_vao = array;
+}
+
+static void GLAPIENTRY cnt_BufferData(GLenum target, GLsizeiptr size, const void* data, GLenum usage) {
+    prev_BufferData(target, size, data, usage);
+    if (!t_counting || data == NULL) return;
+    ++g_current.buffer_uploads;
+    g_current.buffer_bytes += (size_t)size;
+}
+
+static void GLAPIENTRY cnt_BufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void* data) {
+    prev_BufferSubData(target, offset, size, data);
+    if (!t_counting) return;
+    ++g_current.buffer_uploads;
+    g_current.buffer_bytes += (size_t)size;
+}
+
+#define COUNT_UNIFORM() do { if (t_counting) ++g_current.uniform_updates; } while (0)
+
+static void GLAPIENTRY cnt_Uniform1i(GLint location, GLint v) {
+    prev_Uniform1i(location, v);
+    COUNT_UNIFORM();
+}
+
+static void GLAPIENTRY cnt_Uniform1ui(GLint location, GLuint v) {
+    prev_Uniform1ui(location, v);
+    COUNT_UNIFORM();
+}
+
+static void GLAPIENTRY cnt_Uniform1f(GLint location, GLfloat v) {
+    prev_Uniform1f(location, v);
+    COUNT_UNIFORM();
+}
+
+static void GLAPIENTRY cnt_Uniform2f(GLint location, GLfloat v0, GLfloat v1) {
+    prev_Uniform2f(location, v0, v1);
+    COUNT_UNIFORM();
+}
+
+static void GLAPIENTRY cnt_Uniform3fv(GLint location, GLsizei count, const GLfloat* v) {
+    prev_Uniform3fv(location, count, v);
+    COUNT_UNIFORM();
+}
+
+static void GLAPIENTRY cnt_Uniform4fv(GLint location, GLsizei count, const GLfloat* v) {
+    prev_Uniform4fv(location, count, v);
+    COUNT_UNIFORM();
+}
+
+static void GLAPIENTRY cnt_UniformMatrix4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat* v) {
+    prev_UniformMatrix4fv(location, count, transpose, v);
+    COUNT_UNIFORM();
+}
+
+static void GLAPIENTRY cnt_UniformMatrix4x3fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat* v) {
+    prev_UniformMatrix4x3fv(location, count, transpose, v);
+    COUNT_UNIFORM();
+}
+
+static void GLAPIENTRY cnt_DrawArraysInstanced(GLenum mode, GLint first, GLsizei count, GLsizei instances) {
+    prev_DrawArraysInstanced(mode, first, count, instances);
+    counters_draw(mode, count, instances);
+}
+
+static void GLAPIENTRY cnt_DrawElementsInstanced(GLenum mode, GLsizei count, GLenum type, const void* indices,
+                                                 GLsizei instances) {
+    prev_DrawElementsInstanced(mode, count, type, indices, instances);
+    counters_draw(mode, count, instances);
+}
+
+static void GLAPIENTRY cnt_DrawElementsBaseVertex(GLenum mode, GLsizei count, GLenum type, const void* indices,
+                                                  GLint base_vertex) {
+    prev_DrawElementsBaseVertex(mode, count, type, indices, base_vertex);
+    counters_draw(mode, count, 1);
+}
+
+static void GLAPIENTRY cnt_MultiDrawElementsIndirect(GLenum mode, GLenum type, const void* indirect,
+                                                     GLsizei drawcount, GLsizei stride) {
+    prev_MultiDrawElementsIndirect(mode, type, indirect, drawcount, stride);
+    if (!t_counting) return;
+    ++g_current.draw_calls;
+    ++g_current.indirect_draws;
+}
+
+static void GLAPIENTRY cnt_MultiDrawElementsIndirectCountARB(GLenum mode, GLenum type, const void* indirect,
+                                                             GLintptr drawcount, GLsizei maxdrawcount, GLsizei stride) {
+    prev_MultiDrawElementsIndirectCountARB(mode, type, indirect, drawcount, maxdrawcount, stride);
+    if (!t_counting) return;
+    ++g_current.draw_calls;
+    ++g_current.indirect_draws;
+}
+
+static void GLAPIENTRY cnt_DispatchCompute(GLuint x, GLuint y, GLuint z) {
+    prev_DispatchCompute(x, y, z);
+    if (t_counting) ++g_current.dispatches;
+}
+
+int counters_init(void) {
+    const int stats = GLEW_VERSION_4_6 || GLEW_ARB_pipeline_statistics_query;
+    unsigned int i, c;
+
+    if (g_enabled) return 1;
+
+    memset(&g_current, 0, sizeof(g_current));
+    memset(&g_latest, 0, sizeof(g_latest));
+    memset(&g_stats, 0, sizeof(g_stats));
+    g_frame = 0;
+    g_head = g_tail = g_in_flight = 0;
+    g_frame_queried = 0;
+
+    for (c = 0; c < GPU_COUNTER_COUNT; ++c)
+        g_target_enabled[c] = stats;
+    g_target_enabled[GPU_COMPUTE_INVOCATIONS] = stats && GLEW_VERSION_4_3;
+    g_target_enabled[GPU_TIME_NS] = 1;
+    if (!stats)
+        fprintf(stderr, "WARNING: ARB_pipeline_statistics_query is not supported, only GPU time is measured.\n");
+
+    for (i = 0; i < COUNTERS_FRAMES; ++i)
+        glGenQueries(GPU_COUNTER_COUNT, g_slots[i].queries);
+    if (glGetError() != GL_NO_ERROR) {
+        fprintf(stderr, "ERROR: Could not create counter queries.\n");
+        return 0;
+    }
+
+    glGetIntegerv(GL_CURRENT_PROGRAM, (GLint*)&g_program);
+    glGetIntegerv(GL_VERTEX_ARRAY_BINDING, (GLint*)&g_vao);
+
+#define INSTALL(name, type) \
+    if (__glew##name != NULL) { prev_##name = __glew##name; __glew##name = cnt_##name; }
+    COUNTER_HOOKS(INSTALL)
+#undef INSTALL
+
+    t_counting = 1;
+    g_enabled = 1;
+    return 1;
+}
+
+void counters_shutdown(void) {
+    unsigned int i;
+
+    if (!g_enabled) return;
+
+    // Hooks installed after ours would be lost, so this assumes they are gone.
+#define UNINSTALL(name, type) \
+    if (prev_##name != NULL) { __glew##name = prev_##name; prev_##name = NULL; }
+    COUNTER_HOOKS(UNINSTALL)
+#undef UNINSTALL
+
+    for (i = 0; i < COUNTERS_FRAMES; ++i)
+        glDeleteQueries(GPU_COUNTER_COUNT, g_slots[i].queries);
+
+    t_counting = 0;
+    g_enabled = 0;
+    g_dump = NULL;
+}
+
+int counters_enabled(void) {
+    return g_enabled;
+}
+
+void counters_set_dump(FILE* fh) {
+    g_dump = fh;
+}
+
+static void add_counters(frame_counters_t* sum, const frame_counters_t* c) {
+    sum->draw_calls += c->draw_calls;
+    sum->indirect_draws += c->indirect_draws;
+    sum->instances += c->instances;
+    sum->triangles += c->triangles;
+    sum->dispatches += c->dispatches;
+    sum->program_binds += c->program_binds;
+    sum->program_switches += c->program_switches;
+    sum->vao_binds += c->vao_binds;
+    sum->vao_switches += c->vao_switches;
+    sum->buffer_uploads += c->buffer_uploads;
+    sum->buffer_bytes += c->buffer_bytes;
+    sum->uniform_updates += c->uniform_updates;
+}
+
+static void complete(const counters_frame_t* f) {
+    g_latest = *f;
+    if (f->gpu_valid) ++g_stats.gpu_frames;
+    if (g_dump != NULL) counters_write_json(g_dump, f);
+}
+
+// Collects the oldest frames whose queries have all landed.
+static void poll_queries(void) {
+    while (g_in_flight > 0) {
+        counters_slot_t* s = &g_slots[g_tail];
+        GLuint available = GL_TRUE;
+        unsigned int c;
+
+        for (c = 0; c < GPU_COUNTER_COUNT && available; ++c)
+            if (g_target_enabled[c])
+                glGetQueryObjectuiv(s->queries[c], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) break;
+
+        for (c = 0; c < GPU_COUNTER_COUNT; ++c)
+            if (g_target_enabled[c])
+                glGetQueryObjectui64v(s->queries[c], GL_QUERY_RESULT, &s->f.gpu[c]);
+        s->f.gpu_valid = 1;
+        complete(&s->f);
+
+        g_tail = (g_tail + 1) % COUNTERS_FRAMES;
+        --g_in_flight;
+    }
+}
+
+void counters_begin_frame(void) {
+    unsigned int c;
+
+    if (!g_enabled) return;
+    memset(&g_current, 0, sizeof(g_current));
+
+    poll_queries();
+    g_frame_queried = g_in_flight < COUNTERS_FRAMES;
+    if (!g_frame_queried) {
+        ++g_stats.gpu_skipped;
+        return;
+    }
+
+    for (c = 0; c < GPU_COUNTER_COUNT; ++c)
+        if (g_target_enabled[c]) glBeginQuery(GPU_TARGETS[c], g_slots[g_head].queries[c]);
+}
+
+void counters_end_frame(void) {
+    counters_frame_t f;
+    unsigned int c;
+
+    if (!g_enabled) return;
+
+    memset(&f, 0, sizeof(f));
+    f.frame = g_frame++;
+    f.cpu = g_current;
+    ++g_stats.frames;
+    add_counters(&g_stats.cpu_total, &g_current);
+
+    if (g_frame_queried) {
+        for (c = 0; c < GPU_COUNTER_COUNT; ++c)
+            if (g_target_enabled[c]) glEndQuery(GPU_TARGETS[c]);
+        g_slots[g_head].f = f;
+        g_head = (g_head + 1) % COUNTERS_FRAMES;
+        ++g_in_flight;
+        g_frame_queried = 0;
+    } else {
+        complete(&f);
+    }
+    poll_queries();
+}
+
+frame_counters_t counters_current(void) {
+    return g_current;
+}
+
+counters_frame_t counters_latest(void) {
+    return g_latest;
+}
+
+counters_stats_t counters_stats(void) {
+    return g_stats;
+}
+
+const char* gpu_counter_name(gpu_counter_t c) {
+    return c < GPU_COUNTER_COUNT ? GPU_NAMES[c] : "unknown";
+}
+
+void counters_write_json(FILE* fh, const counters_frame_t* f) {
+    const frame_counters_t* c = &f->cpu;
+    const char* sep = "";
+    unsigned int i;
+
+    fprintf(fh, "{\"frame\":%lu,\"draw_calls\":%lu,\"indirect_draws\":%lu,\"instances\":%lu,"
+                "\"triangles\":%lu,\"dispatches\":%lu,\"program_binds\":%lu,\"program_switches\":%lu,"
+                "\"vao_binds\":%lu,\"vao_switches\":%lu,\"buffer_uploads\":%lu,\"buffer_bytes\":%zu,"
+                "\"uniform_updates\":%lu,\"gpu\":",
+            f->frame, c->draw_calls, c->indirect_draws, c->instances, c->triangles, c->dispatches,
+            c->program_binds, c->program_switches, c->vao_binds, c->vao_switches,
+            c->buffer_uploads, c->buffer_bytes, c->uniform_updates);
+
+    if (!f->gpu_valid) {
+        fputs("null}\n", fh);
+        return;
+    }
+    fputc('{', fh);
+    for (i = 0; i < GPU_COUNTER_COUNT; ++i) {
+        if (!g_target_enabled[i]) continue;
+        fprintf(fh, "%s\"%s\":%llu", sep, GPU_NAMES[i], (unsigned long long)f->gpu[i]);
+        sep = ",";
+    }
+    fputs("}}\n", fh);
+}
@@ -0,0 +1,85 @@
+#ifndef RENDER_COUNTERS_H
+#define RENDER_COUNTERS_H
+
+#include <stdio.h>
+#include <GL/glew.h>
+
+// Per-frame renderer work counters.
+//
+// On the CPU side, the GLEW entry points for draws, program and vertex array
+// binds, buffer uploads and uniform updates are wrapped (chaining to whatever
+// was installed before, e.g. the trace recorder) and counted. GL 1.1 draws are
+// counted through the wrappers in "render/trace_gl.h". Only calls made from
+// the thread that called counters_init() are counted.
+//
+// On the GPU side, each frame is bracketed by ARB_pipeline_statistics_query
+// queries (where supported) and a GL_TIME_ELAPSED query. Their results are
+// polled without blocking a few frames later; if they are still pending when
+// the ring wraps, that frame is reported without GPU numbers.
+
+#define COUNTERS_FRAMES 8
+
+typedef struct frame_counters_ {
+    unsigned long draw_calls;           // Every glDraw* and glMultiDraw* call.
+    unsigned long indirect_draws;       // Multi-draw-indirect calls (their draws are counted by the GPU).
+    unsigned long instances;            // Instances drawn by direct draws.
+    unsigned long triangles;            // Triangles in direct draws.
+    unsigned long dispatches;
+    unsigned long program_binds;
+    unsigned long program_switches;     // Binds that changed the program.
+    unsigned long vao_binds;
+    unsigned long vao_switches;
+    unsigned long buffer_uploads;       // glBufferData / glBufferSubData with data.
+    size_t buffer_bytes;
+    unsigned long uniform_updates;
+} frame_counters_t;
+
+typedef enum gpu_counter_ {
+    GPU_VERTICES_SUBMITTED = 0,
+    GPU_PRIMITIVES_SUBMITTED,
+    GPU_VERTEX_INVOCATIONS,
+    GPU_CLIPPING_INPUT,
+    GPU_CLIPPING_OUTPUT,
+    GPU_FRAGMENT_INVOCATIONS,
+    GPU_COMPUTE_INVOCATIONS,
+    GPU_TIME_NS,
+    GPU_COUNTER_COUNT
+} gpu_counter_t;
+
+typedef struct counters_frame_ {
+    unsigned long frame;
+    frame_counters_t cpu;
+    GLuint64 gpu[GPU_COUNTER_COUNT];
+    int gpu_valid;                      // Zero when the GPU results were skipped.
+} counters_frame_t;
+
+typedef struct counters_stats_ {
+    unsigned long frames;
+    unsigned long gpu_frames;           // Frames with GPU results.
+    unsigned long gpu_skipped;          // Frames whose queries couldn't be issued.
+    frame_counters_t cpu_total;
+} counters_stats_t;
+
+// Call with the context current on the render thread, after glewInit().
+int  counters_init(void);
+void counters_shutdown(void);
+int  counters_enabled(void);
+
+// Writes each completed frame to `fh` as a line of JSON (NULL to stop).
+void counters_set_dump(FILE* fh);
+
+void counters_begin_frame(void);
+void counters_end_frame(void);
+
+// The frame in progress, the latest frame with all its results, and totals.
+frame_counters_t counters_current(void);
+counters_frame_t counters_latest(void);
+counters_stats_t counters_stats(void);
+
+void counters_write_json(FILE* fh, const counters_frame_t* f);
+const char* gpu_counter_name(gpu_counter_t c);
+
+// Counts a GL 1.1 draw, see trace_gl.h.
+void counters_draw(GLenum mode, GLsizei count, GLsizei instances);
+
+#endif // RENDER_COUNTERS_H
@@ -0,0 +1,125 @@
+#include "dynamic_res.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#define TIME_EMA 0.25f      // Weight of a new reading in the full-resolution estimate.
+#define DOWN_RATE 0.5f      // Fraction of the way to the desired scale stepped per frame,
+#define UP_RATE 0.05f       // so drops take a few frames and rises a second or so.
+#define MIN_STEP 0.01f      // Smaller changes aren't worth a new render size.
+
+static GLsizei scaled(GLsizei size, float scale) {
+    const GLsizei s = (GLsizei)(size * scale + 0.5f);
+    return s > 0 ? s : 1;
+}
+
+int dynamic_res_init(dynamic_res_t* d, float budget_ms) {
+    memset(d, 0, sizeof(*d));
+    if (!GLEW_VERSION_3_3 && !GLEW_ARB_timer_query) {
+        fprintf(stderr, "ERROR: Dynamic resolution needs timer queries (GL 3.3 or ARB_timer_query).\n");
+        return 0;
+    }
+    if (budget_ms <= 0) {
+        fprintf(stderr, "ERROR: Invalid dynamic resolution budget %g ms.\n", budget_ms);
+        return 0;
+    }
+
+    d->budget_ms = budget_ms;
+    d->min_scale = DYNAMIC_RES_MIN_SCALE;
+    d->scale = 1.f;
+    d->stats.min_scale = d->stats.max_scale = 1.f;
+
+    glGenQueries(2 * DYNAMIC_RES_FRAMES, &d->queries[0][0]);
+    if (glGetError() != GL_NO_ERROR) {
+        fprintf(stderr, "ERROR: Could not create dynamic resolution queries.\n");
+        return 0;
+    }
+    return 1;
+}
+
+void dynamic_res_destroy(dynamic_res_t* d) {
+    glDeleteQueries(2 * DYNAMIC_RES_FRAMES, &d->queries[0][0]);
+    d->in_flight = 0;
+}
+
+// Folds one frame's GPU time, rendered at `scale`, into the estimate.
+static void measure(dynamic_res_t* d, float ms, float scale) {
+    const float full = ms / (scale * scale);
+
+    if (d->full_ms == 0) {
+        d->full_ms = full;
+        d->gpu_ms = ms;
+    } else {
+        d->full_ms += TIME_EMA * (full - d->full_ms);
+        d->gpu_ms += TIME_EMA * (ms - d->gpu_ms);
+    }
+    ++d->stats.measured;
+    if (ms > d->budget_ms) ++d->stats.over_budget;
+}
+
+// Collects the oldest frames whose end timestamps have landed (the start
+// one was issued before, so it has too).
+static void poll_queries(dynamic_res_t* d) {
+    while (d->in_flight > 0) {
+        GLuint available = GL_FALSE;
+        GLuint64 start, end;
+
+        glGetQueryObjectuiv(d->queries[d->tail][1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) break;
+        glGetQueryObjectui64v(d->queries[d->tail][0], GL_QUERY_RESULT, &start);
+        glGetQueryObjectui64v(d->queries[d->tail][1], GL_QUERY_RESULT, &end);
+        measure(d, end > start ? (float)((end - start) * 1e-6) : 0.f, d->frame_scale[d->tail]);
+
+        d->tail = (d->tail + 1) % DYNAMIC_RES_FRAMES;
+        --d->in_flight;
+    }
+}
+
+static void update_scale(dynamic_res_t* d) {
+    const float aim = d->budget_ms * DYNAMIC_RES_HEADROOM;
+    float desired, rate, step;
+
+    if (d->full_ms <= 0) return;
+    desired = sqrtf(aim / d->full_ms);
+    if (desired < d->min_scale) desired = d->min_scale;
+    if (desired > 1.f) desired = 1.f;
+    if (fabsf(desired - d->scale) < MIN_STEP) return;
+
+    if (d->gpu_ms > d->budget_ms && desired < d->scale) rate = DOWN_RATE;
+    else if (d->gpu_ms < aim && desired > d->scale) rate = UP_RATE;
+    else return;
+
+    step = rate * (desired - d->scale);
+    if (fabsf(step) < MIN_STEP) step = step < 0 ? -MIN_STEP : MIN_STEP;
+    d->scale += step;
+}
+
+void dynamic_res_begin_frame(dynamic_res_t* d, GLsizei width, GLsizei height) {
+    const GLsizei last_width = d->width, last_height = d->height;
+
+    poll_queries(d);
+    update_scale(d);
+
+    d->width = scaled(width, d->scale);
+    d->height = scaled(height, d->scale);
+    if (d->stats.frames > 0 && (d->width != last_width || d->height != last_height)) ++d->stats.changes;
+    ++d->stats.frames;
+    d->stats.scale_sum += d->scale;
+    if (d->scale < d->stats.min_scale) d->stats.min_scale = d->scale;
+    if (d->scale > d->stats.max_scale) d->stats.max_scale = d->scale;
+
+    // All queries still pending: this frame goes unmeasured.
+    d->frame_queried = d->in_flight < DYNAMIC_RES_FRAMES;
+    if (!d->frame_queried) return;
+    d->frame_scale[d->head] = d->scale;
+    glQueryCounter(d->queries[d->head][0], GL_TIMESTAMP);
+}
+
+void dynamic_res_end_frame(dynamic_res_t* d) {
+    if (!d->frame_queried) return;
+    glQueryCounter(d->queries[d->head][1], GL_TIMESTAMP);
+    d->head = (d->head + 1) % DYNAMIC_RES_FRAMES;
+    ++d->in_flight;
+    d->frame_queried = 0;
+}
@@ -0,0 +1,73 @@
+#ifndef RENDER_DYNAMIC_RES_H
+#define RENDER_DYNAMIC_RES_H
+
+#include <GL/glew.h>
+
+// Dynamic resolution: picks, every frame, the fraction of the window's
+// resolution the scene is rendered at so the GPU frame time stays within a
+// budget.
+//
+// Each frame's GPU work is bracketed by a pair of GL_TIMESTAMP queries
+// (unlike GL_TIME_ELAPSED, they may overlap the counters' query), read back
+// without blocking a few frames later. Fragment work goes with the pixel
+// count, so each reading is divided by the square of the scale its frame was
+// rendered at, smoothed into an estimate of the full-resolution time, and the
+// scale that would bring a frame to a time `t` is sqrt(t / full_ms). Frames
+// still in flight when the scale changes so don't throw the estimate off.
+//
+// The governor aims at DYNAMIC_RES_HEADROOM of the budget: it steps down
+// quickly once a frame is over budget, up slowly while frames are under the
+// aim, and holds in between, so it settles instead of hunting. Work that
+// doesn't scale (full-resolution post-processing) inflates the estimate at
+// low scales, which only makes the governor a little more cautious.
+//
+// Callers render into the bottom-left `width` x `height` of a target the
+// size of the window and stretch that over it, so changing the scale never
+// reallocates anything.
+//
+// Typical loop:
+//     dynamic_res_begin_frame(&d, window_width, window_height);
+//     ... render the scene at d.width x d.height, upscale, post ...
+//     dynamic_res_end_frame(&d);
+
+#define DYNAMIC_RES_FRAMES 4            // Frames of queries in flight.
+#define DYNAMIC_RES_MIN_SCALE 0.5f
+#define DYNAMIC_RES_HEADROOM 0.85f      // Scale up only below this much of the budget.
+
+typedef struct dynamic_res_stats_ {
+    unsigned long frames;
+    unsigned long measured;         // Frames whose GPU time was read back,
+    unsigned long over_budget;      // and of those, the ones over budget.
+    unsigned long changes;          // Frames whose render size changed.
+    double scale_sum;
+    float min_scale, max_scale;     // Seen.
+} dynamic_res_stats_t;
+
+typedef struct dynamic_res_ {
+    float budget_ms;
+    float min_scale;
+    float scale;                    // Of each dimension, in [min_scale, 1].
+    float gpu_ms;                   // Smoothed GPU frame time, 0 until measured.
+    float full_ms;                  // The same, estimated at full resolution.
+    GLsizei width, height;          // This frame's render size.
+
+    // Ring of frames in flight, oldest at `tail`: start and end timestamps,
+    // and the scale each frame was rendered at.
+    GLuint queries[DYNAMIC_RES_FRAMES][2];
+    float frame_scale[DYNAMIC_RES_FRAMES];
+    unsigned int head, tail, in_flight;
+    int frame_queried;
+
+    dynamic_res_stats_t stats;
+} dynamic_res_t;
+
+// `budget_ms` of GPU time per frame. Needs timer queries (GL 3.3).
+int  dynamic_res_init(dynamic_res_t* d, float budget_ms);
+void dynamic_res_destroy(dynamic_res_t* d);
+
+// Reads back finished frames, updates the scale and sets this frame's
+// render size for a `width` x `height` window, then starts timing.
+void dynamic_res_begin_frame(dynamic_res_t* d, GLsizei width, GLsizei height);
+void dynamic_res_end_frame(dynamic_res_t* d);
+
+#endif // RENDER_DYNAMIC_RES_H
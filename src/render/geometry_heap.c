@@ -0,0 +1,475 @@
+#include "geometry_heap.h"
+#include "trace.h"
+
+#define REGION_VERTICES 0
+#define REGION_INDICES 1
+
+static int region_init(geometry_region_t* r, GLuint capacity) {
+    memset(r, 0, sizeof(*r));
+    if ((r->free = (geometry_block_t*) malloc(sizeof(geometry_block_t) * 4)) == NULL) return 0;
+    r->free_capacity = 4;
+    r->capacity = capacity;
+    r->free[0].offset = 0;
+    r->free[0].size = capacity;
+    r->free_count = 1;
+    return 1;
+}
+
+static void region_destroy(geometry_region_t* r) {
+    free(r->free);
+    memset(r, 0, sizeof(*r));
+}
+
+// Smallest free block of at least `size`, or -1.
+static int region_find(const geometry_region_t* r, GLuint size) {
+    int best = -1;
+    unsigned int i;
+
+    for (i = 0; i < r->free_count; ++i) {
+        if (r->free[i].size < size) continue;
+        if (best < 0 || r->free[i].size < r->free[best].size) best = (int)i;
+        if (r->free[i].size == size) break;
+    }
+    return best;
+}
+
+static GLuint region_take(geometry_region_t* r, int block, GLuint size) {
+    geometry_block_t* b = &r->free[block];
+    const GLuint offset = b->offset;
+
+    b->offset += size;
+    b->size -= size;
+    if (b->size == 0) {
+        memmove(b, b + 1, sizeof(*b) * (r->free_count - block - 1));
+        --r->free_count;
+    }
+    r->used += size;
+    return offset;
+}
+
+// Inserts a free block at `at`, growing the list if needed.
+static int region_insert(geometry_region_t* r, unsigned int at, GLuint offset, GLuint size) {
+    if (r->free_count == r->free_capacity) {
+        geometry_block_t* grown = (geometry_block_t*) realloc(r->free, sizeof(geometry_block_t) * r->free_capacity * 2);
+        if (grown == NULL) return 0;
+        r->free = grown;
+        r->free_capacity *= 2;
+    }
+    memmove(&r->free[at + 1], &r->free[at], sizeof(geometry_block_t) * (r->free_count - at));
+    r->free[at].offset = offset;
+    r->free[at].size = size;
+    ++r->free_count;
+    return 1;
+}
+
+static void region_release(geometry_region_t* r, GLuint offset, GLuint size) {
+    unsigned int lo = 0, hi = r->free_count;
+    int merged = 0;
+
+    // First block after `offset`.
+    while (lo < hi) {
+        const unsigned int mid = (lo + hi) / 2;
+        if (r->free[mid].offset < offset) lo = mid + 1;
+        else hi = mid;
+    }
+
+    r->used -= size;
+    if (lo > 0 && r->free[lo - 1].offset + r->free[lo - 1].size == offset) {
+        r->free[lo - 1].size += size;
+        merged = 1;
+    }
+    if (lo < r->free_count && offset + size == r->free[lo].offset) {
+        if (merged) {
+            r->free[lo - 1].size += r->free[lo].size;
+            memmove(&r->free[lo], &r->free[lo + 1], sizeof(geometry_block_t) * (r->free_count - lo - 1));
+            --r->free_count;
+        } else {
+            r->free[lo].offset = offset;
+            r->free[lo].size += size;
+        }
+        merged = 1;
+    }
+    // Out of memory here only leaks the hole until the next defrag.
+    if (!merged) region_insert(r, lo, offset, size);
+}
+
+static GLuint region_largest(const geometry_region_t* r) {
+    GLuint largest = 0;
+    unsigned int i;
+
+    for (i = 0; i < r->free_count; ++i)
+        if (r->free[i].size > largest) largest = r->free[i].size;
+    return largest;
+}
+
+static void create_storage(geometry_heap_t* h, GLuint buffer, size_t size) {
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    if (h->immutable) glBufferStorage(GL_COPY_WRITE_BUFFER, size, NULL, GL_DYNAMIC_STORAGE_BIT);
+    else glBufferData(GL_COPY_WRITE_BUFFER, size, NULL, GL_STATIC_DRAW);
+}
+
+static int add_page(geometry_heap_t* h) {
+    geometry_page_t* p = &h->pages[h->page_count];
+
+    if (h->page_count == GEOMETRY_HEAP_MAX_PAGES) return 0;
+    memset(p, 0, sizeof(*p));
+    if (!region_init(&p->vertices, h->page_vertices) || !region_init(&p->indices, h->page_indices)) {
+        fprintf(stderr, "ERROR: Could not allocate a geometry page.\n");
+        region_destroy(&p->vertices);
+        region_destroy(&p->indices);
+        return 0;
+    }
+
+    glGenBuffers(1, &p->vbo);
+    glGenBuffers(1, &p->ibo);
+    create_storage(h, p->vbo, sizeof(vertex_t) * (size_t)h->page_vertices);
+    create_storage(h, p->ibo, sizeof(GLuint) * (size_t)h->page_indices);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    glGenVertexArrays(1, &p->vao);
+    glBindVertexArray(p->vao);
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    glBindBuffer(GL_ARRAY_BUFFER, p->vbo);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(vertex_t), (GLvoid*)0);
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(vertex_t), (GLvoid*)sizeof(((vertex_t*)0)->pos));
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, p->ibo);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    if (glGetError() != GL_NO_ERROR) {
+        fprintf(stderr, "ERROR: Could not create a geometry page of %u vertices / %u indices.\n",
+                h->page_vertices, h->page_indices);
+        glDeleteVertexArrays(1, &p->vao);
+        glDeleteBuffers(1, &p->vbo);
+        glDeleteBuffers(1, &p->ibo);
+        region_destroy(&p->vertices);
+        region_destroy(&p->indices);
+        return 0;
+    }
+    ++h->page_count;
+    return 1;
+}
+
+static geometry_handle_t new_handle(geometry_heap_t* h) {
+    if (h->free_handle_count > 0) return h->free_handles[--h->free_handle_count];
+
+    if (h->mesh_count == h->mesh_capacity) {
+        const unsigned int capacity = h->mesh_capacity > 0 ? h->mesh_capacity * 2 : 64;
+        geometry_mesh_t* meshes = (geometry_mesh_t*) realloc(h->meshes, sizeof(geometry_mesh_t) * capacity);
+        unsigned int* handles;
+
+        if (meshes == NULL) return 0;
+        h->meshes = meshes;
+        if ((handles = (unsigned int*) realloc(h->free_handles, sizeof(unsigned int) * capacity)) == NULL) return 0;
+        h->free_handles = handles;
+        h->mesh_capacity = capacity;
+    }
+    return ++h->mesh_count;
+}
+
+int geometry_heap_init(geometry_heap_t* h, GLuint page_vertices, GLuint page_indices) {
+    memset(h, 0, sizeof(*h));
+    if (page_vertices == 0 || page_indices == 0) return 0;
+    h->page_vertices = page_vertices;
+    h->page_indices = page_indices;
+    h->immutable = !trace_recording() && (GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage);
+    if (!add_page(h)) {
+        geometry_heap_destroy(h);
+        return 0;
+    }
+    return 1;
+}
+
+void geometry_heap_destroy(geometry_heap_t* h) {
+    unsigned int i;
+
+    for (i = 0; i < h->page_count; ++i) {
+        geometry_page_t* p = &h->pages[i];
+        glDeleteVertexArrays(1, &p->vao);
+        glDeleteBuffers(1, &p->vbo);
+        glDeleteBuffers(1, &p->ibo);
+        region_destroy(&p->vertices);
+        region_destroy(&p->indices);
+    }
+    if (h->scratch != 0) glDeleteBuffers(1, &h->scratch);
+    free(h->meshes);
+    free(h->free_handles);
+    free(h->placements);
+    free(h->spare_free);
+    memset(h, 0, sizeof(*h));
+}
+
+geometry_handle_t geometry_heap_alloc(geometry_heap_t* h, GLuint vertex_count, GLuint index_count) {
+    geometry_handle_t handle;
+    geometry_mesh_t* m;
+    unsigned int i;
+    int vb = -1, ib = -1;
+
+    if (vertex_count == 0 || index_count == 0 || vertex_count > h->page_vertices || index_count > h->page_indices) {
+        ++h->stats.failed;
+        return 0;
+    }
+
+    // First page with room for both, else a new one.
+    for (i = 0; i < h->page_count; ++i) {
+        vb = region_find(&h->pages[i].vertices, vertex_count);
+        ib = region_find(&h->pages[i].indices, index_count);
+        if (vb >= 0 && ib >= 0) break;
+    }
+    if (i == h->page_count) {
+        if (!add_page(h)) {
+            ++h->stats.failed;
+            return 0;
+        }
+        vb = ib = 0;
+    }
+    if ((handle = new_handle(h)) == 0) {
+        ++h->stats.failed;
+        return 0;
+    }
+
+    m = &h->meshes[handle - 1];
+    m->page = i;
+    m->vertex_count = vertex_count;
+    m->index_count = index_count;
+    m->first_vertex = region_take(&h->pages[i].vertices, vb, vertex_count);
+    m->first_index = region_take(&h->pages[i].indices, ib, index_count);
+    m->live = 1;
+    ++h->stats.allocs;
+    ++h->stats.meshes;
+    return handle;
+}
+
+void geometry_heap_free(geometry_heap_t* h, geometry_handle_t mesh) {
+    geometry_mesh_t* m;
+
+    if (mesh == 0 || mesh > h->mesh_count || !h->meshes[mesh - 1].live) return;
+    m = &h->meshes[mesh - 1];
+    region_release(&h->pages[m->page].vertices, m->first_vertex, m->vertex_count);
+    region_release(&h->pages[m->page].indices, m->first_index, m->index_count);
+    m->live = 0;
+    h->free_handles[h->free_handle_count++] = mesh;
+    ++h->stats.frees;
+    --h->stats.meshes;
+}
+
+void geometry_heap_upload(geometry_heap_t* h, geometry_handle_t mesh, const vertex_t* vertices, const GLuint* indices) {
+    const geometry_mesh_t* m = &h->meshes[mesh - 1];
+    const geometry_page_t* p = &h->pages[m->page];
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, p->vbo);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, sizeof(vertex_t) * (size_t)m->first_vertex,
+                    sizeof(vertex_t) * (size_t)m->vertex_count, vertices);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, p->ibo);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, sizeof(GLuint) * (size_t)m->first_index,
+                    sizeof(GLuint) * (size_t)m->index_count, indices);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+geometry_handle_t geometry_heap_add(geometry_heap_t* h, const mesh_desc_t* desc, arena_t* arena) {
+    geometry_handle_t mesh = 0;
+    size_t vc, ic;
+    arena_mark_t mark;
+    vertex_t* vertices;
+    GLuint* indices;
+
+    mesh_counts(desc, &vc, &ic);
+    if (vc == 0 || vc > h->page_vertices || ic > h->page_indices) {
+        fprintf(stderr, "ERROR: A mesh of %zu vertices / %zu indices doesn't fit a geometry page.\n", vc, ic);
+        ++h->stats.failed;
+        return 0;
+    }
+    if (arena == NULL && (arena = scratch_arena()) == NULL) return 0;
+
+    // The mesh only needs to live until it's uploaded.
+    mark = arena_mark(arena);
+    vertices = ARENA_NEW(arena, vertex_t, vc);
+    indices = ARENA_NEW(arena, GLuint, ic);
+    if (vertices != NULL && indices != NULL && mesh_generate(desc, vertices, indices, 0)
+            && (mesh = geometry_heap_alloc(h, (GLuint)vc, (GLuint)ic)) != 0)
+        geometry_heap_upload(h, mesh, vertices, indices);
+    arena_rewind(arena, mark);
+    return mesh;
+}
+
+geometry_range_t geometry_heap_range(const geometry_heap_t* h, geometry_handle_t mesh) {
+    const geometry_mesh_t* m = &h->meshes[mesh - 1];
+    geometry_range_t r;
+
+    r.page = m->page;
+    r.index_count = m->index_count;
+    r.first_index = m->first_index;
+    r.base_vertex = (GLint)m->first_vertex;
+    return r;
+}
+
+GLuint geometry_heap_vao(const geometry_heap_t* h, unsigned int page) {
+    return page < h->page_count ? h->pages[page].vao : 0;
+}
+
+void geometry_heap_draw(const geometry_heap_t* h, geometry_handle_t mesh) {
+    const geometry_mesh_t* m = &h->meshes[mesh - 1];
+
+    glDrawElementsBaseVertex(GL_TRIANGLES, (GLsizei)m->index_count, GL_UNSIGNED_INT,
+                             (GLvoid*)(sizeof(GLuint) * (size_t)m->first_index), (GLint)m->first_vertex);
+}
+
+static int compare_placements(const void* a, const void* b) {
+    const GLuint x = ((const geometry_placement_t*)a)->offset, y = ((const geometry_placement_t*)b)->offset;
+    return x < y ? -1 : x > y;
+}
+
+// Copies `size` bytes of `buffer` down from `src` to `dst`. A buffer can't
+// be copied onto an overlapping range of itself, so those go through the
+// scratch buffer.
+static void move_bytes(geometry_heap_t* h, GLuint buffer, size_t src, size_t dst, size_t size) {
+    if (src - dst >= size) {
+        glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, src, dst, size);
+        return;
+    }
+    if (h->scratch == 0) glGenBuffers(1, &h->scratch);
+    if (h->scratch_size < size) {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, h->scratch);
+        glBufferData(GL_COPY_WRITE_BUFFER, size, NULL, GL_STREAM_COPY);
+        h->scratch_size = size;
+    }
+    glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, h->scratch);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, src, 0, size);
+    glBindBuffer(GL_COPY_READ_BUFFER, h->scratch);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, dst, size);
+}
+
+// Slides one page's vertex or index ranges towards the start of the buffer,
+// in offset order, until `moved` reaches `budget`; then rebuilds the free
+// list from the gaps left. The new list goes into the heap's spare one,
+// sized before anything moves, and is swapped in once complete, so a failed
+// allocation leaves the page as it was.
+static int compact_region(geometry_heap_t* h, unsigned int page, int kind, size_t budget, size_t* moved) {
+    geometry_page_t* p = &h->pages[page];
+    geometry_region_t* r = kind == REGION_VERTICES ? &p->vertices : &p->indices;
+    const GLuint buffer = kind == REGION_VERTICES ? p->vbo : p->ibo;
+    const size_t element = kind == REGION_VERTICES ? sizeof(vertex_t) : sizeof(GLuint);
+    geometry_placement_t* placements = h->placements;
+    geometry_block_t* spare;
+    unsigned int count = 0, free_count = 0, capacity, i;
+    GLuint cursor = 0;
+
+    // Nothing to do if the free space is one block at the end.
+    if (r->free_count == 0 || (r->free_count == 1 && r->free[0].offset + r->free[0].size == r->capacity))
+        return 1;
+
+    for (i = 0; i < h->mesh_count; ++i) {
+        const geometry_mesh_t* m = &h->meshes[i];
+        if (!m->live || m->page != page) continue;
+        placements[count].offset = kind == REGION_VERTICES ? m->first_vertex : m->first_index;
+        placements[count].mesh = i + 1;
+        ++count;
+    }
+    qsort(placements, count, sizeof(geometry_placement_t), compare_placements);
+
+    // One gap before each mesh and one after the last, at most.
+    if (h->spare_free_capacity < count + 1) {
+        capacity = h->spare_free_capacity > 0 ? h->spare_free_capacity : 4;
+        while (capacity < count + 1) capacity *= 2;
+        if ((spare = (geometry_block_t*) realloc(h->spare_free, sizeof(geometry_block_t) * capacity)) == NULL)
+            return 0;
+        h->spare_free = spare;
+        h->spare_free_capacity = capacity;
+    }
+
+    for (i = 0; i < count && (budget == 0 || *moved < budget); ++i) {
+        geometry_mesh_t* m = &h->meshes[placements[i].mesh - 1];
+        const GLuint size = kind == REGION_VERTICES ? m->vertex_count : m->index_count;
+
+        if (placements[i].offset > cursor) {
+            move_bytes(h, buffer, element * placements[i].offset, element * cursor, element * size);
+            if (kind == REGION_VERTICES) m->first_vertex = cursor;
+            else m->first_index = cursor;
+            placements[i].offset = cursor;
+            *moved += element * size;
+            ++h->stats.defrag_moves;
+        }
+        cursor += size;
+    }
+
+    // The gaps, in order.
+    spare = h->spare_free;
+    cursor = 0;
+    for (i = 0; i <= count; ++i) {
+        const GLuint end = i < count ? placements[i].offset : r->capacity;
+        if (end > cursor) {
+            spare[free_count].offset = cursor;
+            spare[free_count].size = end - cursor;
+            ++free_count;
+        }
+        if (i < count) {
+            const geometry_mesh_t* m = &h->meshes[placements[i].mesh - 1];
+            cursor = end + (kind == REGION_VERTICES ? m->vertex_count : m->index_count);
+        }
+    }
+
+    h->spare_free = r->free;
+    capacity = h->spare_free_capacity;
+    h->spare_free_capacity = r->free_capacity;
+    r->free = spare;
+    r->free_capacity = capacity;
+    r->free_count = free_count;
+    return 1;
+}
+
+size_t geometry_heap_defrag(geometry_heap_t* h, size_t budget) {
+    size_t moved = 0;
+    unsigned int page;
+    int kind;
+
+    if (h->stats.meshes == 0) return 0;
+    if (h->placement_capacity < h->stats.meshes) {
+        geometry_placement_t* placements =
+            (geometry_placement_t*) realloc(h->placements, sizeof(geometry_placement_t) * h->stats.meshes);
+        if (placements == NULL) return 0;
+        h->placements = placements;
+        h->placement_capacity = h->stats.meshes;
+    }
+
+    for (page = 0; page < h->page_count && (budget == 0 || moved < budget); ++page) {
+        for (kind = REGION_VERTICES; kind <= REGION_INDICES && (budget == 0 || moved < budget); ++kind) {
+            if (!compact_region(h, page, kind, budget, &moved)) {
+                fprintf(stderr, "ERROR: Could not allocate a geometry page's free list.\n");
+                break;
+            }
+        }
+    }
+    if (moved > 0) {
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+    h->stats.defrag_bytes += moved;
+    return moved;
+}
+
+geometry_heap_stats_t geometry_heap_stats(const geometry_heap_t* h) {
+    geometry_heap_stats_t st = h->stats;
+    size_t largest_vertices = 0, largest_indices = 0, free_vertices = 0, free_indices = 0;
+    unsigned int i;
+
+    st.pages = h->page_count;
+    st.capacity_bytes = (sizeof(vertex_t) * (size_t)h->page_vertices + sizeof(GLuint) * (size_t)h->page_indices)
+                      * h->page_count;
+    st.used_bytes = 0;
+    for (i = 0; i < h->page_count; ++i) {
+        const geometry_page_t* p = &h->pages[i];
+        st.used_bytes += sizeof(vertex_t) * (size_t)p->vertices.used + sizeof(GLuint) * (size_t)p->indices.used;
+        free_vertices += p->vertices.capacity - p->vertices.used;
+        free_indices += p->indices.capacity - p->indices.used;
+        largest_vertices += region_largest(&p->vertices);
+        largest_indices += region_largest(&p->indices);
+    }
+    st.vertex_fragmentation = free_vertices > 0 ? 1.0f - (float)largest_vertices / free_vertices : 0.f;
+    st.index_fragmentation = free_indices > 0 ? 1.0f - (float)largest_indices / free_indices : 0.f;
+    return st;
+}
@@ -0,0 +1,138 @@
+#ifndef RENDER_GEOMETRY_HEAP_H
+#define RENDER_GEOMETRY_HEAP_H
+
+#include <GL/glew.h>
+#include "math/mesh.h"
+#include "core/arena.h"
+
+// Many meshes suballocated from a few large buffers.
+//
+// The heap is a list of pages, each an immutable (glBufferStorage) vertex
+// buffer of vertex_t and index buffer of GLuint indices, with its own VAO
+// (attribute 0 the position, 1 the color, like the book's cube). A mesh
+// takes a range of vertices and a range of indices out of one page: its
+// indices are relative to its first vertex and it is drawn with
+// glDrawElementsBaseVertex, so thousands of meshes need one VAO bind per
+// page instead of one per mesh. Pages are added when no page has room, up
+// to GEOMETRY_HEAP_MAX_PAGES.
+//
+// Free space in each buffer is a list of blocks sorted by offset: allocation
+// takes the best fit and freeing coalesces with the neighbours. Freed holes
+// are closed by geometry_heap_defrag(), which slides meshes down with
+// glCopyBufferSubData a bounded number of bytes at a time, so it can run a
+// little every frame. Moving a mesh changes its range: look ranges up with
+// geometry_heap_range() when drawing rather than keeping them.
+//
+// While a GL trace is recording, pages are created with glBufferData (the
+// recorder doesn't know immutable storage); they're used the same way.
+
+#define GEOMETRY_HEAP_MAX_PAGES 16
+
+typedef unsigned int geometry_handle_t;     // 0 is never a mesh.
+
+typedef struct geometry_block_ {
+    GLuint offset, size;                    // In elements.
+} geometry_block_t;
+
+// Free space in one buffer.
+typedef struct geometry_region_ {
+    GLuint capacity, used;
+    geometry_block_t* free;                 // Sorted by offset, never adjacent.
+    unsigned int free_count, free_capacity;
+} geometry_region_t;
+
+typedef struct geometry_page_ {
+    GLuint vao, vbo, ibo;
+    geometry_region_t vertices, indices;
+} geometry_page_t;
+
+typedef struct geometry_mesh_ {
+    unsigned int page;
+    GLuint first_vertex, vertex_count;
+    GLuint first_index, index_count;
+    int live;
+} geometry_mesh_t;
+
+// What to draw a mesh with: bind the page's VAO, then
+// glDrawElementsBaseVertex(GL_TRIANGLES, index_count, GL_UNSIGNED_INT,
+// first_index * sizeof(GLuint), base_vertex).
+// A mesh's range in the region being compacted.
+typedef struct geometry_placement_ {
+    GLuint offset;
+    geometry_handle_t mesh;
+} geometry_placement_t;
+
+typedef struct geometry_range_ {
+    unsigned int page;
+    GLuint index_count, first_index;
+    GLint base_vertex;
+} geometry_range_t;
+
+typedef struct geometry_heap_stats_ {
+    unsigned int pages, meshes;
+    size_t capacity_bytes, used_bytes;
+    // 1 - (largest free block of each page, summed) / free space, per kind:
+    // 0 when every page's free space is in one piece, towards 1 when it's
+    // scattered in small holes.
+    float vertex_fragmentation, index_fragmentation;
+    unsigned long allocs, frees, failed;
+    unsigned long defrag_moves;
+    size_t defrag_bytes;                    // Copied by geometry_heap_defrag(), in total.
+} geometry_heap_stats_t;
+
+typedef struct geometry_heap_ {
+    GLuint page_vertices, page_indices;
+    geometry_page_t pages[GEOMETRY_HEAP_MAX_PAGES];
+    unsigned int page_count;
+    int immutable;
+
+    geometry_mesh_t* meshes;                // Indexed by handle - 1.
+    unsigned int mesh_count, mesh_capacity;
+    unsigned int* free_handles;
+    unsigned int free_handle_count;
+
+    GLuint scratch;                         // Staging for overlapping moves.
+    size_t scratch_size;
+
+    // Kept between geometry_heap_defrag() calls: the meshes of the region
+    // being compacted, and the free list it's rebuilt into before being
+    // swapped with the region's.
+    geometry_placement_t* placements;
+    unsigned int placement_capacity;
+    geometry_block_t* spare_free;
+    unsigned int spare_free_capacity;
+
+    geometry_heap_stats_t stats;
+} geometry_heap_t;
+
+// Pages hold `page_vertices` vertices and `page_indices` indices; no mesh
+// can be larger. Needs a current context.
+int  geometry_heap_init(geometry_heap_t* h, GLuint page_vertices, GLuint page_indices);
+void geometry_heap_destroy(geometry_heap_t* h);
+
+// Reserves room for a mesh; its contents are undefined until uploaded.
+// Returns 0 when it doesn't fit.
+geometry_handle_t geometry_heap_alloc(geometry_heap_t* h, GLuint vertex_count, GLuint index_count);
+void geometry_heap_free(geometry_heap_t* h, geometry_handle_t mesh);
+
+// Fills a mesh; `indices` are relative to its first vertex.
+void geometry_heap_upload(geometry_heap_t* h, geometry_handle_t mesh, const vertex_t* vertices, const GLuint* indices);
+
+// Allocates, generates and uploads a procedural mesh. Needs the job system.
+// The mesh is generated in `arena` (NULL: the thread's scratch arena), which
+// is rewound once it's uploaded.
+geometry_handle_t geometry_heap_add(geometry_heap_t* h, const mesh_desc_t* desc, arena_t* arena);
+
+geometry_range_t geometry_heap_range(const geometry_heap_t* h, geometry_handle_t mesh);
+GLuint geometry_heap_vao(const geometry_heap_t* h, unsigned int page);
+
+// Draws a mesh, with its page's VAO bound.
+void geometry_heap_draw(const geometry_heap_t* h, geometry_handle_t mesh);
+
+// Compacts pages, moving at most about `budget` bytes (0: no limit).
+// Returns the bytes moved.
+size_t geometry_heap_defrag(geometry_heap_t* h, size_t budget);
+
+geometry_heap_stats_t geometry_heap_stats(const geometry_heap_t* h);
+
+#endif // RENDER_GEOMETRY_HEAP_H
@@ -0,0 +1,244 @@
+#include "gpu_scene.h"
+#include "program.h"
+#include "math/frustum.h"
+
+#define CULL_GROUP_SIZE 64
+
+// Shared by the compute and vertex shaders.
+#define OBJECT_STRUCT \
+    "struct Object {\n" \
+    "  mat4 model;\n" \
+    "  vec4 bounds;\n" \
+    "  uvec4 mesh;\n" \
+    "};\n" \
+    "layout(std430, binding=0) readonly buffer Objects { Object objects[]; };\n"
+
+static const GLchar* CULL_SHADER = {
+    "#version 430 core\n"
+    "layout(local_size_x=64) in;\n"
+    OBJECT_STRUCT
+    "struct Mesh { uint count; uint first_index; int base_vertex; uint pad; };\n"
+    "struct Command { uint count; uint instance_count; uint first_index; int base_vertex; uint base_instance; };\n"
+    "layout(std430, binding=1) readonly buffer Meshes { Mesh meshes[]; };\n"
+    "layout(std430, binding=2) writeonly buffer Commands { Command commands[]; };\n"
+    "layout(std430, binding=3) buffer DrawCount { uint draw_count; };\n"
+
+    "uniform vec4 Planes[6];\n"
+    "uniform uint ObjectCount;\n"
+    "uniform bool Compact;\n"
+
+    "void main(void)\n"
+    "{\n"
+    "  uint i = gl_GlobalInvocationID.x;\n"
+    "  if (i >= ObjectCount) return;\n"
+
+    "  mat4 model = objects[i].model;\n"
+    "  vec4 bounds = objects[i].bounds;\n"
+    "  vec3 center = (model * vec4(bounds.xyz, 1.0)).xyz;\n"
+    "  float s = max(length(model[0].xyz), max(length(model[1].xyz), length(model[2].xyz)));\n"
+    "  float radius = bounds.w * s;\n"
+
+    "  bool visible = true;\n"
+    "  for (int p = 0; p < 6; ++p)\n"
+    "    if (dot(Planes[p].xyz, center) + Planes[p].w < -radius) visible = false;\n"
+
+    "  uint slot = i;\n"
+    "  if (Compact) {\n"
+    "    if (!visible) return;\n"
+    "    slot = atomicAdd(draw_count, 1u);\n"
+    "  }\n"
+
+    "  Mesh m = meshes[objects[i].mesh.x];\n"
+    "  commands[slot] = Command(m.count, visible ? 1u : 0u, m.first_index, m.base_vertex, i);\n"
+    "}\n"
+};
+
+// The object index arrives through an instanced attribute: base_instance in
+// the command offsets it, which works without ARB_shader_draw_parameters.
+static const GLchar* DRAW_VERTEX_SHADER = {
+    "#version 430 core\n"
+    "layout(location=0) in vec4 in_Position;\n"
+    "layout(location=1) in vec4 in_Color;\n"
+    "layout(location=2) in uint in_ObjectId;\n"
+    OBJECT_STRUCT
+    "uniform mat4 ViewMatrix;\n"
+    "uniform mat4 ProjectionMatrix;\n"
+    "out vec4 ex_Color;\n"
+    "out vec3 ex_ViewPos;\n"
+
+    "void main(void)\n"
+    "{\n"
+    "  vec4 view_pos = ViewMatrix * objects[in_ObjectId].model * in_Position;\n"
+    "  gl_Position = ProjectionMatrix * view_pos;\n"
+    "  ex_Color = in_Color;\n"
+    "  ex_ViewPos = view_pos.xyz;\n"
+    "}\n"
+};
+
+static const GLchar* DRAW_FRAGMENT_SHADER = {
+    "#version 430 core\n"
+    "in vec4 ex_Color;\n"
+    "out vec4 out_Color;\n"
+
+    "void main(void)\n"
+    "{\n"
+    "  out_Color = ex_Color;\n"
+    "}\n"
+};
+
+int gpu_scene_init(gpu_scene_t* s, GLuint capacity, GLuint vbo, GLuint ibo,
+                   const gpu_mesh_t* meshes, GLuint mesh_count) {
+    return gpu_scene_init_shaded(s, capacity, vbo, ibo, meshes, mesh_count, DRAW_FRAGMENT_SHADER);
+}
+
+int gpu_scene_init_shaded(gpu_scene_t* s, GLuint capacity, GLuint vbo, GLuint ibo,
+                          const gpu_mesh_t* meshes, GLuint mesh_count, const GLchar* fragment_src) {
+    GLuint* ids;
+    GLuint i;
+
+    memset(s, 0, sizeof(*s));
+    s->capacity = capacity;
+    s->mesh_count = mesh_count;
+    s->use_draw_count = GLEW_VERSION_4_6 || GLEW_ARB_indirect_parameters;
+
+    if ((s->cull_prog = compute_program_from_source(CULL_SHADER)) == 0
+            || (s->draw_prog = program_from_source(DRAW_VERTEX_SHADER, fragment_src)) == 0) {
+        fprintf(stderr, "ERROR: Could not build GPU-driven programs.\n");
+        return 0;
+    }
+
+    s->planes_uloc = glGetUniformLocation(s->cull_prog, "Planes");
+    s->object_count_uloc = glGetUniformLocation(s->cull_prog, "ObjectCount");
+    s->compact_uloc = glGetUniformLocation(s->cull_prog, "Compact");
+    s->view_uloc = glGetUniformLocation(s->draw_prog, "ViewMatrix");
+    s->proj_uloc = glGetUniformLocation(s->draw_prog, "ProjectionMatrix");
+    exit_on_glError("ERROR: Could not get GPU-driven uniform locations.");
+
+    glGenBuffers(1, &s->objects_ssbo);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, s->objects_ssbo);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(gpu_object_t) * capacity, NULL, GL_DYNAMIC_DRAW);
+
+    glGenBuffers(1, &s->meshes_ssbo);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, s->meshes_ssbo);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(gpu_mesh_t) * mesh_count, meshes, GL_STATIC_DRAW);
+
+    // Written by the compute shader, read by the draw: never touched by the CPU.
+    glGenBuffers(1, &s->commands_buf);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, s->commands_buf);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * 5 * capacity, NULL, GL_DYNAMIC_COPY);
+
+    glGenBuffers(1, &s->count_buf);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, s->count_buf);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint), NULL, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    exit_on_glError("ERROR: Could not create GPU-driven buffers.");
+
+    // Object ids 0..capacity-1, fetched once per instance.
+    if ((ids = (GLuint*) malloc(sizeof(GLuint) * capacity)) == NULL) {
+        fprintf(stderr, "ERROR: Could not allocate %u object ids.\n", capacity);
+        return 0;
+    }
+    for (i = 0; i < capacity; ++i) ids[i] = i;
+
+    glGenVertexArrays(1, &s->vao);
+    glBindVertexArray(s->vao);
+
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(vertex_t), (GLvoid*)0);
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(vertex_t), (GLvoid*)sizeof(((vertex_t*)0)->pos));
+
+    glGenBuffers(1, &s->ids_buf);
+    glBindBuffer(GL_ARRAY_BUFFER, s->ids_buf);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(GLuint) * capacity, ids, GL_STATIC_DRAW);
+    glEnableVertexAttribArray(2);
+    glVertexAttribIPointer(2, 1, GL_UNSIGNED_INT, sizeof(GLuint), (GLvoid*)0);
+    glVertexAttribDivisor(2, 1);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    free(ids);
+    exit_on_glError("ERROR: Could not create GPU-driven VAO.");
+
+    return 1;
+}
+
+void gpu_scene_destroy(gpu_scene_t* s) {
+    GLuint buffers[5];
+
+    buffers[0] = s->objects_ssbo;
+    buffers[1] = s->meshes_ssbo;
+    buffers[2] = s->commands_buf;
+    buffers[3] = s->count_buf;
+    buffers[4] = s->ids_buf;
+    glDeleteBuffers(5, buffers);
+    glDeleteVertexArrays(1, &s->vao);
+    glDeleteProgram(s->cull_prog);
+    glDeleteProgram(s->draw_prog);
+    exit_on_glError("ERROR: Could not destroy GPU-driven scene.");
+}
+
+void gpu_scene_set_objects(gpu_scene_t* s, const gpu_object_t* objects, GLuint first, GLuint count) {
+    if (first + count > s->capacity) {
+        fprintf(stderr, "ERROR: GPU scene holds at most %u objects.\n", s->capacity);
+        return;
+    }
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, s->objects_ssbo);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, sizeof(gpu_object_t) * first,
+                    sizeof(gpu_object_t) * count, objects);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    if (first + count > s->object_count) s->object_count = first + count;
+}
+
+void gpu_scene_draw(gpu_scene_t* s, const mat4_t* view, const mat4_t* projection) {
+    const GLuint zero = 0;
+    mat4_t view_proj;
+    frustum_t frustum;
+
+    if (s->object_count == 0) return;
+
+    // World-space frustum for the culling pass.
+    view_proj = mat_mult(view, projection);
+    frustum_from_matrix(&frustum, &view_proj);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, s->objects_ssbo);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, s->meshes_ssbo);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, s->commands_buf);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, s->count_buf);
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, s->count_buf);
+    glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    glUseProgram(s->cull_prog);
+    glUniform4fv(s->planes_uloc, 6, &frustum.planes[0][0]);
+    glUniform1ui(s->object_count_uloc, s->object_count);
+    glUniform1i(s->compact_uloc, s->use_draw_count);
+    glDispatchCompute((s->object_count + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+
+    // Commands are consumed as indirect arguments, objects through the SSBO.
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+
+    glUseProgram(s->draw_prog);
+    glUniformMatrix4fv(s->view_uloc, 1, GL_FALSE, view->m);
+    glUniformMatrix4fv(s->proj_uloc, 1, GL_FALSE, projection->m);
+
+    glBindVertexArray(s->vao);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, s->commands_buf);
+    if (s->use_draw_count) {
+        glBindBuffer(GL_PARAMETER_BUFFER_ARB, s->count_buf);
+        glMultiDrawElementsIndirectCountARB(GL_TRIANGLES, GL_UNSIGNED_INT, (GLvoid*)0, 0,
+                                            s->object_count, 0);
+        glBindBuffer(GL_PARAMETER_BUFFER_ARB, 0);
+    } else {
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (GLvoid*)0, s->object_count, 0);
+    }
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    glBindVertexArray(0);
+    glUseProgram(0);
+    exit_on_glError("ERROR: Could not draw GPU-driven scene.");
+}
@@ -0,0 +1,63 @@
+#ifndef RENDER_GPU_SCENE_H
+#define RENDER_GPU_SCENE_H
+
+#include <GL/glew.h>
+#include "math/utils.h"
+
+// GPU-driven rendering: object transforms and bounds live in a shader
+// storage buffer, a compute shader frustum-culls them and writes one
+// DrawElementsIndirectCommand per surviving object, and a single
+// multi-draw-indirect call submits the lot. The CPU cost of a frame is a
+// handful of GL calls whatever the object count.
+//
+// With ARB_indirect_parameters (or GL 4.6) the survivors are compacted and
+// drawn with glMultiDrawElementsIndirectCount. Otherwise every object keeps
+// its command slot and culled ones get an instance count of 0, which still
+// needs no CPU readback. Requires GL 4.3 (compute, SSBOs, MDI); llvmpipe's
+// 4.5 core profile is enough.
+//
+// Meshes share one vertex buffer (vertex_t layout) and one index buffer of
+// GLuint indices, addressed by first index and base vertex.
+
+typedef struct gpu_mesh_ {
+    GLuint index_count;
+    GLuint first_index;
+    GLint base_vertex;
+    GLuint pad;
+} gpu_mesh_t;
+
+// Matches the std430 layout of `Object` in the shaders (96 bytes).
+typedef struct gpu_object_ {
+    mat4_t model;
+    float bounds[4];    // Object-space bounding sphere: center xyz, radius.
+    GLuint mesh;
+    GLuint pad[3];
+} gpu_object_t;
+
+typedef struct gpu_scene_ {
+    GLuint cull_prog, draw_prog;
+    GLuint vao;
+    GLuint objects_ssbo, meshes_ssbo, commands_buf, count_buf, ids_buf;
+    GLuint capacity, object_count, mesh_count;
+    int use_draw_count;
+
+    GLint planes_uloc, object_count_uloc, compact_uloc;
+    GLint view_uloc, proj_uloc;
+} gpu_scene_t;
+
+int  gpu_scene_init(gpu_scene_t* s, GLuint capacity, GLuint vbo, GLuint ibo,
+                    const gpu_mesh_t* meshes, GLuint mesh_count);
+
+// Same, drawing with another fragment shader (GLSL 4.30). It receives
+// `in vec4 ex_Color` and `in vec3 ex_ViewPos`, the view-space position.
+int  gpu_scene_init_shaded(gpu_scene_t* s, GLuint capacity, GLuint vbo, GLuint ibo,
+                           const gpu_mesh_t* meshes, GLuint mesh_count, const GLchar* fragment_src);
+void gpu_scene_destroy(gpu_scene_t* s);
+
+// Replaces objects [first, first + count) and grows the object count to cover them.
+void gpu_scene_set_objects(gpu_scene_t* s, const gpu_object_t* objects, GLuint first, GLuint count);
+
+// Culls and draws every object: one dispatch, one barrier, one draw call.
+void gpu_scene_draw(gpu_scene_t* s, const mat4_t* view, const mat4_t* projection);
+
+#endif // RENDER_GPU_SCENE_H
@@ -0,0 +1,530 @@
+#include "image.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+typedef struct block_format_ {
+    uint32_t code;          // DDS FourCC, DXGI format or VkFormat.
+    GLenum internal_format;
+    int block_bytes;
+} block_format_t;
+
+#define FOURCC(a, b, c, d) \
+    ((uint32_t)(a) | ((uint32_t)(b) << 8) | ((uint32_t)(c) << 16) | ((uint32_t)(d) << 24))
+
+static const block_format_t DDS_FOURCC_FORMATS[] = {
+    { FOURCC('D', 'X', 'T', '1'), GL_COMPRESSED_RGBA_S3TC_DXT1_EXT, 8 },
+    { FOURCC('D', 'X', 'T', '3'), GL_COMPRESSED_RGBA_S3TC_DXT3_EXT, 16 },
+    { FOURCC('D', 'X', 'T', '5'), GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, 16 },
+    { FOURCC('A', 'T', 'I', '1'), GL_COMPRESSED_RED_RGTC1, 8 },
+    { FOURCC('B', 'C', '4', 'U'), GL_COMPRESSED_RED_RGTC1, 8 },
+    { FOURCC('A', 'T', 'I', '2'), GL_COMPRESSED_RG_RGTC2, 16 },
+    { FOURCC('B', 'C', '5', 'U'), GL_COMPRESSED_RG_RGTC2, 16 },
+    { 0, 0, 0 }
+};
+
+static const block_format_t DXGI_FORMATS[] = {
+    { 71, GL_COMPRESSED_RGBA_S3TC_DXT1_EXT, 8 },
+    { 72, GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT, 8 },
+    { 74, GL_COMPRESSED_RGBA_S3TC_DXT3_EXT, 16 },
+    { 75, GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT, 16 },
+    { 77, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, 16 },
+    { 78, GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT, 16 },
+    { 80, GL_COMPRESSED_RED_RGTC1, 8 },
+    { 81, GL_COMPRESSED_SIGNED_RED_RGTC1, 8 },
+    { 83, GL_COMPRESSED_RG_RGTC2, 16 },
+    { 84, GL_COMPRESSED_SIGNED_RG_RGTC2, 16 },
+    { 95, GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT, 16 },
+    { 96, GL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT, 16 },
+    { 98, GL_COMPRESSED_RGBA_BPTC_UNORM, 16 },
+    { 99, GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM, 16 },
+    { 0, 0, 0 }
+};
+
+static const block_format_t VK_FORMATS[] = {
+    { 131, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, 8 },
+    { 132, GL_COMPRESSED_SRGB_S3TC_DXT1_EXT, 8 },
+    { 133, GL_COMPRESSED_RGBA_S3TC_DXT1_EXT, 8 },
+    { 134, GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT, 8 },
+    { 135, GL_COMPRESSED_RGBA_S3TC_DXT3_EXT, 16 },
+    { 136, GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT, 16 },
+    { 137, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, 16 },
+    { 138, GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT, 16 },
+    { 139, GL_COMPRESSED_RED_RGTC1, 8 },
+    { 140, GL_COMPRESSED_SIGNED_RED_RGTC1, 8 },
+    { 141, GL_COMPRESSED_RG_RGTC2, 16 },
+    { 142, GL_COMPRESSED_SIGNED_RG_RGTC2, 16 },
+    { 143, GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT, 16 },
+    { 144, GL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT, 16 },
+    { 145, GL_COMPRESSED_RGBA_BPTC_UNORM, 16 },
+    { 146, GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM, 16 },
+    { 0, 0, 0 }
+};
+
+// Uncompressed KTX2 formats we can upload as-is.
+#define VK_FORMAT_R8G8B8A8_UNORM 37
+#define VK_FORMAT_R8G8B8A8_SRGB  43
+
+static const unsigned char KTX2_IDENTIFIER[12] = {
+    0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'
+};
+
+static int decode_tga(const unsigned char* src, size_t size, image_t* out);
+static int decode_ppm(const unsigned char* src, size_t size, image_t* out);
+static int parse_dds(unsigned char* src, size_t size, image_t* out);
+static int parse_ktx2(unsigned char* src, size_t size, image_t* out);
+
+static uint32_t read_u32(const unsigned char* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint64_t read_u64(const unsigned char* p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static const block_format_t* find_format(const block_format_t* table, uint32_t code) {
+    for (; table->code != 0; ++table)
+        if (table->code == code) return table;
+    return NULL;
+}
+
+// Sizes come straight from file headers: anything else would make empty
+// rows, or wrap negative through int.
+static int valid_size(uint32_t width, uint32_t height) {
+    return width > 0 && height > 0 && width <= IMAGE_MAX_SIZE && height <= IMAGE_MAX_SIZE;
+}
+
+int image_level_count(int width, int height) {
+    int levels = 1, size = width > height ? width : height;
+    while (size > 1) {
+        size >>= 1;
+        ++levels;
+    }
+    return levels;
+}
+
+static int has_extension(const char* path, const char* ext) {
+    const size_t plen = strlen(path), elen = strlen(ext);
+    size_t i;
+
+    if (plen < elen) return 0;
+    for (i = 0; i < elen; ++i) {
+        char c = path[plen - elen + i];
+        if (c >= 'A' && c <= 'Z') c = (char)(c - 'A' + 'a');
+        if (c != ext[i]) return 0;
+    }
+    return 1;
+}
+
+static unsigned char* read_file(const char* path, size_t* size) {
+    FILE* fd;
+    long fsz = -1;
+    unsigned char* buf = NULL;
+
+    if ((fd = fopen(path, "rb")) == NULL) {
+        fprintf(stderr, "ERROR: Could not open image %s.\n", path);
+        return NULL;
+    }
+
+    if (fseek(fd, 0, SEEK_END) == 0 && (fsz = ftell(fd)) > 0) {
+        rewind(fd);
+        if ((buf = (unsigned char*) malloc((size_t)fsz)) != NULL
+                && fread(buf, 1, (size_t)fsz, fd) != (size_t)fsz) {
+            free(buf);
+            buf = NULL;
+        }
+    }
+    fclose(fd);
+
+    if (buf == NULL) fprintf(stderr, "ERROR: Could not read image %s.\n", path);
+    else *size = (size_t)fsz;
+    return buf;
+}
+
+int image_load(const char* path, image_t* out) {
+    unsigned char* file;
+    size_t size = 0;
+
+    memset(out, 0, sizeof(*out));
+    if ((file = read_file(path, &size)) == NULL) return 0;
+    return image_decode(path, file, size, out);
+}
+
+int image_decode(const char* path, unsigned char* file, size_t size, image_t* out) {
+    int ok;
+
+    memset(out, 0, sizeof(*out));
+
+    // Compressed containers keep the file buffer as their pixel storage.
+    if (size >= 4 && memcmp(file, "DDS ", 4) == 0) {
+        if ((ok = parse_dds(file, size, out)) == 0) free(file);
+        return ok;
+    }
+    if (size >= sizeof(KTX2_IDENTIFIER) && memcmp(file, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) == 0) {
+        if ((ok = parse_ktx2(file, size, out)) == 0) free(file);
+        return ok;
+    }
+
+    if (size >= 2 && file[0] == 'P' && file[1] == '6') ok = decode_ppm(file, size, out);
+    else if (has_extension(path, ".tga")) ok = decode_tga(file, size, out);
+    else {
+        fprintf(stderr, "ERROR: Unsupported image format: %s.\n", path);
+        ok = 0;
+    }
+    free(file);
+
+    if (ok && !image_generate_mips(out)) {
+        image_free(out);
+        ok = 0;
+    }
+    if (!ok) fprintf(stderr, "ERROR: Could not decode image %s.\n", path);
+    return ok;
+}
+
+void image_free(image_t* img) {
+    free(img->data);
+    img->data = NULL;
+    img->data_size = 0;
+    img->levels = 0;
+}
+
+// Sets up a single-level RGBA8 image of the given size.
+static int alloc_rgba8(image_t* out, int width, int height) {
+    if (width <= 0 || height <= 0 || !valid_size((uint32_t)width, (uint32_t)height)) return 0;
+
+    out->width = width;
+    out->height = height;
+    out->levels = 1;
+    out->compressed = 0;
+    out->internal_format = GL_RGBA8;
+    out->format = GL_RGBA;
+    out->type = GL_UNSIGNED_BYTE;
+    out->block_bytes = 4;
+    out->data_size = (size_t)width * height * 4;
+    if ((out->data = (unsigned char*) malloc(out->data_size)) == NULL) return 0;
+
+    out->level[0].offset = 0;
+    out->level[0].size = out->data_size;
+    out->level[0].width = width;
+    out->level[0].height = height;
+    out->level[0].row_bytes = (size_t)width * 4;
+    out->level[0].rows = height;
+    return 1;
+}
+
+int image_generate_mips(image_t* img) {
+    size_t total = 0, offset = 0;
+    int levels, i, w, h;
+    unsigned char* data;
+
+    if (img->compressed || img->block_bytes != 4) return 0;
+
+    levels = image_level_count(img->width, img->height);
+    if (levels > IMAGE_MAX_LEVELS) levels = IMAGE_MAX_LEVELS;
+
+    for (i = 0, w = img->width, h = img->height; i < levels; ++i) {
+        total += (size_t)w * h * 4;
+        w = w > 1 ? w / 2 : 1;
+        h = h > 1 ? h / 2 : 1;
+    }
+
+    if ((data = (unsigned char*) realloc(img->data, total)) == NULL) return 0;
+    img->data = data;
+    img->data_size = total;
+
+    for (i = 0, w = img->width, h = img->height; i < levels; ++i) {
+        image_level_t* l = &img->level[i];
+        l->offset = offset;
+        l->size = (size_t)w * h * 4;
+        l->width = w;
+        l->height = h;
+        l->row_bytes = (size_t)w * 4;
+        l->rows = h;
+        offset += l->size;
+
+        if (i > 0) {
+            // 2x2 box filter, clamping at odd edges.
+            const image_level_t* p = &img->level[i - 1];
+            const unsigned char* src = data + p->offset;
+            unsigned char* dst = data + l->offset;
+            int x, y, c;
+
+            for (y = 0; y < h; ++y) {
+                const int y0 = y * 2, y1 = y0 + 1 < p->height ? y0 + 1 : y0;
+                for (x = 0; x < w; ++x) {
+                    const int x0 = x * 2, x1 = x0 + 1 < p->width ? x0 + 1 : x0;
+                    for (c = 0; c < 4; ++c) {
+                        const unsigned int sum =
+                            src[((size_t)y0 * p->width + x0) * 4 + c] +
+                            src[((size_t)y0 * p->width + x1) * 4 + c] +
+                            src[((size_t)y1 * p->width + x0) * 4 + c] +
+                            src[((size_t)y1 * p->width + x1) * 4 + c];
+                        dst[((size_t)y * w + x) * 4 + c] = (unsigned char)((sum + 2) / 4);
+                    }
+                }
+            }
+        }
+
+        w = w > 1 ? w / 2 : 1;
+        h = h > 1 ? h / 2 : 1;
+    }
+
+    img->levels = levels;
+    return 1;
+}
+
+// TGA: 18 byte header, optional id, then pixels (BGR(A) or grey), optionally
+// RLE packed. Origin is bottom-left unless bit 5 of the descriptor is set.
+static int decode_tga(const unsigned char* src, size_t size, image_t* out) {
+    const unsigned char* p;
+    const unsigned char* end = src + size;
+    int type, bpp, width, height, top_down, y;
+    size_t pixel = 0, count;
+
+    if (size < 18) return 0;
+
+    type = src[2];
+    width = src[12] | (src[13] << 8);
+    height = src[14] | (src[15] << 8);
+    bpp = src[16] / 8;
+    top_down = (src[17] & 0x20) != 0;
+
+    if (src[1] != 0 || (type != 2 && type != 3 && type != 10 && type != 11)) return 0;
+    if (bpp != 1 && bpp != 3 && bpp != 4) return 0;
+    if (!alloc_rgba8(out, width, height)) return 0;
+
+    p = src + 18 + src[0];
+    count = (size_t)width * height;
+
+    while (pixel < count) {
+        size_t run = 1;
+        int raw = 1, i;
+
+        if (type >= 9) {
+            if (p >= end) return 0;
+            raw = (*p & 0x80) == 0;
+            run = (size_t)(*p & 0x7F) + 1;
+            ++p;
+        }
+        if (pixel + run > count) run = count - pixel;
+
+        for (i = 0; i < (int)run; ++i) {
+            unsigned char* dst = out->data + (pixel + i) * 4;
+            if (p + bpp > end) return 0;
+            if (bpp == 1) {
+                dst[0] = dst[1] = dst[2] = p[0];
+                dst[3] = 255;
+            } else {
+                dst[0] = p[2];
+                dst[1] = p[1];
+                dst[2] = p[0];
+                dst[3] = bpp == 4 ? p[3] : 255;
+            }
+            if (raw || i + 1 == (int)run) p += bpp;
+        }
+        pixel += run;
+    }
+
+    // Flip top-down images so row 0 is the bottom one.
+    if (top_down) {
+        const size_t row = (size_t)width * 4;
+        for (y = 0; y < height / 2; ++y) {
+            unsigned char* a = out->data + (size_t)y * row;
+            unsigned char* b = out->data + (size_t)(height - 1 - y) * row;
+            size_t i;
+            for (i = 0; i < row; ++i) {
+                const unsigned char t = a[i];
+                a[i] = b[i];
+                b[i] = t;
+            }
+        }
+    }
+    return 1;
+}
+
+static const unsigned char* ppm_int(const unsigned char* p, const unsigned char* end, int* v) {
+    // Skip whitespace and comments.
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r' || *p == '#')) {
+        if (*p == '#') while (p < end && *p != '\n') ++p;
+        else ++p;
+    }
+    *v = 0;
+    if (p >= end || *p < '0' || *p > '9') return NULL;
+    while (p < end && *p >= '0' && *p <= '9') *v = *v * 10 + (*p++ - '0');
+    return p;
+}
+
+// Binary PPM: "P6 <w> <h> <max>" then 8-bit RGB, top row first.
+static int decode_ppm(const unsigned char* src, size_t size, image_t* out) {
+    const unsigned char* end = src + size;
+    const unsigned char* p = src + 2;
+    int width, height, maxval, x, y;
+
+    if ((p = ppm_int(p, end, &width)) == NULL
+            || (p = ppm_int(p, end, &height)) == NULL
+            || (p = ppm_int(p, end, &maxval)) == NULL
+            || maxval != 255)
+        return 0;
+    ++p; // Single whitespace before the pixels.
+
+    if ((size_t)(end - p) < (size_t)width * height * 3) return 0;
+    if (!alloc_rgba8(out, width, height)) return 0;
+
+    for (y = 0; y < height; ++y) {
+        unsigned char* dst = out->data + (size_t)(height - 1 - y) * width * 4;
+        for (x = 0; x < width; ++x, p += 3, dst += 4) {
+            dst[0] = p[0];
+            dst[1] = p[1];
+            dst[2] = p[2];
+            dst[3] = 255;
+        }
+    }
+    return 1;
+}
+
+// Fills in the levels of a block-compressed image whose levels are stored
+// back to back starting at `offset`.
+static int setup_block_levels(image_t* out, size_t size, size_t offset, int levels) {
+    int i, w = out->width, h = out->height;
+
+    // A longer chain than the size allows would fail glTexStorage2D.
+    if (levels < 1) levels = 1;
+    if (levels > image_level_count(w, h)) levels = image_level_count(w, h);
+    if (levels > IMAGE_MAX_LEVELS) levels = IMAGE_MAX_LEVELS;
+
+    for (i = 0; i < levels; ++i) {
+        image_level_t* l = &out->level[i];
+        const int bw = (w + 3) / 4, bh = (h + 3) / 4;
+
+        l->offset = offset;
+        l->width = w;
+        l->height = h;
+        l->row_bytes = (size_t)bw * out->block_bytes;
+        l->rows = bh;
+        l->size = l->row_bytes * bh;
+        offset += l->size;
+        if (offset > size) return 0;
+
+        w = w > 1 ? w / 2 : 1;
+        h = h > 1 ? h / 2 : 1;
+    }
+    out->levels = levels;
+    return 1;
+}
+
+// DDS: "DDS " + 124 byte header (+ 20 byte DX10 header), then every level
+// of the top-level mip chain back to back.
+static int parse_dds(unsigned char* src, size_t size, image_t* out) {
+    const block_format_t* fmt;
+    size_t offset = 128;
+    uint32_t fourcc;
+
+    if (size < 128) return 0;
+
+    if (!valid_size(read_u32(src + 16), read_u32(src + 12))) {
+        fprintf(stderr, "ERROR: Invalid DDS size %ux%u.\n", read_u32(src + 16), read_u32(src + 12));
+        return 0;
+    }
+    out->height = (int)read_u32(src + 12);
+    out->width = (int)read_u32(src + 16);
+    fourcc = read_u32(src + 84);
+
+    if (fourcc == FOURCC('D', 'X', '1', '0')) {
+        if (size < 148) return 0;
+        fmt = find_format(DXGI_FORMATS, read_u32(src + 128));
+        offset = 148;
+    } else {
+        fmt = find_format(DDS_FOURCC_FORMATS, fourcc);
+    }
+
+    if (fmt == NULL) {
+        fprintf(stderr, "ERROR: Unsupported DDS pixel format.\n");
+        return 0;
+    }
+
+    out->compressed = 1;
+    out->internal_format = fmt->internal_format;
+    out->block_bytes = fmt->block_bytes;
+    out->data = src;
+    out->data_size = size;
+    return setup_block_levels(out, size, offset, (int)read_u32(src + 28));
+}
+
+// KTX2: identifier, header, level index (level 0 first), then the levels at
+// arbitrary offsets. Only plain 2D textures without supercompression.
+static int parse_ktx2(unsigned char* src, size_t size, image_t* out) {
+    const block_format_t* fmt;
+    uint32_t vk_format, faces, levels, layers, depth, i;
+    int w, h;
+
+    if (size < 80) return 0;
+
+    vk_format = read_u32(src + 12);
+    if (!valid_size(read_u32(src + 20), read_u32(src + 24))) {
+        fprintf(stderr, "ERROR: Invalid KTX2 size %ux%u.\n", read_u32(src + 20), read_u32(src + 24));
+        return 0;
+    }
+    out->width = (int)read_u32(src + 20);
+    out->height = (int)read_u32(src + 24);
+    depth = read_u32(src + 28);
+    layers = read_u32(src + 32);
+    faces = read_u32(src + 36);
+    levels = read_u32(src + 40);
+
+    if (depth > 1 || layers > 1 || faces != 1 || read_u32(src + 44) != 0) {
+        fprintf(stderr, "ERROR: Only uncompressed-stream 2D KTX2 textures are supported.\n");
+        return 0;
+    }
+    if (levels == 0) levels = 1;
+    if (levels > (uint32_t)image_level_count(out->width, out->height) || levels > IMAGE_MAX_LEVELS
+            || size < 80 + (size_t)levels * 24)
+        return 0;
+
+    if (vk_format == VK_FORMAT_R8G8B8A8_UNORM || vk_format == VK_FORMAT_R8G8B8A8_SRGB) {
+        out->compressed = 0;
+        out->internal_format = vk_format == VK_FORMAT_R8G8B8A8_SRGB ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+        out->format = GL_RGBA;
+        out->type = GL_UNSIGNED_BYTE;
+        out->block_bytes = 4;
+    } else if ((fmt = find_format(VK_FORMATS, vk_format)) != NULL) {
+        out->compressed = 1;
+        out->internal_format = fmt->internal_format;
+        out->block_bytes = fmt->block_bytes;
+    } else {
+        fprintf(stderr, "ERROR: Unsupported KTX2 vkFormat %u.\n", vk_format);
+        return 0;
+    }
+
+    for (i = 0, w = out->width, h = out->height; i < levels; ++i) {
+        image_level_t* l = &out->level[i];
+        const uint64_t offset = read_u64(src + 80 + i * 24);
+        const uint64_t length = read_u64(src + 80 + i * 24 + 8);
+
+        l->offset = (size_t)offset;
+        l->size = (size_t)length;
+        l->width = w;
+        l->height = h;
+        if (out->compressed) {
+            l->row_bytes = (size_t)((w + 3) / 4) * out->block_bytes;
+            l->rows = (h + 3) / 4;
+        } else {
+            l->row_bytes = (size_t)w * 4;
+            l->rows = h;
+        }
+        if (offset + length > size || l->row_bytes * l->rows > length) return 0;
+
+        w = w > 1 ? w / 2 : 1;
+        h = h > 1 ? h / 2 : 1;
+    }
+
+    out->levels = (int)levels;
+    out->data = src;
+    out->data_size = size;
+    return 1;
+}
@@ -0,0 +1,53 @@
+#ifndef RENDER_IMAGE_H
+#define RENDER_IMAGE_H
+
+#include <stddef.h>
+#include <GL/glew.h>
+
+// CPU-side images, ready to be copied into a texture level by level.
+//
+// Supported inputs:
+//   - TGA (uncompressed or RLE, 8/24/32 bpp) and binary PPM (P6), decoded to
+//     RGBA8 with a box-filtered mip chain generated on load.
+//   - DDS and KTX2 holding BC1-BC7 (or RGBA8 in KTX2), kept as-is and
+//     uploaded directly with their own mip levels.
+//
+// Decoded images store rows bottom-up, the way glTexSubImage2D expects them.
+// DDS/KTX2 data is uploaded as stored (top row first), so flip V for those.
+
+#define IMAGE_MAX_LEVELS 16
+#define IMAGE_MAX_SIZE 16384    // GL 4's minimum GL_MAX_TEXTURE_SIZE; larger images are rejected.
+
+typedef struct image_level_ {
+    size_t offset;      // Into image_t::data.
+    size_t size;
+    int width, height;
+    size_t row_bytes;   // One pixel row, or one row of 4x4 blocks.
+    int rows;           // Pixel rows, or block rows.
+} image_level_t;
+
+typedef struct image_ {
+    int width, height, levels;
+    int compressed;
+    GLenum internal_format;
+    GLenum format, type;    // Uncompressed only.
+    int block_bytes;        // Bytes per 4x4 block (compressed) or per pixel.
+    unsigned char* data;    // Owned.
+    size_t data_size;
+    image_level_t level[IMAGE_MAX_LEVELS];
+} image_t;
+
+// Reads and decodes `path`. Safe to call from any thread; does not touch GL.
+int  image_load(const char* path, image_t* out);
+// Decodes a file already in memory (e.g. unpacked from an asset archive),
+// taking ownership of the malloc()ed `file`; `path` picks the format when
+// the contents don't.
+int  image_decode(const char* path, unsigned char* file, size_t size, image_t* out);
+void image_free(image_t* img);
+
+// Replaces the levels of an RGBA8 image with a full box-filtered mip chain.
+int  image_generate_mips(image_t* img);
+
+int  image_level_count(int width, int height);
+
+#endif // RENDER_IMAGE_H
@@ -0,0 +1,309 @@
+#include "loader.h"
+#include "program.h"
+#include "shader_variants.h"
+#include "math/utils.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static void* loader_main(void* arg);
+static int load_buffer(resource_t* r);
+static int load_program(resource_t* r);
+static void free_resource(resource_loader_t* l, resource_t* r);
+static void delete_submitted(resource_loader_t* l, resource_t* r);
+
+int resource_loader_init(resource_loader_t* l, GLFWwindow* share, size_t max_resources) {
+    memset(l, 0, sizeof(*l));
+    if (!pool_init(&l->resources, sizeof(resource_t), max_resources)) return 0;
+
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    l->context = glfwCreateWindow(1, 1, "loader", NULL, share);
+    // Windows created after this one shouldn't come out hidden.
+    glfwDefaultWindowHints();
+    if (l->context == NULL) {
+        fprintf(stderr, "ERROR: Could not create a shared context for loading.\n");
+        pool_destroy(&l->resources);
+        return 0;
+    }
+
+    pthread_mutex_init(&l->lock, NULL);
+    pthread_cond_init(&l->has_work, NULL);
+    l->running = 1;
+    if (pthread_create(&l->thread, NULL, loader_main, l) != 0) {
+        fprintf(stderr, "ERROR: Could not start the loader thread.\n");
+        pthread_cond_destroy(&l->has_work);
+        pthread_mutex_destroy(&l->lock);
+        glfwDestroyWindow(l->context);
+        pool_destroy(&l->resources);
+        return 0;
+    }
+    return 1;
+}
+
+void resource_loader_destroy(resource_loader_t* l) {
+    resource_t *r, *next;
+
+    pthread_mutex_lock(&l->lock);
+    l->running = 0;
+    pthread_cond_signal(&l->has_work);
+    pthread_mutex_unlock(&l->lock);
+    pthread_join(l->thread, NULL);
+
+    // Whatever was submitted is complete once the loader thread has
+    // finished, but its fences and objects still need deleting: nothing can
+    // take them once the pool is gone.
+    for (r = l->done_head; r != NULL; r = next) {
+        next = r->next;
+        delete_submitted(l, r);
+    }
+    for (r = l->fenced; r != NULL; r = next) {
+        next = r->next;
+        delete_submitted(l, r);
+    }
+
+    glfwDestroyWindow(l->context);
+    pthread_cond_destroy(&l->has_work);
+    pthread_mutex_destroy(&l->lock);
+    pool_destroy(&l->resources);
+}
+
+static resource_t* new_resource(resource_loader_t* l, resource_type_t type) {
+    resource_t* r = (resource_t*) pool_alloc(&l->resources);
+
+    if (r == NULL) {
+        fprintf(stderr, "ERROR: Too many resources in flight.\n");
+        return NULL;
+    }
+    memset(r, 0, sizeof(*r));
+    atomic_init(&r->state, RESOURCE_QUEUED);
+    atomic_init(&r->released, 0);
+    r->type = type;
+    return r;
+}
+
+static resource_t* enqueue(resource_loader_t* l, resource_t* r) {
+    if (r == NULL) return NULL;
+
+    pthread_mutex_lock(&l->lock);
+    if (l->queue_tail != NULL) l->queue_tail->next = r;
+    else l->queue_head = r;
+    l->queue_tail = r;
+    pthread_cond_signal(&l->has_work);
+    pthread_mutex_unlock(&l->lock);
+    return r;
+}
+
+resource_t* resource_buffer(resource_loader_t* l, GLsizeiptr size, const void* data, GLenum usage) {
+    resource_t* r = new_resource(l, RESOURCE_BUFFER);
+    if (r != NULL) {
+        r->size = size;
+        r->data = data;
+        r->usage = usage;
+    }
+    return enqueue(l, r);
+}
+
+resource_t* resource_buffer_fill(resource_loader_t* l, GLsizeiptr size, resource_fill_fn fill, void* arg,
+                                 GLenum usage) {
+    resource_t* r = new_resource(l, RESOURCE_BUFFER);
+    if (r != NULL) {
+        r->size = size;
+        r->fill = fill;
+        r->arg = arg;
+        r->usage = usage;
+    }
+    return enqueue(l, r);
+}
+
+resource_t* resource_program(resource_loader_t* l, const char* vertex_path, const char* fragment_path) {
+    resource_t* r = new_resource(l, RESOURCE_PROGRAM);
+    if (r != NULL) {
+        r->vertex_path = vertex_path;
+        r->fragment_path = fragment_path;
+    }
+    return enqueue(l, r);
+}
+
+resource_state_t resource_state(const resource_t* r) {
+    return (resource_state_t) atomic_load(&r->state);
+}
+
+void resource_loader_update(resource_loader_t* l) {
+    resource_t *r, *next, *waiting = NULL;
+
+    // Pick up everything the loader has submitted since the last update.
+    pthread_mutex_lock(&l->lock);
+    if (l->done_head != NULL) {
+        l->done_tail->next = l->fenced;
+        l->fenced = l->done_head;
+        l->done_head = l->done_tail = NULL;
+    }
+    pthread_mutex_unlock(&l->lock);
+
+    for (r = l->fenced; r != NULL; r = next) {
+        int ok = 0; // No fence: the loader failed.
+
+        next = r->next;
+
+        // A zero timeout only polls, so the render thread never blocks here.
+        if (r->fence != 0) {
+            GLenum res = glClientWaitSync(r->fence, 0, 0);
+            if (res == GL_TIMEOUT_EXPIRED) {
+                r->next = waiting;
+                waiting = r;
+                ++l->stats.fence_polls;
+                continue;
+            }
+            glDeleteSync(r->fence);
+            r->fence = 0;
+            ok = res != GL_WAIT_FAILED;
+        }
+
+        // READY and FAILED are only set here, once the resource has left the
+        // loader's hands, which is what makes releasing them safe.
+        r->next = NULL;
+        atomic_store(&r->state, ok ? RESOURCE_READY : RESOURCE_FAILED);
+        if (ok) {
+            if (r->type == RESOURCE_BUFFER) {
+                ++l->stats.buffers_loaded;
+                l->stats.bytes_uploaded += (size_t)r->size;
+            } else {
+                ++l->stats.programs_loaded;
+            }
+        }
+        if (atomic_load(&r->released)) free_resource(l, r);
+    }
+    l->fenced = waiting;
+}
+
+loader_stats_t resource_loader_stats(const resource_loader_t* l) {
+    return l->stats;
+}
+
+GLuint resource_take(resource_loader_t* l, resource_t* r) {
+    GLuint id;
+
+    if (r == NULL || resource_state(r) != RESOURCE_READY) return 0;
+    id = r->id;
+    pool_free(&l->resources, r);
+    return id;
+}
+
+void resource_release(resource_loader_t* l, resource_t* r) {
+    resource_state_t state;
+
+    if (r == NULL) return;
+    state = resource_state(r);
+    if (state == RESOURCE_READY || state == RESOURCE_FAILED) free_resource(l, r);
+    else atomic_store(&r->released, 1); // Freed by resource_loader_update().
+}
+
+static void free_resource(resource_loader_t* l, resource_t* r) {
+    if (r->id != 0) {
+        if (r->type == RESOURCE_BUFFER) glDeleteBuffers(1, &r->id);
+        else glDeleteProgram(r->id);
+    }
+    pool_free(&l->resources, r);
+}
+
+// A resource the loader has handed back but no update has finished.
+static void delete_submitted(resource_loader_t* l, resource_t* r) {
+    if (r->fence != 0) glDeleteSync(r->fence);
+    free_resource(l, r);
+}
+
+static void* loader_main(void* arg) {
+    resource_loader_t* l = (resource_loader_t*) arg;
+    resource_t* r;
+    int ok;
+
+    glfwMakeContextCurrent(l->context);
+
+    for (;;) {
+        pthread_mutex_lock(&l->lock);
+        while (l->running && l->queue_head == NULL)
+            pthread_cond_wait(&l->has_work, &l->lock);
+        if (!l->running) {
+            pthread_mutex_unlock(&l->lock);
+            break;
+        }
+        r = l->queue_head;
+        if ((l->queue_head = r->next) == NULL) l->queue_tail = NULL;
+        r->next = NULL;
+        pthread_mutex_unlock(&l->lock);
+
+        atomic_store(&r->state, RESOURCE_LOADING);
+        ok = r->type == RESOURCE_BUFFER ? load_buffer(r) : load_program(r);
+
+        // The flush makes sure the fence, and the work before it, reaches
+        // the GPU without waiting for this context's next batch.
+        if (ok) {
+            r->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            glFlush();
+        }
+        atomic_store(&r->state, RESOURCE_FENCED);
+
+        pthread_mutex_lock(&l->lock);
+        if (l->done_tail != NULL) l->done_tail->next = r;
+        else l->done_head = r;
+        l->done_tail = r;
+        pthread_mutex_unlock(&l->lock);
+    }
+
+    // Everything already submitted has to be complete before the context goes.
+    glFinish();
+    glfwMakeContextCurrent(NULL);
+    return NULL;
+}
+
+static int load_buffer(resource_t* r) {
+    int filled = 1;
+
+    glGenBuffers(1, &r->id);
+    // The copy-write target leaves the render context's bindings alone.
+    glBindBuffer(GL_COPY_WRITE_BUFFER, r->id);
+    glBufferData(GL_COPY_WRITE_BUFFER, r->size, r->data, r->usage);
+
+    if (r->fill != NULL) {
+        void* dst = glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, r->size,
+                                     GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        if (dst != NULL) {
+            r->fill(dst, (size_t)r->size, r->arg);
+            filled = glUnmapBuffer(GL_COPY_WRITE_BUFFER) == GL_TRUE; // False if the contents were lost.
+        } else {
+            filled = 0;
+        }
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    if (glGetError() != GL_NO_ERROR || !filled) {
+        fprintf(stderr, "ERROR: Could not load a %ld byte buffer.\n", (long)r->size);
+        glDeleteBuffers(1, &r->id);
+        r->id = 0;
+        return 0;
+    }
+    return 1;
+}
+
+static GLuint load_stage(const char* path, GLenum type) {
+    char* src = shader_preprocess(path, NULL); // Resolves #include.
+    GLuint shader_id = src != NULL ? shader_from_source(src, type) : 0;
+
+    free(src);
+    return shader_id;
+}
+
+static int load_program(resource_t* r) {
+    GLuint shaders[2];
+
+    shaders[0] = load_stage(r->vertex_path, GL_VERTEX_SHADER);
+    shaders[1] = load_stage(r->fragment_path, GL_FRAGMENT_SHADER);
+    if (shaders[0] != 0 && shaders[1] != 0)
+        r->id = program_link(shaders, 2);
+    else
+        fprintf(stderr, "ERROR: Could not load %s or %s.\n", r->vertex_path, r->fragment_path);
+
+    glDeleteShader(shaders[0]);
+    glDeleteShader(shaders[1]);
+    return r->id != 0;
+}
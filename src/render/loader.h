@@ -0,0 +1,118 @@
+#ifndef RENDER_LOADER_H
+#define RENDER_LOADER_H
+
+#include <stddef.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+#include "core/pool.h"
+
+// Background resource loading.
+//
+// A loader thread owns a hidden window whose context shares objects with the
+// render context. Buffers and programs requested through the loader are
+// created, filled and linked there; each is followed by a fence and a flush.
+// Once per frame the render thread calls resource_loader_update(), which
+// polls those fences without waiting and marks resources whose fence has
+// signalled READY. Requests, releases and updates all come from the render
+// thread.
+//
+// Only buffers and programs are shared between contexts: vertex array
+// objects have to be built on the render thread once their buffers are
+// ready.
+
+typedef enum resource_state_ {
+    RESOURCE_QUEUED = 0,    // Waiting for the loader thread.
+    RESOURCE_LOADING,       // Being created on the loader thread.
+    RESOURCE_FENCED,        // Submitted, waiting for its fence.
+    RESOURCE_READY,         // Usable from the render context.
+    RESOURCE_FAILED
+} resource_state_t;
+
+typedef enum resource_type_ {
+    RESOURCE_BUFFER = 0,
+    RESOURCE_PROGRAM
+} resource_type_t;
+
+// Fills a freshly mapped buffer on the loader thread.
+typedef void (*resource_fill_fn)(void* dst, size_t size, void* arg);
+
+typedef struct resource_ {
+    GLuint id;                  // Buffer or program, valid once READY.
+    atomic_int state;
+    atomic_int released;        // Released while in flight.
+    resource_type_t type;
+
+    // Buffers: either copied from `data` (which must stay valid until the
+    // resource is READY) or written by `fill`.
+    GLsizeiptr size;
+    GLenum usage;
+    const void* data;
+    resource_fill_fn fill;
+    void* arg;
+
+    // Programs: shader file paths, which must stay valid until READY.
+    const char* vertex_path;
+    const char* fragment_path;
+
+    GLsync fence;
+    struct resource_* next;     // Queue link.
+} resource_t;
+
+typedef struct loader_stats_ {
+    unsigned long buffers_loaded;
+    unsigned long programs_loaded;
+    size_t bytes_uploaded;
+    unsigned long fence_polls;  // Fences found unsignalled by an update.
+} loader_stats_t;
+
+typedef struct resource_loader_ {
+    GLFWwindow* context;        // Hidden, shares with the render window.
+    pool_t resources;
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t has_work;
+    int running;
+
+    // Requests (render thread -> loader) and submitted resources (loader ->
+    // render thread), both under the lock.
+    resource_t* queue_head;
+    resource_t* queue_tail;
+    resource_t* done_head;
+    resource_t* done_tail;
+
+    resource_t* fenced;         // Waiting on their fences (render thread only).
+    loader_stats_t stats;
+} resource_loader_t;
+
+// Creates the shared context with the current window hints, which are reset
+// to their defaults afterwards; call from the main thread, like every GLFW
+// window function.
+int  resource_loader_init(resource_loader_t* l, GLFWwindow* share, size_t max_resources);
+
+// Deletes the GL objects of resources still in flight; READY ones belong to
+// the caller and should be taken or released first. Needs the render
+// context current.
+void resource_loader_destroy(resource_loader_t* l);
+void resource_loader_update(resource_loader_t* l);
+loader_stats_t resource_loader_stats(const resource_loader_t* l);
+
+resource_t* resource_buffer(resource_loader_t* l, GLsizeiptr size, const void* data, GLenum usage);
+resource_t* resource_buffer_fill(resource_loader_t* l, GLsizeiptr size, resource_fill_fn fill, void* arg,
+                                 GLenum usage);
+resource_t* resource_program(resource_loader_t* l, const char* vertex_path, const char* fragment_path);
+
+resource_state_t resource_state(const resource_t* r);
+
+// Hands the GL object of a READY resource over to the caller and frees the
+// handle.
+GLuint resource_take(resource_loader_t* l, resource_t* r);
+
+// Deletes the resource's GL object. In-flight resources are deleted as soon
+// as the loader is done with them.
+void resource_release(resource_loader_t* l, resource_t* r);
+
+#endif // RENDER_LOADER_H
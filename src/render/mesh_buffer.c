@@ -0,0 +1,98 @@
+#include "mesh_buffer.h"
+#include "trace.h"
+
+// Generates every mesh into `vertices` / `indices`, filling the draw ranges.
+static int generate_all(const mesh_desc_t* descs, unsigned int count, gpu_mesh_t* meshes,
+                        vertex_t* vertices, GLuint* indices) {
+    size_t first_vertex = 0, first_index = 0;
+    unsigned int i;
+
+    for (i = 0; i < count; ++i) {
+        size_t vc, ic;
+        mesh_counts(&descs[i], &vc, &ic);
+        // Indices are absolute, so base_vertex stays 0 and the meshes can
+        // also be drawn with plain glDrawElements.
+        if (!mesh_generate(&descs[i], vertices + first_vertex, indices + first_index, (GLuint)first_vertex))
+            return 0;
+        meshes[i].index_count = (GLuint)ic;
+        meshes[i].first_index = (GLuint)first_index;
+        meshes[i].base_vertex = 0;
+        meshes[i].pad = 0;
+        first_vertex += vc;
+        first_index += ic;
+    }
+    return 1;
+}
+
+static void* map_buffer(GLenum target, GLuint buffer, size_t size) {
+    glBindBuffer(target, buffer);
+    glBufferData(target, size, NULL, GL_STATIC_DRAW);
+    return glMapBufferRange(target, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+}
+
+int mesh_buffer_create(mesh_buffer_t* b, const mesh_desc_t* descs, unsigned int count, gpu_mesh_t* meshes) {
+    const double start = glfwGetTime();
+    size_t vertex_bytes, index_bytes;
+    vertex_t* vertices;
+    GLuint* indices;
+    int ok;
+    unsigned int i;
+
+    memset(b, 0, sizeof(*b));
+    for (i = 0; i < count; ++i) {
+        size_t vc, ic;
+        mesh_counts(&descs[i], &vc, &ic);
+        b->vertex_count += vc;
+        b->index_count += ic;
+    }
+    if (b->vertex_count == 0 || b->vertex_count > 0xFFFFFFFFu || b->index_count > 0xFFFFFFFFu) {
+        fprintf(stderr, "ERROR: Cannot build a mesh buffer of %zu vertices.\n", b->vertex_count);
+        return 0;
+    }
+    vertex_bytes = b->vertex_count * sizeof(vertex_t);
+    index_bytes = b->index_count * sizeof(GLuint);
+
+    glGenBuffers(1, &b->vbo);
+    glGenBuffers(1, &b->ibo);
+
+    // The element array binding belongs to the bound VAO, so uploads go
+    // through the copy targets.
+    if (trace_recording()) {
+        vertices = (vertex_t*) malloc(vertex_bytes);
+        indices = (GLuint*) malloc(index_bytes);
+        ok = vertices != NULL && indices != NULL && generate_all(descs, count, meshes, vertices, indices);
+        if (ok) {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, b->vbo);
+            glBufferData(GL_COPY_WRITE_BUFFER, vertex_bytes, vertices, GL_STATIC_DRAW);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, b->ibo);
+            glBufferData(GL_COPY_WRITE_BUFFER, index_bytes, indices, GL_STATIC_DRAW);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        }
+        free(vertices);
+        free(indices);
+    } else {
+        vertices = (vertex_t*) map_buffer(GL_COPY_WRITE_BUFFER, b->vbo, vertex_bytes);
+        indices = (GLuint*) map_buffer(GL_COPY_READ_BUFFER, b->ibo, index_bytes);
+        ok = vertices != NULL && indices != NULL && generate_all(descs, count, meshes, vertices, indices);
+        // An unmap returns false if the contents were lost meanwhile.
+        if (vertices != NULL && glUnmapBuffer(GL_COPY_WRITE_BUFFER) != GL_TRUE) ok = 0;
+        if (indices != NULL && glUnmapBuffer(GL_COPY_READ_BUFFER) != GL_TRUE) ok = 0;
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    }
+
+    if (glGetError() != GL_NO_ERROR || !ok) {
+        fprintf(stderr, "ERROR: Could not build %zu vertices / %zu indices of meshes.\n",
+                b->vertex_count, b->index_count);
+        mesh_buffer_destroy(b);
+        return 0;
+    }
+    b->generate_ms = (glfwGetTime() - start) * 1000.;
+    return 1;
+}
+
+void mesh_buffer_destroy(mesh_buffer_t* b) {
+    if (b->vbo != 0) glDeleteBuffers(1, &b->vbo);
+    if (b->ibo != 0) glDeleteBuffers(1, &b->ibo);
+    b->vbo = b->ibo = 0;
+}
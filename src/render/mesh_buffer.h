@@ -0,0 +1,25 @@
+#ifndef RENDER_MESH_BUFFER_H
+#define RENDER_MESH_BUFFER_H
+
+#include <GL/glew.h>
+#include "math/mesh.h"
+#include "gpu_scene.h"
+
+// Procedural meshes (math/mesh.h) packed into one vertex and one index
+// buffer. The buffers are allocated at their final size and mapped, and the
+// generators write straight into them, so millions of triangles are never
+// staged in client memory. While a GL trace is recording (which can't see
+// writes through a mapping) they are generated on the heap and uploaded with
+// glBufferData instead.
+
+typedef struct mesh_buffer_ {
+    GLuint vbo, ibo;
+    size_t vertex_count, index_count;
+    double generate_ms;     // Generation and upload, wall time.
+} mesh_buffer_t;
+
+// `meshes` receives the gpu_scene draw ranges, one per descriptor.
+int  mesh_buffer_create(mesh_buffer_t* b, const mesh_desc_t* descs, unsigned int count, gpu_mesh_t* meshes);
+void mesh_buffer_destroy(mesh_buffer_t* b);
+
+#endif // RENDER_MESH_BUFFER_H
@@ -0,0 +1,340 @@
+#include "occlusion.h"
+#include "core/jobs.h"
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define OCCLUSION_SSE 1
+#endif
+
+// Vertices closer than this (in clip-space w) count as crossing the near plane.
+#define NEAR_W 1e-4f
+#define TRI_FLOATS 9
+
+typedef struct transform_job_ {
+    occlusion_buffer_t* ob;
+    const occluder_t* occluders;
+    const size_t* first_tri;    // Per occluder, into ob->tris.
+} transform_job_t;
+
+typedef struct test_job_ {
+    const occlusion_buffer_t* ob;
+    const float (*mins)[3];
+    const float (*maxs)[3];
+    unsigned char* visible;
+} test_job_t;
+
+static void transform_range(size_t begin, size_t end, void* arg);
+static void raster_band(size_t begin, size_t end, void* arg);
+static void test_range(size_t begin, size_t end, void* arg);
+
+int occlusion_init(occlusion_buffer_t* ob, int width, int height) {
+    memset(ob, 0, sizeof(*ob));
+
+    if (width <= 0 || height <= 0 || width % OCCLUSION_TILE != 0 || height % OCCLUSION_TILE != 0) {
+        fprintf(stderr, "ERROR: Occlusion buffer size must be a multiple of %d.\n", OCCLUSION_TILE);
+        return 0;
+    }
+
+    ob->width = width;
+    ob->height = height;
+    ob->tiles_x = width / OCCLUSION_TILE;
+    ob->tiles_y = height / OCCLUSION_TILE;
+    ob->depth = (float*) malloc(sizeof(float) * width * height);
+    ob->tile_max = (float*) malloc(sizeof(float) * ob->tiles_x * ob->tiles_y);
+
+    if (ob->depth == NULL || ob->tile_max == NULL) {
+        fprintf(stderr, "ERROR: Could not allocate %dx%d occlusion buffer.\n", width, height);
+        occlusion_destroy(ob);
+        return 0;
+    }
+    return 1;
+}
+
+void occlusion_destroy(occlusion_buffer_t* ob) {
+    free(ob->depth);
+    free(ob->tile_max);
+    free(ob->tris);
+    free(ob->first_tri);
+    ob->depth = ob->tile_max = ob->tris = NULL;
+    ob->first_tri = NULL;
+    ob->tri_capacity = ob->occluder_capacity = 0;
+}
+
+void occlusion_begin(occlusion_buffer_t* ob, const mat4_t* view, const mat4_t* projection) {
+    int i;
+
+    ob->view_proj = mat_mult(view, projection);
+    for (i = 0; i < ob->width * ob->height; ++i) ob->depth[i] = 1.f;
+    for (i = 0; i < ob->tiles_x * ob->tiles_y; ++i) ob->tile_max[i] = 1.f;
+    ob->tri_count = 0;
+    memset(&ob->stats, 0, sizeof(ob->stats));
+}
+
+void occlusion_render(occlusion_buffer_t* ob, const occluder_t* occluders, size_t count) {
+    transform_job_t job;
+    size_t i, total = 0;
+
+    if (count == 0) return;
+
+    // Per-occluder offsets and screen-space triangles only grow, so steady
+    // state does not allocate.
+    if (count > ob->occluder_capacity) {
+        size_t* first_tri = (size_t*) realloc(ob->first_tri, sizeof(size_t) * count);
+        if (first_tri == NULL) {
+            fprintf(stderr, "ERROR: Could not allocate %zu occluders.\n", count);
+            return;
+        }
+        ob->first_tri = first_tri;
+        ob->occluder_capacity = count;
+    }
+
+    for (i = 0; i < count; ++i) {
+        ob->first_tri[i] = total;
+        total += occluders[i].index_count / 3;
+    }
+
+    if (total > ob->tri_capacity) {
+        float* tris = (float*) realloc(ob->tris, sizeof(float) * TRI_FLOATS * total);
+        if (tris == NULL) {
+            fprintf(stderr, "ERROR: Could not allocate %zu occluder triangles.\n", total);
+            return;
+        }
+        ob->tris = tris;
+        ob->tri_capacity = total;
+    }
+    ob->tri_count = total;
+
+    // 1. Project every occluder triangle to the screen.
+    job.ob = ob;
+    job.occluders = occluders;
+    job.first_tri = ob->first_tri;
+    jobs_parallel_for(count, 1, transform_range, &job);
+
+    for (i = 0; i < total; ++i)
+        if (ob->tris[i * TRI_FLOATS] != ob->tris[i * TRI_FLOATS]) ++ob->stats.triangles_clipped;
+    ob->stats.triangles_rasterized = total - ob->stats.triangles_clipped;
+
+    // 2. Rasterize in bands of one tile row, so threads never share pixels.
+    jobs_parallel_for((size_t)ob->tiles_y, 1, raster_band, ob);
+}
+
+int occlusion_test_aabb(const occlusion_buffer_t* ob, const float min[3], const float max[3]) {
+    const float* m = ob->view_proj.m;
+    float sx0 = 1e30f, sy0 = 1e30f, sx1 = -1e30f, sy1 = -1e30f, zmin = 1e30f;
+    int c, x0, y0, x1, y1, tx, ty, x, y;
+
+    for (c = 0; c < 8; ++c) {
+        const float px = (c & 1) ? max[0] : min[0];
+        const float py = (c & 2) ? max[1] : min[1];
+        const float pz = (c & 4) ? max[2] : min[2];
+        const float w = m[3] * px + m[7] * py + m[11] * pz + m[15];
+        float sx, sy, sz;
+
+        if (w <= NEAR_W) return 1; // Crosses the near plane: can't tell.
+
+        sx = ((m[0] * px + m[4] * py + m[8] * pz + m[12]) / w * 0.5f + 0.5f) * ob->width;
+        sy = ((m[1] * px + m[5] * py + m[9] * pz + m[13]) / w * 0.5f + 0.5f) * ob->height;
+        sz = (m[2] * px + m[6] * py + m[10] * pz + m[14]) / w;
+
+        if (sx < sx0) sx0 = sx;
+        if (sx > sx1) sx1 = sx;
+        if (sy < sy0) sy0 = sy;
+        if (sy > sy1) sy1 = sy;
+        if (sz < zmin) zmin = sz;
+    }
+
+    x0 = sx0 < 0 ? 0 : (int)sx0;
+    y0 = sy0 < 0 ? 0 : (int)sy0;
+    x1 = sx1 >= ob->width ? ob->width - 1 : (int)floorf(sx1);
+    y1 = sy1 >= ob->height ? ob->height - 1 : (int)floorf(sy1);
+    if (x0 > x1 || y0 > y1 || zmin > 1.f) return 0; // Off screen or past the far plane.
+
+    for (ty = y0 / OCCLUSION_TILE; ty <= y1 / OCCLUSION_TILE; ++ty) {
+        for (tx = x0 / OCCLUSION_TILE; tx <= x1 / OCCLUSION_TILE; ++tx) {
+            int px0, py0, px1, py1;
+
+            // Whole tile in front of the box: nothing to see here.
+            if (ob->tile_max[ty * ob->tiles_x + tx] < zmin) continue;
+
+            px0 = tx * OCCLUSION_TILE > x0 ? tx * OCCLUSION_TILE : x0;
+            py0 = ty * OCCLUSION_TILE > y0 ? ty * OCCLUSION_TILE : y0;
+            px1 = (tx + 1) * OCCLUSION_TILE - 1 < x1 ? (tx + 1) * OCCLUSION_TILE - 1 : x1;
+            py1 = (ty + 1) * OCCLUSION_TILE - 1 < y1 ? (ty + 1) * OCCLUSION_TILE - 1 : y1;
+
+            for (y = py0; y <= py1; ++y)
+                for (x = px0; x <= px1; ++x)
+                    if (ob->depth[y * ob->width + x] >= zmin) return 1;
+        }
+    }
+    return 0;
+}
+
+size_t occlusion_test_aabbs(occlusion_buffer_t* ob, const float (*mins)[3], const float (*maxs)[3],
+                            size_t count, unsigned char* visible) {
+    test_job_t job;
+    size_t i, visible_count = 0;
+
+    job.ob = ob;
+    job.mins = mins;
+    job.maxs = maxs;
+    job.visible = visible;
+    jobs_parallel_for(count, 64, test_range, &job);
+
+    for (i = 0; i < count; ++i) visible_count += visible[i];
+    ob->stats.boxes_tested += count;
+    ob->stats.boxes_occluded += count - visible_count;
+    return visible_count;
+}
+
+static void transform_range(size_t begin, size_t end, void* arg) {
+    const transform_job_t* job = (const transform_job_t*) arg;
+    const occlusion_buffer_t* ob = job->ob;
+    size_t o, t;
+    int v;
+
+    for (o = begin; o < end; ++o) {
+        const occluder_t* occ = &job->occluders[o];
+        const mat4_t model_view = mat_mult(&occ->model, &ob->view_proj);
+        const float* m = model_view.m;
+        float* out = ob->tris + job->first_tri[o] * TRI_FLOATS;
+
+        for (t = 0; t + 2 < occ->index_count; t += 3, out += TRI_FLOATS) {
+            for (v = 0; v < 3; ++v) {
+                const float* p = (const float*)((const unsigned char*)occ->positions
+                                                + occ->stride * occ->indices[t + v]);
+                const float w = m[3] * p[0] + m[7] * p[1] + m[11] * p[2] + m[15];
+
+                if (w <= NEAR_W) {
+                    out[0] = NAN; // Dropping an occluder is always conservative.
+                    break;
+                }
+                out[v * 3 + 0] = ((m[0] * p[0] + m[4] * p[1] + m[8] * p[2] + m[12]) / w * 0.5f + 0.5f) * ob->width;
+                out[v * 3 + 1] = ((m[1] * p[0] + m[5] * p[1] + m[9] * p[2] + m[13]) / w * 0.5f + 0.5f) * ob->height;
+                out[v * 3 + 2] = (m[2] * p[0] + m[6] * p[1] + m[10] * p[2] + m[14]) / w;
+            }
+        }
+    }
+}
+
+// Rasterizes one triangle into rows [band_y0, band_y1).
+static void raster_triangle(occlusion_buffer_t* ob, const float* t, int band_y0, int band_y1) {
+    float x0 = t[0], y0 = t[1], z0 = t[2];
+    float x1 = t[3], y1 = t[4], z1 = t[5];
+    float x2 = t[6], y2 = t[7], z2 = t[8];
+    float area, a[3], b[3], c[3], az, bz, cz;
+    int xmin, xmax, ymin, ymax, x, y;
+
+    area = (x1 - x0) * (y2 - y0) - (x2 - x0) * (y1 - y0);
+    if (area > -1e-6f && area < 1e-6f) return;
+    if (area < 0) {
+        // Either winding occludes; make it counter-clockwise.
+        float tmp;
+        tmp = x1; x1 = x2; x2 = tmp;
+        tmp = y1; y1 = y2; y2 = tmp;
+        tmp = z1; z1 = z2; z2 = tmp;
+        area = -area;
+    }
+
+    xmin = (int)floorf(fminf(x0, fminf(x1, x2)));
+    xmax = (int)ceilf(fmaxf(x0, fmaxf(x1, x2)));
+    ymin = (int)floorf(fminf(y0, fminf(y1, y2)));
+    ymax = (int)ceilf(fmaxf(y0, fmaxf(y1, y2)));
+    if (xmin < 0) xmin = 0;
+    if (xmax > ob->width - 1) xmax = ob->width - 1;
+    if (ymin < band_y0) ymin = band_y0;
+    if (ymax > band_y1 - 1) ymax = band_y1 - 1;
+    if (xmin > xmax || ymin > ymax) return;
+
+    // Edge functions opposite v0, v1 and v2; all >= 0 inside. Coverage is
+    // sampled at pixel centres so triangles sharing an edge leave no cracks.
+    a[0] = y1 - y2; b[0] = x2 - x1; c[0] = x1 * y2 - x2 * y1;
+    a[1] = y2 - y0; b[1] = x0 - x2; c[1] = x2 * y0 - x0 * y2;
+    a[2] = y0 - y1; b[2] = x1 - x0; c[2] = x0 * y1 - x1 * y0;
+
+    // Depth plane from the barycentrics, biased to the farthest value the
+    // triangle reaches inside a pixel.
+    az = (a[0] * z0 + a[1] * z1 + a[2] * z2) / area;
+    bz = (b[0] * z0 + b[1] * z1 + b[2] * z2) / area;
+    cz = (c[0] * z0 + c[1] * z1 + c[2] * z2) / area + 0.5f * (fabsf(az) + fabsf(bz));
+
+    xmin &= ~3; // Whole groups of four pixels; the width is a multiple of 8.
+
+    for (y = ymin; y <= ymax; ++y) {
+        const float cy = (float)y + 0.5f;
+        float* row = ob->depth + y * ob->width;
+
+#ifdef OCCLUSION_SSE
+        const __m128 lane = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+        const __m128 e0r = _mm_set1_ps(b[0] * cy + c[0]);
+        const __m128 e1r = _mm_set1_ps(b[1] * cy + c[1]);
+        const __m128 e2r = _mm_set1_ps(b[2] * cy + c[2]);
+        const __m128 zr = _mm_set1_ps(bz * cy + cz);
+        const __m128 va0 = _mm_set1_ps(a[0]), va1 = _mm_set1_ps(a[1]), va2 = _mm_set1_ps(a[2]);
+        const __m128 vaz = _mm_set1_ps(az), zero = _mm_setzero_ps();
+
+        for (x = xmin; x <= xmax; x += 4) {
+            const __m128 cx = _mm_add_ps(_mm_set1_ps((float)x), lane);
+            const __m128 e0 = _mm_add_ps(_mm_mul_ps(va0, cx), e0r);
+            const __m128 e1 = _mm_add_ps(_mm_mul_ps(va1, cx), e1r);
+            const __m128 e2 = _mm_add_ps(_mm_mul_ps(va2, cx), e2r);
+            const __m128 inside = _mm_and_ps(_mm_cmpge_ps(e0, zero),
+                                  _mm_and_ps(_mm_cmpge_ps(e1, zero), _mm_cmpge_ps(e2, zero)));
+            __m128 z, d;
+
+            if (_mm_movemask_ps(inside) == 0) continue;
+
+            z = _mm_add_ps(_mm_mul_ps(vaz, cx), zr);
+            d = _mm_loadu_ps(row + x);
+            // Keep the nearest occluder: min(depth, z) where covered.
+            d = _mm_or_ps(_mm_and_ps(inside, _mm_min_ps(d, z)), _mm_andnot_ps(inside, d));
+            _mm_storeu_ps(row + x, d);
+        }
+#else
+        for (x = xmin; x <= xmax; ++x) {
+            const float cx = (float)x + 0.5f;
+            if (a[0] * cx + b[0] * cy + c[0] >= 0
+                    && a[1] * cx + b[1] * cy + c[1] >= 0
+                    && a[2] * cx + b[2] * cy + c[2] >= 0) {
+                const float z = az * cx + bz * cy + cz;
+                if (z < row[x]) row[x] = z;
+            }
+        }
+#endif
+    }
+}
+
+static void raster_band(size_t begin, size_t end, void* arg) {
+    occlusion_buffer_t* ob = (occlusion_buffer_t*) arg;
+    size_t band, t;
+    int tx, x, y;
+
+    for (band = begin; band < end; ++band) {
+        const int y0 = (int)band * OCCLUSION_TILE, y1 = y0 + OCCLUSION_TILE;
+
+        for (t = 0; t < ob->tri_count; ++t) {
+            const float* tri = ob->tris + t * TRI_FLOATS;
+            if (tri[0] != tri[0]) continue; // Clipped.
+            if (fmaxf(tri[1], fmaxf(tri[4], tri[7])) < (float)y0
+                    || fminf(tri[1], fminf(tri[4], tri[7])) > (float)y1)
+                continue;
+            raster_triangle(ob, tri, y0, y1);
+        }
+
+        // Coarse level for the box tests.
+        for (tx = 0; tx < ob->tiles_x; ++tx) {
+            float farthest = -1e30f;
+            for (y = y0; y < y1; ++y)
+                for (x = tx * OCCLUSION_TILE; x < (tx + 1) * OCCLUSION_TILE; ++x)
+                    farthest = fmaxf(farthest, ob->depth[y * ob->width + x]);
+            ob->tile_max[band * ob->tiles_x + tx] = farthest;
+        }
+    }
+}
+
+static void test_range(size_t begin, size_t end, void* arg) {
+    const test_job_t* job = (const test_job_t*) arg;
+    size_t i;
+
+    for (i = begin; i < end; ++i)
+        job->visible[i] = (unsigned char) occlusion_test_aabb(job->ob, job->mins[i], job->maxs[i]);
+}
@@ -0,0 +1,71 @@
+#ifndef RENDER_OCCLUSION_H
+#define RENDER_OCCLUSION_H
+
+#include <stddef.h>
+#include "math/utils.h"
+
+// Software occlusion culling.
+//
+// Designated occluder meshes are rasterized on the CPU into a small depth
+// buffer (e.g. 256x128) together with a per-tile "farthest depth" level.
+// Object bounding boxes are then tested against it, and anything entirely
+// behind the occluders can be skipped before submission.
+//
+// Depth is kept conservative: occluders store the farthest depth their
+// triangle reaches within each covered pixel, triangles crossing the near
+// plane are dropped, and boxes crossing it are always visible. Coverage is
+// sampled at pixel centres, so silhouettes are exact to within half a pixel
+// of the low-resolution buffer. Rasterization processes four pixels at a
+// time with SSE and runs in horizontal bands across the job system.
+
+#define OCCLUSION_TILE 8
+
+typedef struct occluder_ {
+    const float* positions;     // xyz at the start of each vertex...
+    size_t stride;              // ...this many bytes apart (e.g. sizeof(vertex_t)).
+    size_t vertex_count;
+    const GLuint* indices;      // Triangle list.
+    size_t index_count;
+    mat4_t model;
+} occluder_t;
+
+typedef struct occlusion_stats_ {
+    unsigned long triangles_rasterized;
+    unsigned long triangles_clipped;    // Crossed the near plane, skipped.
+    unsigned long boxes_tested;
+    unsigned long boxes_occluded;
+} occlusion_stats_t;
+
+typedef struct occlusion_buffer_ {
+    int width, height;          // Multiples of OCCLUSION_TILE.
+    int tiles_x, tiles_y;
+    float* depth;               // NDC depth, 1 = far plane, row 0 at the bottom.
+    float* tile_max;            // Farthest depth within each tile.
+    mat4_t view_proj;
+
+    // Screen-space triangles from the last occluder pass: x, y, z per vertex.
+    float* tris;
+    size_t tri_count, tri_capacity;
+    size_t* first_tri;          // Per occluder, into tris.
+    size_t occluder_capacity;
+
+    occlusion_stats_t stats;
+} occlusion_buffer_t;
+
+int  occlusion_init(occlusion_buffer_t* ob, int width, int height);
+void occlusion_destroy(occlusion_buffer_t* ob);
+
+// Clears the buffer for a new frame seen through view and projection.
+void occlusion_begin(occlusion_buffer_t* ob, const mat4_t* view, const mat4_t* projection);
+
+void occlusion_render(occlusion_buffer_t* ob, const occluder_t* occluders, size_t count);
+
+// Returns 1 if the world-space box may be visible, 0 if it is hidden.
+int  occlusion_test_aabb(const occlusion_buffer_t* ob, const float min[3], const float max[3]);
+
+// Tests `count` boxes (min/max pairs) in parallel, writing 1 (visible) or
+// 0 (occluded) per box. Returns the number of visible boxes.
+size_t occlusion_test_aabbs(occlusion_buffer_t* ob, const float (*mins)[3], const float (*maxs)[3],
+                            size_t count, unsigned char* visible);
+
+#endif // RENDER_OCCLUSION_H
@@ -0,0 +1,195 @@
+#include "pacing.h"
+
+#include <stdio.h>
+#include <time.h>
+
+// The OS scheduler can oversleep by a fraction of a millisecond, so stop
+// sleeping this long before the deadline and spin for the remainder.
+#define SPIN_MARGIN 0.001
+#define LATENCY_EMA 0.1
+#define CALIBRATE_PERIOD 1.0    // Seconds between GPU clock calibrations.
+
+const pacing_config_t PACING_DEFAULTS = { VSYNC_ON, 0.f, 0, 2, 0 };
+
+static void retire_frame(pacing_t* p, GLuint64 timeout_ns);
+
+// Pairs the GL clock with glfwGetTime(). Reading GL_TIMESTAMP doesn't wait
+// for the GPU, so the two are taken within a few microseconds of each other.
+static void calibrate_clock(pacing_t* p) {
+    GLint64 gpu_now;
+    glGetInteger64v(GL_TIMESTAMP, &gpu_now);
+    p->calibrated_at = glfwGetTime();
+    p->gpu_clock_offset = p->calibrated_at - (double)gpu_now * 1e-9;
+}
+
+void pacing_init(pacing_t* p, GLFWwindow* wnd, const pacing_config_t* cfg) {
+    unsigned int i;
+
+    p->wnd = wnd;
+    p->cfg = cfg != NULL ? *cfg : PACING_DEFAULTS;
+    if (p->cfg.max_queued_frames < 0) p->cfg.max_queued_frames = 0;
+    if (p->cfg.max_queued_frames > PACING_MAX_QUEUED) p->cfg.max_queued_frames = PACING_MAX_QUEUED;
+
+    for (i = 0; i < PACING_MAX_QUEUED; ++i) {
+        p->fences[i] = 0;
+        p->timestamps[i] = 0;
+        p->fence_input_time[i] = 0;
+    }
+    p->head = p->tail = p->in_flight = 0;
+    p->timer_queries = GLEW_VERSION_3_3 || GLEW_ARB_timer_query;
+    if (p->timer_queries) {
+        glGenQueries(PACING_MAX_QUEUED, p->timestamps);
+        calibrate_clock(p);
+    }
+    p->deadline = p->input_time = glfwGetTime();
+    pacing_reset_latency(p);
+
+    pacing_set_vsync(p, p->cfg.vsync);
+}
+
+void pacing_destroy(pacing_t* p) {
+    while (p->in_flight > 0) retire_frame(p, GL_TIMEOUT_IGNORED);
+    if (p->timer_queries) glDeleteQueries(PACING_MAX_QUEUED, p->timestamps);
+    p->timer_queries = 0;
+}
+
+void pacing_set_vsync(pacing_t* p, vsync_mode_t mode) {
+    p->cfg.vsync = mode;
+    p->vsync_applied = mode;
+
+    if (mode == VSYNC_ADAPTIVE
+            && !glfwExtensionSupported("GLX_EXT_swap_control_tear")
+            && !glfwExtensionSupported("WGL_EXT_swap_control_tear")) {
+        fprintf(stderr, "WARNING: Adaptive vsync is not supported, using vsync on.\n");
+        p->vsync_applied = VSYNC_ON;
+    }
+
+    switch (p->vsync_applied) {
+        case VSYNC_OFF:      glfwSwapInterval(0); break;
+        case VSYNC_ADAPTIVE: glfwSwapInterval(-1); break;
+        default:             glfwSwapInterval(1); break;
+    }
+}
+
+void pacing_begin_frame(pacing_t* p) {
+    // 1. Frame cap: wait for this frame's slot.
+    if (p->cfg.fps_cap > 0) {
+        const double period = 1.0 / p->cfg.fps_cap;
+        double now = glfwGetTime();
+
+        if (now < p->deadline) {
+            precise_wait_until(p->deadline);
+            p->deadline += period;
+        } else {
+            // Running late: don't try to catch up with a burst of frames.
+            p->deadline = now + period;
+        }
+    }
+
+    // 2. Bound the frames in flight. Waiting here, before any input is read,
+    // keeps the CPU from running ahead of the GPU with stale input.
+    if (p->cfg.max_queued_frames > 0)
+        while (p->in_flight >= (unsigned int)p->cfg.max_queued_frames)
+            retire_frame(p, GL_TIMEOUT_IGNORED);
+
+    // 3. Late input sampling: read input as close to submission as possible.
+    if (p->cfg.late_input) {
+        if (!p->cfg.external_events) glfwPollEvents();
+        p->input_time = glfwGetTime();
+    }
+}
+
+void pacing_end_frame(pacing_t* p) {
+    glfwSwapBuffers(p->wnd);
+
+    // Fence the frame so we know when the GPU is done with it. If the ring is
+    // full (unbounded queue and a slow GPU), retire the oldest entry first.
+    if (p->in_flight == PACING_MAX_QUEUED) retire_frame(p, GL_TIMEOUT_IGNORED);
+    if (p->timer_queries) {
+        if (glfwGetTime() - p->calibrated_at > CALIBRATE_PERIOD) calibrate_clock(p);
+        glQueryCounter(p->timestamps[p->head], GL_TIMESTAMP);
+    }
+    p->fences[p->head] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    p->fence_input_time[p->head] = p->input_time;
+    p->head = (p->head + 1) % PACING_MAX_QUEUED;
+    ++p->in_flight;
+
+    // Pick up any frames that completed without blocking.
+    while (p->in_flight > 0) {
+        const unsigned int before = p->in_flight;
+        retire_frame(p, 0);
+        if (p->in_flight == before) break;
+    }
+
+    if (!p->cfg.late_input) {
+        if (!p->cfg.external_events) glfwPollEvents();
+        p->input_time = glfwGetTime();
+    }
+}
+
+latency_stats_t pacing_latency(const pacing_t* p) { return p->latency; }
+
+void pacing_reset_latency(pacing_t* p) {
+    p->latency.last = p->latency.avg = p->latency.max = 0;
+    p->latency.samples = 0;
+}
+
+const char* vsync_mode_name(vsync_mode_t mode) {
+    switch (mode) {
+        case VSYNC_OFF:      return "off";
+        case VSYNC_ON:       return "on";
+        case VSYNC_ADAPTIVE: return "adaptive";
+    }
+    return "?";
+}
+
+void precise_wait_until(double when) {
+    double remaining = when - glfwGetTime();
+
+    if (remaining > SPIN_MARGIN) {
+        struct timespec ts;
+        const double sleep_for = remaining - SPIN_MARGIN;
+        ts.tv_sec = (time_t)sleep_for;
+        ts.tv_nsec = (long)((sleep_for - (double)ts.tv_sec) * 1e9);
+        nanosleep(&ts, NULL);
+    }
+
+    while (glfwGetTime() < when)
+        ; // Spin for the last stretch.
+}
+
+// Wait up to `timeout_ns` for the oldest frame in flight and, if it has
+// completed, release its fence and record its input-to-completion latency.
+static void retire_frame(pacing_t* p, GLuint64 timeout_ns) {
+    GLenum res;
+    double done, latency;
+    GLsync fence = p->fences[p->tail];
+
+    if (p->in_flight == 0) return;
+
+    res = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, timeout_ns);
+    if (res == GL_TIMEOUT_EXPIRED) return;
+    if (res == GL_WAIT_FAILED) fprintf(stderr, "ERROR: Waiting on frame fence failed.\n");
+
+    // The timestamp was written before the fence, so it has landed too.
+    if (p->timer_queries) {
+        GLuint64 gpu_done;
+        glGetQueryObjectui64v(p->timestamps[p->tail], GL_QUERY_RESULT, &gpu_done);
+        done = (double)gpu_done * 1e-9 + p->gpu_clock_offset;
+    } else {
+        done = glfwGetTime(); // An upper bound: the fence may have signalled a frame ago.
+    }
+    latency = done - p->fence_input_time[p->tail];
+    if (latency < 0) latency = 0;
+    p->latency.last = latency;
+    p->latency.avg = p->latency.samples == 0
+        ? latency
+        : p->latency.avg + LATENCY_EMA * (latency - p->latency.avg);
+    if (latency > p->latency.max) p->latency.max = latency;
+    ++p->latency.samples;
+
+    glDeleteSync(fence);
+    p->fences[p->tail] = 0;
+    p->tail = (p->tail + 1) % PACING_MAX_QUEUED;
+    --p->in_flight;
+}
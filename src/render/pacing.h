@@ -0,0 +1,86 @@
+#ifndef RENDER_PACING_H
+#define RENDER_PACING_H
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+// Frame pacing for the main loop: swap interval, an optional frame-rate cap,
+// late input sampling and a bound on the number of frames the driver may queue.
+//
+// Typical loop:
+//     pacing_begin_frame(&p);  // cap, wait for the GPU, sample input
+//     ... issue GL commands ...
+//     pacing_end_frame(&p);    // swap and fence the frame
+//
+// Latency runs from input sampling to the GPU finishing the frame. Where
+// timer queries are supported (GL 3.3), a GL_TIMESTAMP query issued next to
+// each frame's fence records when the GPU got there, mapped onto the
+// glfwGetTime() clock by an offset recalibrated every second. Without them,
+// the time the fence is seen signalled is used, which overstates latency by
+// up to a frame since fences are polled once per frame.
+//
+// The pacing calls must come from the thread the window's context is current
+// on. Events can only be polled on the main thread, so a render thread of its
+// own sets `external_events` and takes its input from the main thread.
+
+#define PACING_MAX_QUEUED 4
+
+typedef enum vsync_mode_ {
+    VSYNC_OFF = 0,
+    VSYNC_ON,
+    VSYNC_ADAPTIVE // Swap tear control: sync when on time, tear when late.
+} vsync_mode_t;
+
+typedef struct pacing_config_ {
+    vsync_mode_t vsync;
+    float fps_cap;          // 0 = uncapped.
+    int late_input;         // Poll events right before submission instead of after the swap.
+    int max_queued_frames;  // 0 = let the driver decide, otherwise 1..PACING_MAX_QUEUED.
+    int external_events;    // Another thread polls events; only note when input was sampled.
+} pacing_config_t;
+
+typedef struct latency_stats_ {
+    double last;    // Seconds from input sampling to the frame's fence signalling.
+    double avg;     // Exponential moving average of the above.
+    double max;
+    unsigned long samples;
+} latency_stats_t;
+
+typedef struct pacing_ {
+    GLFWwindow* wnd;
+    pacing_config_t cfg;
+    vsync_mode_t vsync_applied; // May differ from cfg.vsync if adaptive is unsupported.
+    double deadline;            // When the next frame may start (frame cap).
+    double input_time;          // When events were last polled.
+
+    // Ring of frames in flight, oldest at `tail`.
+    GLsync fences[PACING_MAX_QUEUED];
+    GLuint timestamps[PACING_MAX_QUEUED];   // 0s without timer queries.
+    double fence_input_time[PACING_MAX_QUEUED];
+    unsigned int head, tail, in_flight;
+
+    int timer_queries;
+    double gpu_clock_offset;    // glfwGetTime() - GL_TIMESTAMP, in seconds.
+    double calibrated_at;
+
+    latency_stats_t latency;
+} pacing_t;
+
+extern const pacing_config_t PACING_DEFAULTS;
+
+void pacing_init(pacing_t* p, GLFWwindow* wnd, const pacing_config_t* cfg);
+void pacing_destroy(pacing_t* p);
+void pacing_set_vsync(pacing_t* p, vsync_mode_t mode);
+void pacing_begin_frame(pacing_t* p);
+void pacing_end_frame(pacing_t* p);
+
+latency_stats_t pacing_latency(const pacing_t* p);
+void pacing_reset_latency(pacing_t* p);
+
+const char* vsync_mode_name(vsync_mode_t mode);
+
+// Sleep until the absolute time `when` (glfwGetTime() clock), sleeping for
+// the bulk of it and spinning for the last stretch to hit it precisely.
+void precise_wait_until(double when);
+
+#endif // RENDER_PACING_H
@@ -0,0 +1,330 @@
+#include "particles.h"
+#include "program.h"
+#include "core/jobs.h"
+#include <stdint.h>
+#include <stdatomic.h>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define PARTICLES_SSE 1
+#endif
+
+#include "trace_gl.h" // Last: the draws go through the recorder and counters.
+
+#define GROUP_GRAIN 1024    // Groups of four particles per parallel_for range.
+#define FENCE_TIMEOUT_NS 1000000000ull
+
+const particle_config_t PARTICLE_DEFAULTS = {
+    { 0.f, 0.f, 0.f },  // emitter
+    0.35f,              // spread
+    3.0f,               // speed
+    -4.0f,              // gravity
+    0.2f,               // drag
+    1.5f, 3.0f,         // life
+    -0.6f,              // floor
+    0.5f,               // restitution
+    0.01f               // size
+};
+
+static const GLchar* VERTEX_SHADER = {
+    "#version 330 core\n"
+    "layout(location=0) in vec4 in_Particle;\n" // xyz, age / life
+    "uniform mat4 ViewMatrix;\n"
+    "uniform mat4 ProjectionMatrix;\n"
+    "uniform float Size;\n"
+    "uniform float ViewportHeight;\n"
+    "out float ex_Age;\n"
+
+    "void main(void)\n"
+    "{\n"
+    "  vec4 view_pos = ViewMatrix * vec4(in_Particle.xyz, 1.0);\n"
+    "  gl_Position = ProjectionMatrix * view_pos;\n"
+    "  gl_PointSize = max(Size * ProjectionMatrix[1][1] * 0.5 * ViewportHeight / max(-view_pos.z, 1e-3), 1.0);\n"
+    "  ex_Age = in_Particle.w;\n"
+    "}\n"
+};
+
+static const GLchar* FRAGMENT_SHADER = {
+    "#version 330 core\n"
+    "in float ex_Age;\n"
+    "out vec4 out_Color;\n"
+
+    "void main(void)\n"
+    "{\n"
+    "  vec2 d = gl_PointCoord * 2.0 - 1.0;\n"
+    "  if (dot(d, d) > 1.0) discard;\n"
+    "  out_Color = vec4(mix(vec3(1.0, 0.9, 0.5), vec3(0.8, 0.2, 0.1), ex_Age), 1.0);\n"
+    "}\n"
+};
+
+typedef struct simulate_job_ {
+    particles_t* p;
+    float dt;
+    float* out;                 // Vertices: x, y, z, age / life.
+    atomic_ulong respawns;
+} simulate_job_t;
+
+static float hash01(uint32_t x) {
+    x ^= x >> 16; x *= 0x7FEB352Du;
+    x ^= x >> 15; x *= 0x846CA68Bu;
+    x ^= x >> 16;
+    return (float)(x >> 8) * (1.0f / 16777216.0f);
+}
+
+// Launches particle i from the emitter; random numbers come from a hash of
+// the particle and the frame, so runs are repeatable whatever the threading.
+static void respawn(particles_t* p, size_t i) {
+    const particle_config_t* c = &p->cfg;
+    const uint32_t key = (uint32_t)i * 0x9E3779B9u + (uint32_t)p->frame * 0x85EBCA6Bu;
+    const float dx = c->spread * (2 * hash01(key) - 1), dz = c->spread * (2 * hash01(key + 1) - 1);
+    const float speed = c->speed * (0.75f + 0.5f * hash01(key + 2)) / sqrtf(1 + dx * dx + dz * dz);
+
+    p->px[i] = c->emitter[0];
+    p->py[i] = c->emitter[1];
+    p->pz[i] = c->emitter[2];
+    p->vx[i] = dx * speed;
+    p->vy[i] = speed;
+    p->vz[i] = dz * speed;
+    p->age[i] = 0;
+    p->life[i] = c->life_min + (c->life_max - c->life_min) * hash01(key + 3);
+}
+
+static void simulate_range(size_t begin, size_t end, void* arg) {
+    simulate_job_t* job = (simulate_job_t*) arg;
+    particles_t* p = job->p;
+    const particle_config_t* c = &p->cfg;
+    const float keep = 1 - c->drag * job->dt;
+    unsigned long respawns = 0;
+    size_t g;
+
+#ifdef PARTICLES_SSE
+    const __m128 dt = _mm_set1_ps(job->dt), k = _mm_set1_ps(keep > 0 ? keep : 0);
+    const __m128 fall = _mm_set1_ps(c->gravity * job->dt), floor_y = _mm_set1_ps(c->floor_y);
+    const __m128 bounce = _mm_set1_ps(-c->restitution);
+
+    for (g = begin; g < end; ++g) {
+        const size_t i = g * 4;
+        __m128 vx = _mm_mul_ps(_mm_loadu_ps(p->vx + i), k);
+        __m128 vy = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(p->vy + i), k), fall);
+        __m128 vz = _mm_mul_ps(_mm_loadu_ps(p->vz + i), k);
+        __m128 px = _mm_add_ps(_mm_loadu_ps(p->px + i), _mm_mul_ps(vx, dt));
+        __m128 py = _mm_add_ps(_mm_loadu_ps(p->py + i), _mm_mul_ps(vy, dt));
+        __m128 pz = _mm_add_ps(_mm_loadu_ps(p->pz + i), _mm_mul_ps(vz, dt));
+        __m128 age = _mm_add_ps(_mm_loadu_ps(p->age + i), dt);
+        __m128 life = _mm_loadu_ps(p->life + i);
+        const __m128 below = _mm_cmplt_ps(py, floor_y);
+        int dead;
+
+        // Bounce: clamp to the floor and reflect what's left of vy.
+        py = _mm_or_ps(_mm_and_ps(below, floor_y), _mm_andnot_ps(below, py));
+        vy = _mm_or_ps(_mm_and_ps(below, _mm_mul_ps(vy, bounce)), _mm_andnot_ps(below, vy));
+
+        _mm_storeu_ps(p->px + i, px); _mm_storeu_ps(p->py + i, py); _mm_storeu_ps(p->pz + i, pz);
+        _mm_storeu_ps(p->vx + i, vx); _mm_storeu_ps(p->vy + i, vy); _mm_storeu_ps(p->vz + i, vz);
+        _mm_storeu_ps(p->age + i, age);
+
+        // Few particles die in any one frame: respawn them one by one.
+        if ((dead = _mm_movemask_ps(_mm_cmpge_ps(age, life))) != 0) {
+            int lane;
+            for (lane = 0; lane < 4; ++lane)
+                if (dead & (1 << lane)) { respawn(p, i + lane); ++respawns; }
+            px = _mm_loadu_ps(p->px + i); py = _mm_loadu_ps(p->py + i); pz = _mm_loadu_ps(p->pz + i);
+            age = _mm_loadu_ps(p->age + i); life = _mm_loadu_ps(p->life + i);
+        }
+
+        if (job->out != NULL) {
+            __m128 t = _mm_div_ps(age, life);
+            _MM_TRANSPOSE4_PS(px, py, pz, t);
+            _mm_storeu_ps(job->out + i * 4, px);
+            _mm_storeu_ps(job->out + i * 4 + 4, py);
+            _mm_storeu_ps(job->out + i * 4 + 8, pz);
+            _mm_storeu_ps(job->out + i * 4 + 12, t);
+        }
+    }
+#else
+    for (g = begin * 4; g < end * 4; ++g) {
+        p->vx[g] *= keep;
+        p->vy[g] = p->vy[g] * keep + c->gravity * job->dt;
+        p->vz[g] *= keep;
+        p->px[g] += p->vx[g] * job->dt;
+        p->py[g] += p->vy[g] * job->dt;
+        p->pz[g] += p->vz[g] * job->dt;
+        if (p->py[g] < c->floor_y) {
+            p->py[g] = c->floor_y;
+            p->vy[g] *= -c->restitution;
+        }
+        if ((p->age[g] += job->dt) >= p->life[g]) { respawn(p, g); ++respawns; }
+        if (job->out != NULL) {
+            job->out[g * 4] = p->px[g];
+            job->out[g * 4 + 1] = p->py[g];
+            job->out[g * 4 + 2] = p->pz[g];
+            job->out[g * 4 + 3] = p->age[g] / p->life[g];
+        }
+    }
+#endif
+    atomic_fetch_add(&job->respawns, respawns);
+}
+
+int particles_init(particles_t* p, size_t count, const particle_config_t* cfg) {
+    size_t i, vertex_bytes;
+
+    memset(p, 0, sizeof(*p));
+    p->cfg = cfg != NULL ? *cfg : PARTICLE_DEFAULTS;
+    p->count = count;
+    p->padded = (count + 3) & ~(size_t)3;
+    vertex_bytes = p->padded * 4 * sizeof(float);
+
+    if (count == 0 || (p->data = (float*) malloc(sizeof(float) * 8 * p->padded)) == NULL) {
+        fprintf(stderr, "ERROR: Could not allocate %zu particles.\n", count);
+        return 0;
+    }
+    p->px = p->data;
+    p->py = p->px + p->padded;
+    p->pz = p->py + p->padded;
+    p->vx = p->pz + p->padded;
+    p->vy = p->vx + p->padded;
+    p->vz = p->vy + p->padded;
+    p->age = p->vz + p->padded;
+    p->life = p->age + p->padded;
+
+    // Start at random points of their lives, so they don't all launch at once.
+    for (i = 0; i < p->padded; ++i) {
+        respawn(p, i);
+        p->age[i] = p->life[i] * hash01((uint32_t)i ^ 0xA5A5A5A5u);
+    }
+
+    if ((p->prog = program_from_source(VERTEX_SHADER, FRAGMENT_SHADER)) == 0) {
+        particles_destroy(p);
+        return 0;
+    }
+    p->view_uloc = glGetUniformLocation(p->prog, "ViewMatrix");
+    p->proj_uloc = glGetUniformLocation(p->prog, "ProjectionMatrix");
+    p->size_uloc = glGetUniformLocation(p->prog, "Size");
+    p->height_uloc = glGetUniformLocation(p->prog, "ViewportHeight");
+
+    glGenVertexArrays(1, &p->vao);
+    glGenBuffers(1, &p->vbo);
+    glBindVertexArray(p->vao);
+    glBindBuffer(GL_ARRAY_BUFFER, p->vbo);
+
+    // Mappings are invisible to the trace recorder: stage through the heap then.
+    p->persistent = !trace_recording() && (GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage);
+    if (p->persistent) {
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_ARRAY_BUFFER, vertex_bytes * PARTICLE_FRAMES, NULL, flags);
+        p->mapped = (unsigned char*) glMapBufferRange(GL_ARRAY_BUFFER, 0, vertex_bytes * PARTICLE_FRAMES, flags);
+        if (p->mapped == NULL) {
+            fprintf(stderr, "ERROR: Could not map the particle buffer.\n");
+            glBindVertexArray(0);
+            particles_destroy(p);
+            return 0;
+        }
+    } else {
+        glBufferData(GL_ARRAY_BUFFER, vertex_bytes, NULL, GL_STREAM_DRAW);
+        if (trace_recording() && (p->staging = (float*) malloc(vertex_bytes)) == NULL) {
+            fprintf(stderr, "ERROR: Could not allocate %zu particle vertices.\n", count);
+            glBindVertexArray(0);
+            particles_destroy(p);
+            return 0;
+        }
+    }
+
+    // Persistent regions are selected with the first vertex of the draw.
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(float) * 4, (GLvoid*)0);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    exit_on_glError("ERROR: Could not create the particle buffers.");
+    return 1;
+}
+
+void particles_destroy(particles_t* p) {
+    int i;
+
+    for (i = 0; i < PARTICLE_FRAMES; ++i)
+        if (p->fences[i] != NULL) glDeleteSync(p->fences[i]);
+    if (p->mapped != NULL) {
+        glBindBuffer(GL_ARRAY_BUFFER, p->vbo);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+    if (p->vbo != 0) glDeleteBuffers(1, &p->vbo);
+    if (p->vao != 0) glDeleteVertexArrays(1, &p->vao);
+    if (p->prog != 0) glDeleteProgram(p->prog);
+    free(p->data);
+    free(p->staging);
+    memset(p, 0, sizeof(*p));
+}
+
+void particles_update(particles_t* p, float dt) {
+    const size_t vertex_bytes = p->padded * 4 * sizeof(float);
+    simulate_job_t job;
+    double start;
+    void* dst = NULL;
+
+    job.p = p;
+    job.dt = dt;
+    atomic_init(&job.respawns, 0);
+    ++p->frame;
+
+    // Where this frame's vertices go.
+    if (p->persistent) {
+        p->region = (p->region + 1) % PARTICLE_FRAMES;
+        if (p->fences[p->region] != NULL) {
+            // Written PARTICLE_FRAMES frames ago; normally long done.
+            if (glClientWaitSync(p->fences[p->region], 0, 0) == GL_TIMEOUT_EXPIRED) {
+                ++p->stats.buffer_waits;
+                glClientWaitSync(p->fences[p->region], GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_TIMEOUT_NS);
+            }
+            glDeleteSync(p->fences[p->region]);
+            p->fences[p->region] = NULL;
+        }
+        dst = p->mapped + vertex_bytes * p->region;
+    } else if (p->staging != NULL) {
+        dst = p->staging;
+    } else {
+        // Orphan last frame's storage and write into a fresh one.
+        glBindBuffer(GL_ARRAY_BUFFER, p->vbo);
+        glBufferData(GL_ARRAY_BUFFER, vertex_bytes, NULL, GL_STREAM_DRAW);
+        dst = glMapBufferRange(GL_ARRAY_BUFFER, 0, vertex_bytes,
+                               GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    }
+    job.out = (float*) dst;
+
+    start = glfwGetTime();
+    jobs_parallel_for(p->padded / 4, GROUP_GRAIN, simulate_range, &job);
+    p->stats.simulate_ms += (glfwGetTime() - start) * 1000.;
+    p->stats.respawns += atomic_load(&job.respawns);
+    p->stats.frames++;
+
+    if (!p->persistent) {
+        glBindBuffer(GL_ARRAY_BUFFER, p->vbo);
+        if (p->staging != NULL)
+            glBufferData(GL_ARRAY_BUFFER, vertex_bytes, p->staging, GL_STREAM_DRAW);
+        else if (dst != NULL)
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+}
+
+void particles_draw(particles_t* p, const mat4_t* view, const mat4_t* projection, int viewport_height) {
+    glUseProgram(p->prog);
+    glUniformMatrix4fv(p->view_uloc, 1, GL_FALSE, view->m);
+    glUniformMatrix4fv(p->proj_uloc, 1, GL_FALSE, projection->m);
+    glUniform1f(p->size_uloc, p->cfg.size);
+    glUniform1f(p->height_uloc, (float)viewport_height);
+
+    glEnable(GL_PROGRAM_POINT_SIZE);
+    glBindVertexArray(p->vao);
+    glDrawArrays(GL_POINTS, p->persistent ? (GLint)(p->padded * p->region) : 0, (GLsizei)p->count);
+    glBindVertexArray(0);
+    glDisable(GL_PROGRAM_POINT_SIZE);
+    glUseProgram(0);
+
+    if (p->persistent) p->fences[p->region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    exit_on_glError("ERROR: Could not draw particles.");
+}
+
+double particles_per_ms(const particles_t* p) {
+    return p->stats.simulate_ms > 0 ? (double)p->count * p->stats.frames / p->stats.simulate_ms : 0.;
+}
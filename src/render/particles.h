@@ -0,0 +1,76 @@
+#ifndef RENDER_PARTICLES_H
+#define RENDER_PARTICLES_H
+
+#include <GL/glew.h>
+#include "math/utils.h"
+
+// CPU particle fountain.
+//
+// Particles are kept as a structure of arrays (one float array per
+// component, padded to a multiple of four) and simulated four at a time with
+// SSE, in ranges spread across the job system: drag and gravity, Euler
+// integration, a bouncy floor, and respawning at the emitter when their
+// lifetime runs out. The same pass writes the positions straight into the
+// vertex buffer the frame will draw, which is either a persistently mapped
+// ring of PARTICLE_FRAMES regions guarded by fences (ARB_buffer_storage) or
+// an orphaned buffer mapped for the frame. Particles are drawn as round point
+// sprites, sized in world units through the camera's mat4_t matrices.
+//
+// While a GL trace is recording (it can't see writes through mappings) the
+// vertices go through a heap buffer and glBufferData instead.
+
+#define PARTICLE_FRAMES 3
+
+typedef struct particle_config_ {
+    float emitter[3];
+    float spread;           // Horizontal over vertical launch velocity, at most.
+    float speed;            // Launch speed, +/- 25%.
+    float gravity;          // Along y.
+    float drag;             // Fraction of the velocity lost per second.
+    float life_min, life_max;   // Seconds.
+    float floor_y;
+    float restitution;      // Vertical speed kept on bouncing off the floor.
+    float size;             // Sprite diameter in world units.
+} particle_config_t;
+
+extern const particle_config_t PARTICLE_DEFAULTS;
+
+typedef struct particles_stats_ {
+    unsigned long frames;
+    double simulate_ms;         // Total CPU time simulating and writing vertices.
+    unsigned long respawns;
+    unsigned long buffer_waits; // Ring region still in use by the GPU.
+} particles_stats_t;
+
+typedef struct particles_ {
+    particle_config_t cfg;
+    size_t count, padded;
+    float* data;                // All the arrays below, in one allocation.
+    float *px, *py, *pz, *vx, *vy, *vz, *age, *life;
+    unsigned long frame;
+
+    GLuint vbo, vao, prog;
+    GLint view_uloc, proj_uloc, size_uloc, height_uloc;
+    int persistent;
+    unsigned char* mapped;      // Persistent ring.
+    GLsync fences[PARTICLE_FRAMES];
+    unsigned int region;        // Written by the last update.
+    float* staging;             // Trace recording only.
+
+    particles_stats_t stats;
+} particles_t;
+
+// Call with the context current; `cfg` may be NULL for the defaults.
+int  particles_init(particles_t* p, size_t count, const particle_config_t* cfg);
+void particles_destroy(particles_t* p);
+
+// Advances the simulation by `dt` seconds and writes this frame's vertices.
+void particles_update(particles_t* p, float dt);
+
+// `viewport_height` in pixels, for the sprite size.
+void particles_draw(particles_t* p, const mat4_t* view, const mat4_t* projection, int viewport_height);
+
+// Simulated particles per millisecond of simulation, averaged so far.
+double particles_per_ms(const particles_t* p);
+
+#endif // RENDER_PARTICLES_H
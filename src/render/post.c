@@ -0,0 +1,259 @@
+#include "post.h"
+#include "program.h"
+#include "math/utils.h"
+
+#include "trace_gl.h" // Last: the draws go through the counters.
+
+// Covers the screen with one triangle; no vertex data.
+static const GLchar* VERTEX_SHADER = {
+    "#version 330 core\n"
+    "out vec2 ex_TexCoord;\n"
+
+    "void main(void)\n"
+    "{\n"
+    "  vec2 p = vec2(float((gl_VertexID & 1) << 2) - 1.0, float((gl_VertexID & 2) << 1) - 1.0);\n"
+    "  ex_TexCoord = p * 0.5 + 0.5;\n"
+    "  gl_Position = vec4(p, 0.0, 1.0);\n"
+    "}\n"
+};
+
+// Bilinear, then unsharp masking against the average of the four
+// neighbours, clamped to the neighbourhood's range.
+static const GLchar* UPSCALE_SHADER = {
+    "#version 330 core\n"
+    "uniform sampler2D Source;\n"
+    "uniform vec2 Scale;\n"        // The rendered fraction of Source.
+    "uniform float Sharpness;\n"
+    "in vec2 ex_TexCoord;\n"
+    "out vec4 out_Color;\n"
+
+    "void main(void)\n"
+    "{\n"
+    "  vec2 texel = 1.0 / vec2(textureSize(Source, 0));\n"
+    "  vec2 lo = 0.5 * texel, hi = Scale - 0.5 * texel;\n"
+    "  vec2 uv = clamp(ex_TexCoord * Scale, lo, hi);\n"
+    "  vec4 c = texture(Source, uv);\n"
+    "  if (Sharpness > 0.0) {\n"
+    "    vec3 n = texture(Source, clamp(uv + vec2(0.0, texel.y), lo, hi)).rgb;\n"
+    "    vec3 s = texture(Source, clamp(uv - vec2(0.0, texel.y), lo, hi)).rgb;\n"
+    "    vec3 e = texture(Source, clamp(uv + vec2(texel.x, 0.0), lo, hi)).rgb;\n"
+    "    vec3 w = texture(Source, clamp(uv - vec2(texel.x, 0.0), lo, hi)).rgb;\n"
+    "    vec3 low = min(c.rgb, min(min(n, s), min(e, w)));\n"
+    "    vec3 high = max(c.rgb, max(max(n, s), max(e, w)));\n"
+    "    c.rgb = clamp(c.rgb + Sharpness * (c.rgb - 0.25 * (n + s + e + w)), low, high);\n"
+    "  }\n"
+    "  out_Color = c;\n"
+    "}\n"
+};
+
+static const GLchar* BRIGHT_SHADER = {
+    "#version 330 core\n"
+    "uniform sampler2D Source;\n"
+    "uniform float Threshold;\n"
+    "in vec2 ex_TexCoord;\n"
+    "out vec4 out_Color;\n"
+
+    "void main(void)\n"
+    "{\n"
+    "  vec3 c = texture(Source, ex_TexCoord).rgb;\n"
+    "  float luma = dot(c, vec3(0.2126, 0.7152, 0.0722));\n"
+    "  out_Color = vec4(c * max(luma - Threshold, 0.0) / max(luma, 1e-4), 1.0);\n"
+    "}\n"
+};
+
+// Nine taps, folded into five weights of the binomial kernel.
+static const GLchar* BLUR_SHADER = {
+    "#version 330 core\n"
+    "uniform sampler2D Source;\n"
+    "uniform vec2 Direction;\n"  // One texel along the blur axis.
+    "in vec2 ex_TexCoord;\n"
+    "out vec4 out_Color;\n"
+    "const float Weights[5] = float[](0.2734375, 0.21875, 0.109375, 0.03125, 0.00390625);\n"
+
+    "void main(void)\n"
+    "{\n"
+    "  vec3 sum = texture(Source, ex_TexCoord).rgb * Weights[0];\n"
+    "  for (int i = 1; i < 5; ++i) {\n"
+    "    sum += texture(Source, ex_TexCoord + Direction * float(i)).rgb * Weights[i];\n"
+    "    sum += texture(Source, ex_TexCoord - Direction * float(i)).rgb * Weights[i];\n"
+    "  }\n"
+    "  out_Color = vec4(sum, 1.0);\n"
+    "}\n"
+};
+
+static const GLchar* COMPOSITE_SHADER = {
+    "#version 330 core\n"
+    "uniform sampler2D Scene;\n"
+    "uniform sampler2D Bloom;\n"
+    "uniform float BloomStrength;\n"
+    "in vec2 ex_TexCoord;\n"
+    "out vec4 out_Color;\n"
+
+    "void main(void)\n"
+    "{\n"
+    "  vec4 c = texture(Scene, ex_TexCoord);\n"
+    "  if (BloomStrength > 0.0) c.rgb += texture(Bloom, ex_TexCoord).rgb * BloomStrength;\n"
+    "  out_Color = c;\n"
+    "}\n"
+};
+
+static GLuint build(const GLchar* fragment_src) {
+    const GLuint prog = program_from_source(VERTEX_SHADER, fragment_src);
+    if (prog == 0) return 0;
+    // Samplers by unit, once.
+    glUseProgram(prog);
+    glUniform1i(glGetUniformLocation(prog, "Source"), 0);
+    glUniform1i(glGetUniformLocation(prog, "Scene"), 0);
+    glUniform1i(glGetUniformLocation(prog, "Bloom"), 1);
+    glUseProgram(0);
+    return prog;
+}
+
+int post_init(post_t* p) {
+    memset(p, 0, sizeof(*p));
+    p->threshold = 0.6f;
+    p->strength = 0.8f;
+    if ((p->upscale_prog = build(UPSCALE_SHADER)) == 0
+            || (p->bright_prog = build(BRIGHT_SHADER)) == 0
+            || (p->blur_prog = build(BLUR_SHADER)) == 0
+            || (p->composite_prog = build(COMPOSITE_SHADER)) == 0) {
+        fprintf(stderr, "ERROR: Could not build the post-processing programs.\n");
+        post_destroy(p);
+        return 0;
+    }
+    p->scale_uloc = glGetUniformLocation(p->upscale_prog, "Scale");
+    p->sharpness_uloc = glGetUniformLocation(p->upscale_prog, "Sharpness");
+    p->threshold_uloc = glGetUniformLocation(p->bright_prog, "Threshold");
+    p->direction_uloc = glGetUniformLocation(p->blur_prog, "Direction");
+    p->strength_uloc = glGetUniformLocation(p->composite_prog, "BloomStrength");
+    glGenVertexArrays(1, &p->vao);
+    exit_on_glError("ERROR: Could not set up post-processing.");
+    return 1;
+}
+
+void post_destroy(post_t* p) {
+    if (p->upscale_prog != 0) glDeleteProgram(p->upscale_prog);
+    if (p->bright_prog != 0) glDeleteProgram(p->bright_prog);
+    if (p->blur_prog != 0) glDeleteProgram(p->blur_prog);
+    if (p->composite_prog != 0) glDeleteProgram(p->composite_prog);
+    if (p->vao != 0) glDeleteVertexArrays(1, &p->vao);
+    memset(p, 0, sizeof(*p));
+}
+
+static void bind_texture(GLenum unit, GLuint texture) {
+    glActiveTexture(unit);
+    glBindTexture(GL_TEXTURE_2D, texture);
+}
+
+static void full_screen(const post_t* p, GLuint prog) {
+    glDisable(GL_DEPTH_TEST);
+    glUseProgram(prog);
+    glBindVertexArray(p->vao);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
+    glUseProgram(0);
+    glEnable(GL_DEPTH_TEST);
+}
+
+static void upscale_pass(const render_graph_t* g, void* arg) {
+    post_t* p = (post_t*)arg;
+    const graph_texture_desc_t* d = &g->resources[p->rendered - 1].desc;
+    bind_texture(GL_TEXTURE0, render_graph_texture(g, p->rendered));
+    glUseProgram(p->upscale_prog);
+    glUniform2f(p->scale_uloc, (float)p->rendered_width / d->width, (float)p->rendered_height / d->height);
+    glUniform1f(p->sharpness_uloc, p->sharpness);
+    full_screen(p, p->upscale_prog);
+    bind_texture(GL_TEXTURE0, 0);
+}
+
+static void bright_pass(const render_graph_t* g, void* arg) {
+    post_t* p = (post_t*)arg;
+    bind_texture(GL_TEXTURE0, render_graph_texture(g, p->scene));
+    glUseProgram(p->bright_prog);
+    glUniform1f(p->threshold_uloc, p->threshold);
+    full_screen(p, p->bright_prog);
+}
+
+static void blur(const render_graph_t* g, const post_t* p, graph_resource_t source, int vertical) {
+    const graph_texture_desc_t* d = &g->resources[source - 1].desc;
+    bind_texture(GL_TEXTURE0, render_graph_texture(g, source));
+    glUseProgram(p->blur_prog);
+    glUniform2f(p->direction_uloc, vertical ? 0.0f : 1.0f / d->width, vertical ? 1.0f / d->height : 0.0f);
+    full_screen(p, p->blur_prog);
+}
+
+static void blur_h_pass(const render_graph_t* g, void* arg) {
+    post_t* p = (post_t*)arg;
+    blur(g, p, p->bright, 0);
+}
+
+static void blur_v_pass(const render_graph_t* g, void* arg) {
+    post_t* p = (post_t*)arg;
+    blur(g, p, p->blurred_h, 1);
+}
+
+static void composite_pass(const render_graph_t* g, void* arg) {
+    post_t* p = (post_t*)arg;
+    bind_texture(GL_TEXTURE1, p->bloom != 0 ? render_graph_texture(g, p->bloom) : 0);
+    bind_texture(GL_TEXTURE0, render_graph_texture(g, p->scene));
+    glUseProgram(p->composite_prog);
+    glUniform1f(p->strength_uloc, p->bloom != 0 ? p->strength : 0.0f);
+    full_screen(p, p->composite_prog);
+    bind_texture(GL_TEXTURE1, 0);
+    bind_texture(GL_TEXTURE0, 0);
+}
+
+graph_resource_t post_add_upscale(post_t* p, render_graph_t* g, graph_resource_t scene, GLsizei rendered_width,
+                                  GLsizei rendered_height, GLsizei width, GLsizei height) {
+    graph_texture_desc_t full;
+    unsigned int pass;
+    graph_resource_t upscaled;
+
+    full.width = width;
+    full.height = height;
+    full.format = GL_RGBA16F;
+    p->rendered = scene;
+    p->rendered_width = rendered_width;
+    p->rendered_height = rendered_height;
+    upscaled = render_graph_create(g, "upscaled", &full);
+
+    pass = render_graph_add_pass(g, "upscale", upscale_pass, p);
+    render_graph_read(g, pass, scene);
+    render_graph_write(g, pass, upscaled);
+    return upscaled;
+}
+
+graph_resource_t post_add_bloom(post_t* p, render_graph_t* g, graph_resource_t scene, GLsizei width, GLsizei height) {
+    graph_texture_desc_t half;
+    unsigned int pass;
+
+    half.width = width > 1 ? width / 2 : 1;
+    half.height = height > 1 ? height / 2 : 1;
+    half.format = GL_RGBA16F;
+    p->scene = scene;
+    p->bright = render_graph_create(g, "bloom bright", &half);
+    p->blurred_h = render_graph_create(g, "bloom blur h", &half);
+    p->bloom = render_graph_create(g, "bloom", &half);
+
+    pass = render_graph_add_pass(g, "bloom bright", bright_pass, p);
+    render_graph_read(g, pass, scene);
+    render_graph_write(g, pass, p->bright);
+    pass = render_graph_add_pass(g, "bloom blur h", blur_h_pass, p);
+    render_graph_read(g, pass, p->bright);
+    render_graph_write(g, pass, p->blurred_h);
+    pass = render_graph_add_pass(g, "bloom blur v", blur_v_pass, p);
+    render_graph_read(g, pass, p->blurred_h);
+    render_graph_write(g, pass, p->bloom);
+    return p->bloom;
+}
+
+void post_add_composite(post_t* p, render_graph_t* g, graph_resource_t scene, graph_resource_t bloom,
+                        graph_resource_t target) {
+    const unsigned int pass = render_graph_add_pass(g, "composite", composite_pass, p);
+
+    p->scene = scene;
+    p->bloom = bloom;
+    render_graph_read(g, pass, scene);
+    if (bloom != 0) render_graph_read(g, pass, bloom);
+    render_graph_write(g, pass, target);
+}
@@ -0,0 +1,51 @@
+#ifndef RENDER_POST_H
+#define RENDER_POST_H
+
+#include <GL/glew.h>
+#include "render_graph.h"
+
+// Post-processing passes for the render graph: upscaling, bloom and the
+// final composite.
+//
+// Upscaling stretches a scene rendered into the bottom-left of its texture
+// (dynamic resolution, see render/dynamic_res.h) over a full-size one with
+// bilinear filtering, clamped to the rendered texels so nothing outside
+// them bleeds in. Sharpening, when on, is folded into the same pass: an
+// unsharp mask over the four neighbours, clamped to their range so edges
+// don't ring.
+//
+// Bloom keeps what's brighter than a threshold at half resolution and blurs
+// it with a separable 9-tap gaussian, one pass per direction, all in
+// RGBA16F. The bright and the vertically blurred textures never live at the
+// same time, so the graph backs them with one texture. The composite adds
+// the bloom to the scene and writes the backbuffer; passing no bloom leaves
+// the bloom passes unread, and the graph culls them.
+//
+// Every pass draws one full-screen triangle made up from gl_VertexID through
+// an empty VAO, with depth testing off.
+
+typedef struct post_ {
+    GLuint upscale_prog, bright_prog, blur_prog, composite_prog, vao;
+    GLint scale_uloc, sharpness_uloc, threshold_uloc, direction_uloc, strength_uloc;
+    float sharpness, threshold, strength;
+
+    // This frame's resources, set as the passes are added.
+    graph_resource_t rendered, scene, bright, blurred_h, bloom;
+    GLsizei rendered_width, rendered_height;
+} post_t;
+
+int  post_init(post_t* p);
+void post_destroy(post_t* p);
+
+// Adds the pass stretching the bottom-left `rendered_width` x `rendered_height`
+// of `scene` over a new `width` x `height` texture, which it returns.
+graph_resource_t post_add_upscale(post_t* p, render_graph_t* g, graph_resource_t scene, GLsizei rendered_width,
+                                  GLsizei rendered_height, GLsizei width, GLsizei height);
+// Adds the bloom passes reading `scene`, which is `width` x `height`, and
+// returns the blurred result.
+graph_resource_t post_add_bloom(post_t* p, render_graph_t* g, graph_resource_t scene, GLsizei width, GLsizei height);
+// Adds the pass writing `scene`, plus `bloom` unless 0, to `target`.
+void post_add_composite(post_t* p, render_graph_t* g, graph_resource_t scene, graph_resource_t bloom,
+                        graph_resource_t target);
+
+#endif // RENDER_POST_H
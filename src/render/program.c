@@ -0,0 +1,78 @@
+#include "program.h"
+
+#include <stdio.h>
+
+#define INFO_LOG_SIZE 2048
+
+GLuint shader_from_source(const char* src, GLenum shader_type) {
+    GLuint shader_id;
+    GLint ok = GL_FALSE;
+
+    if ((shader_id = glCreateShader(shader_type)) == 0) {
+        fprintf(stderr, "ERROR: Could not create shader.\n");
+        return 0;
+    }
+
+    glShaderSource(shader_id, 1, &src, NULL);
+    glCompileShader(shader_id);
+    glGetShaderiv(shader_id, GL_COMPILE_STATUS, &ok);
+
+    if (ok != GL_TRUE) {
+        char log[INFO_LOG_SIZE];
+        glGetShaderInfoLog(shader_id, sizeof(log), NULL, log);
+        fprintf(stderr, "ERROR: Could not compile shader:\n%s\n", log);
+        glDeleteShader(shader_id);
+        return 0;
+    }
+    return shader_id;
+}
+
+GLuint program_link(const GLuint* shaders, int count) {
+    GLuint prog_id;
+    GLint ok = GL_FALSE;
+    int i;
+
+    if ((prog_id = glCreateProgram()) == 0) {
+        fprintf(stderr, "ERROR: Could not create program.\n");
+        return 0;
+    }
+
+    for (i = 0; i < count; ++i)
+        if (shaders[i] != 0) glAttachShader(prog_id, shaders[i]);
+    glLinkProgram(prog_id);
+    for (i = 0; i < count; ++i)
+        if (shaders[i] != 0) glDetachShader(prog_id, shaders[i]);
+
+    glGetProgramiv(prog_id, GL_LINK_STATUS, &ok);
+    if (ok != GL_TRUE) {
+        char log[INFO_LOG_SIZE];
+        glGetProgramInfoLog(prog_id, sizeof(log), NULL, log);
+        fprintf(stderr, "ERROR: Could not link program:\n%s\n", log);
+        glDeleteProgram(prog_id);
+        return 0;
+    }
+    return prog_id;
+}
+
+GLuint program_from_source(const char* vertex_src, const char* fragment_src) {
+    GLuint shaders[2], prog_id = 0;
+
+    shaders[0] = shader_from_source(vertex_src, GL_VERTEX_SHADER);
+    shaders[1] = shader_from_source(fragment_src, GL_FRAGMENT_SHADER);
+    if (shaders[0] != 0 && shaders[1] != 0)
+        prog_id = program_link(shaders, 2);
+
+    glDeleteShader(shaders[0]);
+    glDeleteShader(shaders[1]);
+    return prog_id;
+}
+
+GLuint compute_program_from_source(const char* compute_src) {
+    GLuint shader_id, prog_id = 0;
+
+    if ((shader_id = shader_from_source(compute_src, GL_COMPUTE_SHADER)) != 0)
+        prog_id = program_link(&shader_id, 1);
+
+    glDeleteShader(shader_id);
+    return prog_id;
+}
@@ -0,0 +1,17 @@
+#ifndef RENDER_PROGRAM_H
+#define RENDER_PROGRAM_H
+
+#include <GL/glew.h>
+
+// Builds programs from in-memory GLSL, printing the info log on failure.
+// Each returns 0 if compiling or linking failed.
+
+GLuint shader_from_source(const char* src, GLenum shader_type);
+GLuint program_from_source(const char* vertex_src, const char* fragment_src);
+GLuint compute_program_from_source(const char* compute_src);
+
+// Links already compiled shaders (0 entries are skipped) into a program.
+// The shaders stay owned by the caller.
+GLuint program_link(const GLuint* shaders, int count);
+
+#endif // RENDER_PROGRAM_H
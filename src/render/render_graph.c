@@ -0,0 +1,451 @@
+#include "render_graph.h"
+#include <stdio.h>
+#include <string.h>
+
+typedef struct format_info_ {
+    GLenum internal, format, type;
+    unsigned int bytes;         // Per texel.
+} format_info_t;
+
+static const format_info_t FORMATS[] = {
+    { GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, 4 },
+    { GL_RGBA16F, GL_RGBA, GL_HALF_FLOAT, 8 },
+    { GL_RGBA32F, GL_RGBA, GL_FLOAT, 16 },
+    { GL_R11F_G11F_B10F, GL_RGB, GL_FLOAT, 4 },
+    { GL_R8, GL_RED, GL_UNSIGNED_BYTE, 1 },
+    { GL_R16F, GL_RED, GL_HALF_FLOAT, 2 },
+    { GL_RG16F, GL_RG, GL_HALF_FLOAT, 4 },
+    { GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, 4 },
+    { GL_DEPTH_COMPONENT32F, GL_DEPTH_COMPONENT, GL_FLOAT, 4 },
+    { GL_DEPTH24_STENCIL8, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, 4 }
+};
+
+static const format_info_t* format_info(GLenum internal) {
+    size_t i;
+
+    for (i = 0; i < sizeof(FORMATS) / sizeof(FORMATS[0]); ++i)
+        if (FORMATS[i].internal == internal) return &FORMATS[i];
+    return NULL;
+}
+
+static size_t desc_bytes(const graph_texture_desc_t* d) {
+    return (size_t)d->width * (size_t)d->height * format_info(d->format)->bytes;
+}
+
+static int same_desc(const graph_texture_desc_t* a, const graph_texture_desc_t* b) {
+    return a->width == b->width && a->height == b->height && a->format == b->format;
+}
+
+static GLenum attachment_point(GLenum internal) {
+    const GLenum format = format_info(internal)->format;
+    if (format == GL_DEPTH_STENCIL) return GL_DEPTH_STENCIL_ATTACHMENT;
+    return format == GL_DEPTH_COMPONENT ? GL_DEPTH_ATTACHMENT : GL_COLOR_ATTACHMENT0;
+}
+
+static void invalidate(render_graph_t* g, const char* what, const char* name) {
+    fprintf(stderr, "ERROR: Render graph: %s (%s).\n", what, name != NULL ? name : "?");
+    g->invalid = 1;
+}
+
+void render_graph_init(render_graph_t* g) {
+    memset(g, 0, sizeof(*g));
+}
+
+static void delete_framebuffer(render_graph_t* g, unsigned int i) {
+    glDeleteFramebuffers(1, &g->framebuffers[i].id);
+    g->framebuffers[i] = g->framebuffers[--g->framebuffer_count];
+}
+
+// Deletes a physical texture and every framebuffer it's attached to.
+static void delete_texture(render_graph_t* g, unsigned int t) {
+    const GLuint id = g->textures[t].id;
+    unsigned int i = 0, a;
+
+    while (i < g->framebuffer_count) {
+        const graph_framebuffer_t* f = &g->framebuffers[i];
+        for (a = 0; a < f->count && f->attachments[a] != id; ++a) {}
+        if (a < f->count) delete_framebuffer(g, i);
+        else ++i;
+    }
+    glDeleteTextures(1, &g->textures[t].id);
+    memset(&g->textures[t], 0, sizeof(g->textures[t]));
+}
+
+void render_graph_destroy(render_graph_t* g) {
+    unsigned int i;
+
+    for (i = 0; i < g->texture_count; ++i)
+        if (g->textures[i].id != 0) delete_texture(g, i);
+    while (g->framebuffer_count > 0) delete_framebuffer(g, 0);
+    memset(g, 0, sizeof(*g));
+}
+
+void render_graph_begin(render_graph_t* g, GLsizei width, GLsizei height) {
+    graph_resource_info_t* bb = &g->resources[0];
+
+    g->pass_count = 0;
+    g->order_count = 0;
+    g->invalid = 0;
+    g->backbuffer_width = width;
+    g->backbuffer_height = height;
+
+    // Resource 1 is always the backbuffer.
+    memset(bb, 0, sizeof(*bb));
+    bb->name = "backbuffer";
+    bb->desc.width = width;
+    bb->desc.height = height;
+    bb->imported = 1;
+    bb->texture = -1;
+    g->resource_count = 1;
+    g->backbuffer = 1;
+}
+
+graph_resource_t render_graph_backbuffer(const render_graph_t* g) {
+    return g->backbuffer;
+}
+
+graph_resource_t render_graph_create(render_graph_t* g, const char* name, const graph_texture_desc_t* desc) {
+    graph_resource_info_t* r;
+
+    if (g->resource_count == RENDER_GRAPH_MAX_RESOURCES) {
+        invalidate(g, "too many resources", name);
+        return 0;
+    }
+    if (format_info(desc->format) == NULL || desc->width <= 0 || desc->height <= 0) {
+        invalidate(g, "unsupported texture", name);
+        return 0;
+    }
+    r = &g->resources[g->resource_count];
+    memset(r, 0, sizeof(*r));
+    r->name = name;
+    r->desc = *desc;
+    r->texture = -1;
+    return ++g->resource_count;
+}
+
+unsigned int render_graph_add_pass(render_graph_t* g, const char* name, graph_pass_fn fn, void* arg) {
+    graph_pass_t* p;
+
+    if (g->pass_count == RENDER_GRAPH_MAX_PASSES) {
+        invalidate(g, "too many passes", name);
+        return RENDER_GRAPH_MAX_PASSES;
+    }
+    p = &g->passes[g->pass_count];
+    memset(p, 0, sizeof(*p));
+    p->name = name;
+    p->fn = fn;
+    p->arg = arg;
+    return g->pass_count++;
+}
+
+void render_graph_read(render_graph_t* g, unsigned int pass, graph_resource_t resource) {
+    graph_pass_t* p;
+
+    if (pass >= g->pass_count || resource == 0 || resource > g->resource_count) return;
+    p = &g->passes[pass];
+    if (p->read_count == RENDER_GRAPH_MAX_PASS_IO) invalidate(g, "too many reads", p->name);
+    else if (resource == g->backbuffer) invalidate(g, "the backbuffer can't be read", p->name);
+    else p->reads[p->read_count++] = resource;
+}
+
+void render_graph_write(render_graph_t* g, unsigned int pass, graph_resource_t resource) {
+    graph_resource_info_t* r;
+    graph_pass_t* p;
+
+    if (pass >= g->pass_count || resource == 0 || resource > g->resource_count) return;
+    p = &g->passes[pass];
+    r = &g->resources[resource - 1];
+    if (p->write_count == RENDER_GRAPH_MAX_PASS_IO) {
+        invalidate(g, "too many writes", p->name);
+        return;
+    }
+    if (!r->imported && r->writer != 0 && r->writer != pass + 1) {
+        invalidate(g, "texture written by two passes", r->name);
+        return;
+    }
+    r->writer = pass + 1;
+    p->writes[p->write_count++] = resource;
+}
+
+// Culls every pass none of whose outputs are read, transitively from the
+// unread transient textures; the backbuffer always counts as read.
+static void cull(render_graph_t* g) {
+    graph_resource_t stack[RENDER_GRAPH_MAX_RESOURCES];
+    unsigned int top = 0, i, j;
+
+    for (i = 0; i < g->resource_count; ++i) g->resources[i].readers = 0;
+    for (i = 0; i < g->pass_count; ++i) {
+        graph_pass_t* p = &g->passes[i];
+        p->refs = p->write_count;
+        p->culled = 0;
+        for (j = 0; j < p->read_count; ++j) ++g->resources[p->reads[j] - 1].readers;
+    }
+    for (i = 1; i < g->resource_count; ++i)
+        if (g->resources[i].readers == 0) stack[top++] = i + 1;
+
+    // Passes without outputs go straight away.
+    for (i = 0; i < g->pass_count; ++i) {
+        graph_pass_t* p = &g->passes[i];
+        if (p->write_count > 0) continue;
+        p->culled = 1;
+        for (j = 0; j < p->read_count; ++j)
+            if (--g->resources[p->reads[j] - 1].readers == 0) stack[top++] = p->reads[j];
+    }
+
+    while (top > 0) {
+        const graph_resource_info_t* r = &g->resources[stack[--top] - 1];
+        graph_pass_t* p;
+
+        if (r->writer == 0) continue;
+        p = &g->passes[r->writer - 1];
+        if (--p->refs > 0) continue;
+        p->culled = 1;
+        for (j = 0; j < p->read_count; ++j)
+            if (--g->resources[p->reads[j] - 1].readers == 0) stack[top++] = p->reads[j];
+    }
+}
+
+static int writes_backbuffer(const render_graph_t* g, const graph_pass_t* p) {
+    unsigned int i;
+
+    for (i = 0; i < p->write_count; ++i)
+        if (p->writes[i] == g->backbuffer) return 1;
+    return 0;
+}
+
+// Whether live pass `a` has to run before live pass `b`: `b` reads what `a`
+// writes, or both write the backbuffer and `a` was declared first.
+static int precedes(const render_graph_t* g, unsigned int a, unsigned int b) {
+    const graph_pass_t* pb = &g->passes[b];
+    unsigned int i;
+
+    for (i = 0; i < pb->read_count; ++i)
+        if (g->resources[pb->reads[i] - 1].writer == a + 1) return 1;
+    return a < b && writes_backbuffer(g, &g->passes[a]) && writes_backbuffer(g, pb);
+}
+
+// Kahn's algorithm, taking the earliest declared ready pass each time.
+static int sort(render_graph_t* g) {
+    unsigned int pending[RENDER_GRAPH_MAX_PASSES];
+    unsigned int live = 0, i, j;
+
+    for (i = 0; i < g->pass_count; ++i) {
+        pending[i] = 0;
+        if (g->passes[i].culled) continue;
+        ++live;
+        for (j = 0; j < g->pass_count; ++j)
+            if (j != i && !g->passes[j].culled && precedes(g, j, i)) ++pending[i];
+    }
+
+    g->order_count = 0;
+    while (g->order_count < live) {
+        for (i = 0; i < g->pass_count; ++i)
+            if (!g->passes[i].culled && pending[i] == 0) break;
+        if (i == g->pass_count) {
+            invalidate(g, "cycle between passes", NULL);
+            return 0;
+        }
+        pending[i] = ~0u; // Scheduled.
+        g->order[g->order_count++] = i;
+        for (j = 0; j < g->pass_count; ++j)
+            if (j != i && !g->passes[j].culled && pending[j] != ~0u && precedes(g, i, j)) --pending[j];
+    }
+    return 1;
+}
+
+static int acquire(render_graph_t* g, graph_resource_info_t* r) {
+    const format_info_t* f = format_info(r->desc.format);
+    int free_slot = -1;
+    unsigned int t;
+    graph_texture_t* tex;
+
+    for (t = 0; t < g->texture_count; ++t) {
+        tex = &g->textures[t];
+        if (tex->id == 0) {
+            if (free_slot < 0) free_slot = (int)t;
+        } else if (!tex->busy && same_desc(&tex->desc, &r->desc)) {
+            break;
+        }
+    }
+    if (t == g->texture_count) {
+        if (free_slot >= 0) t = (unsigned int)free_slot;
+        else if (g->texture_count < RENDER_GRAPH_MAX_TEXTURES) t = g->texture_count++;
+        else {
+            invalidate(g, "too many textures", r->name);
+            return 0;
+        }
+
+        tex = &g->textures[t];
+        tex->desc = r->desc;
+        glGenTextures(1, &tex->id);
+        glBindTexture(GL_TEXTURE_2D, tex->id);
+        glTexImage2D(GL_TEXTURE_2D, 0, (GLint)f->internal, r->desc.width, r->desc.height, 0, f->format, f->type, NULL);
+        // Depth is only ever attached, color sampled as a whole.
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, f->format == GL_RGBA || f->format == GL_RGB
+                        || f->format == GL_RG || f->format == GL_RED ? GL_LINEAR : GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, f->format == GL_RGBA || f->format == GL_RGB
+                        || f->format == GL_RG || f->format == GL_RED ? GL_LINEAR : GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    tex = &g->textures[t];
+    tex->busy = tex->used = 1;
+    r->texture = (int)t;
+    return 1;
+}
+
+// Walks the passes in order, giving each transient texture a physical one
+// at its first use and handing that back after its last.
+static int allocate(render_graph_t* g) {
+    unsigned int step, i, j;
+
+    for (i = 1; i < g->resource_count; ++i) {
+        g->resources[i].first = g->resources[i].last = -1;
+        g->resources[i].texture = -1;
+    }
+    for (step = 0; step < g->order_count; ++step) {
+        const graph_pass_t* p = &g->passes[g->order[step]];
+        for (j = 0; j < p->read_count + p->write_count; ++j) {
+            graph_resource_info_t* r =
+                &g->resources[(j < p->read_count ? p->reads[j] : p->writes[j - p->read_count]) - 1];
+            if (r->first < 0) r->first = (int)step;
+            r->last = (int)step;
+        }
+    }
+
+    for (i = 0; i < g->texture_count; ++i) g->textures[i].busy = g->textures[i].used = 0;
+    for (step = 0; step < g->order_count; ++step) {
+        for (i = 1; i < g->resource_count; ++i)
+            if (g->resources[i].first == (int)step && !acquire(g, &g->resources[i])) return 0;
+        for (i = 1; i < g->resource_count; ++i)
+            if (g->resources[i].last == (int)step) g->textures[g->resources[i].texture].busy = 0;
+    }
+
+    // Whatever this frame didn't need (another size, a pass that's gone).
+    for (i = 0; i < g->texture_count; ++i)
+        if (g->textures[i].id != 0 && !g->textures[i].used) delete_texture(g, i);
+    while (g->texture_count > 0 && g->textures[g->texture_count - 1].id == 0) --g->texture_count;
+    return 1;
+}
+
+int render_graph_compile(render_graph_t* g) {
+    unsigned int i, j;
+
+    if (g->invalid) return 0;
+    for (i = 0; i < g->pass_count; ++i) {
+        const graph_pass_t* p = &g->passes[i];
+        for (j = 0; j < p->read_count; ++j)
+            if (g->resources[p->reads[j] - 1].writer == 0) {
+                invalidate(g, "texture read but never written", g->resources[p->reads[j] - 1].name);
+                return 0;
+            }
+        for (j = 1; j < p->write_count; ++j) {
+            const graph_texture_desc_t* a = &g->resources[p->writes[0] - 1].desc;
+            const graph_texture_desc_t* b = &g->resources[p->writes[j] - 1].desc;
+            if (a->width != b->width || a->height != b->height
+                    || p->writes[0] == g->backbuffer || p->writes[j] == g->backbuffer) {
+                invalidate(g, "a pass's outputs differ in size or mix in the backbuffer", p->name);
+                return 0;
+            }
+        }
+    }
+
+    cull(g);
+    if (!sort(g) || !allocate(g)) return 0;
+
+    memset(&g->stats, 0, offsetof(render_graph_stats_t, peak_texture_bytes));
+    g->stats.passes = g->order_count;
+    g->stats.culled = g->pass_count - g->order_count;
+    for (i = 1; i < g->resource_count; ++i) {
+        if (g->resources[i].first < 0) continue;
+        ++g->stats.resources;
+        g->stats.transient_bytes += desc_bytes(&g->resources[i].desc);
+    }
+    for (i = 0; i < g->texture_count; ++i) {
+        if (g->textures[i].id == 0) continue;
+        ++g->stats.textures;
+        g->stats.texture_bytes += desc_bytes(&g->textures[i].desc);
+    }
+    if (g->stats.texture_bytes > g->stats.peak_texture_bytes)
+        g->stats.peak_texture_bytes = g->stats.texture_bytes;
+    return 1;
+}
+
+// The cached framebuffer with exactly the pass's outputs attached.
+static GLuint framebuffer_for(render_graph_t* g, const graph_pass_t* p) {
+    GLenum draw_buffers[RENDER_GRAPH_MAX_PASS_IO];
+    GLuint attachments[RENDER_GRAPH_MAX_PASS_IO];
+    graph_framebuffer_t* f;
+    unsigned int i, colors = 0;
+
+    for (i = 0; i < p->write_count; ++i)
+        attachments[i] = g->textures[g->resources[p->writes[i] - 1].texture].id;
+    for (i = 0; i < g->framebuffer_count; ++i) {
+        f = &g->framebuffers[i];
+        if (f->count == p->write_count && memcmp(f->attachments, attachments, sizeof(GLuint) * f->count) == 0) {
+            f->used = 1;
+            return f->id;
+        }
+    }
+    if (g->framebuffer_count == RENDER_GRAPH_MAX_FRAMEBUFFERS) {
+        fprintf(stderr, "ERROR: Render graph: too many framebuffers (%s).\n", p->name);
+        return 0;
+    }
+
+    f = &g->framebuffers[g->framebuffer_count++];
+    memcpy(f->attachments, attachments, sizeof(attachments));
+    f->count = p->write_count;
+    f->used = 1;
+    glGenFramebuffers(1, &f->id);
+    glBindFramebuffer(GL_FRAMEBUFFER, f->id);
+    for (i = 0; i < p->write_count; ++i) {
+        GLenum point = attachment_point(g->resources[p->writes[i] - 1].desc.format);
+        if (point == GL_COLOR_ATTACHMENT0) {
+            point += colors;
+            draw_buffers[colors++] = point;
+        }
+        glFramebufferTexture2D(GL_FRAMEBUFFER, point, GL_TEXTURE_2D, attachments[i], 0);
+    }
+    if (colors > 0) glDrawBuffers((GLsizei)colors, draw_buffers);
+    else glDrawBuffer(GL_NONE);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        fprintf(stderr, "ERROR: Render graph: incomplete framebuffer (%s).\n", p->name);
+    return f->id;
+}
+
+void render_graph_execute(render_graph_t* g) {
+    unsigned int step, i;
+
+    for (i = 0; i < g->framebuffer_count; ++i) g->framebuffers[i].used = 0;
+    for (step = 0; step < g->order_count; ++step) {
+        const graph_pass_t* p = &g->passes[g->order[step]];
+        if (writes_backbuffer(g, p)) {
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            glViewport(0, 0, g->backbuffer_width, g->backbuffer_height);
+        } else {
+            const graph_texture_desc_t* d = &g->resources[p->writes[0] - 1].desc;
+            glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_for(g, p));
+            glViewport(0, 0, d->width, d->height);
+        }
+        p->fn(g, p->arg);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, g->backbuffer_width, g->backbuffer_height);
+
+    i = 0;
+    while (i < g->framebuffer_count) {
+        if (!g->framebuffers[i].used) delete_framebuffer(g, i);
+        else ++i;
+    }
+}
+
+GLuint render_graph_texture(const render_graph_t* g, graph_resource_t resource) {
+    const graph_resource_info_t* r;
+
+    if (resource == 0 || resource > g->resource_count) return 0;
+    r = &g->resources[resource - 1];
+    return r->texture >= 0 ? g->textures[r->texture].id : 0;
+}
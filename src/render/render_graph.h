@@ -0,0 +1,134 @@
+#ifndef RENDER_RENDER_GRAPH_H
+#define RENDER_RENDER_GRAPH_H
+
+#include <stddef.h>
+#include <GL/glew.h>
+
+// Frame graph: passes declared with the textures they read and write.
+//
+// Every frame, passes are added in any order, each with its reads and
+// writes. Textures are either transient (created by the graph for this frame
+// only: a size and an internal format) or the imported backbuffer.
+// render_graph_compile() then
+//
+// - culls passes whose outputs nobody reads: only passes that (indirectly)
+//   feed the backbuffer survive;
+// - orders the survivors so every texture is written before it's read,
+//   keeping the declaration order where the data flow allows it;
+// - works out each transient texture's lifetime (first to last pass using
+//   it) and binds it to a physical texture: a texture whose lifetime has
+//   ended is reused by a later one of the same size and format, so passes
+//   that never overlap share memory without any hand-managed reuse.
+//
+// render_graph_execute() runs the passes in order, each with a framebuffer
+// of the textures it writes bound (color formats as color attachments in
+// declaration order, a depth format as the depth attachment) and the
+// viewport set to their size. Framebuffers are cached by attachments, so
+// aliased textures share them too. Physical textures and framebuffers live
+// across frames; ones a frame didn't use are deleted at the end of it, which
+// also takes care of resizes.
+//
+// A transient texture has one writer; a pass that wants to modify one reads
+// it and writes a new one. The backbuffer can have several writers, which
+// keep their declaration order. Textures and framebuffers aren't captured by
+// the GL trace recorder.
+
+#define RENDER_GRAPH_MAX_PASSES 32
+#define RENDER_GRAPH_MAX_RESOURCES 64
+#define RENDER_GRAPH_MAX_PASS_IO 8          // Reads, and writes, per pass.
+#define RENDER_GRAPH_MAX_TEXTURES 64        // Physical.
+#define RENDER_GRAPH_MAX_FRAMEBUFFERS 32
+
+typedef unsigned int graph_resource_t;      // 0 is never a resource.
+
+struct render_graph_;
+typedef void (*graph_pass_fn)(const struct render_graph_* g, void* arg);
+
+typedef struct graph_texture_desc_ {
+    GLsizei width, height;
+    GLenum format;              // Sized internal format, e.g. GL_RGBA16F or GL_DEPTH_COMPONENT24.
+} graph_texture_desc_t;
+
+typedef struct graph_resource_info_ {
+    const char* name;
+    graph_texture_desc_t desc;
+    int imported;               // The backbuffer.
+    unsigned int writer;        // Pass index + 1, or 0.
+    unsigned int readers;       // Live passes reading it, once compiled.
+    int first, last;            // Positions in the execution order, -1 if unused.
+    int texture;                // Physical texture index, -1 if none.
+} graph_resource_info_t;
+
+typedef struct graph_pass_ {
+    const char* name;
+    graph_pass_fn fn;
+    void* arg;
+    graph_resource_t reads[RENDER_GRAPH_MAX_PASS_IO], writes[RENDER_GRAPH_MAX_PASS_IO];
+    unsigned int read_count, write_count;
+    unsigned int refs;          // Outputs still needed, while culling.
+    int culled;
+} graph_pass_t;
+
+typedef struct graph_texture_ {
+    GLuint id;
+    graph_texture_desc_t desc;
+    int busy;                   // Holding a live resource at the current compile step.
+    int used;                   // Used this frame.
+} graph_texture_t;
+
+typedef struct graph_framebuffer_ {
+    GLuint id;
+    GLuint attachments[RENDER_GRAPH_MAX_PASS_IO];   // Texture names, in write order.
+    unsigned int count;
+    int used;
+} graph_framebuffer_t;
+
+typedef struct render_graph_stats_ {
+    unsigned int passes, culled;
+    unsigned int resources;         // Transient, declared this frame.
+    unsigned int textures;          // Physical, backing them.
+    size_t transient_bytes;         // What the transient textures would take unaliased.
+    size_t texture_bytes;           // What they take.
+    size_t peak_texture_bytes;      // Highest texture_bytes so far.
+} render_graph_stats_t;
+
+typedef struct render_graph_ {
+    graph_pass_t passes[RENDER_GRAPH_MAX_PASSES];
+    graph_resource_info_t resources[RENDER_GRAPH_MAX_RESOURCES];
+    unsigned int pass_count, resource_count;
+    unsigned int order[RENDER_GRAPH_MAX_PASSES];    // Live passes, in execution order.
+    unsigned int order_count;
+    graph_resource_t backbuffer;
+    GLsizei backbuffer_width, backbuffer_height;
+    int invalid;                // A declaration failed; compiling will too.
+
+    graph_texture_t textures[RENDER_GRAPH_MAX_TEXTURES];
+    unsigned int texture_count;
+    graph_framebuffer_t framebuffers[RENDER_GRAPH_MAX_FRAMEBUFFERS];
+    unsigned int framebuffer_count;
+
+    render_graph_stats_t stats;
+} render_graph_t;
+
+void render_graph_init(render_graph_t* g);
+void render_graph_destroy(render_graph_t* g);
+
+// Starts declaring a frame drawn into a `width` x `height` backbuffer.
+void render_graph_begin(render_graph_t* g, GLsizei width, GLsizei height);
+graph_resource_t render_graph_backbuffer(const render_graph_t* g);
+graph_resource_t render_graph_create(render_graph_t* g, const char* name, const graph_texture_desc_t* desc);
+
+// `name` and `arg` must outlive the frame. Returns the pass index.
+unsigned int render_graph_add_pass(render_graph_t* g, const char* name, graph_pass_fn fn, void* arg);
+void render_graph_read(render_graph_t* g, unsigned int pass, graph_resource_t resource);
+void render_graph_write(render_graph_t* g, unsigned int pass, graph_resource_t resource);
+
+// Culls, orders and allocates; returns 0 (with a message) on a malformed
+// graph: a texture read but never written, written twice, or a cycle.
+int  render_graph_compile(render_graph_t* g);
+void render_graph_execute(render_graph_t* g);
+
+// The texture behind a resource, for passes to sample what they read.
+GLuint render_graph_texture(const render_graph_t* g, graph_resource_t resource);
+
+#endif // RENDER_RENDER_GRAPH_H
@@ -0,0 +1,400 @@
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define U64(lo, hi) ((uint64_t)(lo) | ((uint64_t)(hi) << 32))
+
+static float bitsf(uint32_t u) {
+    float f;
+    memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+// Walks the records, checking their sizes and locating the frame markers.
+static int index_trace(trace_t* t) {
+    size_t offset = 0;
+    unsigned long markers = 0;
+
+    while (offset < t->size) {
+        uint32_t head[2];
+
+        if (t->size - offset < sizeof(head)) break;
+        memcpy(head, t->data + offset, sizeof(head));
+        if (head[0] == 0 || head[0] >= TRACE_OP_COUNT || head[1] > t->size - offset - sizeof(head)) break;
+        offset += sizeof(head) + head[1];
+
+        if (head[0] == TRACE_OP_FRAME) {
+            if (markers++ == 0) t->setup_end = offset;
+            t->frames_end = offset;
+        }
+    }
+    if (offset != t->size) {
+        fprintf(stderr, "ERROR: Trace is corrupt at offset %zu.\n", offset);
+        return 0;
+    }
+
+    t->frames = markers > 0 ? markers - 1 : 0;
+    if (markers == 0) t->setup_end = t->frames_end = t->size;
+    return 1;
+}
+
+int trace_load(trace_t* t, const char* path) {
+    FILE* fh;
+    long fsz;
+
+    memset(t, 0, sizeof(*t));
+    if ((fh = fopen(path, "rb")) == NULL) {
+        fprintf(stderr, "ERROR: Could not open trace %s.\n", path);
+        return 0;
+    }
+
+    fseek(fh, 0, SEEK_END);
+    fsz = ftell(fh);
+    fseek(fh, 0, SEEK_SET);
+
+    if (fsz < (long)sizeof(t->header) || fread(&t->header, sizeof(t->header), 1, fh) != 1
+            || memcmp(t->header.magic, TRACE_MAGIC, sizeof(t->header.magic)) != 0
+            || t->header.version != TRACE_VERSION) {
+        fprintf(stderr, "ERROR: %s is not a version %d trace.\n", path, TRACE_VERSION);
+        fclose(fh);
+        return 0;
+    }
+
+    t->size = (size_t)fsz - sizeof(t->header);
+    if ((t->data = (unsigned char*) malloc(t->size > 0 ? t->size : 1)) == NULL
+            || fread(t->data, 1, t->size, fh) != t->size) {
+        fprintf(stderr, "ERROR: Could not read trace %s.\n", path);
+        fclose(fh);
+        trace_free(t);
+        return 0;
+    }
+    fclose(fh);
+
+    if (!index_trace(t)) {
+        trace_free(t);
+        return 0;
+    }
+    return 1;
+}
+
+void trace_free(trace_t* t) {
+    free(t->data);
+    memset(t, 0, sizeof(*t));
+}
+
+static void map_set(trace_name_map_t* m, GLuint from, GLuint to) {
+    if (from >= m->size) {
+        GLuint size = m->size > 0 ? m->size : 64;
+        GLuint* names;
+
+        while (size <= from) size *= 2;
+        if ((names = (GLuint*) realloc(m->names, sizeof(GLuint) * size)) == NULL) {
+            fprintf(stderr, "ERROR: Could not grow the trace name map.\n");
+            exit(EXIT_FAILURE);
+        }
+        memset(names + m->size, 0, sizeof(GLuint) * (size - m->size));
+        m->names = names;
+        m->size = size;
+    }
+    m->names[from] = to;
+}
+
+static GLuint map_get(const trace_name_map_t* m, GLuint from) {
+    return from < m->size ? m->names[from] : 0;
+}
+
+static GLint uniform_get(const trace_player_t* p, GLint from) {
+    size_t i;
+    for (i = 0; i < p->uniform_count; ++i)
+        if (p->uniforms[i].program == p->current_program && p->uniforms[i].from == from)
+            return p->uniforms[i].to;
+    return -1; // Silently ignored by GL, like the recorded call would have been.
+}
+
+static void uniform_set(trace_player_t* p, GLuint program, GLint from, GLint to) {
+    size_t i;
+    for (i = 0; i < p->uniform_count; ++i) {
+        if (p->uniforms[i].program == program && p->uniforms[i].from == from) {
+            p->uniforms[i].to = to;
+            return;
+        }
+    }
+
+    if (p->uniform_count == p->uniform_capacity) {
+        size_t capacity = p->uniform_capacity > 0 ? p->uniform_capacity * 2 : 32;
+        trace_uniform_map_t* uniforms;
+        if ((uniforms = (trace_uniform_map_t*) realloc(p->uniforms, sizeof(*uniforms) * capacity)) == NULL) {
+            fprintf(stderr, "ERROR: Could not grow the trace uniform map.\n");
+            exit(EXIT_FAILURE);
+        }
+        p->uniforms = uniforms;
+        p->uniform_capacity = capacity;
+    }
+    p->uniforms[p->uniform_count].program = program;
+    p->uniforms[p->uniform_count].from = from;
+    p->uniforms[p->uniform_count].to = to;
+    ++p->uniform_count;
+}
+
+static void gen_names(trace_name_map_t* m, const uint32_t* recorded, GLsizei n,
+                      PFNGLGENBUFFERSPROC gen) {
+    GLuint names[64];
+    GLsizei i, done, batch;
+
+    for (done = 0; done < n; done += batch) {
+        batch = n - done < 64 ? n - done : 64;
+        gen(batch, names);
+        for (i = 0; i < batch; ++i) map_set(m, recorded[done + i], names[i]);
+    }
+}
+
+static void delete_names(trace_name_map_t* m, const uint32_t* recorded, GLsizei n,
+                         PFNGLDELETEBUFFERSPROC del) {
+    GLuint names[64];
+    GLsizei i, done, batch;
+
+    for (done = 0; done < n; done += batch) {
+        batch = n - done < 64 ? n - done : 64;
+        for (i = 0; i < batch; ++i) {
+            names[i] = map_get(m, recorded[done + i]);
+            map_set(m, recorded[done + i], 0);
+        }
+        del(batch, names);
+    }
+}
+
+// 32-bit arguments each op reads before any data.
+static size_t op_args(uint32_t op) {
+    switch (op) {
+    case TRACE_OP_FRAME:
+        return 0;
+    case TRACE_OP_CLEAR: case TRACE_OP_ENABLE: case TRACE_OP_DISABLE: case TRACE_OP_DEPTH_FUNC:
+    case TRACE_OP_CULL_FACE: case TRACE_OP_FRONT_FACE: case TRACE_OP_CREATE_PROGRAM:
+    case TRACE_OP_COMPILE_SHADER: case TRACE_OP_LINK_PROGRAM: case TRACE_OP_DELETE_SHADER:
+    case TRACE_OP_DELETE_PROGRAM: case TRACE_OP_USE_PROGRAM: case TRACE_OP_GEN_BUFFERS:
+    case TRACE_OP_DELETE_BUFFERS: case TRACE_OP_GEN_VERTEX_ARRAYS: case TRACE_OP_DELETE_VERTEX_ARRAYS:
+    case TRACE_OP_BIND_VERTEX_ARRAY: case TRACE_OP_ENABLE_ATTRIB: case TRACE_OP_DISABLE_ATTRIB:
+    case TRACE_OP_MEMORY_BARRIER:
+        return 1;
+    case TRACE_OP_CREATE_SHADER: case TRACE_OP_SHADER_SOURCE: case TRACE_OP_ATTACH_SHADER:
+    case TRACE_OP_DETACH_SHADER: case TRACE_OP_UNIFORM_LOCATION: case TRACE_OP_UNIFORM_1I:
+    case TRACE_OP_UNIFORM_1UI: case TRACE_OP_UNIFORM_1F: case TRACE_OP_UNIFORM_3FV:
+    case TRACE_OP_UNIFORM_4FV: case TRACE_OP_BIND_BUFFER: case TRACE_OP_ATTRIB_DIVISOR:
+        return 2;
+    case TRACE_OP_UNIFORM_2F: case TRACE_OP_UNIFORM_MATRIX_4FV: case TRACE_OP_UNIFORM_MATRIX_4X3FV:
+    case TRACE_OP_BIND_BUFFER_BASE: case TRACE_OP_DRAW_ARRAYS: case TRACE_OP_DISPATCH_COMPUTE:
+        return 3;
+    case TRACE_OP_CLEAR_COLOR: case TRACE_OP_VIEWPORT:
+        return 4;
+    case TRACE_OP_BUFFER_DATA: case TRACE_OP_BUFFER_SUB_DATA: case TRACE_OP_CLEAR_BUFFER_DATA:
+    case TRACE_OP_DRAW_ELEMENTS:
+        return 5;
+    case TRACE_OP_ATTRIB_IPOINTER: case TRACE_OP_MULTI_DRAW_INDIRECT: case TRACE_OP_DRAW_ELEMENTS_INSTANCED:
+    case TRACE_OP_DRAW_ELEMENTS_BASE_VERTEX:
+        return 6;
+    case TRACE_OP_ATTRIB_POINTER:
+        return 7;
+    case TRACE_OP_MULTI_DRAW_INDIRECT_COUNT: case TRACE_OP_COPY_BUFFER_SUB_DATA:
+        return 8;
+    }
+    return 0;
+}
+
+// Whether a record's payload holds everything issue() reads for its op: the
+// arguments, then the data they describe.
+static int payload_fits(uint32_t op, const uint32_t* a, size_t size) {
+    const size_t args = op_args(op) * sizeof(uint32_t);
+    uint64_t data = 0;
+
+    if (size < args) return 0;
+    switch (op) {
+    case TRACE_OP_SHADER_SOURCE: data = a[1]; break;
+    case TRACE_OP_UNIFORM_LOCATION: return memchr(&a[2], 0, size - args) != NULL;
+    case TRACE_OP_UNIFORM_3FV: data = (uint64_t)a[1] * 3 * sizeof(GLfloat); break;
+    case TRACE_OP_UNIFORM_4FV: data = (uint64_t)a[1] * 4 * sizeof(GLfloat); break;
+    case TRACE_OP_UNIFORM_MATRIX_4FV: data = (uint64_t)a[1] * 16 * sizeof(GLfloat); break;
+    case TRACE_OP_UNIFORM_MATRIX_4X3FV: data = (uint64_t)a[1] * 12 * sizeof(GLfloat); break;
+    case TRACE_OP_GEN_BUFFERS: case TRACE_OP_DELETE_BUFFERS:
+    case TRACE_OP_GEN_VERTEX_ARRAYS: case TRACE_OP_DELETE_VERTEX_ARRAYS:
+        data = (uint64_t)a[0] * sizeof(GLuint);
+        break;
+    case TRACE_OP_BUFFER_DATA: data = a[4] ? U64(a[2], a[3]) : 0; break;
+    case TRACE_OP_BUFFER_SUB_DATA: data = U64(a[3], a[4]); break;
+    case TRACE_OP_CLEAR_BUFFER_DATA: data = a[4]; break;
+    }
+    return data <= size - args;
+}
+
+// Issues one record; a = 32-bit arguments, followed by any data, `size`
+// bytes in all.
+static void issue(trace_player_t* p, uint32_t op, const uint32_t* a, size_t size) {
+    if (!payload_fits(op, a, size)) {
+        fprintf(stderr, "ERROR: Trace record (op %u) is shorter than its arguments, skipped.\n", op);
+        return;
+    }
+
+    switch (op) {
+    case TRACE_OP_FRAME:
+        break;
+
+    case TRACE_OP_CLEAR: glClear(a[0]); break;
+    case TRACE_OP_CLEAR_COLOR: glClearColor(bitsf(a[0]), bitsf(a[1]), bitsf(a[2]), bitsf(a[3])); break;
+    case TRACE_OP_ENABLE: glEnable(a[0]); break;
+    case TRACE_OP_DISABLE: glDisable(a[0]); break;
+    case TRACE_OP_DEPTH_FUNC: glDepthFunc(a[0]); break;
+    case TRACE_OP_CULL_FACE: glCullFace(a[0]); break;
+    case TRACE_OP_FRONT_FACE: glFrontFace(a[0]); break;
+    case TRACE_OP_VIEWPORT: glViewport((GLint)a[0], (GLint)a[1], (GLsizei)a[2], (GLsizei)a[3]); break;
+
+    case TRACE_OP_CREATE_PROGRAM: map_set(&p->programs, a[0], glCreateProgram()); break;
+    case TRACE_OP_CREATE_SHADER: map_set(&p->programs, a[1], glCreateShader(a[0])); break;
+    case TRACE_OP_SHADER_SOURCE: {
+        const GLchar* src = (const GLchar*)&a[2];
+        const GLint len = (GLint)a[1];
+        glShaderSource(map_get(&p->programs, a[0]), 1, &src, &len);
+        break;
+    }
+    case TRACE_OP_COMPILE_SHADER: glCompileShader(map_get(&p->programs, a[0])); break;
+    case TRACE_OP_ATTACH_SHADER: glAttachShader(map_get(&p->programs, a[0]), map_get(&p->programs, a[1])); break;
+    case TRACE_OP_DETACH_SHADER: glDetachShader(map_get(&p->programs, a[0]), map_get(&p->programs, a[1])); break;
+    case TRACE_OP_LINK_PROGRAM: glLinkProgram(map_get(&p->programs, a[0])); break;
+    case TRACE_OP_DELETE_SHADER:
+        glDeleteShader(map_get(&p->programs, a[0]));
+        map_set(&p->programs, a[0], 0);
+        break;
+    case TRACE_OP_DELETE_PROGRAM:
+        glDeleteProgram(map_get(&p->programs, a[0]));
+        map_set(&p->programs, a[0], 0);
+        break;
+    case TRACE_OP_USE_PROGRAM:
+        p->current_program = a[0];
+        glUseProgram(map_get(&p->programs, a[0]));
+        break;
+    case TRACE_OP_UNIFORM_LOCATION:
+        uniform_set(p, a[0], (GLint)a[1],
+                    glGetUniformLocation(map_get(&p->programs, a[0]), (const GLchar*)&a[2]));
+        break;
+    case TRACE_OP_UNIFORM_1I: glUniform1i(uniform_get(p, (GLint)a[0]), (GLint)a[1]); break;
+    case TRACE_OP_UNIFORM_1UI: glUniform1ui(uniform_get(p, (GLint)a[0]), a[1]); break;
+    case TRACE_OP_UNIFORM_1F: glUniform1f(uniform_get(p, (GLint)a[0]), bitsf(a[1])); break;
+    case TRACE_OP_UNIFORM_2F: glUniform2f(uniform_get(p, (GLint)a[0]), bitsf(a[1]), bitsf(a[2])); break;
+    case TRACE_OP_UNIFORM_3FV:
+        glUniform3fv(uniform_get(p, (GLint)a[0]), (GLsizei)a[1], (const GLfloat*)&a[2]);
+        break;
+    case TRACE_OP_UNIFORM_4FV:
+        glUniform4fv(uniform_get(p, (GLint)a[0]), (GLsizei)a[1], (const GLfloat*)&a[2]);
+        break;
+    case TRACE_OP_UNIFORM_MATRIX_4FV:
+        glUniformMatrix4fv(uniform_get(p, (GLint)a[0]), (GLsizei)a[1], (GLboolean)a[2], (const GLfloat*)&a[3]);
+        break;
+    case TRACE_OP_UNIFORM_MATRIX_4X3FV:
+        glUniformMatrix4x3fv(uniform_get(p, (GLint)a[0]), (GLsizei)a[1], (GLboolean)a[2], (const GLfloat*)&a[3]);
+        break;
+
+    case TRACE_OP_GEN_BUFFERS: gen_names(&p->buffers, &a[1], (GLsizei)a[0], glGenBuffers); break;
+    case TRACE_OP_DELETE_BUFFERS: delete_names(&p->buffers, &a[1], (GLsizei)a[0], glDeleteBuffers); break;
+    case TRACE_OP_BIND_BUFFER: glBindBuffer(a[0], map_get(&p->buffers, a[1])); break;
+    case TRACE_OP_BIND_BUFFER_BASE: glBindBufferBase(a[0], a[1], map_get(&p->buffers, a[2])); break;
+    case TRACE_OP_BUFFER_DATA:
+        glBufferData(a[0], (GLsizeiptr)U64(a[2], a[3]), a[4] ? (const void*)&a[5] : NULL, a[1]);
+        break;
+    case TRACE_OP_BUFFER_SUB_DATA:
+        glBufferSubData(a[0], (GLintptr)U64(a[1], a[2]), (GLsizeiptr)U64(a[3], a[4]), &a[5]);
+        break;
+    case TRACE_OP_CLEAR_BUFFER_DATA:
+        glClearBufferData(a[0], a[1], a[2], a[3], a[4] > 0 ? (const void*)&a[5] : NULL);
+        break;
+    case TRACE_OP_GEN_VERTEX_ARRAYS: gen_names(&p->vertex_arrays, &a[1], (GLsizei)a[0], glGenVertexArrays); break;
+    case TRACE_OP_DELETE_VERTEX_ARRAYS:
+        delete_names(&p->vertex_arrays, &a[1], (GLsizei)a[0], glDeleteVertexArrays);
+        break;
+    case TRACE_OP_BIND_VERTEX_ARRAY: glBindVertexArray(map_get(&p->vertex_arrays, a[0])); break;
+    case TRACE_OP_ENABLE_ATTRIB: glEnableVertexAttribArray(a[0]); break;
+    case TRACE_OP_DISABLE_ATTRIB: glDisableVertexAttribArray(a[0]); break;
+    case TRACE_OP_ATTRIB_POINTER:
+        glVertexAttribPointer(a[0], (GLint)a[1], a[2], (GLboolean)a[3], (GLsizei)a[4],
+                              (const void*)(uintptr_t)U64(a[5], a[6]));
+        break;
+    case TRACE_OP_ATTRIB_IPOINTER:
+        glVertexAttribIPointer(a[0], (GLint)a[1], a[2], (GLsizei)a[3], (const void*)(uintptr_t)U64(a[4], a[5]));
+        break;
+    case TRACE_OP_ATTRIB_DIVISOR: glVertexAttribDivisor(a[0], a[1]); break;
+
+    case TRACE_OP_DRAW_ARRAYS: glDrawArrays(a[0], (GLint)a[1], (GLsizei)a[2]); break;
+    case TRACE_OP_DRAW_ELEMENTS:
+        glDrawElements(a[0], (GLsizei)a[1], a[2], (const void*)(uintptr_t)U64(a[3], a[4]));
+        break;
+    case TRACE_OP_DISPATCH_COMPUTE: glDispatchCompute(a[0], a[1], a[2]); break;
+    case TRACE_OP_MEMORY_BARRIER: glMemoryBarrier(a[0]); break;
+    case TRACE_OP_MULTI_DRAW_INDIRECT:
+        glMultiDrawElementsIndirect(a[0], a[1], (const void*)(uintptr_t)U64(a[2], a[3]), (GLsizei)a[4], (GLsizei)a[5]);
+        break;
+    case TRACE_OP_MULTI_DRAW_INDIRECT_COUNT:
+        glMultiDrawElementsIndirectCountARB(a[0], a[1], (const void*)(uintptr_t)U64(a[2], a[3]),
+                                            (GLintptr)U64(a[4], a[5]), (GLsizei)a[6], (GLsizei)a[7]);
+        break;
+    case TRACE_OP_DRAW_ELEMENTS_INSTANCED:
+        glDrawElementsInstanced(a[0], (GLsizei)a[1], a[2], (const void*)(uintptr_t)U64(a[3], a[4]), (GLsizei)a[5]);
+        break;
+    case TRACE_OP_DRAW_ELEMENTS_BASE_VERTEX:
+        glDrawElementsBaseVertex(a[0], (GLsizei)a[1], a[2], (const void*)(uintptr_t)U64(a[3], a[4]), (GLint)a[5]);
+        break;
+    case TRACE_OP_COPY_BUFFER_SUB_DATA:
+        glCopyBufferSubData(a[0], a[1], (GLintptr)U64(a[2], a[3]), (GLintptr)U64(a[4], a[5]), (GLsizeiptr)U64(a[6], a[7]));
+        break;
+    }
+    ++p->records;
+}
+
+// Issues records from the cursor up to `end`, or through the next frame
+// marker when stop_at_frame is set.
+static void run(trace_player_t* p, size_t end, int stop_at_frame) {
+    const unsigned char* data = p->trace->data;
+
+    while (p->cursor < end) {
+        uint32_t head[2];
+
+        memcpy(head, data + p->cursor, sizeof(head));
+        // Records are 4-byte aligned within the malloc'd block.
+        issue(p, head[0], (const uint32_t*)(data + p->cursor + sizeof(head)), head[1]);
+        p->cursor += sizeof(head) + head[1];
+
+        if (stop_at_frame && head[0] == TRACE_OP_FRAME) break;
+    }
+}
+
+void trace_player_init(trace_player_t* p, const trace_t* t) {
+    memset(p, 0, sizeof(*p));
+    p->trace = t;
+}
+
+void trace_player_destroy(trace_player_t* p) {
+    free(p->buffers.names);
+    free(p->vertex_arrays.names);
+    free(p->programs.names);
+    free(p->uniforms);
+    memset(p, 0, sizeof(*p));
+}
+
+int trace_player_setup(trace_player_t* p) {
+    p->cursor = 0;
+    run(p, p->trace->setup_end, 0);
+    return glGetError() == GL_NO_ERROR;
+}
+
+int trace_player_frame(trace_player_t* p) {
+    if (p->cursor < p->trace->setup_end || p->cursor >= p->trace->frames_end) return 0;
+    run(p, p->trace->frames_end, 1);
+    return 1;
+}
+
+void trace_player_rewind(trace_player_t* p) {
+    p->cursor = p->trace->setup_end;
+}
+
+void trace_player_finish(trace_player_t* p) {
+    p->cursor = p->trace->frames_end;
+    run(p, p->trace->size, 0);
+}
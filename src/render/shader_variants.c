@@ -0,0 +1,438 @@
+#include "shader_variants.h"
+#include "program.h"
+#include "math/utils.h"
+
+#define MAX_PATH_LEN 512
+#define MAX_VERSION_LEN 128
+#define MAX_NAME_LEN 64
+
+typedef struct text_ {
+    char* data;
+    size_t length, capacity;
+    int failed;             // Out of memory; the text is incomplete.
+} text_t;
+
+// One expansion of a top-level file and everything it includes.
+typedef struct expansion_ {
+    text_t body;
+    char version[MAX_VERSION_LEN];  // Hoisted above the injected defines.
+    char files[SHADER_MAX_INCLUDES][MAX_PATH_LEN];
+    int file_count;
+} expansion_t;
+
+typedef struct define_ {
+    const char* name;
+    size_t name_len;
+    const char* value;      // NULL for a plain switch.
+    size_t value_len;
+} define_t;
+
+static void text_append(text_t* t, const char* s, size_t n) {
+    if (t->failed) return;
+    if (t->length + n + 1 > t->capacity) {
+        size_t capacity = t->capacity > 0 ? t->capacity : 4096;
+        char* data;
+        while (capacity < t->length + n + 1) capacity *= 2;
+        if ((data = (char*) realloc(t->data, capacity)) == NULL) {
+            t->failed = 1;
+            return;
+        }
+        t->data = data;
+        t->capacity = capacity;
+    }
+    memcpy(t->data + t->length, s, n);
+    t->length += n;
+    t->data[t->length] = '\0';
+}
+
+static void text_printf(text_t* t, const char* format, int a, int b) {
+    char line[64];
+    int n = snprintf(line, sizeof(line), format, a, b);
+    text_append(t, line, (size_t)n);
+}
+
+static char* read_file(const char* path, void* arg) {
+    FILE* fd;
+    long size = -1;
+    char* src = NULL;
+
+    if ((fd = fopen(path, "rb")) == NULL) return NULL;
+    if (fseek(fd, 0, SEEK_END) == 0 && (size = ftell(fd)) != -1) {
+        rewind(fd);
+        if ((src = (char*) malloc(size + 1)) != NULL) {
+            if ((long)fread(src, 1, size, fd) == size) {
+                src[size] = '\0';
+            } else {
+                free(src);
+                src = NULL;
+            }
+        }
+    }
+    fclose(fd);
+    return src;
+}
+
+static shader_read_fn g_read = read_file;
+static void* g_read_arg = NULL;
+
+void shader_set_reader(shader_read_fn fn, void* arg) {
+    g_read = fn != NULL ? fn : read_file;
+    g_read_arg = arg;
+}
+
+// Returns the rest of `line` if it is the preprocessor directive `name`.
+static const char* directive(const char* line, const char* end, const char* name) {
+    const size_t len = strlen(name);
+
+    while (line < end && (*line == ' ' || *line == '\t')) ++line;
+    if (line == end || *line++ != '#') return NULL;
+    while (line < end && (*line == ' ' || *line == '\t')) ++line;
+    if ((size_t)(end - line) < len || strncmp(line, name, len) != 0) return NULL;
+    line += len;
+    return line == end || *line == ' ' || *line == '\t' || *line == '"' || *line == '<' ? line : NULL;
+}
+
+// Removes "./" and "dir/../" from a relative or absolute path, so each file
+// has one name when checking what's been included.
+static void normalize_path(char* path) {
+    char* segments[MAX_PATH_LEN / 2];
+    char copy[MAX_PATH_LEN];
+    char *s, *save;
+    int count = 0, i;
+    const int absolute = path[0] == '/';
+
+    snprintf(copy, sizeof(copy), "%s", path);
+    for (s = strtok_r(copy, "/", &save); s != NULL; s = strtok_r(NULL, "/", &save)) {
+        if (strcmp(s, ".") == 0) continue;
+        if (strcmp(s, "..") == 0 && count > 0 && strcmp(segments[count - 1], "..") != 0) --count;
+        else segments[count++] = s;
+    }
+    path[0] = '\0';
+    for (i = 0; i < count; ++i) {
+        strcat(path, i > 0 || absolute ? "/" : "");
+        strcat(path, segments[i]);
+    }
+}
+
+static int expand_file(expansion_t* e, const char* path) {
+    const int index = e->file_count;
+    char* src;
+    const char* line;
+    int line_no = 1, i;
+
+    if (index == SHADER_MAX_INCLUDES) {
+        fprintf(stderr, "ERROR: More than %d shader files included from %s.\n",
+                SHADER_MAX_INCLUDES, e->files[0]);
+        return 0;
+    }
+    if ((src = g_read(path, g_read_arg)) == NULL) {
+        fprintf(stderr, "ERROR: Could not read shader %s.\n", path);
+        return 0;
+    }
+    snprintf(e->files[index], MAX_PATH_LEN, "%s", path);
+    normalize_path(e->files[index]);
+    e->file_count++;
+
+    text_printf(&e->body, "#line %d %d\n", 1, index);
+    for (line = src; *line != '\0'; ++line_no) {
+        const char* end = strchr(line, '\n');
+        const char* next = end != NULL ? end + 1 : line + strlen(line);
+        const char* rest;
+        if (end == NULL) end = next;
+
+        if ((rest = directive(line, end, "version")) != NULL) {
+            if (index > 0) {
+                fprintf(stderr, "ERROR: %s:%d: #version in an included file.\n", path, line_no);
+                free(src);
+                return 0;
+            }
+            snprintf(e->version, sizeof(e->version), "%.*s", (int)(end - line), line);
+            text_append(&e->body, "\n", 1); // Keeps the line numbers.
+        } else if ((rest = directive(line, end, "include")) != NULL) {
+            char included[MAX_PATH_LEN];
+            const char *name, *name_end, *slash = strrchr(path, '/');
+            int seen = 0;
+
+            while (rest < end && (*rest == ' ' || *rest == '\t')) ++rest;
+            name = rest + 1;
+            name_end = rest < end ? memchr(name, *rest == '<' ? '>' : '"', end - name) : NULL;
+            if (rest == end || (*rest != '"' && *rest != '<') || name_end == NULL) {
+                fprintf(stderr, "ERROR: %s:%d: Malformed #include.\n", path, line_no);
+                free(src);
+                return 0;
+            }
+            // Relative to the including file.
+            if (*name == '/' || slash == NULL)
+                snprintf(included, sizeof(included), "%.*s", (int)(name_end - name), name);
+            else
+                snprintf(included, sizeof(included), "%.*s%.*s", (int)(slash + 1 - path), path,
+                         (int)(name_end - name), name);
+            normalize_path(included);
+
+            for (i = 0; i < e->file_count && !seen; ++i) seen = strcmp(e->files[i], included) == 0;
+            if (seen) {
+                text_append(&e->body, "\n", 1);
+            } else {
+                if (!expand_file(e, included)) {
+                    free(src);
+                    return 0;
+                }
+                text_printf(&e->body, "#line %d %d\n", line_no + 1, index);
+            }
+        } else {
+            text_append(&e->body, line, end - line);
+            text_append(&e->body, "\n", 1);
+        }
+        line = next;
+    }
+    free(src);
+    return 1;
+}
+
+// Whether `name` appears in `src` as a whole identifier.
+static int mentions(const char* src, const char* name, size_t len) {
+    const char* s;
+
+    for (s = src; (s = strstr(s, name)) != NULL; s += len) {
+        const char before = s > src ? s[-1] : ' ', after = s[len];
+        if (!(before == '_' || (before >= '0' && before <= '9') || ((before | 0x20) >= 'a' && (before | 0x20) <= 'z'))
+                && !(after == '_' || (after >= '0' && after <= '9') || ((after | 0x20) >= 'a' && (after | 0x20) <= 'z')))
+            return 1;
+    }
+    return 0;
+}
+
+static int compare_defines(const void* a, const void* b) {
+    const define_t *x = (const define_t*) a, *y = (const define_t*) b;
+    const int c = strncmp(x->name, y->name, x->name_len < y->name_len ? x->name_len : y->name_len);
+    return c != 0 ? c : (int)x->name_len - (int)y->name_len;
+}
+
+static int parse_defines(const char* defines, define_t* out) {
+    const char* s = defines;
+    int count = 0;
+
+    while (s != NULL && *s != '\0') {
+        size_t len;
+        const char* eq;
+        while (*s == ' ' || *s == '\t') ++s;
+        if ((len = strcspn(s, " \t")) == 0) break;
+        if (count == SHADER_MAX_DEFINES) {
+            fprintf(stderr, "ERROR: More than %d shader defines in \"%s\".\n", SHADER_MAX_DEFINES, defines);
+            return -1;
+        }
+        eq = memchr(s, '=', len);
+        out[count].name = s;
+        out[count].name_len = eq != NULL ? (size_t)(eq - s) : len;
+        out[count].value = eq != NULL ? eq + 1 : NULL;
+        out[count].value_len = eq != NULL ? len - (eq + 1 - s) : 0;
+        ++count;
+        s += len;
+    }
+    // Same set, same source, whatever order they were given in.
+    qsort(out, count, sizeof(*out), compare_defines);
+    return count;
+}
+
+char* shader_preprocess(const char* path, const char* defines) {
+    define_t parsed[SHADER_MAX_DEFINES];
+    expansion_t* e;
+    text_t out = { NULL, 0, 0, 0 };
+    int count, i;
+
+    if ((count = parse_defines(defines, parsed)) < 0) return NULL;
+    if ((e = (expansion_t*) calloc(1, sizeof(*e))) == NULL) {
+        fprintf(stderr, "ERROR: Could not allocate a shader expansion.\n");
+        return NULL;
+    }
+
+    if (expand_file(e, path) && !e->body.failed) {
+        if (e->version[0] != '\0') {
+            text_append(&out, e->version, strlen(e->version));
+            text_append(&out, "\n", 1);
+        }
+        for (i = 0; i < count; ++i) {
+            char name[MAX_NAME_LEN];
+            snprintf(name, sizeof(name), "%.*s", (int)parsed[i].name_len, parsed[i].name);
+            if (!mentions(e->body.data, name, strlen(name))) continue;
+            text_append(&out, "#define ", 8);
+            text_append(&out, name, strlen(name));
+            if (parsed[i].value != NULL) {
+                text_append(&out, " ", 1);
+                text_append(&out, parsed[i].value, parsed[i].value_len);
+            }
+            text_append(&out, "\n", 1);
+        }
+        text_append(&out, e->body.data, e->body.length);
+        if (out.failed) {
+            fprintf(stderr, "ERROR: Could not allocate the source of %s.\n", path);
+            free(out.data);
+            out.data = NULL;
+        }
+    } else if (e->body.failed) {
+        fprintf(stderr, "ERROR: Could not allocate the source of %s.\n", path);
+    }
+
+    free(e->body.data);
+    free(e);
+    return out.data;
+}
+
+static uint64_t fnv1a(uint64_t h, const void* data, size_t size) {
+    const unsigned char* p = (const unsigned char*) data;
+    size_t i;
+
+    for (i = 0; i < size; ++i) {
+        h ^= p[i];
+        h *= 0x100000001B3ull;
+    }
+    return h;
+}
+
+#define FNV_OFFSET 0xCBF29CE484222325ull
+
+static GLuint find_object(const shader_object_t* objects, unsigned int count, uint64_t hash) {
+    unsigned int i;
+
+    for (i = 0; i < count; ++i)
+        if (objects[i].hash == hash) return objects[i].id;
+    return 0;
+}
+
+static int add_object(shader_object_t** objects, unsigned int* count, unsigned int* capacity,
+                      uint64_t hash, GLuint id) {
+    if (*count == *capacity) {
+        const unsigned int grown = *capacity > 0 ? *capacity * 2 : 8;
+        shader_object_t* o = (shader_object_t*) realloc(*objects, sizeof(*o) * grown);
+        if (o == NULL) return 0;
+        *objects = o;
+        *capacity = grown;
+    }
+    (*objects)[*count].hash = hash;
+    (*objects)[(*count)++].id = id;
+    return 1;
+}
+
+static char* copy_string(const char* s) {
+    const size_t len = s != NULL ? strlen(s) : 0;
+    char* copy = (char*) malloc(len + 1);
+
+    if (copy != NULL) {
+        memcpy(copy, s != NULL ? s : "", len);
+        copy[len] = '\0';
+    }
+    return copy;
+}
+
+void shader_cache_init(shader_cache_t* c) {
+    memset(c, 0, sizeof(*c));
+}
+
+void shader_cache_destroy(shader_cache_t* c) {
+    unsigned int i;
+
+    for (i = 0; i < c->program_count; ++i) glDeleteProgram(c->programs[i].id);
+    for (i = 0; i < c->shader_count; ++i) glDeleteShader(c->shaders[i].id);
+    for (i = 0; i < c->variant_count; ++i) {
+        free(c->variants[i].vertex_path);
+        free(c->variants[i].fragment_path);
+        free(c->variants[i].defines);
+    }
+    free(c->variants);
+    free(c->shaders);
+    free(c->programs);
+    memset(c, 0, sizeof(*c));
+}
+
+int shader_cache_variant(shader_cache_t* c, const char* vertex_path, const char* fragment_path,
+                         const char* defines) {
+    shader_variant_t* v;
+
+    if (c->variant_count == c->variant_capacity) {
+        const unsigned int grown = c->variant_capacity > 0 ? c->variant_capacity * 2 : 8;
+        if ((v = (shader_variant_t*) realloc(c->variants, sizeof(*v) * grown)) == NULL) {
+            fprintf(stderr, "ERROR: Could not allocate %u shader variants.\n", grown);
+            return -1;
+        }
+        c->variants = v;
+        c->variant_capacity = grown;
+    }
+
+    v = &c->variants[c->variant_count];
+    memset(v, 0, sizeof(*v));
+    v->vertex_path = copy_string(vertex_path);
+    v->fragment_path = copy_string(fragment_path);
+    v->defines = copy_string(defines);
+    if (v->vertex_path == NULL || v->fragment_path == NULL || v->defines == NULL) {
+        fprintf(stderr, "ERROR: Could not allocate a shader variant.\n");
+        free(v->vertex_path);
+        free(v->fragment_path);
+        free(v->defines);
+        return -1;
+    }
+    c->stats.variants++;
+    return (int)c->variant_count++;
+}
+
+// Compiles one stage of a variant, or finds it already compiled.
+static GLuint variant_shader(shader_cache_t* c, const char* path, const char* defines,
+                             GLenum type, uint64_t* hash) {
+    char* src;
+    GLuint id;
+
+    if ((src = shader_preprocess(path, defines)) == NULL) return 0;
+    *hash = fnv1a(fnv1a(FNV_OFFSET, &type, sizeof(type)), src, strlen(src));
+
+    if ((id = find_object(c->shaders, c->shader_count, *hash)) != 0) {
+        c->stats.shaders_shared++;
+    } else if ((id = shader_from_source(src, type)) != 0) {
+        if (!add_object(&c->shaders, &c->shader_count, &c->shader_capacity, *hash, id)) {
+            glDeleteShader(id);
+            id = 0;
+        } else {
+            c->stats.shaders_compiled++;
+        }
+    }
+    free(src);
+    return id;
+}
+
+GLuint shader_cache_program(shader_cache_t* c, int variant) {
+    shader_variant_t* v;
+    GLuint shaders[2], prog_id = 0;
+    uint64_t hashes[2];
+    double start;
+
+    if (variant < 0 || (unsigned int)variant >= c->variant_count) return 0;
+    v = &c->variants[variant];
+    if (v->program != 0 || v->failed) return v->program;
+
+    start = glfwGetTime();
+    shaders[0] = variant_shader(c, v->vertex_path, v->defines, GL_VERTEX_SHADER, &hashes[0]);
+    shaders[1] = shaders[0] != 0
+        ? variant_shader(c, v->fragment_path, v->defines, GL_FRAGMENT_SHADER, &hashes[1]) : 0;
+
+    if (shaders[1] != 0) {
+        const uint64_t pair = fnv1a(FNV_OFFSET, hashes, sizeof(hashes));
+        if ((prog_id = find_object(c->programs, c->program_count, pair)) != 0) {
+            c->stats.programs_shared++;
+        } else if ((prog_id = program_link(shaders, 2)) != 0) {
+            if (!add_object(&c->programs, &c->program_count, &c->program_capacity, pair, prog_id)) {
+                glDeleteProgram(prog_id);
+                prog_id = 0;
+            } else {
+                c->stats.programs_linked++;
+            }
+        }
+    }
+    c->stats.build_ms += (glfwGetTime() - start) * 1000.;
+
+    if (prog_id == 0) {
+        fprintf(stderr, "ERROR: Could not build %s + %s with \"%s\".\n",
+                v->vertex_path, v->fragment_path, v->defines);
+        v->failed = 1;
+        return 0;
+    }
+    c->stats.variants_built++;
+    return v->program = prog_id;
+}
@@ -0,0 +1,82 @@
+#ifndef RENDER_SHADER_VARIANTS_H
+#define RENDER_SHADER_VARIANTS_H
+
+#include <GL/glew.h>
+#include <stdint.h>
+
+// Shader preprocessing and permutations.
+//
+// shader_preprocess() expands `#include "file"` lines (relative to the
+// including file, each file at most once) and injects `#define`s right after
+// the `#version` line, so one GLSL file can be built with any set of feature
+// switches. `#line` directives keep compile errors pointing at the right
+// line; their source string numbers count the files in order of inclusion,
+// the top-level file being 0.
+//
+// A shader_cache_t hands out variants, a vertex and fragment file plus a set
+// of defines, without compiling anything: the program is built on the first
+// shader_cache_program() call for it. Defines a stage never mentions are left
+// out of that stage and the rest are sorted, then every stage's source is
+// hashed, so variants that end up with the same GLSL share one shader object,
+// and ones with the same pair of shaders share one program.
+
+#define SHADER_MAX_INCLUDES 32
+#define SHADER_MAX_DEFINES 16
+
+// Where shader files come from: the file system unless set, e.g. to assets
+// unpacked from an archive. Returns a NUL-terminated copy to free(), or NULL
+// if there's no such file. Set it before any shader is preprocessed; it's
+// then called from whichever thread builds programs.
+typedef char* (*shader_read_fn)(const char* path, void* arg);
+void shader_set_reader(shader_read_fn fn, void* arg);
+
+// `defines` is a space separated list of NAME or NAME=VALUE (may be NULL).
+// Returns the expanded source, to free(), or NULL after printing the error.
+char* shader_preprocess(const char* path, const char* defines);
+
+typedef struct shader_variant_ {
+    char* vertex_path;
+    char* fragment_path;
+    char* defines;
+    GLuint program;             // 0 until first used.
+    int failed;                 // Don't retry broken variants every frame.
+} shader_variant_t;
+
+typedef struct shader_object_ {
+    uint64_t hash;              // Of the stage and its preprocessed source.
+    GLuint id;
+} shader_object_t;
+
+typedef struct shader_cache_stats_ {
+    unsigned int variants;          // Registered.
+    unsigned int variants_built;    // Used at least once.
+    unsigned int shaders_compiled;
+    unsigned int shaders_shared;    // Stages found already compiled.
+    unsigned int programs_linked;
+    unsigned int programs_shared;   // Variants found already linked.
+    double build_ms;                // Preprocessing, compiling and linking.
+} shader_cache_stats_t;
+
+typedef struct shader_cache_ {
+    shader_variant_t* variants;
+    unsigned int variant_count, variant_capacity;
+    shader_object_t* shaders;
+    unsigned int shader_count, shader_capacity;
+    shader_object_t* programs;      // Hash of the shader pair.
+    unsigned int program_count, program_capacity;
+    shader_cache_stats_t stats;
+} shader_cache_t;
+
+void shader_cache_init(shader_cache_t* c);
+// Deletes every shader and program the cache built.
+void shader_cache_destroy(shader_cache_t* c);
+
+// Registers a variant and returns its handle, or -1 if out of memory.
+int shader_cache_variant(shader_cache_t* c, const char* vertex_path, const char* fragment_path,
+                         const char* defines);
+
+// The variant's program, built on first use; 0 if it doesn't compile or link.
+// Programs stay owned by the cache.
+GLuint shader_cache_program(shader_cache_t* c, int variant);
+
+#endif // RENDER_SHADER_VARIANTS_H
@@ -0,0 +1,377 @@
+#include "skinning.h"
+#include "program.h"
+#include "trace.h"
+#include "math/mesh.h"
+#include "core/jobs.h"
+
+#include <stddef.h>
+
+#ifdef MATH_FAST_SSE
+#define SKINNING_SSE 1
+#endif
+
+#include "trace_gl.h" // Last: the CPU path's draw goes through the recorder and counters.
+
+#define PALETTE_GRAIN 16        // Characters per parallel_for range.
+#define SKIN_GRAIN 4
+#define TENTACLE_SEGMENTS 12
+#define TENTACLE_RADIUS 0.08f
+
+static const GLchar* CPU_VERTEX_SHADER = {
+    "#version 330 core\n"
+    "layout(location=0) in vec4 in_Position;\n" // Already skinned, in world space.
+    "uniform mat4 ViewMatrix;\n"
+    "uniform mat4 ProjectionMatrix;\n"
+    "out vec3 ex_ViewPos;\n"
+
+    "void main(void)\n"
+    "{\n"
+    "  vec4 view_pos = ViewMatrix * in_Position;\n"
+    "  gl_Position = ProjectionMatrix * view_pos;\n"
+    "  ex_ViewPos = view_pos.xyz;\n"
+    "}\n"
+};
+
+static const GLchar* GPU_VERTEX_SHADER = {
+    "#version 430 core\n"
+    "layout(location=0) in vec4 in_Position;\n"
+    "layout(location=1) in vec4 in_Weights;\n"
+    "layout(location=2) in uvec4 in_Joints;\n"
+    "layout(std430, binding=7) readonly buffer Palettes { mat3x4 palettes[]; };\n"
+    "uniform mat4 ViewMatrix;\n"
+    "uniform mat4 ProjectionMatrix;\n"
+    "uniform uint JointCount;\n"
+    "out vec3 ex_ViewPos;\n"
+
+    "void main(void)\n"
+    "{\n"
+    "  uint base = uint(gl_InstanceID) * JointCount;\n"
+    "  mat3x4 skin = in_Weights.x * palettes[base + in_Joints.x]\n"
+    "            + in_Weights.y * palettes[base + in_Joints.y]\n"
+    "            + in_Weights.z * palettes[base + in_Joints.z]\n"
+    "            + in_Weights.w * palettes[base + in_Joints.w];\n"
+    "  vec4 view_pos = ViewMatrix * vec4(in_Position * skin, 1.0);\n"
+    "  gl_Position = ProjectionMatrix * view_pos;\n"
+    "  ex_ViewPos = view_pos.xyz;\n"
+    "}\n"
+};
+
+static const GLchar* FRAGMENT_SHADER = {
+    "#version 330 core\n"
+    "in vec3 ex_ViewPos;\n"
+    "uniform vec4 Tint;\n"
+    "out vec4 out_Color;\n"
+
+    "void main(void)\n"
+    "{\n"
+    "  vec3 n = normalize(cross(dFdx(ex_ViewPos), dFdy(ex_ViewPos)));\n"
+    "  out_Color = vec4(Tint.rgb * (0.25 + 0.75 * abs(n.z)), Tint.a);\n"
+    "}\n"
+};
+
+typedef struct skin_job_ {
+    skinning_t* s;
+    float time;
+    float* out;                 // Positions, vertex_count per character.
+} skin_job_t;
+
+// Samples and builds the palettes of characters [begin, end).
+static void palette_range(size_t begin, size_t end, void* arg) {
+    skin_job_t* job = (skin_job_t*) arg;
+    skinning_t* s = job->s;
+    const unsigned int joints = s->skeleton.joint_count;
+    joint_pose_t pose[SKIN_MAX_JOINTS];
+    mat4x3_t world[SKIN_MAX_JOINTS];
+    size_t c;
+
+    for (c = begin; c < end; ++c) {
+        animation_sample(&s->animation, job->time - s->start_times[c], pose);
+        skeleton_palette(&s->skeleton, pose, &s->models[c], world, s->palettes + c * joints);
+    }
+}
+
+// Skins characters [begin, end) into the position stream.
+static void skin_range(size_t begin, size_t end, void* arg) {
+    skin_job_t* job = (skin_job_t*) arg;
+    skinning_t* s = job->s;
+    const unsigned int joints = s->skeleton.joint_count;
+    size_t c;
+    unsigned int v;
+
+    for (c = begin; c < end; ++c) {
+        const mat4x3_t* palette = s->palettes + c * joints;
+        float* out = job->out + c * s->vertex_count * 4;
+#ifdef SKINNING_SSE
+        // Palettes are rows; the vertex loop wants columns, once per character.
+        __m128 columns[SKIN_MAX_JOINTS][4];
+        unsigned int j;
+
+        for (j = 0; j < joints; ++j) mat4x3_columns(columns[j], &palette[j]);
+#endif
+
+        for (v = 0; v < s->vertex_count; ++v) {
+            const skin_vertex_t* in = &s->vertices[v];
+#ifdef SKINNING_SSE
+            const __m128 x = _mm_set1_ps(in->pos[0]), y = _mm_set1_ps(in->pos[1]), z = _mm_set1_ps(in->pos[2]);
+            __m128 acc = _mm_setzero_ps();
+            int i;
+
+            // Transform by each influence's matrix (columns), then blend.
+            // Unused influences come last: stop at the first.
+            for (i = 0; i < SKIN_INFLUENCES && in->weights[i] > 0; ++i) {
+                const __m128* m = columns[in->joints[i]];
+                __m128 p = _mm_add_ps(_mm_mul_ps(x, m[0]), _mm_mul_ps(y, m[1]));
+                p = _mm_add_ps(p, _mm_add_ps(_mm_mul_ps(z, m[2]), m[3]));
+                acc = _mm_add_ps(acc, _mm_mul_ps(p, _mm_set1_ps(in->weights[i])));
+            }
+            _mm_storeu_ps(out + v * 4, acc);
+#else
+            float p[4] = { 0, 0, 0, 0 };
+            int i, k;
+
+            // w is the sum of the weights, as the SSE path's is.
+            for (i = 0; i < SKIN_INFLUENCES && in->weights[i] > 0; ++i) {
+                const float* m = palette[in->joints[i]].m;
+                for (k = 0; k < 3; ++k)
+                    p[k] += in->weights[i] * (in->pos[0] * m[k * 4] + in->pos[1] * m[k * 4 + 1] + in->pos[2] * m[k * 4 + 2] + m[k * 4 + 3]);
+                p[3] += in->weights[i];
+            }
+            memcpy(out + v * 4, p, sizeof(p));
+#endif
+        }
+    }
+}
+
+// A tapering tube from y = 0 to 1, each ring bound to the two joints around it.
+static int build_tentacle(skinning_t* s, GLuint** indices) {
+    const unsigned int joints = s->skeleton.joint_count;
+    const mesh_desc_t d = mesh_cylinder(TENTACLE_SEGMENTS, 4 * joints, TENTACLE_RADIUS, 1.0f);
+    const float segment = 1.0f / joints;
+    vertex_t* tube;
+    size_t vc, ic, v;
+
+    mesh_counts(&d, &vc, &ic);
+    tube = (vertex_t*) malloc(sizeof(vertex_t) * vc);
+    s->vertices = (skin_vertex_t*) malloc(sizeof(skin_vertex_t) * vc);
+    *indices = (GLuint*) malloc(sizeof(GLuint) * ic);
+    if (tube == NULL || s->vertices == NULL || *indices == NULL || !mesh_generate(&d, tube, *indices, 0)) {
+        fprintf(stderr, "ERROR: Could not build the skinned mesh.\n");
+        free(tube);
+        return 0;
+    }
+
+    for (v = 0; v < vc; ++v) {
+        skin_vertex_t* out = &s->vertices[v];
+        const float y = tube[v].pos[1] + 0.5f, taper = 1.0f - 0.7f * y;
+        const float u = y / segment;
+        const unsigned int j = u < joints - 1 ? (unsigned int)u : joints - 1;
+        const float f = j < joints - 1 ? u - j : 0;
+
+        out->pos[0] = tube[v].pos[0] * taper;
+        out->pos[1] = y;
+        out->pos[2] = tube[v].pos[2] * taper;
+        out->pos[3] = 1;
+        memset(out->weights, 0, sizeof(out->weights));
+        memset(out->joints, 0, sizeof(out->joints));
+        out->joints[0] = (GLubyte)j;
+        out->weights[0] = 1 - f;
+        out->joints[1] = (GLubyte)(j < joints - 1 ? j + 1 : j);
+        out->weights[1] = f;
+    }
+    s->vertex_count = (unsigned int)vc;
+    s->index_count = (unsigned int)ic;
+    free(tube);
+    return 1;
+}
+
+int skinning_init(skinning_t* s, unsigned int characters, unsigned int joints, skinning_mode_t mode) {
+    const size_t palette_count = (size_t)characters * joints;
+    unsigned int side, c;
+    GLuint* indices = NULL;
+    float spacing;
+
+    memset(s, 0, sizeof(*s));
+    s->mode = mode;
+    s->count = characters;
+    if (characters == 0 || joints < 2 || joints > SKIN_MAX_JOINTS) {
+        fprintf(stderr, "ERROR: Skinning needs characters and 2 to %d joints.\n", SKIN_MAX_JOINTS);
+        return 0;
+    }
+    if (mode == SKINNING_GPU && !GLEW_VERSION_4_3) {
+        fprintf(stderr, "ERROR: GPU skinning needs OpenGL 4.3.\n");
+        return 0;
+    }
+    if (!skeleton_chain(&s->skeleton, joints, 1.0f)
+            || !animation_wave(&s->animation, &s->skeleton, 17, 2.0f, 0.35f)
+            || !build_tentacle(s, &indices)) {
+        free(indices);
+        skinning_destroy(s);
+        return 0;
+    }
+
+    s->models = (mat4x3_t*) malloc(sizeof(mat4x3_t) * characters);
+    s->start_times = (float*) malloc(sizeof(float) * characters);
+    s->palettes = (mat4x3_t*) malloc(sizeof(mat4x3_t) * palette_count);
+    if (s->models == NULL || s->start_times == NULL || s->palettes == NULL) {
+        fprintf(stderr, "ERROR: Could not allocate %u skinned characters.\n", characters);
+        free(indices);
+        skinning_destroy(s);
+        return 0;
+    }
+
+    // Grid over [-1, 1] in x and z, standing on y = -0.5.
+    for (side = 1; side * side < characters; ++side) {}
+    spacing = 2.0f / side;
+    for (c = 0; c < characters; ++c) {
+        mat4x3_t* m = &s->models[c];
+        memset(m, 0, sizeof(*m));
+        m->m[0] = m->m[5] = m->m[10] = 0.9f * spacing;
+        m->m[3] = -1.0f + spacing * (0.5f + c % side);
+        m->m[7] = -0.5f;
+        m->m[11] = -1.0f + spacing * (0.5f + c / side);
+        s->start_times[c] = 0.37f * c;
+    }
+
+    s->prog = program_from_source(mode == SKINNING_GPU ? GPU_VERTEX_SHADER : CPU_VERTEX_SHADER, FRAGMENT_SHADER);
+    if (s->prog == 0) {
+        free(indices);
+        skinning_destroy(s);
+        return 0;
+    }
+    s->view_uloc = glGetUniformLocation(s->prog, "ViewMatrix");
+    s->proj_uloc = glGetUniformLocation(s->prog, "ProjectionMatrix");
+    s->joints_uloc = glGetUniformLocation(s->prog, "JointCount");
+    s->tint_uloc = glGetUniformLocation(s->prog, "Tint");
+
+    glGenVertexArrays(1, &s->vao);
+    glGenBuffers(1, &s->ibo);
+    glBindVertexArray(s->vao);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, s->ibo);
+
+    if (mode == SKINNING_GPU) {
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * s->index_count, indices, GL_STATIC_DRAW);
+        free(indices);
+
+        glGenBuffers(1, &s->bind_vbo);
+        glBindBuffer(GL_ARRAY_BUFFER, s->bind_vbo);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(skin_vertex_t) * s->vertex_count, s->vertices, GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glEnableVertexAttribArray(1);
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(skin_vertex_t), (GLvoid*)offsetof(skin_vertex_t, pos));
+        glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(skin_vertex_t), (GLvoid*)offsetof(skin_vertex_t, weights));
+        glVertexAttribIPointer(2, 4, GL_UNSIGNED_BYTE, sizeof(skin_vertex_t), (GLvoid*)offsetof(skin_vertex_t, joints));
+        glGenBuffers(1, &s->palette_ssbo);
+    } else {
+        const size_t stream_bytes = sizeof(float) * 4 * s->vertex_count * characters;
+        GLuint* all = (GLuint*) malloc(sizeof(GLuint) * s->index_count * characters);
+        unsigned int i;
+
+        // Mappings are invisible to the trace recorder: stage through the heap then.
+        if (trace_recording()) s->staging = (float*) malloc(stream_bytes);
+        if (all == NULL || (trace_recording() && s->staging == NULL)) {
+            fprintf(stderr, "ERROR: Could not allocate %u skinned characters.\n", characters);
+            free(all);
+            free(indices);
+            glBindVertexArray(0);
+            skinning_destroy(s);
+            return 0;
+        }
+        // Every character's copy of the indices, so one draw covers the stream.
+        for (c = 0; c < characters; ++c)
+            for (i = 0; i < s->index_count; ++i)
+                all[(size_t)c * s->index_count + i] = indices[i] + c * s->vertex_count;
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * s->index_count * characters, all, GL_STATIC_DRAW);
+        free(all);
+        free(indices);
+
+        glGenBuffers(1, &s->stream_vbo);
+        glBindBuffer(GL_ARRAY_BUFFER, s->stream_vbo);
+        glBufferData(GL_ARRAY_BUFFER, stream_bytes, NULL, GL_STREAM_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(float) * 4, (GLvoid*)0);
+    }
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    exit_on_glError("ERROR: Could not create the skinned meshes.");
+    return 1;
+}
+
+void skinning_destroy(skinning_t* s) {
+    if (s->palette_ssbo != 0) glDeleteBuffers(1, &s->palette_ssbo);
+    if (s->stream_vbo != 0) glDeleteBuffers(1, &s->stream_vbo);
+    if (s->bind_vbo != 0) glDeleteBuffers(1, &s->bind_vbo);
+    if (s->ibo != 0) glDeleteBuffers(1, &s->ibo);
+    if (s->vao != 0) glDeleteVertexArrays(1, &s->vao);
+    if (s->prog != 0) glDeleteProgram(s->prog);
+    skeleton_destroy(&s->skeleton);
+    animation_destroy(&s->animation);
+    free(s->vertices);
+    free(s->models);
+    free(s->start_times);
+    free(s->palettes);
+    free(s->staging);
+    memset(s, 0, sizeof(*s));
+}
+
+void skinning_update(skinning_t* s, float time) {
+    skin_job_t job;
+    double start = glfwGetTime(), palettes_done;
+
+    job.s = s;
+    job.time = time;
+    job.out = NULL;
+    jobs_parallel_for(s->count, PALETTE_GRAIN, palette_range, &job);
+    palettes_done = glfwGetTime();
+    s->stats.palette_ms += (palettes_done - start) * 1000.;
+    s->stats.frames++;
+
+    if (s->mode == SKINNING_GPU) {
+        const size_t bytes = sizeof(mat4x3_t) * s->count * s->skeleton.joint_count;
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, s->palette_ssbo);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, bytes, s->palettes, GL_STREAM_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        s->stats.upload_bytes = bytes;
+    } else {
+        const size_t bytes = sizeof(float) * 4 * s->vertex_count * s->count;
+
+        glBindBuffer(GL_ARRAY_BUFFER, s->stream_vbo);
+        if (s->staging != NULL) {
+            job.out = s->staging;
+        } else {
+            // Orphan last frame's storage and write into a fresh one.
+            glBufferData(GL_ARRAY_BUFFER, bytes, NULL, GL_STREAM_DRAW);
+            job.out = (float*) glMapBufferRange(GL_ARRAY_BUFFER, 0, bytes,
+                                                GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        }
+        if (job.out != NULL) jobs_parallel_for(s->count, SKIN_GRAIN, skin_range, &job);
+
+        if (s->staging != NULL) glBufferData(GL_ARRAY_BUFFER, bytes, s->staging, GL_STREAM_DRAW);
+        else if (job.out != NULL) glUnmapBuffer(GL_ARRAY_BUFFER);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        s->stats.upload_bytes = bytes;
+        s->stats.skin_ms += (glfwGetTime() - palettes_done) * 1000.;
+    }
+}
+
+void skinning_draw(skinning_t* s, const mat4_t* view, const mat4_t* projection) {
+    static const GLfloat TINT[4] = { 0.9f, 0.55f, 0.35f, 1.0f };
+
+    glUseProgram(s->prog);
+    glUniformMatrix4fv(s->view_uloc, 1, GL_FALSE, view->m);
+    glUniformMatrix4fv(s->proj_uloc, 1, GL_FALSE, projection->m);
+    glUniform4fv(s->tint_uloc, 1, TINT);
+    glBindVertexArray(s->vao);
+
+    if (s->mode == SKINNING_GPU) {
+        glUniform1ui(s->joints_uloc, s->skeleton.joint_count);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SKIN_BINDING_PALETTES, s->palette_ssbo);
+        glDrawElementsInstanced(GL_TRIANGLES, (GLsizei)s->index_count, GL_UNSIGNED_INT, (GLvoid*)0, (GLsizei)s->count);
+    } else {
+        glDrawElements(GL_TRIANGLES, (GLsizei)(s->index_count * s->count), GL_UNSIGNED_INT, (GLvoid*)0);
+    }
+
+    glBindVertexArray(0);
+    glUseProgram(0);
+    exit_on_glError("ERROR: Could not draw the skinned meshes.");
+}
@@ -0,0 +1,78 @@
+#ifndef RENDER_SKINNING_H
+#define RENDER_SKINNING_H
+
+#include <GL/glew.h>
+#include "math/utils.h"
+#include "math/skeleton.h"
+
+// Linear-blend skinned crowds.
+//
+// Every character is the same tentacle: a tube bound to a chain skeleton,
+// playing a looping wave animation from its own start time. Each frame the
+// animation is sampled and the joint palettes built for all characters, in
+// parallel on the job system. Then either:
+//
+// - SKINNING_CPU: the bind-pose vertices are skinned on the CPU (SSE, one
+//   vertex per iteration, the four influences blended in registers) across
+//   the job system, straight into an orphaned and mapped stream of
+//   positions, and one glDrawElements draws every character from it with a
+//   static index buffer covering them all. Upload is positions, every frame.
+// - SKINNING_GPU: only the palettes are uploaded, to a shader storage buffer,
+//   and one instanced draw skins the shared bind-pose vertices in the vertex
+//   shader. Needs GL 4.3. Palettes are mat4x3_t, three rows the shader reads
+//   as a std430 mat3x4: 48 bytes a joint rather than 64.
+//
+// Shading uses flat normals from screen-space derivatives, so neither path
+// needs to skin normals.
+
+#define SKIN_INFLUENCES 4
+#define SKIN_MAX_JOINTS 64
+#define SKIN_BINDING_PALETTES 7    // Shader storage, clear of gpu_scene and clusters.
+
+typedef enum skinning_mode_ {
+    SKINNING_CPU = 0,
+    SKINNING_GPU
+} skinning_mode_t;
+
+// Bind-pose vertex, as the GPU path's attributes read it.
+typedef struct skin_vertex_ {
+    float pos[4];
+    float weights[SKIN_INFLUENCES];     // Sum to 1; unused ones last, and 0.
+    GLubyte joints[SKIN_INFLUENCES];
+} skin_vertex_t;
+
+typedef struct skinning_stats_ {
+    unsigned long frames;
+    double palette_ms;          // Total CPU time sampling and building palettes.
+    double skin_ms;             // Total CPU time skinning and uploading (CPU path).
+    size_t upload_bytes;        // Last frame.
+} skinning_stats_t;
+
+typedef struct skinning_ {
+    skinning_mode_t mode;
+    skeleton_t skeleton;
+    animation_t animation;
+    unsigned int count;                     // Characters.
+    unsigned int vertex_count, index_count; // Per character.
+    skin_vertex_t* vertices;
+    mat4x3_t* models;
+    float* start_times;
+    mat4x3_t* palettes;                     // joint_count per character.
+
+    GLuint prog, vao, bind_vbo, ibo, stream_vbo, palette_ssbo;
+    GLint view_uloc, proj_uloc, joints_uloc, tint_uloc;
+    float* staging;                         // CPU path while a trace records.
+
+    skinning_stats_t stats;
+} skinning_t;
+
+// Lays `characters` tentacles of `joints` joints out on a grid spanning
+// [-1, 1] in x and z. Needs the job system and a current context.
+int  skinning_init(skinning_t* s, unsigned int characters, unsigned int joints, skinning_mode_t mode);
+void skinning_destroy(skinning_t* s);
+
+// Poses every character at `time` seconds and skins or uploads palettes.
+void skinning_update(skinning_t* s, float time);
+void skinning_draw(skinning_t* s, const mat4_t* view, const mat4_t* projection);
+
+#endif // RENDER_SKINNING_H
@@ -0,0 +1,312 @@
+#include "texture.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static void decode_job(void* arg);
+static int upload_chunk(texture_streamer_t* ts, texture_t* tex, size_t budget_left);
+static int begin_upload(texture_t* tex);
+static void finish_texture(texture_streamer_t* ts, texture_t* tex);
+static void free_released(texture_streamer_t* ts);
+
+int texture_streamer_init(texture_streamer_t* ts, size_t max_textures, size_t budget_bytes) {
+    unsigned int i;
+
+    memset(ts, 0, sizeof(*ts));
+    if (!pool_init(&ts->textures, sizeof(texture_t), max_textures)) return 0;
+
+    ts->budget = budget_bytes > 0 ? budget_bytes : TEXTURE_DEFAULT_BUDGET;
+    pthread_mutex_init(&ts->lock, NULL);
+    atomic_init(&ts->decoding.pending, 0);
+
+    glGenBuffers(TEXTURE_PBO_COUNT, ts->pbos);
+    for (i = 0; i < TEXTURE_PBO_COUNT; ++i) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ts->pbos[i]);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, TEXTURE_PBO_SIZE, NULL, GL_STREAM_DRAW);
+        ts->fences[i] = 0;
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    if (glGetError() != GL_NO_ERROR) {
+        fprintf(stderr, "ERROR: Could not create texture upload buffers.\n");
+        return 0;
+    }
+    return 1;
+}
+
+void texture_streamer_destroy(texture_streamer_t* ts) {
+    unsigned int i;
+
+    // Workers write into pool slots, so let them finish first.
+    jobs_wait(&ts->decoding);
+    free_released(ts);
+
+    for (i = 0; i < TEXTURE_PBO_COUNT; ++i)
+        if (ts->fences[i] != 0) glDeleteSync(ts->fences[i]);
+    glDeleteBuffers(TEXTURE_PBO_COUNT, ts->pbos);
+
+    pthread_mutex_destroy(&ts->lock);
+    pool_destroy(&ts->textures);
+}
+
+texture_t* texture_load(texture_streamer_t* ts, const char* path) {
+    texture_t* tex = (texture_t*) pool_alloc(&ts->textures);
+
+    if (tex == NULL) {
+        fprintf(stderr, "ERROR: Too many textures, cannot load %s.\n", path);
+        return NULL;
+    }
+
+    memset(tex, 0, sizeof(*tex));
+    atomic_init(&tex->state, TEXTURE_LOADING);
+    strncpy(tex->path, path, TEXTURE_PATH_MAX - 1);
+    tex->owner = ts;
+
+    jobs_submit(decode_job, tex, &ts->decoding);
+    return tex;
+}
+
+void texture_release(texture_t* tex) {
+    texture_streamer_t* ts;
+    texture_state_t state;
+
+    if (tex == NULL) return;
+    ts = tex->owner;
+
+    // Workers only change the state under the lock, so this can't race with
+    // the end of a decode.
+    pthread_mutex_lock(&ts->lock);
+    state = (texture_state_t) atomic_load(&tex->state);
+    if (state == TEXTURE_LOADING) {
+        // Still decoding: the job hands it back through the released list.
+        tex->released = 1;
+        pthread_mutex_unlock(&ts->lock);
+        return;
+    }
+    if (state == TEXTURE_DECODED) {
+        texture_t *t, *prev = NULL;
+
+        for (t = ts->ready_head; t != NULL; prev = t, t = t->next) {
+            if (t != tex) continue;
+            if (prev != NULL) prev->next = t->next;
+            else ts->ready_head = t->next;
+            if (ts->ready_tail == t) ts->ready_tail = prev;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&ts->lock);
+    if (ts->current == tex) ts->current = NULL;
+
+    image_free(&tex->image);
+    if (tex->id != 0) glDeleteTextures(1, &tex->id);
+    pool_free(&ts->textures, tex);
+}
+
+texture_state_t texture_state(const texture_t* tex) {
+    return (texture_state_t) atomic_load(&tex->state);
+}
+
+int texture_bind(const texture_t* tex, GLuint unit) {
+    const texture_state_t state = tex != NULL ? texture_state(tex) : TEXTURE_FAILED;
+
+    if ((state != TEXTURE_UPLOADING && state != TEXTURE_RESIDENT) || tex->base_level >= tex->levels)
+        return 0;
+
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_2D, tex->id);
+    return 1;
+}
+
+void texture_streamer_update(texture_streamer_t* ts) {
+    size_t budget_left = ts->budget;
+    int uploaded;
+
+    ts->stats.bytes_last_frame = 0;
+    free_released(ts);
+
+    while (budget_left > 0) {
+        if (ts->current == NULL) {
+            pthread_mutex_lock(&ts->lock);
+            if ((ts->current = ts->ready_head) != NULL) {
+                ts->ready_head = ts->current->next;
+                if (ts->ready_head == NULL) ts->ready_tail = NULL;
+            }
+            pthread_mutex_unlock(&ts->lock);
+
+            if (ts->current == NULL) break; // Nothing to upload.
+            if (!begin_upload(ts->current)) {
+                ts->current = NULL;
+                continue;
+            }
+        }
+
+        if ((uploaded = upload_chunk(ts, ts->current, budget_left)) <= 0) {
+            if (uploaded < 0) ++ts->stats.pbo_stalls;
+            break;
+        }
+
+        budget_left = (size_t)uploaded >= budget_left ? 0 : budget_left - uploaded;
+        ts->stats.bytes_last_frame += (size_t)uploaded;
+
+        if (ts->current->upload_level < 0) {
+            finish_texture(ts, ts->current);
+            ts->current = NULL;
+        }
+    }
+
+    ts->stats.bytes_total += ts->stats.bytes_last_frame;
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+texture_stats_t texture_streamer_stats(const texture_streamer_t* ts) { return ts->stats; }
+
+// Worker side: decode, generate mips, then hand over to the render thread.
+static void decode_job(void* arg) {
+    texture_t* tex = (texture_t*) arg;
+    texture_streamer_t* ts = tex->owner;
+    const int loaded = image_load(tex->path, &tex->image);
+
+    if (loaded) {
+        tex->width = tex->image.width;
+        tex->height = tex->image.height;
+        tex->levels = tex->image.levels;
+        tex->base_level = tex->levels;
+    }
+
+    pthread_mutex_lock(&ts->lock);
+    tex->next = NULL;
+    if (tex->released) {
+        // Nobody wants it any more; the pool isn't thread-safe, so the
+        // render thread frees the slot.
+        if (loaded) image_free(&tex->image);
+        tex->next = ts->released_head;
+        ts->released_head = tex;
+    } else if (!loaded) {
+        atomic_store(&tex->state, TEXTURE_FAILED);
+    } else {
+        if (ts->ready_tail != NULL) ts->ready_tail->next = tex;
+        else ts->ready_head = tex;
+        ts->ready_tail = tex;
+        atomic_store(&tex->state, TEXTURE_DECODED);
+    }
+    pthread_mutex_unlock(&ts->lock);
+}
+
+// Render thread: allocate immutable storage for all levels.
+static int begin_upload(texture_t* tex) {
+    GLint max_size;
+
+    // Uploads go one row (of pixels or blocks) at a time at the least.
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+    if (tex->width > max_size || tex->height > max_size || tex->image.level[0].row_bytes > TEXTURE_PBO_SIZE) {
+        fprintf(stderr, "ERROR: Texture %s is too large to stream.\n", tex->path);
+        image_free(&tex->image);
+        atomic_store(&tex->state, TEXTURE_FAILED);
+        return 0;
+    }
+
+    glGenTextures(1, &tex->id);
+    glBindTexture(GL_TEXTURE_2D, tex->id);
+    glTexStorage2D(GL_TEXTURE_2D, tex->levels, tex->image.internal_format, tex->width, tex->height);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, tex->levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, tex->levels - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, tex->levels - 1);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    tex->upload_level = tex->levels - 1;
+    tex->upload_row = 0;
+    atomic_store(&tex->state, TEXTURE_UPLOADING);
+    return 1;
+}
+
+// Copies as many rows of the current level as fit in one PBO and the budget
+// and issues the upload. Returns the bytes uploaded, 0 when out of budget, or
+// -1 when the next PBO is still in use by the GPU.
+static int upload_chunk(texture_streamer_t* ts, texture_t* tex, size_t budget_left) {
+    const image_level_t* l = &tex->image.level[tex->upload_level];
+    const unsigned int slot = ts->next_pbo;
+    size_t limit, bytes;
+    int rows;
+    void* dst;
+
+    if (ts->fences[slot] != 0) {
+        // Never wait: if the GPU still reads from this PBO, try next frame.
+        const GLenum res = glClientWaitSync(ts->fences[slot], 0, 0);
+        if (res == GL_TIMEOUT_EXPIRED) return -1;
+        glDeleteSync(ts->fences[slot]);
+        ts->fences[slot] = 0;
+    }
+
+    limit = budget_left < TEXTURE_PBO_SIZE ? budget_left : TEXTURE_PBO_SIZE;
+    rows = (int)(limit / l->row_bytes);
+    if (rows > l->rows - tex->upload_row) rows = l->rows - tex->upload_row;
+    if (rows <= 0) {
+        // A single row bigger than what's left: only take it on a fresh
+        // budget, so a small budget still makes progress.
+        if (budget_left < ts->budget) return 0;
+        rows = 1;
+    }
+    bytes = (size_t)rows * l->row_bytes;
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ts->pbos[slot]);
+    dst = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes,
+                           GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    if (dst == NULL) {
+        fprintf(stderr, "ERROR: Could not map texture upload buffer.\n");
+        return 0;
+    }
+    memcpy(dst, tex->image.data + l->offset + (size_t)tex->upload_row * l->row_bytes, bytes);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+    glBindTexture(GL_TEXTURE_2D, tex->id);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    if (tex->image.compressed) {
+        // Rows here are rows of 4x4 blocks.
+        const int y = tex->upload_row * 4;
+        const int h = (tex->upload_row + rows) * 4 > l->height ? l->height - y : rows * 4;
+        glCompressedTexSubImage2D(GL_TEXTURE_2D, tex->upload_level, 0, y, l->width, h,
+                                  tex->image.internal_format, (GLsizei)bytes, (const GLvoid*)0);
+    } else {
+        glTexSubImage2D(GL_TEXTURE_2D, tex->upload_level, 0, tex->upload_row, l->width, rows,
+                        tex->image.format, tex->image.type, (const GLvoid*)0);
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    ts->fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    ts->next_pbo = (slot + 1) % TEXTURE_PBO_COUNT;
+
+    tex->upload_row += rows;
+    if (tex->upload_row == l->rows) {
+        // Level complete: let sampling use it.
+        tex->base_level = tex->upload_level;
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, tex->base_level);
+        --tex->upload_level;
+        tex->upload_row = 0;
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    return (int)bytes;
+}
+
+static void finish_texture(texture_streamer_t* ts, texture_t* tex) {
+    image_free(&tex->image);
+    atomic_store(&tex->state, TEXTURE_RESIDENT);
+    ++ts->stats.textures_resident;
+}
+
+static void free_released(texture_streamer_t* ts) {
+    texture_t* tex;
+
+    pthread_mutex_lock(&ts->lock);
+    tex = ts->released_head;
+    ts->released_head = NULL;
+    pthread_mutex_unlock(&ts->lock);
+
+    while (tex != NULL) {
+        texture_t* next = tex->next;
+        pool_free(&ts->textures, tex);
+        tex = next;
+    }
+}
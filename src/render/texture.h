@@ -0,0 +1,99 @@
+#ifndef RENDER_TEXTURE_H
+#define RENDER_TEXTURE_H
+
+#include <stddef.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <GL/glew.h>
+
+#include "core/pool.h"
+#include "core/jobs.h"
+#include "image.h"
+
+// Asynchronous texture streaming.
+//
+// texture_load() returns immediately with a handle; decoding and mip
+// generation happen on the job system. Once per frame the render thread calls
+// texture_streamer_update(), which copies decoded levels into a ring of pixel
+// buffer objects and issues the texture uploads from them, up to a byte
+// budget. A PBO is only reused after its fence has signalled, and if none is
+// free the upload simply waits for the next frame, so the render loop never
+// blocks on a load.
+//
+// Levels are uploaded smallest first and GL_TEXTURE_BASE_LEVEL follows them,
+// so a texture becomes usable (at low resolution) after its first level.
+//
+// texture_release() never waits either: a texture still decoding is only
+// marked, and its slot is reclaimed by the update after its job finishes.
+
+#define TEXTURE_PBO_COUNT 4
+#define TEXTURE_PBO_SIZE (4 * 1024 * 1024)
+#define TEXTURE_DEFAULT_BUDGET (8 * 1024 * 1024)
+#define TEXTURE_PATH_MAX 256
+
+typedef enum texture_state_ {
+    TEXTURE_LOADING = 0,    // Queued or decoding on a worker.
+    TEXTURE_DECODED,        // Waiting for upload.
+    TEXTURE_UPLOADING,      // Some levels resident.
+    TEXTURE_RESIDENT,       // All levels resident.
+    TEXTURE_FAILED
+} texture_state_t;
+
+typedef struct texture_ {
+    GLuint id;              // 0 until the first upload.
+    atomic_int state;
+    int width, height, levels;
+    int base_level;         // Lowest level resident so far (== levels when none).
+
+    // Upload cursor.
+    int upload_level;
+    int upload_row;
+
+    image_t image;          // Owned by the worker until DECODED, then by the render thread.
+    char path[TEXTURE_PATH_MAX];
+    struct texture_streamer_* owner;
+    int released;           // Released while LOADING; under the streamer's lock.
+    struct texture_* next;  // Ready or released queue link.
+} texture_t;
+
+typedef struct texture_stats_ {
+    size_t bytes_last_frame;
+    size_t bytes_total;
+    unsigned long textures_resident;
+    unsigned long pbo_stalls;       // Frames where uploads waited on a busy PBO.
+} texture_stats_t;
+
+typedef struct texture_streamer_ {
+    pool_t textures;
+    size_t budget;
+
+    // Decoded textures waiting for upload, in completion order. Shared with
+    // the workers, hence the lock.
+    pthread_mutex_t lock;
+    texture_t* ready_head;
+    texture_t* ready_tail;
+    texture_t* current;             // Being uploaded (render thread only).
+    texture_t* released_head;       // Released while decoding, decode done: free on update.
+    job_counter_t decoding;
+
+    GLuint pbos[TEXTURE_PBO_COUNT];
+    GLsync fences[TEXTURE_PBO_COUNT];
+    unsigned int next_pbo;
+
+    texture_stats_t stats;
+} texture_streamer_t;
+
+int  texture_streamer_init(texture_streamer_t* ts, size_t max_textures, size_t budget_bytes);
+void texture_streamer_destroy(texture_streamer_t* ts);
+void texture_streamer_update(texture_streamer_t* ts);
+texture_stats_t texture_streamer_stats(const texture_streamer_t* ts);
+
+texture_t* texture_load(texture_streamer_t* ts, const char* path);
+void texture_release(texture_t* tex);
+
+// Binds the texture to `unit` if at least one level is resident. Returns 0
+// (binding nothing) otherwise, so callers can fall back to a placeholder.
+int texture_bind(const texture_t* tex, GLuint unit);
+texture_state_t texture_state(const texture_t* tex);
+
+#endif // RENDER_TEXTURE_H
@@ -0,0 +1,471 @@
+#include "trace.h"
+#include "counters.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// Entry points loaded by GLEW, swapped for recording wrappers while a trace
+// is open. Functions a context lacks (NULL pointers) are left alone.
+#define TRACE_HOOKS(X) \
+    X(CreateProgram, PFNGLCREATEPROGRAMPROC) \
+    X(CreateShader, PFNGLCREATESHADERPROC) \
+    X(ShaderSource, PFNGLSHADERSOURCEPROC) \
+    X(CompileShader, PFNGLCOMPILESHADERPROC) \
+    X(AttachShader, PFNGLATTACHSHADERPROC) \
+    X(DetachShader, PFNGLDETACHSHADERPROC) \
+    X(LinkProgram, PFNGLLINKPROGRAMPROC) \
+    X(DeleteShader, PFNGLDELETESHADERPROC) \
+    X(DeleteProgram, PFNGLDELETEPROGRAMPROC) \
+    X(UseProgram, PFNGLUSEPROGRAMPROC) \
+    X(GetUniformLocation, PFNGLGETUNIFORMLOCATIONPROC) \
+    X(Uniform1i, PFNGLUNIFORM1IPROC) \
+    X(Uniform1ui, PFNGLUNIFORM1UIPROC) \
+    X(Uniform1f, PFNGLUNIFORM1FPROC) \
+    X(Uniform2f, PFNGLUNIFORM2FPROC) \
+    X(Uniform3fv, PFNGLUNIFORM3FVPROC) \
+    X(Uniform4fv, PFNGLUNIFORM4FVPROC) \
+    X(UniformMatrix4fv, PFNGLUNIFORMMATRIX4FVPROC) \
+    X(UniformMatrix4x3fv, PFNGLUNIFORMMATRIX4X3FVPROC) \
+    X(GenBuffers, PFNGLGENBUFFERSPROC) \
+    X(DeleteBuffers, PFNGLDELETEBUFFERSPROC) \
+    X(BindBuffer, PFNGLBINDBUFFERPROC) \
+    X(BindBufferBase, PFNGLBINDBUFFERBASEPROC) \
+    X(BufferData, PFNGLBUFFERDATAPROC) \
+    X(BufferSubData, PFNGLBUFFERSUBDATAPROC) \
+    X(ClearBufferData, PFNGLCLEARBUFFERDATAPROC) \
+    X(GenVertexArrays, PFNGLGENVERTEXARRAYSPROC) \
+    X(DeleteVertexArrays, PFNGLDELETEVERTEXARRAYSPROC) \
+    X(BindVertexArray, PFNGLBINDVERTEXARRAYPROC) \
+    X(EnableVertexAttribArray, PFNGLENABLEVERTEXATTRIBARRAYPROC) \
+    X(DisableVertexAttribArray, PFNGLDISABLEVERTEXATTRIBARRAYPROC) \
+    X(VertexAttribPointer, PFNGLVERTEXATTRIBPOINTERPROC) \
+    X(VertexAttribIPointer, PFNGLVERTEXATTRIBIPOINTERPROC) \
+    X(VertexAttribDivisor, PFNGLVERTEXATTRIBDIVISORPROC) \
+    X(DispatchCompute, PFNGLDISPATCHCOMPUTEPROC) \
+    X(MemoryBarrier, PFNGLMEMORYBARRIERPROC) \
+    X(MultiDrawElementsIndirect, PFNGLMULTIDRAWELEMENTSINDIRECTPROC) \
+    X(MultiDrawElementsIndirectCountARB, PFNGLMULTIDRAWELEMENTSINDIRECTCOUNTARBPROC) \
+    X(DrawElementsInstanced, PFNGLDRAWELEMENTSINSTANCEDPROC) \
+    X(DrawElementsBaseVertex, PFNGLDRAWELEMENTSBASEVERTEXPROC) \
+    X(CopyBufferSubData, PFNGLCOPYBUFFERSUBDATAPROC)
+
+#define DECLARE_REAL(name, type) static type real_##name = NULL;
+TRACE_HOOKS(DECLARE_REAL)
+#undef DECLARE_REAL
+
+#define TRACE_BUFFER_SIZE (1 << 20)
+
+static FILE* g_trace = NULL;
+static trace_stats_t g_stats;
+
+#define LO(x) ((uint32_t)(uint64_t)(x))
+#define HI(x) ((uint32_t)((uint64_t)(x) >> 32))
+
+static uint32_t fbits(float f) {
+    uint32_t u;
+    memcpy(&u, &f, sizeof(u));
+    return u;
+}
+
+static void begin_record(trace_op_t op, const uint32_t* args, uint32_t nargs, size_t size) {
+    uint32_t head[2];
+
+    head[0] = (uint32_t)op;
+    head[1] = (uint32_t)(nargs * sizeof(uint32_t) + ((size + 3) & ~(size_t)3));
+    fwrite(head, sizeof(head), 1, g_trace);
+    if (nargs > 0) fwrite(args, sizeof(uint32_t), nargs, g_trace);
+
+    ++g_stats.records;
+    g_stats.bytes += sizeof(head) + head[1];
+}
+
+static void end_record(size_t size) {
+    static const unsigned char pad[4] = { 0 };
+    if (size & 3) fwrite(pad, 1, 4 - (size & 3), g_trace);
+}
+
+static void put_record(trace_op_t op, const uint32_t* args, uint32_t nargs, const void* data, size_t size) {
+    begin_record(op, args, nargs, size);
+    if (size > 0) fwrite(data, 1, size, g_trace);
+    end_record(size);
+}
+
+#define RECORD(op, data, size, ...) do { \
+        const uint32_t args_[] = { __VA_ARGS__ }; \
+        put_record(op, args_, sizeof(args_) / sizeof(args_[0]), data, size); \
+    } while (0)
+
+// Bytes in one element of glClearBufferData's data.
+static size_t element_size(GLenum format, GLenum type) {
+    size_t components, bytes;
+
+    switch (format) {
+    case GL_RED: case GL_RED_INTEGER: components = 1; break;
+    case GL_RG: case GL_RG_INTEGER: components = 2; break;
+    case GL_RGB: case GL_RGB_INTEGER: components = 3; break;
+    default: components = 4; break;
+    }
+    switch (type) {
+    case GL_BYTE: case GL_UNSIGNED_BYTE: bytes = 1; break;
+    case GL_SHORT: case GL_UNSIGNED_SHORT: case GL_HALF_FLOAT: bytes = 2; break;
+    default: bytes = 4; break;
+    }
+    return components * bytes;
+}
+
+// Recording wrappers: forward first, so that generated names are known.
+static GLuint GLAPIENTRY rec_CreateProgram(void) {
+    GLuint program = real_CreateProgram();
+    RECORD(TRACE_OP_CREATE_PROGRAM, NULL, 0, program);
+    return program;
+}
+
+static GLuint GLAPIENTRY rec_CreateShader(GLenum type) {
+    GLuint shader = real_CreateShader(type);
+    RECORD(TRACE_OP_CREATE_SHADER, NULL, 0, type, shader);
+    return shader;
+}
+
+// The strings are recorded as one.
+static void GLAPIENTRY rec_ShaderSource(GLuint shader, GLsizei count, const GLchar* const* strings, const GLint* lengths) {
+    uint32_t args[2];
+    size_t size = 0;
+    GLsizei i;
+
+    real_ShaderSource(shader, count, strings, lengths);
+
+    for (i = 0; i < count; ++i)
+        size += lengths != NULL && lengths[i] >= 0 ? (size_t)lengths[i] : strlen(strings[i]);
+    args[0] = shader;
+    args[1] = (uint32_t)size;
+    begin_record(TRACE_OP_SHADER_SOURCE, args, 2, size);
+    for (i = 0; i < count; ++i)
+        fwrite(strings[i], 1, lengths != NULL && lengths[i] >= 0 ? (size_t)lengths[i] : strlen(strings[i]), g_trace);
+    end_record(size);
+}
+
+static void GLAPIENTRY rec_CompileShader(GLuint shader) {
+    real_CompileShader(shader);
+    RECORD(TRACE_OP_COMPILE_SHADER, NULL, 0, shader);
+}
+
+static void GLAPIENTRY rec_AttachShader(GLuint program, GLuint shader) {
+    real_AttachShader(program, shader);
+    RECORD(TRACE_OP_ATTACH_SHADER, NULL, 0, program, shader);
+}
+
+static void GLAPIENTRY rec_DetachShader(GLuint program, GLuint shader) {
+    real_DetachShader(program, shader);
+    RECORD(TRACE_OP_DETACH_SHADER, NULL, 0, program, shader);
+}
+
+static void GLAPIENTRY rec_LinkProgram(GLuint program) {
+    real_LinkProgram(program);
+    RECORD(TRACE_OP_LINK_PROGRAM, NULL, 0, program);
+}
+
+static void GLAPIENTRY rec_DeleteShader(GLuint shader) {
+    real_DeleteShader(shader);
+    RECORD(TRACE_OP_DELETE_SHADER, NULL, 0, shader);
+}
+
+static void GLAPIENTRY rec_DeleteProgram(GLuint program) {
+    real_DeleteProgram(program);
+    RECORD(TRACE_OP_DELETE_PROGRAM, NULL, 0, program);
+}
+
+static void GLAPIENTRY rec_UseProgram(GLuint program) {
+    real_UseProgram(program);
+    RECORD(TRACE_OP_USE_PROGRAM, NULL, 0, program);
+}
+
+static GLint GLAPIENTRY rec_GetUniformLocation(GLuint program, const GLchar* name) {
+    GLint location = real_GetUniformLocation(program, name);
+    RECORD(TRACE_OP_UNIFORM_LOCATION, name, strlen(name) + 1, program, (uint32_t)location);
+    return location;
+}
+
+static void GLAPIENTRY rec_Uniform1i(GLint location, GLint v) {
+    real_Uniform1i(location, v);
+    RECORD(TRACE_OP_UNIFORM_1I, NULL, 0, (uint32_t)location, (uint32_t)v);
+}
+
+static void GLAPIENTRY rec_Uniform1ui(GLint location, GLuint v) {
+    real_Uniform1ui(location, v);
+    RECORD(TRACE_OP_UNIFORM_1UI, NULL, 0, (uint32_t)location, v);
+}
+
+static void GLAPIENTRY rec_Uniform1f(GLint location, GLfloat v) {
+    real_Uniform1f(location, v);
+    RECORD(TRACE_OP_UNIFORM_1F, NULL, 0, (uint32_t)location, fbits(v));
+}
+
+static void GLAPIENTRY rec_Uniform2f(GLint location, GLfloat x, GLfloat y) {
+    real_Uniform2f(location, x, y);
+    RECORD(TRACE_OP_UNIFORM_2F, NULL, 0, (uint32_t)location, fbits(x), fbits(y));
+}
+
+static void GLAPIENTRY rec_Uniform3fv(GLint location, GLsizei count, const GLfloat* v) {
+    real_Uniform3fv(location, count, v);
+    RECORD(TRACE_OP_UNIFORM_3FV, v, sizeof(GLfloat) * 3 * count, (uint32_t)location, (uint32_t)count);
+}
+
+static void GLAPIENTRY rec_Uniform4fv(GLint location, GLsizei count, const GLfloat* v) {
+    real_Uniform4fv(location, count, v);
+    RECORD(TRACE_OP_UNIFORM_4FV, v, sizeof(GLfloat) * 4 * count, (uint32_t)location, (uint32_t)count);
+}
+
+static void GLAPIENTRY rec_UniformMatrix4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat* v) {
+    real_UniformMatrix4fv(location, count, transpose, v);
+    RECORD(TRACE_OP_UNIFORM_MATRIX_4FV, v, sizeof(GLfloat) * 16 * count,
+           (uint32_t)location, (uint32_t)count, transpose);
+}
+
+static void GLAPIENTRY rec_UniformMatrix4x3fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat* v) {
+    real_UniformMatrix4x3fv(location, count, transpose, v);
+    RECORD(TRACE_OP_UNIFORM_MATRIX_4X3FV, v, sizeof(GLfloat) * 12 * count,
+           (uint32_t)location, (uint32_t)count, transpose);
+}
+
+static void GLAPIENTRY rec_GenBuffers(GLsizei n, GLuint* buffers) {
+    real_GenBuffers(n, buffers);
+    RECORD(TRACE_OP_GEN_BUFFERS, buffers, sizeof(GLuint) * n, (uint32_t)n);
+}
+
+static void GLAPIENTRY rec_DeleteBuffers(GLsizei n, const GLuint* buffers) {
+    real_DeleteBuffers(n, buffers);
+    RECORD(TRACE_OP_DELETE_BUFFERS, buffers, sizeof(GLuint) * n, (uint32_t)n);
+}
+
+static void GLAPIENTRY rec_BindBuffer(GLenum target, GLuint buffer) {
+    real_BindBuffer(target, buffer);
+    RECORD(TRACE_OP_BIND_BUFFER, NULL, 0, target, buffer);
+}
+
+static void GLAPIENTRY rec_BindBufferBase(GLenum target, GLuint index, GLuint buffer) {
+    real_BindBufferBase(target, index, buffer);
+    RECORD(TRACE_OP_BIND_BUFFER_BASE, NULL, 0, target, index, buffer);
+}
+
+static void GLAPIENTRY rec_BufferData(GLenum target, GLsizeiptr size, const void* data, GLenum usage) {
+    real_BufferData(target, size, data, usage);
+    RECORD(TRACE_OP_BUFFER_DATA, data, data != NULL ? (size_t)size : 0,
+           target, usage, LO(size), HI(size), data != NULL);
+}
+
+static void GLAPIENTRY rec_BufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void* data) {
+    real_BufferSubData(target, offset, size, data);
+    RECORD(TRACE_OP_BUFFER_SUB_DATA, data, (size_t)size, target, LO(offset), HI(offset), LO(size), HI(size));
+}
+
+static void GLAPIENTRY rec_ClearBufferData(GLenum target, GLenum internalformat, GLenum format, GLenum type, const void* data) {
+    const size_t size = data != NULL ? element_size(format, type) : 0;
+    real_ClearBufferData(target, internalformat, format, type, data);
+    RECORD(TRACE_OP_CLEAR_BUFFER_DATA, data, size, target, internalformat, format, type, (uint32_t)size);
+}
+
+static void GLAPIENTRY rec_GenVertexArrays(GLsizei n, GLuint* arrays) {
+    real_GenVertexArrays(n, arrays);
+    RECORD(TRACE_OP_GEN_VERTEX_ARRAYS, arrays, sizeof(GLuint) * n, (uint32_t)n);
+}
+
+static void GLAPIENTRY rec_DeleteVertexArrays(GLsizei n, const GLuint* arrays) {
+    real_DeleteVertexArrays(n, arrays);
+    RECORD(TRACE_OP_DELETE_VERTEX_ARRAYS, arrays, sizeof(GLuint) * n, (uint32_t)n);
+}
+
+static void GLAPIENTRY rec_BindVertexArray(GLuint array) {
+    real_BindVertexArray(array);
+    RECORD(TRACE_OP_BIND_VERTEX_ARRAY, NULL, 0, array);
+}
+
+static void GLAPIENTRY rec_EnableVertexAttribArray(GLuint index) {
+    real_EnableVertexAttribArray(index);
+    RECORD(TRACE_OP_ENABLE_ATTRIB, NULL, 0, index);
+}
+
+static void GLAPIENTRY rec_DisableVertexAttribArray(GLuint index) {
+    real_DisableVertexAttribArray(index);
+    RECORD(TRACE_OP_DISABLE_ATTRIB, NULL, 0, index);
+}
+
+// Attribute pointers are offsets into the bound GL_ARRAY_BUFFER.
+static void GLAPIENTRY rec_VertexAttribPointer(GLuint index, GLint size, GLenum type, GLboolean normalized,
+                                               GLsizei stride, const void* pointer) {
+    real_VertexAttribPointer(index, size, type, normalized, stride, pointer);
+    RECORD(TRACE_OP_ATTRIB_POINTER, NULL, 0, index, (uint32_t)size, type, normalized, (uint32_t)stride,
+           LO((uintptr_t)pointer), HI((uintptr_t)pointer));
+}
+
+static void GLAPIENTRY rec_VertexAttribIPointer(GLuint index, GLint size, GLenum type, GLsizei stride, const void* pointer) {
+    real_VertexAttribIPointer(index, size, type, stride, pointer);
+    RECORD(TRACE_OP_ATTRIB_IPOINTER, NULL, 0, index, (uint32_t)size, type, (uint32_t)stride,
+           LO((uintptr_t)pointer), HI((uintptr_t)pointer));
+}
+
+static void GLAPIENTRY rec_VertexAttribDivisor(GLuint index, GLuint divisor) {
+    real_VertexAttribDivisor(index, divisor);
+    RECORD(TRACE_OP_ATTRIB_DIVISOR, NULL, 0, index, divisor);
+}
+
+static void GLAPIENTRY rec_DispatchCompute(GLuint x, GLuint y, GLuint z) {
+    real_DispatchCompute(x, y, z);
+    RECORD(TRACE_OP_DISPATCH_COMPUTE, NULL, 0, x, y, z);
+}
+
+static void GLAPIENTRY rec_MemoryBarrier(GLbitfield barriers) {
+    real_MemoryBarrier(barriers);
+    RECORD(TRACE_OP_MEMORY_BARRIER, NULL, 0, barriers);
+}
+
+static void GLAPIENTRY rec_MultiDrawElementsIndirect(GLenum mode, GLenum type, const void* indirect,
+                                                     GLsizei drawcount, GLsizei stride) {
+    real_MultiDrawElementsIndirect(mode, type, indirect, drawcount, stride);
+    RECORD(TRACE_OP_MULTI_DRAW_INDIRECT, NULL, 0, mode, type, LO((uintptr_t)indirect), HI((uintptr_t)indirect),
+           (uint32_t)drawcount, (uint32_t)stride);
+}
+
+static void GLAPIENTRY rec_MultiDrawElementsIndirectCountARB(GLenum mode, GLenum type, const void* indirect,
+                                                             GLintptr drawcount, GLsizei maxdrawcount, GLsizei stride) {
+    real_MultiDrawElementsIndirectCountARB(mode, type, indirect, drawcount, maxdrawcount, stride);
+    RECORD(TRACE_OP_MULTI_DRAW_INDIRECT_COUNT, NULL, 0, mode, type, LO((uintptr_t)indirect), HI((uintptr_t)indirect),
+           LO(drawcount), HI(drawcount), (uint32_t)maxdrawcount, (uint32_t)stride);
+}
+
+static void GLAPIENTRY rec_DrawElementsInstanced(GLenum mode, GLsizei count, GLenum type, const void* indices,
+                                                 GLsizei instances) {
+    real_DrawElementsInstanced(mode, count, type, indices, instances);
+    RECORD(TRACE_OP_DRAW_ELEMENTS_INSTANCED, NULL, 0, mode, (uint32_t)count, type,
+           LO((uintptr_t)indices), HI((uintptr_t)indices), (uint32_t)instances);
+}
+
+static void GLAPIENTRY rec_DrawElementsBaseVertex(GLenum mode, GLsizei count, GLenum type, const void* indices,
+                                                  GLint base_vertex) {
+    real_DrawElementsBaseVertex(mode, count, type, indices, base_vertex);
+    RECORD(TRACE_OP_DRAW_ELEMENTS_BASE_VERTEX, NULL, 0, mode, (uint32_t)count, type,
+           LO((uintptr_t)indices), HI((uintptr_t)indices), (uint32_t)base_vertex);
+}
+
+static void GLAPIENTRY rec_CopyBufferSubData(GLenum read_target, GLenum write_target, GLintptr read_offset,
+                                             GLintptr write_offset, GLsizeiptr size) {
+    real_CopyBufferSubData(read_target, write_target, read_offset, write_offset, size);
+    RECORD(TRACE_OP_COPY_BUFFER_SUB_DATA, NULL, 0, read_target, write_target, LO(read_offset), HI(read_offset),
+           LO(write_offset), HI(write_offset), LO(size), HI(size));
+}
+
+int trace_begin_record(const char* path) {
+    trace_header_t header;
+    GLint viewport[4] = { 0 }, profile = 0;
+
+    if (g_trace != NULL) {
+        fprintf(stderr, "ERROR: A trace is already being recorded.\n");
+        return 0;
+    }
+    if ((g_trace = fopen(path, "wb")) == NULL) {
+        fprintf(stderr, "ERROR: Could not open trace %s.\n", path);
+        return 0;
+    }
+    setvbuf(g_trace, NULL, _IOFBF, TRACE_BUFFER_SIZE);
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.version = TRACE_VERSION;
+    glGetIntegerv(GL_MAJOR_VERSION, &header.gl_major);
+    glGetIntegerv(GL_MINOR_VERSION, &header.gl_minor);
+    glGetIntegerv(GL_CONTEXT_PROFILE_MASK, &profile);
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    glGetError(); // The profile mask is unknown before 3.2.
+    header.core_profile = (profile & GL_CONTEXT_CORE_PROFILE_BIT) != 0;
+    header.width = viewport[2];
+    header.height = viewport[3];
+    fwrite(&header, sizeof(header), 1, g_trace);
+
+    memset(&g_stats, 0, sizeof(g_stats));
+    g_stats.bytes = sizeof(header);
+
+#define INSTALL(name, type) \
+    if (__glew##name != NULL) { real_##name = __glew##name; __glew##name = rec_##name; }
+    TRACE_HOOKS(INSTALL)
+#undef INSTALL
+
+    return 1;
+}
+
+trace_stats_t trace_end_record(void) {
+    if (g_trace == NULL) return g_stats;
+
+#define UNINSTALL(name, type) \
+    if (real_##name != NULL) { __glew##name = real_##name; real_##name = NULL; }
+    TRACE_HOOKS(UNINSTALL)
+#undef UNINSTALL
+
+    if (fclose(g_trace) != 0)
+        fprintf(stderr, "ERROR: Could not write the trace.\n");
+    g_trace = NULL;
+    return g_stats;
+}
+
+int trace_recording(void) {
+    return g_trace != NULL;
+}
+
+void trace_frame(void) {
+    if (g_trace == NULL) return;
+    put_record(TRACE_OP_FRAME, NULL, 0, NULL, 0);
+    ++g_stats.frames;
+}
+
+void trace_glClear(GLbitfield mask) {
+    glClear(mask);
+    if (g_trace != NULL) RECORD(TRACE_OP_CLEAR, NULL, 0, mask);
+}
+
+void trace_glClearColor(GLfloat r, GLfloat g, GLfloat b, GLfloat a) {
+    glClearColor(r, g, b, a);
+    if (g_trace != NULL) RECORD(TRACE_OP_CLEAR_COLOR, NULL, 0, fbits(r), fbits(g), fbits(b), fbits(a));
+}
+
+void trace_glEnable(GLenum cap) {
+    glEnable(cap);
+    if (g_trace != NULL) RECORD(TRACE_OP_ENABLE, NULL, 0, cap);
+}
+
+void trace_glDisable(GLenum cap) {
+    glDisable(cap);
+    if (g_trace != NULL) RECORD(TRACE_OP_DISABLE, NULL, 0, cap);
+}
+
+void trace_glDepthFunc(GLenum func) {
+    glDepthFunc(func);
+    if (g_trace != NULL) RECORD(TRACE_OP_DEPTH_FUNC, NULL, 0, func);
+}
+
+void trace_glCullFace(GLenum mode) {
+    glCullFace(mode);
+    if (g_trace != NULL) RECORD(TRACE_OP_CULL_FACE, NULL, 0, mode);
+}
+
+void trace_glFrontFace(GLenum mode) {
+    glFrontFace(mode);
+    if (g_trace != NULL) RECORD(TRACE_OP_FRONT_FACE, NULL, 0, mode);
+}
+
+void trace_glViewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+    glViewport(x, y, width, height);
+    if (g_trace != NULL) RECORD(TRACE_OP_VIEWPORT, NULL, 0, (uint32_t)x, (uint32_t)y, (uint32_t)width, (uint32_t)height);
+}
+
+void trace_glDrawArrays(GLenum mode, GLint first, GLsizei count) {
+    glDrawArrays(mode, first, count);
+    counters_draw(mode, count, 1);
+    if (g_trace != NULL) RECORD(TRACE_OP_DRAW_ARRAYS, NULL, 0, mode, (uint32_t)first, (uint32_t)count);
+}
+
+// Indices are an offset into the bound GL_ELEMENT_ARRAY_BUFFER.
+void trace_glDrawElements(GLenum mode, GLsizei count, GLenum type, const GLvoid* indices) {
+    glDrawElements(mode, count, type, indices);
+    counters_draw(mode, count, 1);
+    if (g_trace != NULL)
+        RECORD(TRACE_OP_DRAW_ELEMENTS, NULL, 0, mode, (uint32_t)count, type,
+               LO((uintptr_t)indices), HI((uintptr_t)indices));
+}
@@ -0,0 +1,176 @@
+#ifndef RENDER_TRACE_H
+#define RENDER_TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <GL/glew.h>
+
+// GL command stream recording and replay.
+//
+// While recording, the GLEW entry points the renderer uses (programs,
+// uniforms, buffers, vertex arrays, draws and dispatches) are swapped for
+// wrappers that forward the call and append it, with its buffer and uniform
+// payloads, to a binary trace. GL 1.1 functions are exported by libGL rather
+// than loaded by GLEW, so translation units that should record them include
+// "render/trace_gl.h" after the GL headers.
+//
+// A trace is a header followed by records: a 32-bit op, a 32-bit payload size
+// and the payload (32-bit arguments, then any data padded to 4 bytes), all in
+// native byte order. TRACE_OP_FRAME marks a frame boundary: records before the
+// first one are setup, every following run of records up to the next one is
+// a frame, and anything after the last one is teardown.
+//
+// Object names and uniform locations are remapped on replay. Mapped buffers,
+// textures and queries are not recorded.
+
+#define TRACE_MAGIC "GLTR"
+#define TRACE_VERSION 1
+
+typedef enum trace_op_ {
+    TRACE_OP_FRAME = 1,
+
+    // Fixed-function state (GL 1.1).
+    TRACE_OP_CLEAR,
+    TRACE_OP_CLEAR_COLOR,
+    TRACE_OP_ENABLE,
+    TRACE_OP_DISABLE,
+    TRACE_OP_DEPTH_FUNC,
+    TRACE_OP_CULL_FACE,
+    TRACE_OP_FRONT_FACE,
+    TRACE_OP_VIEWPORT,
+
+    // Programs and uniforms.
+    TRACE_OP_CREATE_PROGRAM,
+    TRACE_OP_CREATE_SHADER,
+    TRACE_OP_SHADER_SOURCE,
+    TRACE_OP_COMPILE_SHADER,
+    TRACE_OP_ATTACH_SHADER,
+    TRACE_OP_DETACH_SHADER,
+    TRACE_OP_LINK_PROGRAM,
+    TRACE_OP_DELETE_SHADER,
+    TRACE_OP_DELETE_PROGRAM,
+    TRACE_OP_USE_PROGRAM,
+    TRACE_OP_UNIFORM_LOCATION,
+    TRACE_OP_UNIFORM_1I,
+    TRACE_OP_UNIFORM_1UI,
+    TRACE_OP_UNIFORM_4FV,
+    TRACE_OP_UNIFORM_MATRIX_4FV,
+
+    // Buffers and vertex arrays.
+    TRACE_OP_GEN_BUFFERS,
+    TRACE_OP_DELETE_BUFFERS,
+    TRACE_OP_BIND_BUFFER,
+    TRACE_OP_BIND_BUFFER_BASE,
+    TRACE_OP_BUFFER_DATA,
+    TRACE_OP_BUFFER_SUB_DATA,
+    TRACE_OP_CLEAR_BUFFER_DATA,
+    TRACE_OP_GEN_VERTEX_ARRAYS,
+    TRACE_OP_DELETE_VERTEX_ARRAYS,
+    TRACE_OP_BIND_VERTEX_ARRAY,
+    TRACE_OP_ENABLE_ATTRIB,
+    TRACE_OP_DISABLE_ATTRIB,
+    TRACE_OP_ATTRIB_POINTER,
+    TRACE_OP_ATTRIB_IPOINTER,
+    TRACE_OP_ATTRIB_DIVISOR,
+
+    // Draws and dispatches.
+    TRACE_OP_DRAW_ARRAYS,
+    TRACE_OP_DRAW_ELEMENTS,
+    TRACE_OP_DISPATCH_COMPUTE,
+    TRACE_OP_MEMORY_BARRIER,
+    TRACE_OP_MULTI_DRAW_INDIRECT,
+    TRACE_OP_MULTI_DRAW_INDIRECT_COUNT,
+    TRACE_OP_DRAW_ELEMENTS_INSTANCED,
+    TRACE_OP_DRAW_ELEMENTS_BASE_VERTEX,
+    TRACE_OP_COPY_BUFFER_SUB_DATA,
+    TRACE_OP_UNIFORM_MATRIX_4X3FV,
+    TRACE_OP_UNIFORM_1F,
+    TRACE_OP_UNIFORM_2F,
+    TRACE_OP_UNIFORM_3FV,
+
+    TRACE_OP_COUNT
+} trace_op_t;
+
+typedef struct trace_header_ {
+    char magic[4];
+    uint32_t version;
+    int32_t gl_major, gl_minor;
+    int32_t core_profile;
+    int32_t width, height;          // Initial viewport.
+} trace_header_t;
+
+typedef struct trace_stats_ {
+    unsigned long frames;
+    unsigned long records;
+    size_t bytes;
+} trace_stats_t;
+
+// Recording. Call trace_begin_record() with the context current, once GLEW
+// is initialized and before any objects the trace uses are created.
+int  trace_begin_record(const char* path);
+trace_stats_t trace_end_record(void);
+int  trace_recording(void);
+
+// Marks a frame boundary: call once when setup is done and after each swap.
+// Does nothing when not recording.
+void trace_frame(void);
+
+// GL 1.1 wrappers, see trace_gl.h.
+void trace_glClear(GLbitfield mask);
+void trace_glClearColor(GLfloat r, GLfloat g, GLfloat b, GLfloat a);
+void trace_glEnable(GLenum cap);
+void trace_glDisable(GLenum cap);
+void trace_glDepthFunc(GLenum func);
+void trace_glCullFace(GLenum mode);
+void trace_glFrontFace(GLenum mode);
+void trace_glViewport(GLint x, GLint y, GLsizei width, GLsizei height);
+void trace_glDrawArrays(GLenum mode, GLint first, GLsizei count);
+void trace_glDrawElements(GLenum mode, GLsizei count, GLenum type, const GLvoid* indices);
+
+// Replay. The whole trace is loaded into memory up front so that replaying
+// measures GL submission only.
+typedef struct trace_ {
+    trace_header_t header;
+    unsigned char* data;            // Records.
+    size_t size;
+    size_t setup_end;               // Offset just past the first frame marker.
+    size_t frames_end;              // Offset just past the last frame marker.
+    unsigned long frames;
+} trace_t;
+
+typedef struct trace_name_map_ {
+    GLuint* names;                  // Indexed by the recorded name.
+    GLuint size;
+} trace_name_map_t;
+
+typedef struct trace_uniform_map_ {
+    GLuint program;                 // Recorded program.
+    GLint from, to;
+} trace_uniform_map_t;
+
+typedef struct trace_player_ {
+    const trace_t* trace;
+    size_t cursor;
+    trace_name_map_t buffers, vertex_arrays, programs; // Shaders share the program namespace.
+    trace_uniform_map_t* uniforms;
+    size_t uniform_count, uniform_capacity;
+    GLuint current_program;         // Recorded name, for uniform lookups.
+    unsigned long records;          // Records issued.
+} trace_player_t;
+
+int  trace_load(trace_t* t, const char* path);
+void trace_free(trace_t* t);
+
+void trace_player_init(trace_player_t* p, const trace_t* t);
+void trace_player_destroy(trace_player_t* p);
+
+// Issues the setup records.
+int  trace_player_setup(trace_player_t* p);
+// Issues the next frame's records; returns 0 once every frame has been played.
+int  trace_player_frame(trace_player_t* p);
+// Goes back to the first frame, for looping.
+void trace_player_rewind(trace_player_t* p);
+// Issues the teardown records.
+void trace_player_finish(trace_player_t* p);
+
+#endif // RENDER_TRACE_H
@@ -0,0 +1,23 @@
+#ifndef RENDER_TRACE_GL_H
+#define RENDER_TRACE_GL_H
+
+#include "trace.h"
+#include "counters.h"
+
+// Routes the GL 1.1 calls of the including translation unit through the
+// trace recorder, and its draws through the frame counters (counters.h).
+// Include after the GL headers; the wrappers forward straight to GL when
+// neither is active.
+
+#define glClear trace_glClear
+#define glClearColor trace_glClearColor
+#define glEnable trace_glEnable
+#define glDisable trace_glDisable
+#define glDepthFunc trace_glDepthFunc
+#define glCullFace trace_glCullFace
+#define glFrontFace trace_glFrontFace
+#define glViewport trace_glViewport
+#define glDrawArrays trace_glDrawArrays
+#define glDrawElements trace_glDrawElements
+
+#endif // RENDER_TRACE_GL_H
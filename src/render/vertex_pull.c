@@ -0,0 +1,87 @@
+#include "vertex_pull.h"
+#include "program.h"
+
+#include "trace_gl.h" // Last: the draws go through the recorder and counters.
+
+// vertex_t is two vec4s, so std430 lays Vertex out the same way.
+static const GLchar* VERTEX_SHADER = {
+    "#version 430 core\n"
+    "struct Vertex { vec4 position; vec4 color; };\n"
+    "layout(std430, binding=0) readonly buffer Vertices { Vertex vertices[]; };\n"
+    "layout(std430, binding=1) readonly buffer Indices { uint indices[]; };\n"
+    "uniform mat4x3 ModelMatrix;\n"
+    "uniform mat4 ViewMatrix;\n"
+    "uniform mat4 ProjectionMatrix;\n"
+    "uniform int BaseVertex;\n"
+    "out vec4 ex_Color;\n"
+
+    "void main(void)\n"
+    "{\n"
+    "  Vertex v = vertices[BaseVertex + int(indices[gl_VertexID])];\n"
+    "  gl_Position = ProjectionMatrix * ViewMatrix * vec4(ModelMatrix * v.position, 1.0);\n"
+    "  ex_Color = v.color;\n"
+    "}\n"
+};
+
+static const GLchar* FRAGMENT_SHADER = {
+    "#version 430 core\n"
+    "in vec4 ex_Color;\n"
+    "out vec4 out_Color;\n"
+
+    "void main(void)\n"
+    "{\n"
+    "  out_Color = ex_Color;\n"
+    "}\n"
+};
+
+int vertex_pull_init(vertex_pull_t* p, const GLchar* fragment_src) {
+    memset(p, 0, sizeof(*p));
+    if (!GLEW_VERSION_4_3) {
+        fprintf(stderr, "ERROR: Vertex pulling needs GL 4.3.\n");
+        return 0;
+    }
+    if ((p->prog = program_from_source(VERTEX_SHADER, fragment_src != NULL ? fragment_src : FRAGMENT_SHADER)) == 0) {
+        fprintf(stderr, "ERROR: Could not build the vertex pulling program.\n");
+        return 0;
+    }
+    p->model_uloc = glGetUniformLocation(p->prog, "ModelMatrix");
+    p->view_uloc = glGetUniformLocation(p->prog, "ViewMatrix");
+    p->proj_uloc = glGetUniformLocation(p->prog, "ProjectionMatrix");
+    p->base_vertex_uloc = glGetUniformLocation(p->prog, "BaseVertex");
+
+    // Core profiles draw nothing without a VAO bound, even with no attributes.
+    glGenVertexArrays(1, &p->vao);
+    exit_on_glError("ERROR: Could not set up vertex pulling.");
+    return 1;
+}
+
+void vertex_pull_destroy(vertex_pull_t* p) {
+    if (p->prog != 0) glDeleteProgram(p->prog);
+    if (p->vao != 0) glDeleteVertexArrays(1, &p->vao);
+    memset(p, 0, sizeof(*p));
+}
+
+void vertex_pull_begin(const vertex_pull_t* p, const mat4_t* view, const mat4_t* projection) {
+    glUseProgram(p->prog);
+    glUniformMatrix4fv(p->view_uloc, 1, GL_FALSE, view->m);
+    glUniformMatrix4fv(p->proj_uloc, 1, GL_FALSE, projection->m);
+    glBindVertexArray(p->vao);
+}
+
+void vertex_pull_bind(GLuint vertices, GLuint indices) {
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, VERTEX_PULL_BINDING_VERTICES, vertices);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, VERTEX_PULL_BINDING_INDICES, indices);
+}
+
+void vertex_pull_draw(const vertex_pull_t* p, const mat4x3_t* model, GLuint index_count, GLuint first_index,
+                      GLint base_vertex) {
+    // Rows, so transposed: GLSL's mat4x3 is four columns of three.
+    glUniformMatrix4x3fv(p->model_uloc, 1, GL_TRUE, model->m);
+    glUniform1i(p->base_vertex_uloc, base_vertex);
+    glDrawArrays(GL_TRIANGLES, (GLint)first_index, (GLsizei)index_count);
+}
+
+void vertex_pull_end(void) {
+    glBindVertexArray(0);
+    glUseProgram(0);
+}
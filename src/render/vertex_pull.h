@@ -0,0 +1,44 @@
+#ifndef RENDER_VERTEX_PULL_H
+#define RENDER_VERTEX_PULL_H
+
+#include <GL/glew.h>
+#include "math/affine.h"
+
+// Programmable vertex pulling: drawing without vertex attributes.
+//
+// Vertices (vertex_t) and GLuint indices are read as shader storage buffers,
+// and the vertex shader fetches its own input: glDrawArrays starting at the
+// mesh's first index makes gl_VertexID walk the index buffer, and each index
+// plus the BaseVertex uniform picks the vertex. Every mesh is then drawn
+// through the same empty VAO, whatever buffers it lives in, so there is no
+// attribute state to switch between draws; changing buffers is two
+// glBindBufferBase calls.
+//
+// Indices are fetched per triangle corner, so the post-transform cache can't
+// reuse vertices shared between triangles. Needs GL 4.3 and shader storage
+// in the vertex stage.
+
+#define VERTEX_PULL_BINDING_VERTICES 0  // Shader storage; rebound by every
+#define VERTEX_PULL_BINDING_INDICES 1   // vertex_pull_bind(), like gpu_scene's.
+
+typedef struct vertex_pull_ {
+    GLuint prog, vao;
+    GLint model_uloc, view_uloc, proj_uloc, base_vertex_uloc;
+} vertex_pull_t;
+
+// `fragment_src` (GLSL 4.30) receives `in vec4 ex_Color`; NULL outputs it.
+int  vertex_pull_init(vertex_pull_t* p, const GLchar* fragment_src);
+void vertex_pull_destroy(vertex_pull_t* p);
+
+// Binds the program and the empty VAO, and sets the camera.
+void vertex_pull_begin(const vertex_pull_t* p, const mat4_t* view, const mat4_t* projection);
+// Buffers the following draws pull from.
+void vertex_pull_bind(GLuint vertices, GLuint indices);
+// Draws triangles from `index_count` indices starting at `first_index`,
+// relative to `base_vertex`. The model matrix is uploaded as a mat4x3, 12
+// floats a draw rather than 16.
+void vertex_pull_draw(const vertex_pull_t* p, const mat4x3_t* model, GLuint index_count, GLuint first_index,
+                      GLint base_vertex);
+void vertex_pull_end(void);
+
+#endif // RENDER_VERTEX_PULL_H
@@ -0,0 +1,87 @@
+#include "core/archive.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+// Packs files into an asset archive (core/archive.h), each named by its path
+// as given on the command line, or lists what an archive holds:
+//
+//     asset_pack ARCHIVE FILE...
+//     asset_pack --list ARCHIVE
+
+static unsigned char* read_file(const char* path, size_t* size) {
+    FILE* fd;
+    long fsz = -1;
+    unsigned char* buf = NULL;
+
+    if ((fd = fopen(path, "rb")) == NULL) {
+        fprintf(stderr, "ERROR: Could not open %s.\n", path);
+        return NULL;
+    }
+    if (fseek(fd, 0, SEEK_END) == 0 && (fsz = ftell(fd)) != -1) {
+        rewind(fd);
+        if ((buf = (unsigned char*) malloc(fsz > 0 ? (size_t)fsz : 1)) != NULL
+                && fread(buf, 1, (size_t)fsz, fd) != (size_t)fsz) {
+            free(buf);
+            buf = NULL;
+        }
+    }
+    fclose(fd);
+
+    if (buf == NULL) fprintf(stderr, "ERROR: Could not read %s.\n", path);
+    else *size = (size_t)fsz;
+    return buf;
+}
+
+static int list(const char* path) {
+    archive_t a;
+    unsigned int i, j;
+
+    if (!archive_open(&a, path)) return EXIT_FAILURE;
+    for (i = 0; i < a.header->entry_count; ++i) {
+        const archive_entry_t* e = &a.entries[i];
+        size_t packed = 0;
+        for (j = 0; j < e->block_count; ++j) packed += a.blocks[e->first_block + j].packed_size;
+        printf("%10zu %10zu  %s\n", (size_t)e->size, packed, archive_name(&a, (int)i));
+    }
+    archive_close(&a);
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char* argv[]) {
+    const unsigned int count = argc > 2 ? (unsigned int)(argc - 2) : 0;
+    const char** names;
+    const void** data;
+    size_t* sizes;
+    size_t total = 0;
+    unsigned int i;
+    int ok = 1;
+
+    if (argc == 3 && strcmp(argv[1], "--list") == 0) return list(argv[2]);
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s ARCHIVE FILE... | --list ARCHIVE\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    names = (const char**) malloc(sizeof(char*) * count);
+    data = (const void**) calloc(count, sizeof(void*));
+    sizes = (size_t*) malloc(sizeof(size_t) * count);
+    if (names == NULL || data == NULL || sizes == NULL) {
+        fprintf(stderr, "ERROR: Could not allocate %u assets.\n", count);
+        return EXIT_FAILURE;
+    }
+    for (i = 0; i < count && ok; ++i) {
+        names[i] = argv[i + 2];
+        ok = (data[i] = read_file(names[i], &sizes[i])) != NULL;
+        if (ok) total += sizes[i];
+    }
+    if (ok && (ok = archive_pack(argv[1], names, data, sizes, count)))
+        printf("Packed %u assets, %zu bytes, into %s.\n", count, total, argv[1]);
+
+    for (i = 0; i < count; ++i) free((void*) data[i]);
+    free(names);
+    free(data);
+    free(sizes);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}